@@ -0,0 +1,93 @@
+#ifndef _DF_CACHE_H
+#define _DF_CACHE_H
+
+#include "diag.h"
+#include "strpool.h"
+#include "token.h"
+
+#include <cstdint>
+#include <string>
+
+using std::string;
+
+/*
+ * 单词流缓存
+ * 以源码内容散列为键，每个源文件对应缓存目录下的一个文件 <键>.tkc：
+ *   CacheHeader
+ *   PackedToken[ntokens]       单词流，只含偏移和长度
+ *   Diagnostic[nlexdiags]      词法诊断
+ *   Diagnostic[ndiags]         全部诊断，即语法分析的结果
+ *   char[strbytes]             字符串常量池，StrPool::save 的格式
+ * 单词不含指针，命中时直接 mmap 使用
+ */
+
+#define CACHE_MAGIC   0x43544644    // "DFTC"
+#define CACHE_VERSION 4
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t src_size;
+    uint32_t ntokens, nlexdiags, ndiags;
+    uint32_t strbytes;
+};
+
+/* 命中时映射出的各段 */
+struct CacheEntry {
+    const PackedToken *tokens;
+    const Diagnostic *lexdiags;
+    const Diagnostic *diags;
+    const char *strs;
+    uint32_t ntokens, nlexdiags, ndiags, strbytes;
+};
+
+struct CacheStats {
+    int hits;
+    int misses;
+    long bytes_read;        // 命中时映射的字节数
+    long bytes_written;
+};
+
+class TokenCache {
+public:
+    /**
+     * 功能：使用 dir 作为缓存目录，不存在时创建
+     */
+    TokenCache(const string &dir);
+    ~TokenCache();
+
+    /**
+     * 功能：计算源码的缓存键
+     * 键同时包含缓存格式版本和程序的编译时间，分析器改动后旧缓存自动失效
+     */
+    static uint64_t key(const string &src);
+
+    /**
+     * 功能：查找并映射 key 对应的缓存，上一次映射随之解除
+     * 返回值：存在且格式正确时为 true
+     */
+    bool lookup(uint64_t key, size_t src_size, CacheEntry &e);
+
+    /**
+     * 功能：写入一个源文件的单词流和诊断
+     */
+    bool store(uint64_t key, size_t src_size,
+        const std::vector<PackedToken> &tokens,
+        const std::vector<Diagnostic> &lexdiags,
+        const std::vector<Diagnostic> &diags,
+        const StrPool &strs);
+
+    const CacheStats& stats() const { return st; }
+
+private:
+    string path(uint64_t key);
+    void release();
+
+    string dir;
+    const char *base;       // 当前映射
+    size_t size;
+    CacheStats st;
+};
+
+#endif // _DF_CACHE_H
@@ -0,0 +1,89 @@
+#ifndef _DF_CFG_H
+#define _DF_CFG_H
+
+#include "ir.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * 控制流图
+ * 边由各块最后一条转移指令得出。后继和前驱都按压缩行存放，
+ * 块 b 的后继为 succ[succ_at[b]] 到 succ[succ_at[b + 1] - 1]，前驱同理，
+ * 整个图只占几个数组，块数上千时也不会逐块分配。
+ */
+struct Cfg {
+    uint32_t nblocks;
+    std::vector<uint32_t> succ_at, succ;
+    std::vector<uint32_t> pred_at, pred;
+    std::vector<uint32_t> rpo;      // 从入口可到达的块，按逆后序排列
+    std::vector<int> rpo_index;     // 块在 rpo 中的位置，不可到达为 -1
+
+    uint32_t edges() const { return succ.size(); }
+    bool reachable(uint32_t b) const { return rpo_index[b] >= 0; }
+
+    const uint32_t *succ_begin(uint32_t b) const { return succ.data() + succ_at[b]; }
+    const uint32_t *succ_end(uint32_t b) const { return succ.data() + succ_at[b + 1]; }
+    const uint32_t *pred_begin(uint32_t b) const { return pred.data() + pred_at[b]; }
+    const uint32_t *pred_end(uint32_t b) const { return pred.data() + pred_at[b + 1]; }
+};
+
+/**
+ * 功能：根据函数的转移指令建立控制流图并求逆后序
+ */
+void build_cfg(const IrFunc &f, Cfg &g);
+
+/*
+ * 支配树
+ * 用 Cooper、Harvey、Kennedy 的迭代算法求直接支配者：按逆后序反复
+ * 对各前驱的支配者求交，直到不再变化，可归约的图一般两遍即收敛。
+ * 之后对支配树编先序和后序号，判断支配关系只需比较两个区间。
+ */
+struct DomTree {
+    std::vector<int> idom;          // 直接支配者，入口为自身，不可到达为 -1
+    std::vector<uint32_t> child_at, child;  // 支配树的孩子，压缩行
+    std::vector<uint32_t> pre, post;        // 支配树上的先序和后序号
+    std::vector<int> depth;         // 在支配树中的深度，入口为 0
+    int passes;                     // 求直接支配者的迭代遍数
+
+    /**
+     * 功能：a 是否支配 b，两块都须可到达
+     */
+    bool dominates(uint32_t a, uint32_t b) const {
+        return pre[a] <= pre[b] && post[b] <= post[a];
+    }
+};
+
+/**
+ * 功能：求控制流图的支配树
+ */
+void build_domtree(const Cfg &g, DomTree &t);
+
+/**
+ * 功能：求各块的支配边界，按压缩行存放：块 b 的支配边界为
+ * df[df_at[b]] 到 df[df_at[b + 1] - 1]
+ * 对每个汇合块，从各前驱沿支配树上行到它的直接支配者为止，
+ * 途经的块的支配边界都含这个汇合块。
+ */
+void dominance_frontiers(const Cfg &g, const DomTree &t,
+    std::vector<uint32_t> &df_at, std::vector<uint32_t> &df);
+
+/* 自然循环 */
+struct Loop {
+    uint32_t header;
+    int preheader;                  // 循环外唯一以跳转转入首块的前驱，没有时为 -1
+    int parent;                     // 直接包含它的循环，-1 为最外层
+    int depth;                      // 最外层为 1
+    std::vector<uint32_t> blocks;   // 含首块，按逆后序排列
+    std::vector<uint32_t> latches;  // 回边的起点
+};
+
+/**
+ * 功能：找出所有自然循环
+ * 回边是终点支配起点的边，同一首块的回边合为一个循环，
+ * 循环体为从各回边起点逆向不经首块能到达的块。
+ * 结果按块数从小到大排列，内层循环在外层之前。
+ */
+void find_loops(const Cfg &g, const DomTree &t, std::vector<Loop> &loops);
+
+#endif // _DF_CFG_H
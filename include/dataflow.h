@@ -0,0 +1,145 @@
+#ifndef _DF_DATAFLOW_H
+#define _DF_DATAFLOW_H
+
+#include "cfg.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+class Diagnostics;
+
+/*
+ * 稀疏集合，元素为 [0, size()) 中的整数，按升序存放
+ * 函数很长时跨块的临时变量很多，但同时活跃的很少，定长位集的空间和每次
+ * 运算都与元素的范围成正比，稀疏存放只与集合的大小成正比。
+ */
+class SparseSet {
+public:
+    SparseSet() : n(0) {}
+    explicit SparseSet(size_t n) : n(n) {}
+
+    size_t size() const { return n; }
+    bool test(size_t i) const { return std::binary_search(v.begin(), v.end(), (uint32_t)i); }
+    void set(size_t i);
+    void reset(size_t i);
+    void clear() { v.clear(); }
+
+    /**
+     * 功能：并上 x，返回自身是否变化
+     */
+    bool unite(const SparseSet &x);
+
+    /**
+     * 功能：去掉 x 中的元素
+     */
+    void subtract(const SparseSet &x);
+
+    /**
+     * 功能：置为 gen ∪ (x − kill)，返回是否变化
+     */
+    bool transfer(const SparseSet &gen, const SparseSet &x, const SparseSet &kill);
+
+    /**
+     * 功能：元素个数
+     */
+    size_t count() const { return v.size(); }
+
+    /**
+     * 功能：从 i 开始的下一个元素，没有时返回 size()
+     */
+    size_t next(size_t i) const;
+
+private:
+    size_t n;
+    std::vector<uint32_t> v;
+};
+
+/*
+ * 以集合表示的数据流问题
+ * 每块的传递函数为 gen ∪ (x − kill)，汇合取并集，边界为空集。
+ * 前向问题中 x 为块入口的值，结果为出口的值；后向问题相反。
+ */
+struct Dataflow {
+    bool forward;
+    size_t nitems;                  // 元素的范围为 [0, nitems)
+    std::vector<SparseSet> gen, kill;
+    std::vector<SparseSet> in, out; // 各块入口和出口的解
+    long visits;                    // 传递函数的计算次数
+};
+
+/**
+ * 功能：求不动点
+ * 工作表按逆后序（后向问题按后序）扫描，只计算标记为待处理的块，
+ * 某块的值变化时标记其后继（后向为前驱）。不可到达的块保持空集。
+ */
+void solve(const Cfg &g, Dataflow &df);
+
+/**
+ * 功能：临时变量的活跃性
+ * 只有在多个块中出现的临时变量才编号，编号 i 为临时变量 temps[i]，
+ * 块内的临时变量占多数，它们不占集合的空间。
+ */
+void liveness(const IrFunc &f, const Cfg &g, std::vector<uint32_t> &temps,
+    Dataflow &df);
+
+/*
+ * 栈槽的到达定值
+ * 定值为地址直接是栈槽的 store 和 copy，编号 i 为 defs[i] 这条指令，
+ * 在块内被之后写满同一栈槽的定值注销的不编号。
+ * 写满整个栈槽的定值注销同一栈槽的其他定值，只写一部分的不注销。
+ * 经指针的写入可能修改任何取过地址的变量，但不算定值，也不注销。
+ * 各块的集合不逐块展开，循环可能不执行时它们的总大小是 块数 × 定值数。
+ * 与构造 SSA 一样，在每个栈槽定值所在块的迭代支配边界放合并节点，
+ * 沿支配树给各块入口的每个栈槽指定一个节点：节点为一个定值并上之前的
+ * 节点（写满时为空集），或为各前驱出口节点的并。节点数与定值数和合并
+ * 节点数成正比，集合只在输出时展开。
+ */
+#define REACH_MERGE UINT32_MAX
+
+struct ReachNode {
+    uint32_t def;       // 定值编号，合并节点为 REACH_MERGE
+    uint32_t arg;       // 之前的节点；合并节点为 ops 的下标，ops[arg] 为
+                        // 前驱数，其后按 pred 的顺序为各前驱出口的节点
+};
+
+struct ReachDefs {
+    std::vector<uint32_t> defs;
+    std::vector<ReachNode> nodes;   // 0 为空集
+    std::vector<uint32_t> ops;
+    std::vector<std::vector<uint32_t>> in;  // 各块入口各栈槽的非空节点
+    long merges;                    // 合并节点数
+};
+
+/**
+ * 功能：求栈槽的到达定值，keep_in 为 true 时记录各块入口的节点
+ */
+void reaching_defs(const IrFunc &f, const Cfg &g, const DomTree &t,
+    ReachDefs &rd, bool keep_in);
+
+/**
+ * 功能：展开块 b 入口到达的定值，按编号升序放入 defs
+ * seen 的长度为节点数，记录各节点上次在哪个块中展开，由调用者保留
+ */
+void reach_in(const ReachDefs &rd, uint32_t b, std::vector<uint32_t> &defs,
+    std::vector<uint32_t> &seen);
+
+/* 控制流分析统计 */
+struct CfgStats {
+    long funcs;
+    long blocks;
+    long edges;
+    long unreachable;
+    long dom_passes;
+    long live_visits;       // 活跃性求解中传递函数的计算次数
+    long reach_merges;      // 到达定值的合并节点数
+};
+
+/**
+ * 功能：对模块中的每个函数建立控制流图、支配树，求活跃性和到达定值
+ * fp 不为空时输出各块的结果，统计累加到 st
+ */
+void cfg_report(const IrModule &m, Diagnostics &diag, FILE *fp, CfgStats &st);
+
+#endif // _DF_DATAFLOW_H
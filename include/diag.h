@@ -0,0 +1,147 @@
+#ifndef _DF_DIAG_H
+#define _DF_DIAG_H
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using std::string;
+
+/* 诊断编号，与 diag.cpp 中的格式表一一对应 */
+enum class DiagCode : uint16_t {
+    ERR_OPEN_FILE = 0,      // 无法打开源文件
+    ERR_ILLEGAL_CHAR,       // 非法字符
+    ERR_ILLEGAL_ESCAPE,     // 非法转义字符
+    ERR_UNTERM_COMMENT,     // 注释没有结束
+    ERR_UNTERM_STRING,      // 字符常量或字符串常量没有结束
+    ERR_EXPECT,             // 缺少单词 args: 期望的单词, 实际的单词
+    ERR_TYPE_EXPECTED,      // 缺少类型区分符 args: 实际的单词
+    ERR_IDENT_EXPECTED,     // 缺少标识符 args: 实际的单词
+    ERR_STRUCT_NAME,        // 缺少结构体名 args: 实际的单词
+    ERR_NESTED_FUNC,        // 不支持嵌套函数定义
+    ERR_PARAM_TYPE,         // 形参缺少类型区分符 args: 实际的单词
+    ERR_PRIMARY,            // 缺少标识符或常量 args: 实际的单词
+    ERR_INCOMPLETE_FIELD,   // 结构体成员的类型大小未知
+    ERR_INCOMPLETE_SIZEOF,  // 对大小未知的类型求 sizeof
+    ERR_NOT_LVALUE,         // 赋值的左边不是左值
+    ERR_INCOMPATIBLE,       // 赋值类型不兼容 args: 左边类型, 右边类型
+    ERR_NOT_FUNC,           // 调用的不是函数 args: 类型
+    ERR_ARG_COUNT,          // 实参个数不对 args: 形参个数, 实参个数
+    ERR_ARG_TYPE,           // 实参类型不兼容 args: 第几个实参, 形参类型
+    ERR_NOT_STRUCT,         // 成员访问的对象不是结构体 args: 类型, . 或 ->
+    ERR_NO_MEMBER,          // 没有该成员 args: 成员名的偏移, 结构体类型
+    ERR_DEREF,              // 对非指针取值 args: 类型
+    ERR_SUBSCRIPT,          // 下标访问的不是数组或指针 args: 类型
+    ERR_RETURN_TYPE,        // 返回值类型不兼容 args: 返回值类型, 函数返回类型
+    ERR_ADDR_LVALUE,        // 对非左值取地址
+    ERR_OPERANDS,           // 运算对象类型不对 args: 运算符
+    ERR_NOT_CONST,          // 全局变量的初值不是常量
+    ERR_INT_OVERFLOW,       // 整型常量超出范围
+    ERR_BAD_DIGIT,          // 八进制常量中的非法数字 args: 字符
+    ERR_BAD_SUFFIX,         // 整型常量之后的非法后缀 args: 后缀的偏移
+    ERR_FLOAT,              // 不支持浮点常量
+    ERR_ESCAPE_RANGE,       // 转义字符超出范围
+    ERR_EMPTY_CHAR,         // 空字符常量
+
+    DIAG_COUNT
+};
+
+/* 诊断输出格式 */
+enum class DiagFormat {
+    HUMAN,      // 文件:行:列: error: 信息 + 源码片段
+    MACHINE     // 文件:行:列:偏移:编号:信息 每条一行，便于工具解析
+};
+
+/**
+ * 一条诊断记录
+ * 只保存编号、字节偏移和两个整型参数，输出时再格式化
+ */
+struct Diagnostic {
+    DiagCode code;
+    uint32_t offset;
+    int32_t  args[2];
+};
+
+class Diagnostics {
+public:
+    Diagnostics();
+
+    /**
+     * 功能：设置诊断对应的源文件
+     * src 指向词法分析器持有的源码，格式化时用于计算行列和截取片段
+     */
+    void set_source(const string &filename, const string *src);
+
+    /**
+     * 功能：设置 %T 参数的展开方法，由语义分析提供类型的书写形式
+     */
+    void set_type_namer(std::function<string(int)> f) { type_namer = f; }
+
+    /**
+     * 功能：诊断信息是否含有类型参数
+     * 类型编号只在一次分析内有效，这样的诊断不能脱离分析单独保存
+     */
+    static bool has_type_args(DiagCode code);
+
+    /**
+     * 功能：设置最多记录的错误数，0 表示不限
+     */
+    void set_max_errors(int n) { max_errors = n; }
+
+    /**
+     * 功能：设置输出格式
+     */
+    void set_format(DiagFormat f) { format = f; }
+
+    /**
+     * 功能：记录一条诊断，不做任何格式化和输出
+     * offset 出错位置在源码中的字节偏移
+     */
+    void report(DiagCode code, uint32_t offset, int a0 = 0, int a1 = 0);
+
+    /**
+     * 功能：是否已达到错误上限，达到后调用者可以提前结束分析
+     */
+    bool full() const {
+        return max_errors > 0 && error_count >= max_errors;
+    }
+
+    /**
+     * 功能：已报告的错误总数，包括超出上限被丢弃的
+     */
+    int errors() const { return error_count; }
+
+    /**
+     * 功能：已记录的诊断
+     */
+    const std::vector<Diagnostic>& entries() const { return diags; }
+
+    /**
+     * 功能：按源码位置排序后格式化输出全部诊断，并清空记录
+     */
+    void flush(std::ostream &os);
+
+    /**
+     * 功能：由字节偏移计算行号和列号（均从1开始）
+     */
+    void locate(uint32_t offset, int &line, int &col);
+
+private:
+    /**
+     * 功能：按格式表展开一条诊断的信息
+     */
+    string message(const Diagnostic &d);
+
+    string filename;
+    const string *src;
+    std::vector<Diagnostic> diags;
+    std::vector<uint32_t> line_start;   // 各行起始偏移，首次输出时建立
+    std::function<string(int)> type_namer;
+    DiagFormat format;
+    int max_errors;
+    int error_count;
+};
+
+#endif // _DF_DIAG_H
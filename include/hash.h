@@ -0,0 +1,22 @@
+#ifndef _DF_HASH_H
+#define _DF_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * 功能：计算一段字节的 64 位 FNV-1a 散列值
+ * h：初值，可以传入上一段的结果以便连续散列
+ */
+inline uint64_t hash_bytes(const void *data, size_t n,
+    uint64_t h = 1469598103934665603ULL)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+#endif // _DF_HASH_H
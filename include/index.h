@@ -0,0 +1,104 @@
+#ifndef _DF_INDEX_H
+#define _DF_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string;
+
+/*
+ * 符号交叉引用索引文件
+ * 整个文件按下面的顺序连续存放，所有位置都是相对文件开头的偏移，
+ * 可以直接 mmap 后查询而不必读入堆中
+ *   IndexHeader
+ *   IndexFile[nfiles]      源文件及其内容散列
+ *   IndexSym[nsyms]        按名字排序的符号，指向 refs 中连续的一段
+ *   IndexRef[nrefs]        引用位置，同一符号的引用按文件和偏移排序
+ *   char[strsize]          名字串池，每个名字以 '\0' 结尾
+ */
+
+#define INDEX_MAGIC   0x58494644    // "DFIX"
+#define INDEX_VERSION 1
+
+struct IndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nfiles, nsyms, nrefs, strsize;
+    uint32_t files_off, syms_off, refs_off, str_off;
+};
+
+struct IndexFile {
+    uint32_t name;          // 文件名在串池中的偏移
+    uint32_t nrefs;         // 该文件贡献的引用数
+    uint64_t hash;          // 文件内容散列
+};
+
+struct IndexSym {
+    uint32_t name;          // 符号名在串池中的偏移
+    uint32_t first;         // 第一个引用的下标
+    uint32_t count;         // 引用个数
+};
+
+struct IndexRef {
+    uint32_t file;          // 文件下标
+    uint32_t offset;        // 字节偏移
+    uint32_t kind : 4;      // 引用种类 XRefKind
+    uint32_t line : 28;     // 行号
+};
+
+/* 一次增量更新的统计 */
+struct IndexStats {
+    int parsed;             // 内容有变化而重新分析的文件数
+    int reused;             // 内容未变直接沿用的文件数
+    int dropped;            // 已不存在而删除的文件数
+    int errors;             // 分析时出错的文件数
+};
+
+class SymbolIndex {
+public:
+    SymbolIndex();
+    ~SymbolIndex();
+
+    /**
+     * 功能：以只读方式映射索引文件
+     * 返回值：文件存在且格式正确、各项的下标和偏移都不越界时为 true
+     */
+    bool open(const string &path);
+
+    /**
+     * 功能：解除映射
+     */
+    void close();
+
+    /**
+     * 功能：二分查找符号，找不到时返回 nullptr
+     */
+    const IndexSym *find(const char *name) const;
+
+    /**
+     * 功能：用 files 中的文件增量更新 path 处的索引
+     * 内容散列未变的文件沿用旧索引中的引用，其余重新分析
+     */
+    static bool update(const string &path, const std::vector<string> &files,
+        IndexStats &st);
+
+    /* 映射后的各段 */
+    const IndexHeader *header() const { return hdr; }
+    const IndexFile *files() const { return (const IndexFile *)(base + hdr->files_off); }
+    const IndexSym *syms() const { return (const IndexSym *)(base + hdr->syms_off); }
+    const IndexRef *refs() const { return (const IndexRef *)(base + hdr->refs_off); }
+    const char *str(uint32_t off) const { return base + hdr->str_off + off; }
+
+private:
+    const char *base;
+    size_t size;
+    const IndexHeader *hdr;
+};
+
+/**
+ * 功能：取得引用种类的名字
+ */
+const char *xref_kind_name(int kind);
+
+#endif // _DF_INDEX_H
@@ -0,0 +1,298 @@
+#ifndef _DF_IR_H
+#define _DF_IR_H
+
+#include "symbol.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using std::string;
+
+class Diagnostics;
+class StrPool;
+
+/*
+ * 三地址中间代码
+ * 每条指令形如 d = a op b，各字段分别存放在函数的几个平行数组中，
+ * 遍历时只访问需要的字段，不经过指针。
+ * 操作数是 32 位的 Ref，高 4 位为种类，低 28 位为编号或立即数。
+ * 临时变量只被定义一次；局部变量和形参都放在栈槽中，以地址引用。
+ * 值一律按 64 位保存，size 为 4 的运算结果截断为 32 位后再符号扩展，
+ * char 和 short 取出时符号扩展，存入时截断，因此访存本身就完成了转换；
+ * 变量提升为临时变量以后，存入时的截断改由 ext 表示。
+ * 提升以后是 SSA 形式，汇合处的值由 phi 选出，离开 SSA 时 phi 改为复制，
+ * 此后一个临时变量可以有多处定值。
+ */
+
+/* 指令，注释中 [x] 表示地址 x 处的内存 */
+enum IrOp : uint8_t {
+    IR_NOP,
+    IR_MOV,         // d = a
+    IR_ADD,         // d = a + b
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_MOD,
+    IR_NEG,         // d = -a
+    IR_EXT,         // d = a 的低 size 个字节符号扩展
+    IR_EQ,          // d = a == b，结果为 0 或 1
+    IR_NE,
+    IR_LT,
+    IR_LE,
+    IR_GT,
+    IR_GE,
+    IR_LOAD,        // d = [a]，size 为取出的字节数
+    IR_STORE,       // [a] = b，size 为存入的字节数
+    IR_COPY,        // 把 [b] 开始的 d 个字节复制到 [a]，d 为立即数
+    IR_PARAM,       // d = 第 a 个形参，只出现在入口块
+    IR_PHI,         // d = 从前驱块 p 转来时的 v，(p, v) 为 phis[a] 起的 b 对，只出现在块首
+    IR_ARG,         // a 为下一个实参，紧接在 IR_CALL 之前
+    IR_CALL,        // d = a(之前的 b 个 IR_ARG)，没有返回值时 d 为空
+    IR_JMP,         // 转到块 a
+    IR_BR,          // a 非 0 时转到块 b，否则转到块 d
+    IR_RET,         // 返回 a，没有返回值时 a 为空
+
+    /* 以下为 16 字节的向量运算，只由 vectorize 生成，size 为每道的字节数 */
+    IR_VSPLAT,      // d = 每道都是 a
+    IR_VLOAD,       // d = [a] 起的 16 个字节
+    IR_VSTORE,      // [a] 起的 16 个字节 = b
+    IR_VADD,        // 各道 d = a + b，按道宽回绕
+    IR_VSUB,
+    IR_VEQ,         // 各道 d = a == b，结果为全 1 或全 0
+    IR_VGT,         // 有符号比较
+    IR_VAND,        // 按位 d = a & b
+    IR_VANDN,       // d = ~a & b
+    IR_VOR,
+
+    IR_OP_COUNT
+};
+
+/* 操作数种类 */
+enum RefTag {
+    RT_NONE,        // 没有操作数
+    RT_TEMP,        // 临时变量
+    RT_IMM,         // 28 位有符号立即数
+    RT_CONST,       // 放不进立即数的常量，值在 IrFunc::consts 中
+    RT_SLOT,        // 栈槽的地址
+    RT_GLOBAL,      // 全局变量或函数的地址，编号为 IrModule::globals 的下标
+    RT_STR,         // 字符串常量的地址，编号为常量池中的编号
+    RT_BLOCK        // 基本块
+};
+
+typedef uint32_t Ref;
+
+#define REF_NONE    0u
+#define IMM_MIN     (-(1 << 27))
+#define IMM_MAX     ((1 << 27) - 1)
+
+inline Ref make_ref(RefTag t, uint32_t v) { return (uint32_t)t << 28 | (v & 0x0fffffff); }
+inline RefTag ref_tag(Ref r) { return (RefTag)(r >> 28); }
+inline uint32_t ref_index(Ref r) { return r & 0x0fffffff; }
+inline int32_t ref_imm(Ref r) { return (int32_t)(r << 4) >> 4; }
+
+/* 基本块，即指令下标的区间 [first, end)，最后一条为转移或返回 */
+struct IrBlock {
+    uint32_t first;
+    uint32_t end;
+};
+
+/* 一条指令，用于在各数组之间整体搬动 */
+struct IrInst {
+    IrOp op;
+    uint8_t size;
+    Ref d, a, b;
+    uint32_t loc;
+};
+
+/* 栈槽 */
+struct IrSlot {
+    int size;
+    int align;
+    int decl;           // 所属变量的字节偏移，用于输出
+    string name;
+};
+
+/* 一个函数的中间代码 */
+struct IrFunc {
+    string name;
+    int global;         // 在 IrModule::globals 中的下标
+    int nparams;        // 形参个数
+    int ret_size;       // 返回值的字节数，void 为 0
+
+    /* 指令，各数组等长 */
+    std::vector<uint8_t> op;        // IrOp
+    std::vector<uint8_t> size;      // 运算或访存的字节数
+    std::vector<Ref> d, a, b;
+    std::vector<uint32_t> loc;      // 对应源码的字节偏移
+
+    std::vector<IrBlock> blocks;    // 按代码顺序排列，0 为入口
+    std::vector<IrSlot> slots;
+    std::vector<int32_t> consts;
+    std::vector<Ref> phis;          // phi 的参数，每个参数为块和值两项
+    uint32_t ntemps;
+
+    IrFunc() : global(-1), nparams(0), ret_size(0), ntemps(0),
+        cur(-1), open(false) {}
+
+    uint32_t count() const { return op.size(); }
+
+    /**
+     * 功能：整体取出或改写第 i 条指令
+     */
+    IrInst inst(uint32_t i) const {
+        IrInst x = {(IrOp)op[i], size[i], d[i], a[i], b[i], loc[i]};
+        return x;
+    }
+    void set(uint32_t i, const IrInst &x) {
+        op[i] = x.op; size[i] = x.size;
+        d[i] = x.d; a[i] = x.a; b[i] = x.b;
+        loc[i] = x.loc;
+    }
+
+    /**
+     * 功能：常量操作数的值
+     */
+    int32_t constant(Ref r) const {
+        return ref_tag(r) == RT_IMM ? ref_imm(r) : consts[ref_index(r)];
+    }
+
+    /* 以下在生成中间代码时使用 */
+
+    /**
+     * 功能：取得值为 v 的常量操作数
+     */
+    Ref imm(int32_t v);
+
+    /**
+     * 功能：新建一个临时变量
+     */
+    Ref temp() { return make_ref(RT_TEMP, ntemps++); }
+
+    /**
+     * 功能：新建一个栈槽
+     */
+    Ref slot(int size, int align, const string &name, int decl);
+
+    /**
+     * 功能：新建一个尚未放置的基本块
+     */
+    Ref new_block();
+
+    /**
+     * 功能：从当前位置开始基本块 b，上一块没有结束时补一条转到 b 的跳转
+     */
+    void place(Ref b);
+
+    /**
+     * 功能：追加一条指令
+     * 上一块已经结束时，之后的指令放在一个新块中，这样的块不可到达
+     */
+    void emit(IrOp op, int size, Ref d, Ref a, Ref b, uint32_t loc);
+
+    /**
+     * 功能：追加一条有结果的指令，返回存放结果的新临时变量
+     */
+    Ref def(IrOp op, int size, Ref a, Ref b, uint32_t loc) {
+        Ref t = temp();
+        emit(op, size, t, a, b, loc);
+        return t;
+    }
+
+    /**
+     * 功能：当前块是否已经以转移或返回结束
+     */
+    bool terminated() const { return !open; }
+
+    /**
+     * 功能：函数分析完后结束最后一块，并把基本块按代码顺序重新编号
+     */
+    void finish(uint32_t loc);
+
+private:
+    int cur;            // 当前块
+    bool open;          // 当前块是否还能追加指令
+};
+
+/*
+ * 对指令数组的批量修改，由 ir_rewrite 一次完成
+ * 各块开头插入 head，转移指令之前插入 tail，dead 为真的块整块删去，
+ * 其余块中的 nop 也一并删去。
+ */
+struct IrEdits {
+    std::vector<std::vector<IrInst>> head, tail;
+    std::vector<char> dead;
+
+    explicit IrEdits(size_t nblocks)
+        : head(nblocks), tail(nblocks), dead(nblocks, 0) {}
+};
+
+/**
+ * 功能：按 e 重建函数的指令数组
+ * 删去块后剩下的块按原顺序重新编号，phi 中来自被删块的参数一并去掉
+ */
+void ir_rewrite(IrFunc &f, const IrEdits &e);
+
+/* 全局变量或函数 */
+struct IrGlobal {
+    string name;
+    bool func;
+    bool defined;       // 函数有函数体，变量有定义
+    bool array;         // 数组以字符串常量为初值时存放其内容，否则存放其地址
+    int size;
+    int align;
+    InitKind init;
+    int value;          // 初值，INIT_STR 时为字符串编号
+};
+
+/* 中间代码统计 */
+struct IrStats {
+    long funcs;
+    long insts;
+    long blocks;
+    long temps;
+    long bytes;         // 指令数组实际占用的字节数
+};
+
+/* 一个翻译单元的中间代码 */
+class IrModule {
+public:
+    IrModule() : strs(nullptr) {}
+
+    /**
+     * 功能：按名字取得全局变量或函数的编号，没有时加入
+     */
+    int global(const string &name, bool func);
+
+    std::vector<IrGlobal> globals;
+    std::vector<IrFunc> funcs;
+    const StrPool *strs;        // 字符串常量池，属于词法分析器
+
+    /**
+     * 功能：统计各函数的指令及其占用的内存
+     */
+    IrStats stats() const;
+
+private:
+    std::unordered_map<string, int> index;
+};
+
+/**
+ * 功能：指令的名字
+ */
+const char *ir_op_name(int op);
+
+/**
+ * 功能：操作数的书写形式，如 t3、&sum、@main、b2
+ */
+string ir_ref_str(const IrModule &m, const IrFunc &f, Ref r);
+
+/**
+ * 功能：以文本形式输出中间代码
+ * diag 用于把指令的源码偏移换算为行号
+ */
+void ir_dump(const IrModule &m, Diagnostics &diag, FILE *fp);
+
+#endif // _DF_IR_H
@@ -0,0 +1,51 @@
+#ifndef _DF_JIT_H
+#define _DF_JIT_H
+
+#include "x86.h"
+
+#include <cstddef>
+#include <string>
+
+/*
+ * 即时执行
+ * 把 x86_encode 的结果装入本进程：整块内存先以读写方式映射，填好重定位
+ * 以后，代码、外部函数的跳板和 GOT 改为只读可执行，数据保持可写。
+ * 外部符号按名字在本进程已装入的库中查找，strlen、printf 等即为 C 库的函数。
+ * 与虚拟机一样，字符串常量放在可写的内存中。
+ */
+
+/* 装入统计 */
+struct JitStats {
+    long code_bytes;
+    long data_bytes;        // 字符串常量、.data 和 .bss
+    long stubs;             // 外部函数的跳板
+    long got;               // GOT 表项
+    long relocs;
+    long pages;
+};
+
+class Jit {
+public:
+    Jit() : base(nullptr), size(0) {}
+    ~Jit();
+
+    /**
+     * 功能：装入模块，找不到外部符号或映射失败时写入 err 并返回 false
+     */
+    bool load(const IrModule &m, const X86Object &obj, JitStats &st, string &err);
+
+    /**
+     * 功能：已装入的函数的地址，没有定义时返回 nullptr
+     */
+    void *function(const IrModule &m, const string &name) const;
+
+private:
+    Jit(const Jit &) = delete;
+    Jit &operator=(const Jit &) = delete;
+
+    uint8_t *base;
+    size_t size;
+    std::vector<uint8_t *> addr;    // 各全局符号的地址
+};
+
+#endif // _DF_JIT_H
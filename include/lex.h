@@ -2,6 +2,8 @@
 #define _DF_LEX_H
 
 #include "token.h"
+#include "diag.h"
+#include "strpool.h"
 
 #include <fstream>
 #include <iostream>
@@ -16,6 +18,12 @@ using std::ifstream;
 
 void color_print(char *fmt, ...);
 void _color_token(Token token);
+
+/**
+ * 功能：改由 color 决定单词的颜色，返回 ANSI 颜色码，0 为不着色
+ * color 为空时恢复按单词种类着色
+ */
+void set_token_color(int (*color)(Token &token));
 const std::unordered_map<string, TokenType> keyword2types{
     {"char",   TokenType::KW_CHAR},
     {"short",  TokenType::KW_SHORT},
@@ -51,6 +59,59 @@ public:
      */
     void getch();
 
+    /**
+     * 取得诊断记录
+     */
+    Diagnostics& diagnostics() { return diag; }
+
+    /**
+     * 功能：从当前的 { 之后快速匹配到对应的 }，不生成单词
+     * 跳过注释、字符常量和字符串常量中的括号
+     * 返回值：} 之后的字节偏移，没有匹配的 } 时返回 -1
+     */
+    int skip_block();
+
+    /**
+     * 功能：重新定位到字节偏移 offset 处，下次取单词从这里开始
+     * end：分析的终点，之后视为文件结束，-1 表示源码末尾
+     */
+    void seek(int offset, int end = -1);
+
+    /**
+     * 功能：取得字符串常量池，字符串常量单词的值是池中的编号
+     * 重放单词流时由缓存恢复
+     */
+    StrPool& strings() { return pool; }
+
+    /**
+     * 功能：取得源码全文
+     */
+    const string& source() { return src; }
+
+    /**
+     * 功能：设置是否记录取得的单词及词法诊断，供写入缓存
+     */
+    void set_record(bool on) { recording = on; }
+
+    /**
+     * 功能：取得记录的单词流
+     */
+    const std::vector<PackedToken>& recorded_tokens() { return tokens; }
+
+    /**
+     * 功能：取得记录的词法诊断
+     * args[1] 为产生诊断时正在扫描的单词的下标
+     */
+    const std::vector<Diagnostic>& recorded_diags() { return lexdiags; }
+
+    /**
+     * 功能：改为从缓存的单词流 toks 中取单词，不再扫描源码
+     * diags 为记录的词法诊断，在取到产生它的单词时重新报告
+     * toks 和 diags 在分析结束前必须保持有效
+     */
+    void replay(const PackedToken *toks, size_t n,
+        const Diagnostic *diags, size_t nd);
+
 private:
     /**
      * 初始化
@@ -62,6 +123,31 @@ private:
      */
     void cleanup();
 
+    /**
+     * 退回最近取得的一个字符
+     */
+    void ungetch();
+
+    /**
+     * 是否已读过源码末尾
+     */
+    bool eof() { return pos > limit; }
+
+    /**
+     * 判断字符能否作为单词的开头
+     */
+    bool is_token_start(char c);
+
+    /**
+     * 扫描源码取得一个单词
+     */
+    Token scan_token();
+
+    /**
+     * 记录一条词法诊断
+     */
+    void lex_error(DiagCode code, uint32_t offset, int a = 0);
+
     /**
      * 注释处理
      */
@@ -83,21 +169,43 @@ private:
     string parse_identifier();
 
     /**
-     * 解析整形常量
+     * 解析整形常量，值存入 tkvalue
      */
     string parse_num();
 
     /**
      * 解析字符常量和字符串常量
      * sep 单引号为 字符常量  双引号为字符串常量
+     * 字符常量的值存入 tkvalue，字符串去掉转义后存入 pool，其编号存入 tkvalue
      */
     string parse_string(char sep);
 
+    /**
+     * 解析 \ 之后的转义字符
+     */
+    int parse_escape();
+
     /* private var */
-    ifstream fin;
+    string src;         // 源码全文
+    size_t pos;         // 下一个要取的字符的偏移，ch 位于 pos-1
+    size_t limit;       // 分析的终点，通常为源码末尾
+    Diagnostics diag;   // 词法及语法诊断
     int line_num;       // 行数
     int column_num;     // 列数
     char ch;            // 当前取得的字符
+    int tkvalue;        // 最近解析的常量的值
+    string body;        // 正在解析的字符串去掉转义后的内容
+    StrPool pool;       // 字符串常量池
+
+    bool recording;     // 是否记录单词流
+    std::vector<PackedToken> tokens;
+    std::vector<Diagnostic> lexdiags;
+    const PackedToken *replay_toks;     // 重放的单词流，为空时扫描源码
+    size_t replay_count;
+    size_t replay_pos;
+    const Diagnostic *replay_diags;
+    size_t replay_ndiags;
+    size_t replay_dpos;
 
     bool is_read;
 };
@@ -0,0 +1,149 @@
+#ifndef _DF_OPT_H
+#define _DF_OPT_H
+
+#include "cfg.h"
+#include "ir.h"
+
+/* 优化统计 */
+struct OptStats {
+    long promoted;      // 提升为临时变量的栈槽
+    long phis;          // 放置的 phi
+    long exts;          // 因存入时截断而加的 ext
+    long consts;        // 替换为常量的操作数
+    long branches;      // 条件恒定而改为跳转的分支
+    long dead_blocks;   // 删去的不可到达块
+    long dead;          // 删去的无用指令
+    long threaded;      // 越过只有一条跳转的块而直接转到目标的转移
+    long hoisted;       // 移出循环的指令
+    long ivs;           // 新建的指针归纳变量
+    long reduced;       // 改用指针归纳变量的地址计算
+    long copies;        // 传播后删去的复制和多余的 ext
+    long merged;        // 并入唯一前驱的块
+    long inlined;       // 内联的调用
+    long inline_insts;  // 内联带来的指令
+    long vectorized;    // 向量化的循环
+    long vec_insts;     // 向量循环中的向量指令
+
+    /* 优化前后的指令数 */
+    long insts[2];
+    long loads[2];
+    long stores[2];
+    long brs[2];
+    long loop_insts[2]; // 其中在循环中的
+};
+
+/*
+ * 内联的代价模型，单位为中间代码的指令数
+ * 被调函数去掉形参的存入和调用本身以后的指令数不超过
+ * threshold + 各项加成时内联；threshold 为负数时不内联。
+ */
+struct InlineParams {
+    int threshold;
+    int loop_bonus;     // 调用处每深一层循环的加成，至多计 3 层
+    int single_bonus;   // 整个模块中只有这一处调用时的加成
+    int const_bonus;    // 每个常量实参的加成
+    int max_size;       // 内联以后调用者至多的指令数
+
+    InlineParams() : threshold(20), loop_bonus(20), single_bonus(40),
+        const_bonus(5), max_size(2000) {}
+};
+
+/**
+ * 功能：按直接调用建立调用图，由被调函数到调用者依次内联
+ * 递归（在调用图的同一强连通分量中）的函数不内联。形参的值直接代入，
+ * 返回值经一个新栈槽传回，由之后的 mem2reg 提升。须在 mem2reg 之前进行。
+ */
+void inline_calls(IrModule &m, const InlineParams &ip, OptStats &st);
+
+/**
+ * 功能：把地址只用于同宽度 load、store 的标量栈槽提升为 SSA 临时变量
+ * 在变量各定值块的迭代支配边界处放置 phi，再沿支配树重命名。
+ * 存入时的截断改为 ext；没有定值就读取的变量取 0。
+ */
+void mem2reg(IrFunc &f, const Cfg &g, const DomTree &t, OptStats &st);
+
+/**
+ * 功能：复制传播
+ * 把 mov 的结果和扩展前已在该宽度内的 ext 的结果换成其源操作数。
+ * 各值的宽度（在几个字节内符号扩展）按定值指令求出，phi 取各参数中的
+ * 最大者，从乐观的初值迭代到不动点。须在 SSA 形式上进行。
+ */
+void copy_prop(IrFunc &f, OptStats &st);
+
+/**
+ * 功能：稀疏条件常量传播
+ * 同时在控制流边和 SSA 定值-使用边上传播格值，只经过可执行的边，
+ * 因此条件恒定的分支另一侧的定值不会妨碍 phi 得到常量。
+ * 结束后常量代入各使用处，恒定分支改为跳转，不可执行的块删去。
+ */
+void sccp(IrFunc &f, const Cfg &g, OptStats &st);
+
+/**
+ * 功能：删除结果不被使用且没有副作用的指令
+ */
+void dce(IrFunc &f, OptStats &st);
+
+/**
+ * 功能：循环不变代码外提
+ * 由内向外把循环中的不变计算移到前置块，strlen 等已知的纯函数在循环
+ * 不写内存时也可以外提。须在 SSA 形式上进行。
+ */
+void licm(const IrModule &m, IrFunc &f, OptStats &st);
+
+/**
+ * 功能：归纳变量的强度削弱
+ * 首块中 i = phi(init, i + c) 为基本归纳变量，循环中的 base + i * s
+ * （base 不变）改为一个新的指针归纳变量 p = phi(base + init * s, p + c * s)，
+ * 原来每次的乘法和加法由 DCE 删去。须在 SSA 形式上进行。
+ */
+void strength_reduce(IrFunc &f, OptStats &st);
+
+/**
+ * 功能：把计数循环改写为 16 字节的向量循环，余下的迭代仍由原来的标量循环完成
+ * 循环须为最内层，首块只有归纳变量的 phi 和 i < n 的判断，访存都经步长为
+ * 元素大小的指针归纳变量，且元素大小相同。if/else 按掩码转换：汇合处的 phi
+ * 和分支中的存入改为按位选择，因此每条路径都须存入同一组指针，取数须在每次
+ * 迭代都执行的块中出现过，以免推测取数出错。不能在编译时确定不重叠的指针
+ * 在前置块中检查，相距不足 16 字节时向量循环执行 0 次。须在 SSA 形式上进行。
+ */
+void vectorize(IrFunc &f, OptStats &st);
+
+/**
+ * 功能：离开 SSA
+ * 每个 phi 有一个新的临时变量 x'，各前驱在转移前把参数复制到 x'，
+ * phi 本身改为 x = x'，这样不必拆分关键边，也不会有复制相互覆盖的问题。
+ */
+void leave_ssa(IrFunc &f);
+
+/**
+ * 功能：转到只有一条跳转的块时直接转到其目标，两个目标相同的分支改为跳转，
+ * 再删去因此不可到达的块。须在离开 SSA 之后进行，这时不必顾及 phi。
+ */
+void thread_jumps(IrFunc &f, OptStats &st);
+
+/**
+ * 功能：以跳转结束的块，其目标只有它一个前驱时把目标并入，
+ * 内联留下的调用处和返回处的跳转由此去掉。须在离开 SSA 之后进行。
+ */
+void merge_blocks(IrFunc &f, OptStats &st);
+
+/**
+ * 功能：统计优化前的指令并内联，是优化中唯一要看整个模块的一步
+ */
+void optimize_module(IrModule &m, OptStats &st, const InlineParams &ip = InlineParams());
+
+/**
+ * 功能：对一个函数依次进行上述优化，只读取 m 中的全局符号，
+ * 不同的函数可以在不同的线程上同时优化
+ * vec 为真时进行向量化，生成的向量运算只有 x86-64 后端支持
+ */
+void optimize_function(const IrModule &m, IrFunc &f, OptStats &st, bool vec = false);
+
+/**
+ * 功能：先内联，再对模块中的每个函数依次进行上述优化
+ * vec 为真时进行向量化，生成的向量运算只有 x86-64 后端支持
+ */
+void optimize(IrModule &m, OptStats &st, const InlineParams &ip = InlineParams(),
+    bool vec = false);
+
+#endif // _DF_OPT_H
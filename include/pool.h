@@ -0,0 +1,64 @@
+#ifndef _DF_POOL_H
+#define _DF_POOL_H
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/*
+ * 工作窃取的线程池
+ * 任务为 0..n-1 的下标，开始时按连续的块分到各线程的双端队列。线程从自己
+ * 队列的头部依次取任务，取完以后从其他线程队列的尾部窃取，较大的任务拖慢
+ * 一个线程时其余的任务会被别的线程取走。调用 run 的线程也执行任务。
+ */
+
+/* 并行执行的统计 */
+struct PoolStats {
+    long threads;
+    long tasks;
+    long steals;        // 从其他线程的队列取走的任务
+};
+
+class TaskPool {
+public:
+    /* threads 不大于 0 时按处理器数 */
+    explicit TaskPool(int threads);
+
+    int threads() const { return nthreads; }
+
+    /**
+     * 功能：执行 n 个任务，全部完成后返回
+     * task(i, w) 在第 w 个线程上执行第 i 个任务，w 小于 threads()，
+     * 同一线程上的任务依次执行，按 w 分开的数据不必加锁
+     */
+    void run(size_t n, const std::function<void(size_t, int)> &task, PoolStats &st);
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    bool take(int w, size_t &task, long &steals);
+    void work(int w, const std::function<void(size_t, int)> &task, long &steals);
+
+    int nthreads;
+    std::vector<Queue> queues;
+};
+
+/**
+ * 功能：把各线程的统计加到一起，统计结构的成员都是 long
+ */
+template <class T>
+void add_stats(T &to, const T &from)
+{
+    static_assert(sizeof(T) % sizeof(long) == 0, "stats are made of long");
+    long *d = reinterpret_cast<long *>(&to);
+    const long *s = reinterpret_cast<const long *>(&from);
+    for (size_t k = 0; k < sizeof(T) / sizeof(long); k++)
+        d[k] += s[k];
+}
+
+#endif // _DF_POOL_H
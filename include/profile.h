@@ -0,0 +1,70 @@
+#ifndef _DF_PROFILE_H
+#define _DF_PROFILE_H
+
+#include "ir.h"
+
+#include <string>
+#include <vector>
+
+using std::string;
+
+/*
+ * 剖析引导的代码布局
+ * 插桩以后，优化后每个函数的每个块在全局数组 __df_prof 中有两个计数：块的执行
+ * 次数，以及以条件转移结束时转向真分支的次数，假分支的次数即为两者之差。
+ * 程序退出时 __df_prof_dump 把整个数组写到剖析文件，链接的程序在 main 开头
+ * 用 atexit 登记，JIT 由驱动程序登记。
+ * 数组开头的 8 个字节为 PROF_MAGIC 和模块的校验和，校验和由优化后各函数的名字
+ * 和块的形状求出，源码或影响优化结果的选项改变以后即不再匹配。
+ * 再次编译时读入计数：热的边尽量落空，从未执行的块移到函数末尾，
+ * 函数按执行的块数从多到少排列。
+ */
+
+#define PROF_MAGIC      0x46504644      // "DFPF"
+#define PROF_ARRAY      "__df_prof"
+#define PROF_DUMP       "__df_prof_dump"
+
+/* 剖析统计 */
+struct ProfStats {
+    long counters;      // 插桩的计数
+    long hot;           // 执行过的函数
+    long moved;         // 换了位置的块
+    long cold;          // 从未执行而移到函数末尾的块
+    long jumps[2];      // 按剖析算出的布局前后转走（不落空）的转移次数
+};
+
+/**
+ * 功能：求模块的校验和，以及各函数的计数在数组中的起点
+ * base 比函数多一项，最后一项为数组的总项数
+ */
+uint32_t prof_shape(const IrModule &m, std::vector<uint32_t> &base);
+
+/**
+ * 功能：为各函数插入计数，新建写出剖析文件的函数 __df_prof_dump
+ * path 和 mode 为文件名和打开方式在字符串常量池中的编号；at_exit 为真时在
+ * main 开头用 atexit 登记，否则由调用者登记
+ */
+void prof_instrument(IrModule &m, int path, int mode, bool at_exit, ProfStats &st);
+
+/**
+ * 功能：读入剖析文件，文件不可读或与 m 不匹配时返回假并设置 err
+ */
+bool prof_read(const IrModule &m, const string &path, std::vector<uint64_t> &counts,
+    string &err);
+
+/**
+ * 功能：按热度从高到低重排函数，未执行的保持原来的相对次序放在最后
+ * base 随函数一同重排
+ */
+void prof_order_functions(IrModule &m, const std::vector<uint64_t> &counts,
+    std::vector<uint32_t> &base, ProfStats &st);
+
+/**
+ * 功能：按一个函数的计数重排它的块
+ * 按权重从大到小取边，边的起点是一条链的末尾、终点是另一条链的开头时把两条链
+ * 接起来，于是热的边落空。入口所在的链在最前，其余执行过的链按原来的次序，
+ * 从未执行的块放在最后。
+ */
+void prof_layout(IrFunc &f, const uint64_t *counts, ProfStats &st);
+
+#endif // _DF_PROFILE_H
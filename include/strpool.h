@@ -0,0 +1,84 @@
+#ifndef _DF_STRPOOL_H
+#define _DF_STRPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string;
+
+/* 池中一个字符串的位置 */
+struct StrEntry {
+    uint32_t off;       // 在 data 中的偏移
+    uint32_t len;       // 长度，不含结尾的 '\0'
+};
+
+/* 字符串池统计 */
+struct StrStats {
+    long interns;       // 加入的字符串常量数
+    long bytes;         // 这些常量去掉转义后的总字节数，含 '\0'
+    long merged;        // 作为其他字符串的尾部共享存储的字符串数
+};
+
+/**
+ * 字符串常量池
+ * 字符串常量去掉转义后存入连续的 data，每个以 '\0' 结尾，内容相同的
+ * 常量只存一份，编号即在 entries 中的下标。
+ * merge_tails 之后，是其他字符串尾部的字符串（如 "bc" 之于 "abc"）
+ * 改为指向长字符串的尾部，后端按 data 输出即可让每个常量只出现一次。
+ * 编号在合并前后不变，只有偏移会变。
+ */
+class StrPool {
+public:
+    StrPool();
+
+    /**
+     * 功能：加入长度为 n 的字符串，已有相同内容时返回原来的编号
+     */
+    int intern(const char *s, size_t n);
+
+    /**
+     * 功能：让是其他字符串尾部的字符串共享存储，并压缩 data
+     */
+    void merge_tails();
+
+    /**
+     * 功能：取得字符串的内容、长度及在 data 中的偏移
+     */
+    const char *str(int id) const { return data.data() + entries[id].off; }
+    size_t length(int id) const { return entries[id].len; }
+    uint32_t offset(int id) const { return entries[id].off; }
+
+    /**
+     * 功能：取得按 C 语言转义后加上双引号的写法，用于输出
+     */
+    string quoted(int id) const;
+
+    /**
+     * 功能：不同字符串的个数及存储的字节数
+     */
+    size_t count() const { return entries.size(); }
+    size_t bytes() const { return data.size(); }
+    const string& bytes_data() const { return data; }
+    const StrStats& stats() const { return st; }
+
+    /**
+     * 功能：把整个池写成一段连续的字节，以及从这样的字节恢复
+     * 格式：uint32_t 个数，StrEntry[个数]，data
+     */
+    void save(string &out) const;
+    bool load(const char *p, size_t n);
+
+private:
+    uint32_t hash(const char *s, size_t n) const;
+    void grow();
+
+    string data;
+    std::vector<StrEntry> entries;
+    std::vector<int> slots;         // 开放定址散列表，存编号，-1 为空
+    std::vector<uint32_t> hashes;   // 各字符串的散列值，扩容时不必重算
+    StrStats st;
+};
+
+#endif // _DF_STRPOOL_H
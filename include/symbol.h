@@ -0,0 +1,119 @@
+#ifndef _DF_SYMBOL_H
+#define _DF_SYMBOL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string;
+
+/* 存储类型 */
+#define SC_LOCAL  0     // 局部变量
+#define SC_GLOBAL 1     // 全局变量及函数
+#define SC_MEMBER 2     // 结构体成员
+#define SC_PARAM  3     // 形参
+#define SC_STRUCT 4     // 结构体名，与普通标识符分属不同的名字空间
+
+/* 全局变量的初值 */
+enum InitKind {
+    INIT_NONE,      // 没有初值，即为 0
+    INIT_CONST,     // 整型常量，value 为其值
+    INIT_STR        // 字符串常量的地址，value 为字符串在常量池中的编号
+};
+
+/* 符号 */
+struct Symbol {
+    string name;
+    uint32_t hash;      // 名字及名字空间的散列值
+    int type;           // 类型在 TypeTable 中的下标，结构体名为结构体类型
+    int sc;             // 存储类型
+    int level;          // 作用域层次，全局为 0
+    int offset;         // 定义处的字节偏移
+    int prev;           // 被本符号遮蔽的同名符号，-1 表示没有
+    int slot;           // 所在的散列槽
+    InitKind init;      // 全局变量的初值
+    int value;
+    int ir;             // 局部变量的栈槽或全局变量在中间代码中的编号，-1 为没有
+};
+
+/* 查找统计 */
+struct SymStats {
+    long pushes;        // 加入的符号数
+    long lookups;       // 查找次数
+    long found;         // 找到的次数
+    long probes;        // 查找时比较的散列槽数
+    long rehashes;      // 散列表扩容次数
+    int max_level;      // 最深的作用域层次
+};
+
+/**
+ * 作用域符号表
+ * 符号按定义顺序存放在符号栈中，散列表采用开放定址，每个槽存放某个名字
+ * 当前可见的最内层符号，被遮蔽的同名符号由 prev 串起来。
+ * 符号栈同时是撤销日志：离开作用域时从栈顶弹出本层的符号，把各自的槽
+ * 恢复为 prev，然后截断符号栈，不需要重新散列。
+ * 作用域严格后进先出，所以槽可以直接置空而不必留墓碑。
+ */
+class SymTable {
+public:
+    SymTable();
+
+    /**
+     * 功能：在当前作用域加入符号，遮蔽外层的同名符号
+     * 返回值：符号在符号栈中的下标
+     * 结构体成员记录在 TypeTable 中，不进符号表
+     */
+    int push(const string &name, int type, int sc, int offset);
+
+    /**
+     * 功能：查找当前可见的符号
+     * tag：为 true 时查找结构体名
+     * 返回值：符号下标，找不到时为 -1
+     */
+    int find(const string &name, bool tag = false);
+
+    /**
+     * 功能：进入新的作用域
+     */
+    void enter_scope();
+
+    /**
+     * 功能：离开当前作用域，删除其中定义的全部符号
+     */
+    void leave_scope();
+
+    /**
+     * 功能：当前作用域层次，全局为 0
+     */
+    int level() const { return marks.size(); }
+
+    Symbol& operator[](int i) { return syms[i]; }
+    int size() const { return syms.size(); }
+    const SymStats& stats() const { return st; }
+
+private:
+    /* 散列槽，保存散列值以免比较名字时访问符号栈 */
+    struct Slot {
+        uint32_t hash;
+        int32_t sym;        // 符号下标，-1 为空槽
+    };
+
+    /**
+     * 功能：查找名字所在的槽，不存在时返回其应插入的空槽，
+     * 名字空间已由 h 的最低位区分
+     */
+    int probe(const string &name, uint32_t h, long &n);
+
+    /**
+     * 功能：散列表扩容为原来的两倍，按定义顺序重新插入
+     */
+    void rehash();
+
+    std::vector<Symbol> syms;   // 符号栈
+    std::vector<int> marks;     // 各层作用域开始时的符号栈高度
+    std::vector<Slot> slots;    // 散列表，大小为 2 的幂
+    int used;                   // 非空槽数
+    SymStats st;
+};
+
+#endif // _DF_SYMBOL_H
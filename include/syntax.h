@@ -3,10 +3,91 @@
 
 #include "lex.h"
 #include "token.h"
+#include "symbol.h"
+#include "type.h"
+#include "ir.h"
+
+/* 单词集合，每个单词编码占一位，用于错误恢复时的同步 */
+typedef uint64_t TokenSet;
+#define TKSET(t) ((TokenSet)1 << (int)(t))
+
+/* 大纲记录的种类 */
+enum OutlineKind {
+    OL_STRUCT,  // 结构体定义
+    OL_FUNC,    // 函数定义
+    OL_PROTO,   // 函数声明
+    OL_VAR      // 全局变量
+};
+
+/* 顶层声明的大纲记录 */
+struct OutlineEntry {
+    OutlineKind kind;
+    string name;
+    int offset;         // 名字的字节偏移
+    int body_begin;     // 函数体 { 的字节偏移，非函数定义为 -1
+    int body_end;       // 函数体 } 之后的字节偏移
+};
+
+/* 剖析时单独统计的结构 */
+enum SpanKind {
+    SPAN_FOR,   // for 语句，含循环体
+    SPAN_CALL   // 函数调用，含实参
+};
+
+/* 结构在源码中的范围 [begin, end)，head 处的代码执行一次即结构执行一次 */
+struct SpanEntry {
+    SpanKind kind;
+    uint32_t begin, end;
+    uint32_t head;      // for 为条件，没有条件时为 for；调用为被调的函数
+};
+
+/* 交叉引用的种类 */
+enum XRefKind {
+    XR_STRUCT_DEF,  // 结构体定义
+    XR_STRUCT_USE,  // 结构体引用
+    XR_FUNC_DEF,    // 函数定义
+    XR_FUNC_DECL,   // 函数声明
+    XR_GLOBAL,      // 全局变量定义
+    XR_LOCAL,       // 局部变量定义
+    XR_PARAM,       // 形参
+    XR_MEMBER_DEF,  // 结构体成员定义
+    XR_MEMBER_USE,  // . 或 -> 之后的成员
+    XR_USE          // 表达式中出现的标识符
+};
 
-#define SC_GLOBAL 1
-#define SC_LOCAL 0
-#define SC_MEMBER 0
+/* 一条交叉引用 */
+struct XRef {
+    XRefKind kind;
+    string name;
+    int offset;     // 名字的字节偏移
+    int decl;       // 所引用的定义的字节偏移，未能解析时为 -1
+};
+
+/* 形参表中的一个形参 */
+struct ParamDecl {
+    string name;
+    int offset;     // 名字的字节偏移
+    int type;
+};
+
+/* 表达式的分析结果 */
+struct Operand {
+    int type;       // 类型，T_UNKNOWN 表示未知，不再检查
+    bool lvalue;    // 是否为左值
+    bool is_const;  // 是否为整型常量表达式
+    int value;      // 常量表达式的值
+    int offset;     // 表达式开头的字节偏移，用于报告错误
+    Ref val;        // 中间代码中的值，左值为其地址
+
+    /* 整数常量 0，可以赋给任何指针 */
+    bool null() const { return is_const && value == 0; }
+};
+
+/* 循环中 break 和 continue 转到的块 */
+struct LoopTarget {
+    Ref brk;
+    Ref cont;
+};
 
 /* 语法状态枚举 */
 enum SynTaxState {
@@ -27,12 +108,99 @@ public:
     */
     void translation_unit();
 
+    /**
+     * 功能：取得词法及语法分析的诊断记录
+     */
+    Diagnostics& diagnostics() { return lex.diagnostics(); }
+
+    /**
+     * 功能：取得内含的词法分析器
+     */
+    Lex& lexer() { return lex; }
+
+    /**
+     * 功能：设置是否输出缩进着色后的源码
+     */
+    void set_echo(bool on) { echo = on; }
+
+    /**
+     * 功能：设置大纲模式
+     * 顶层函数体只做括号匹配记录范围，不进入 compound_statement
+     */
+    void set_lazy_body(bool on) { lazy_body = on; }
+
+    /**
+     * 功能：取得顶层声明的大纲，按源码顺序排列
+     */
+    const std::vector<OutlineEntry>& outline() const { return outlines; }
+
+    /**
+     * 功能：按需分析大纲模式下跳过的函数体
+     */
+    void parse_body(const OutlineEntry &e);
+
+    /**
+     * 功能：设置是否记录交叉引用
+     */
+    void set_xref(bool on) { want_xref = on; }
+
+    /**
+     * 功能：取得记录的交叉引用，按源码顺序排列
+     */
+    const std::vector<XRef>& xref() const { return xrefs; }
+
+    /**
+     * 功能：取得符号表
+     */
+    SymTable& symbols() { return symtab; }
+
+    /**
+     * 功能：取得类型表，含各结构体的布局
+     */
+    const TypeTable& types() const { return typetab; }
+
+    /**
+     * 功能：设置是否在分析的同时生成中间代码
+     * 有错误时生成的中间代码不完整，不应使用
+     */
+    void set_lower(bool on) { lower = on; }
+
+    /**
+     * 功能：取得生成的中间代码
+     */
+    IrModule& ir() { return irmod; }
+
+    /**
+     * 功能：取得生成中间代码时记录的 for 语句和调用，按结束的先后排列
+     */
+    const std::vector<SpanEntry>& spans() const { return spanlist; }
+
 private:
     Lex lex;            // 内含有的词法分析器
     Token token;        // 当前分析到的词
     int syntax_state;   // 语法状态
-    int syntax_level;   // 缩进级别
+    int syntax_level;   // 缩进级别，即当前所在的 { } 嵌套层数
     bool is_read;
+    bool panic;         // 错误恢复中，重新同步前不再报告语法错误
+    long tkcount;       // 已取得的单词数，用于判断循环是否前进
+    bool echo;          // 是否输出缩进着色后的源码
+    bool lazy_body;     // 大纲模式
+    string decl_name;   // 最近一个声明符的标识符
+    int decl_offset;    // 及其字节偏移
+    bool decl_func;     // 及其是否为函数声明符
+    int end_offset;     // 最近一个复合语句 } 之后的字节偏移
+    std::vector<OutlineEntry> outlines;
+    bool want_xref;     // 是否记录交叉引用
+    std::vector<XRef> xrefs;
+    SymTable symtab;    // 符号表
+    TypeTable typetab;  // 类型表
+    std::vector<ParamDecl> params;  // 最近一个形参表中的形参
+    int func_ret;       // 当前函数的返回类型
+    bool lower;         // 是否生成中间代码
+    IrModule irmod;
+    IrFunc *fn;         // 正在生成的函数，函数外为空
+    std::vector<SpanEntry> spanlist;
+    std::vector<LoopTarget> loops;  // 所在的各层循环
 
     /**
      * 功能： 解析外部声明
@@ -47,49 +215,54 @@ private:
 
     /**
      * 功能：解析类型区分符
+     * t：取得的类型
      * 返回值：是否发现合法的类型区分符
      * <type_specifier>
      *  --> <KW_INT>|<KW_CHAR>|<KW_SHORT>|<KW_VOID>|<struct_specifier>
      */
-    int type_specifier();
+    int type_specifier(int &t);
 
     /**
      * 功能：结构体类型区分符
+     * t：取得的结构体类型
      * <struct_specifier>
      *   --> <KW_STRUCT><IDENTIFIER><TK_BEGIN><struct_declaration_list><TK_END>
      *      | <KW_STRUCT><IDENTIFIER>
      */
-    void struct_specifier();
+    void struct_specifier(int &t);
 
     /**
      * 功能：结构体中声明的变量的全体
+     * t：结构体类型，分析完成后确定其布局
      * <struct_declaration_list> 
      *  --> <struct_declaration>{<struct_declaration>}
      */
-    void struct_declaration_list();
+    void struct_declaration_list(int t);
 
     /**
      * 功能：结构体中声明的变量
+     * t：结构体类型，成员按顺序加入
      * <strcut_declaration>
      *  --> <type_specifier><struct_declarator_list><TK_SEMICOLON>
      * <struct_declarator_list>
      *  --> <declarator>{<TK_COMMA><declarator>}
      */
-    void struct_declaration();
+    void struct_declaration(int t);
 
     /**
      * 功能：声明符的解析
+     * t：传入类型区分符的类型，传出加上指针、数组、函数后的类型
      * <declarator>
      *  --> {<pointer>}<direct_declarator>
      */
-    void declarator();
+    void declarator(int &t);
 
     /**
      * 功能：直接声明符解析
      * <direct_declarator>
      *  --> <IDENTIFIER><direct_declarator_postfix>
      */
-    void direct_declarator();
+    void direct_declarator(int &t);
 
     /**
      * 功能：直接声明符后缀
@@ -99,7 +272,7 @@ private:
      *    | <TK_OPENPA><parameter_type_list><TK_CLOSPA>
      *    | <TK_OPENPA><TK_CLOSPA>
      */
-    void direct_declarator_postfix();
+    void direct_declarator_postfix(int &t);
 
     /**
      * 功能：解析形参类型表
@@ -110,16 +283,25 @@ private:
     void parameter_type_list();
 
     /**
-     * 功能：函数体解析
+     * 功能：函数体解析，形参在函数体外单独一层作用域
      * <funcbody> --> <compound_statement>
      */
     void funcbody();
 
     /**
-     * 功能：解析初值符
+     * 功能：大纲模式下跳过函数体，只记录其范围
+     * e：函数的大纲记录，填入函数体的范围
+     */
+    void skip_funcbody(OutlineEntry &e);
+
+    /**
+     * 功能：解析初值符，检查初值能否赋给所声明的类型
+     * 全局变量的初值折叠为常量存入符号
+     * t：所声明的类型
+     * sym：所声明的符号，没有时为 -1
      * <initializer> --> <assignment_expression>
      */
-    void initializer();
+    void initializer(int t, int sym);
 
     /**
      * 功能：语句解析
@@ -182,23 +364,24 @@ private:
 
     /**
      * 功能：解析表达式
+     * 返回值：表达式的类型及是否为左值，以下各类表达式相同
      * <expression>--><assignment_expression>{<TK_COMMA><assignment_expression>}
      */
-    void expression();
+    Operand expression();
 
     /**
      * 功能：解析赋值表达式
      * <assignment_expression>
      *  --> <equality_expression>|<unary_expression><TK_ASSIGN><assignment_expression>
      */
-    void assignment_expression();
+    Operand assignment_expression();
 
     /**
      * 功能：解析相等类表达式
      * <equality_expression> --> <relational_expression>
      *  {<TK_EQ><relational_expression>}|<TK_NEQ><relational_expression>
      */
-    void equality_expression();
+    Operand equality_expression();
 
     /**
      * 功能：关系表达式
@@ -208,21 +391,21 @@ private:
      *  | <TK_LEQ><additive_expression>
      *  | <TK_GEQ><additive_expression>}
      */
-    void relational_expression();
+    Operand relational_expression();
 
     /**
      * 功能：加减类表达式
      * <additive_expression> --> <multiplicative_expression>
      *  {<TK_PLUS>|<TK_MINUS><multiplicative_expression>}
      */
-    void additive_expression();
+    Operand additive_expression();
 
     /**
      * 功能：乘法除法表达式
      * <multiplicative_expression> --> <unary_expression>
      *  {<TK_STAR>|<TK_DIVIDE>|<TK_MOD><unary_expression>}
      */
-    void multiplicative_expression();
+    Operand multiplicative_expression();
 
     /**
      * 功能：一元表达式解析
@@ -230,13 +413,14 @@ private:
      *  | <TK_AND>|<TK_STAR> <unary_expression>
      *  |<sizeof_expression>
      */
-    void unary_expression();
+    Operand unary_expression();
 
     /**
      * 功能：解析sizeof表达式
+     * 返回值：类型的大小，大小未知时为 -1
      * <sizeof_expression> --> <KW_SIZEOF><TK_OPENPA><type_specifier><TK_CLOSEPA>
      */
-    void sizeof_expression();
+    int sizeof_expression();
 
     /**
      * 功能：后缀表达式
@@ -244,21 +428,23 @@ private:
      *  {<TK_OPENBR><expression><TK_CLOSEBR>|<TK_OPENPA><TK_CLOSEPA>
      *  |<TK_DOT><IDENTIFIER>|<TK_POINTSTO><IDENTIFIER>}
      */
-    void postfix_expression();
+    Operand postfix_expression();
 
     /**
      * 功能：解析初值表达式
      * <primary_expression> --> <IDENTIFIER>|<TK_CINT>|<TK_CSTR>|<TK_CCHAR>|
      *  <TK_OPENPA><expression><TK_CLOSEPA>
      */
-    void primary_expression();
+    Operand primary_expression();
 
     /**
-     * 功能：解析实参表达式
+     * 功能：解析实参表达式，并按函数类型检查实参
+     * callee：被调用的对象
+     * 返回值：各实参的值
      * <argument_expression_list> --> <assignment_expression>
      *  { <TK_COMMA><assignment_expression> }
      */
-    void argument_expression_list();
+    std::vector<Ref> argument_expression_list(const Operand &callee);
 
     /**
      * 功能：语法缩进
@@ -276,6 +462,79 @@ private:
      * c 要跳过的单词
     */
     void skip(TokenType c); 
+
+    /**
+     * 功能：在 offset 处记录一条语法错误
+     * offset 缺省为当前单词的位置
+     */
+    void error(DiagCode code, int a0 = 0, int a1 = 0, int offset = -1);
+
+    /**
+     * 功能：记录一条类型错误
+     * 类型错误不影响语法分析，不进入错误恢复；恢复中的表达式不再检查
+     */
+    void type_error(DiagCode code, int a0 = 0, int a1 = 0, int offset = -1);
+
+    /**
+     * 功能：二元运算的结果类型，运算对象不合要求时报告错误
+     * op：运算符
+     */
+    int binary_type(TokenType op, const Operand &a, const Operand &b);
+
+    /**
+     * 功能：分析完二元运算的右边后确定结果的类型和值，并生成运算的代码
+     * x：左边的值，在分析右边之前取得
+     */
+    void binary(TokenType op, Operand &a, Ref x, const Operand &b);
+
+    /**
+     * 功能：生成二元运算的代码，指针加减整数时整数乘以所指类型的大小
+     */
+    Ref lower_binary(TokenType op, const Operand &a, Ref x, const Operand &b);
+
+    /**
+     * 功能：取得表达式的值，左值需从其地址取出
+     * 数组、函数和结构体的值就是其地址
+     */
+    Ref rvalue(const Operand &op);
+
+    /**
+     * 功能：类型的值存取时的字节数，大小未知的按 int 处理
+     */
+    int mem_size(int t) const;
+
+    /**
+     * 功能：为全局变量或函数在中间代码中建立记录
+     * sym：符号下标，defined：是否为定义
+     */
+    void declare_global(int sym, bool defined);
+
+    /**
+     * 功能：两个运算对象都是常量时计算二元运算的值，结果存入 a
+     * 除数为 0 时不折叠
+     */
+    void fold(TokenType op, Operand &a, const Operand &b);
+
+    /**
+     * 功能：出错后跳过单词，直到遇到同步单词
+     * 函数内同步单词为 FOLLOW(statement) 中的 ; } { 及语句关键字，
+     * 顶层为 FOLLOW(external_declaration) 中的类型区分符及 ;
+     * 跳过的 { } 成对匹配，同步单词本身不被跳过
+     * follow：调用者额外希望停下的单词
+     */
+    void synchronize(TokenSet follow = 0);
+
+    /**
+     * 功能：记录一条交叉引用
+     * decl：引用所指定义的偏移，只对各种引用有意义，定义指向其自身
+     */
+    void add_xref(XRefKind kind, const string &name, int offset, int decl = -1) {
+        if (want_xref && !name.empty()) {
+            bool use = kind == XR_USE || kind == XR_MEMBER_USE || kind == XR_STRUCT_USE;
+            XRef x = {kind, name, offset, use ? decl : offset};
+            xrefs.push_back(x);
+        }
+    }
 };
 
 #endif // _DF_SYNTAX_H
\ No newline at end of file
@@ -1,5 +1,6 @@
 #ifndef _DF_TOKEN_H
 #define _DF_TOKEN_H
+#include <cstdint>
 #include <string>
 
 using std::string;
@@ -57,8 +58,26 @@ enum class TokenType {
 };
 
 
+/**
+ * 紧凑的单词记录，不含指针，拼写由源码偏移和长度还原
+ * 用于缓存单词流
+ */
+struct PackedToken {
+    uint32_t type;      // TokenType
+    uint32_t offset;    // 词首字符的字节偏移
+    uint32_t len;       // 拼写长度
+    int32_t value;      // 常量的值
+};
+
+/**
+ * 功能：取得单词编号对应的名字，用于诊断信息
+ */
+const char *token_name(TokenType type);
+
+
 class Token {
 public:
+    Token() : tkcode(TokenType::TK_EOF), tkoffset(0), tkvalue(0) {}
 
     /**
      * 设置该词的符号编码
@@ -88,9 +107,39 @@ public:
         return spelling;
     }
 
+    /**
+     * 设置词在源码中的字节偏移
+     */
+    void setoffset(int off) {
+        tkoffset = off;
+    }
+
+    /**
+     * 取得词在源码中的字节偏移
+     */
+    int offset() {
+        return tkoffset;
+    }
+
+    /**
+     * 设置常量的值，由词法分析时解析
+     */
+    void setvalue(int v) {
+        tkvalue = v;
+    }
+
+    /**
+     * 取得整型常量或字符常量的值
+     */
+    int value() {
+        return tkvalue;
+    }
+
 private:
     TokenType tkcode;       // 词法符号编码
     string    spelling;     // 词的字符串
+    int       tkoffset;     // 词首字符的字节偏移
+    int       tkvalue;      // 整型常量和字符常量的值
 };
 
 #endif // _DF_TOKEN_H
\ No newline at end of file
@@ -0,0 +1,169 @@
+#ifndef _DF_TYPE_H
+#define _DF_TYPE_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using std::string;
+
+/* 类型种类 */
+enum TypeKind {
+    T_INT,
+    T_CHAR,
+    T_SHORT,
+    T_VOID,
+    T_PTR,      // ref 为所指类型
+    T_ARRAY,    // ref 为元素类型，count 为元素个数，未给出时为 -1
+    T_FUNC,     // ref 为返回值类型，count 为形参个数，first 为第一个形参
+    T_STRUCT    // ref 为结构体下标
+};
+
+/**
+ * 类型，以 TypeTable 中的下标表示
+ * 除结构体外的类型都经过驻留，结构相同的类型下标相同，
+ * 判断类型是否相同只需比较下标
+ */
+struct TypeInfo {
+    TypeKind kind;
+    int ref;
+    int count;
+    int first;      // 函数形参类型在形参表中的起始下标
+};
+
+/* 类型未知，如未声明的标识符，不参与类型检查 */
+#define T_UNKNOWN   -1
+
+/* 结构体成员 */
+struct Member {
+    string name;
+    int type;
+    int offset;         // 在结构体中的字节偏移
+    int decl;           // 声明处的字节偏移
+};
+
+/* 结构体 */
+struct StructInfo {
+    string name;
+    int decl;           // 结构体名的字节偏移
+    int size;           // 未定义时为 -1
+    int align;
+    std::vector<Member> members;
+};
+
+#define PTR_SIZE    8       // 目标机为 x86-64
+#define CACHE_LINE  64
+
+/**
+ * 类型表
+ * 结构体的布局在这里保存，离开作用域删除结构体符号后仍可查询
+ */
+class TypeTable {
+public:
+    TypeTable();
+
+    /**
+     * 功能：基本类型，其下标与 TypeKind 相同
+     */
+    int basic(TypeKind k) const { return k; }
+
+    /**
+     * 功能：构造指针、数组、函数类型，已有结构相同的类型时直接返回它
+     * 函数形参中的数组按指针处理
+     */
+    int pointer(int t);
+    int array(int t, int n);
+    int func(int ret, const std::vector<int> &params);
+
+    /**
+     * 功能：取得函数的第 i 个形参类型
+     */
+    int param(int f, int i) const { return params[types[f].first + i]; }
+
+    /**
+     * 功能：数组和函数在表达式中转换为指针
+     */
+    int decay(int t);
+
+    /**
+     * 功能：类型判断，T_UNKNOWN 均返回 false
+     */
+    bool is_integer(int t) const {
+        return t >= 0 && t <= T_SHORT;
+    }
+    bool is_pointer(int t) const {
+        return t >= 0 && types[t].kind == T_PTR;
+    }
+    bool is_scalar(int t) const { return is_integer(t) || is_pointer(t); }
+
+    /**
+     * 功能：from 类型的值能否赋给 to 类型
+     * null：值为整数常量 0，可以赋给任何指针
+     */
+    bool assignable(int to, int from, bool null);
+
+    /**
+     * 功能：在结构体中查找成员
+     * 返回值：成员，找不到时为 nullptr
+     */
+    const Member *find_member(int t, const string &name) const;
+
+    /**
+     * 功能：构造类型的请求次数，与类型数比较可知驻留的效果
+     */
+    long requests() const { return nrequests; }
+    int count() const { return types.size(); }
+
+    /**
+     * 功能：新建一个尚未定义的结构体类型
+     */
+    int new_struct(const string &name, int decl);
+
+    /**
+     * 功能：按声明顺序为结构体加入成员，偏移按对齐要求确定
+     * 返回值：成员类型大小未知时为 false，成员按大小 0 处理
+     */
+    bool add_member(int t, const string &name, int type, int decl);
+
+    /**
+     * 功能：结构体成员全部加入后确定其大小和对齐
+     */
+    void finish_struct(int t);
+
+    /**
+     * 功能：类型的大小和对齐，大小未知时为 -1
+     */
+    int size(int t) const;
+    int align(int t) const;
+
+    /**
+     * 功能：类型的书写形式，如 char *、int [4]、struct node
+     */
+    string name(int t) const;
+
+    const TypeInfo& operator[](int t) const { return types[t]; }
+    StructInfo& struct_info(int t) { return structs[types[t].ref]; }
+    const std::vector<StructInfo>& all_structs() const { return structs; }
+
+private:
+    int add(TypeKind k, int ref, int count, int first = 0);
+
+    /**
+     * 功能：驻留类型，key 为类型的结构编码
+     */
+    int intern(const string &key, TypeKind k, int ref, int count, int first = 0);
+
+    std::vector<TypeInfo> types;
+    std::vector<StructInfo> structs;
+    std::vector<int> params;                    // 各函数的形参类型
+    std::unordered_map<string, int> interned;   // 结构编码 -> 类型
+    long nrequests;
+};
+
+/**
+ * 功能：输出各结构体的布局，指出填充浪费的字节和跨越缓存行的成员，
+ * 并给出按对齐从大到小重排后的建议
+ */
+void layout_report(const TypeTable &tt, const string &filename);
+
+#endif // _DF_TYPE_H
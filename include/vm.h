@@ -0,0 +1,156 @@
+#ifndef _DF_VM_H
+#define _DF_VM_H
+
+#include "ir.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * 字节码虚拟机
+ * 由中间代码逐函数翻译为寄存器式字节码：临时变量、常量、栈槽的地址和
+ * 实参各占帧中的一个 64 位寄存器，操作数一律是寄存器编号，执行时不再
+ * 区分操作数的种类。常量和栈槽地址在进入函数时一次填好。
+ * 运算按宽度分为不同的操作码，执行时不必再看 size。
+ * 指针就是宿主的地址，字符串常量和全局变量放在虚拟机自己的内存中，
+ * 因此 strlen、printf 等内建函数可以直接交给 C 库。
+ */
+
+#define VM_OPS(X) \
+    X(MOV) \
+    X(ADD4) X(ADD8) X(SUB4) X(SUB8) X(MUL4) X(MUL8) \
+    X(DIV4) X(DIV8) X(MOD4) X(MOD8) X(NEG4) X(NEG8) \
+    X(EXT1) X(EXT2) X(EXT4) \
+    X(EQ) X(NE) X(LT) X(LE) X(GT) X(GE) \
+    X(LOAD1) X(LOAD2) X(LOAD4) X(LOAD8) \
+    X(STORE1) X(STORE2) X(STORE4) X(STORE8) \
+    X(COPY) X(ARG) X(CALL) X(CALLB) X(CALLI) \
+    X(JMP) X(BNZ) X(BZ) \
+    X(BEQ) X(BNE) X(BLT) X(BLE) X(BGT) X(BGE) \
+    X(LOADX1) X(LOADX2) X(LOADX4) X(LOADX8) \
+    X(LOADXS2) X(LOADXS4) X(LOADXS8) \
+    X(RET) X(RETV)
+
+/*
+ * 操作码，d、a、b 为寄存器，目标为指令下标
+ * BZ/BNZ a 为 0/非 0 时转到 d；BEQ 等比较 a、b，成立时转到 d；
+ * 比较加分支和取下标元素（LOADX d = [a + b]，LOADXS d = [a + b * 宽度]）
+ * 是合并的超级指令。CALL 的 a 为函数编号，CALLB 为内建函数编号，
+ * CALLI 的 a 为存放函数地址的寄存器，b 为实参个数。
+ */
+enum VmOp : uint8_t {
+#define VM_ENUM(x) VM_##x,
+    VM_OPS(VM_ENUM)
+#undef VM_ENUM
+    VM_OP_COUNT
+};
+
+/* 一条字节码，label 为线索化以后处理程序的地址 */
+struct VmInst {
+    const void *label;
+    VmOp op;
+    uint8_t size;       // 调用结果的宽度，用于截断
+    uint16_t pad;
+    int32_t d, a, b;
+};
+
+/* 一个函数的字节码及其帧的布局 */
+struct VmFunc {
+    string name;
+    uint32_t entry;             // 第一条字节码的下标
+    uint32_t nregs;             // 帧中的寄存器数
+    uint32_t nparams;
+    uint32_t param_base;        // 实参寄存器的起点
+    uint32_t const_base;        // 常量寄存器的起点
+    std::vector<int64_t> consts;
+    uint32_t slot_base;         // 栈槽地址寄存器的起点
+    std::vector<uint32_t> slot_off;     // 各栈槽在帧内存中的偏移
+    uint32_t frame_bytes;
+};
+
+/* 执行统计 */
+struct VmStats {
+    long insts;         // 中间代码的指令数
+    long code;          // 生成的字节码条数
+    long fused;         // 合并为超级指令的指令对
+    uint64_t steps;     // 执行的字节码条数
+    uint64_t calls;
+    int max_depth;
+};
+
+/*
+ * 剖析的结果，run 时传入才统计
+ * 字节码的执行次数在分派时累加，是准确的；时间靠采样，每隔一段时间
+ * 由 SIGALRM 记下正在执行的字节码（在内建函数中时为调用它的字节码）和调用栈
+ * 上的各个函数和调用点。递归时同一函数或调用点在一次采样中只计一次，
+ * incl_steps 和 site_steps 也只在最外层的调用返回时累加。
+ * 同一时刻只能有一个虚拟机在剖析。
+ */
+struct VmProfile {
+    std::vector<uint64_t> hits;         // 下标为字节码
+    std::vector<uint64_t> samples;      // 采样时正在执行
+    std::vector<uint64_t> site_steps;   // 调用点：被调函数内执行的字节码，含更深的调用
+    std::vector<uint64_t> site_samples; // 调用点：采样时在被调函数中
+    std::vector<uint64_t> calls;        // 下标为函数
+    std::vector<uint64_t> incl_steps;
+    std::vector<uint64_t> incl_samples;
+    uint64_t nsamples;
+    double sample_ns;                   // 每次采样代表的时间
+};
+
+/* 分派方式 */
+enum class VmDispatch {
+    THREADED,   // 每条字节码末尾经 label 直接转到下一条的处理程序
+    SWITCH      // 每条字节码回到同一个 switch
+};
+
+class Vm {
+public:
+    /**
+     * 功能：把模块的中间代码翻译为字节码
+     * 模块须没有错误，optimize 前后的中间代码都可以
+     */
+    Vm(const IrModule &m, VmStats &st);
+
+    /**
+     * 功能：从名为 entry 的函数开始执行，返回其返回值
+     * 运行时错误写入 err 并返回 false
+     */
+    bool run(const string &entry, VmDispatch dispatch, int64_t &ret, string &err,
+        VmProfile *prof = nullptr);
+
+    /**
+     * 功能：取得函数、各条字节码对应的源码字节偏移，供剖析时对照
+     * 合并的比较和分支取分支的位置，其余超级指令取第一条中间代码的位置
+     */
+    const std::vector<VmFunc>& functions() const { return funcs; }
+    const std::vector<uint32_t>& locations() const { return locs; }
+
+    /**
+     * 功能：以文本形式输出字节码
+     */
+    void dump(FILE *fp) const;
+
+private:
+    void layout_data();
+    void compile(uint32_t fi, const IrFunc &f);
+    template <bool THREADED, bool PROFILE>
+    bool exec(uint32_t fi, int64_t &ret, string &err, VmProfile *prof);
+
+    const IrModule &mod;
+    VmStats &st;
+    std::vector<VmInst> code;
+    std::vector<uint32_t> locs;     // 各条字节码对应的源码字节偏移
+    std::vector<VmFunc> funcs;
+    std::vector<int> func_of;       // 全局编号对应的函数编号，-1 为没有定义
+    std::vector<int> builtin_of;    // 全局编号对应的内建函数编号，-1 为不是
+    std::vector<char> data;         // 字符串常量和全局变量
+    std::vector<uint32_t> global_off;
+    std::unordered_map<uintptr_t, int> global_at;  // 函数地址对应的全局编号
+    uint32_t str_off;               // 字符串常量在 data 中的起点
+    bool threaded;                  // code 中的 label 是否已经填好
+};
+
+#endif // _DF_VM_H
@@ -0,0 +1,80 @@
+#ifndef _DF_VMPROF_H
+#define _DF_VMPROF_H
+
+#include "syntax.h"
+#include "vm.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using std::string;
+
+/*
+ * 虚拟机剖析的报告
+ * 字节码的执行次数和采样按其源码位置归到源码行和分析时记录的 for 语句、
+ * 调用上，内建函数的时间归到调用它的那一行。结构的累计值含其中调用的函数，
+ * 调用点在递归中再次执行时不重复计入，但递归调用所在结构自身的字节码
+ * 各层都会计入。
+ */
+
+/* 一行或一个结构的累计 */
+struct VmCost {
+    uint64_t steps;     // 执行的字节码，结构含被调函数中的
+    double ns;
+};
+
+class VmReport {
+public:
+    /**
+     * 功能：汇总 vm 按 prof 剖析的结果，syn 为生成 vm 所用中间代码的分析器
+     */
+    VmReport(Syntax &syn, const Vm &vm, const VmProfile &prof);
+
+    /**
+     * 功能：按自身执行的字节码从多到少列出执行过的函数
+     */
+    void print_functions(FILE *fp) const;
+
+    /**
+     * 功能：列出累计执行字节码最多的至多 n 个 for 语句和调用
+     */
+    void print_spans(FILE *fp, size_t n) const;
+
+    /**
+     * 功能：列出执行字节码最多的至多 n 行
+     */
+    void print_lines(FILE *fp, size_t n) const;
+
+    /**
+     * 功能：重新分析 file，按各行的热度着色输出缩进后的源码
+     */
+    void print_listing(const string &file) const;
+
+    /**
+     * 功能：源码字节偏移所在行的热度颜色，没有代码的行为 0
+     */
+    int heat(uint32_t offset) const;
+
+private:
+    /* 一条字节码的源码位置及其剖析值 */
+    struct Site {
+        uint32_t loc;
+        uint32_t pc;
+    };
+
+    VmCost sum(uint32_t begin, uint32_t end) const;
+    string text(uint32_t begin, uint32_t end) const;
+
+    Syntax &syn;
+    const Vm &vm;
+    const VmProfile &prof;
+    std::vector<Site> sites;            // 按源码位置排序
+    std::vector<VmCost> prefix;         // sites 的前缀和，多一项
+    std::vector<VmCost> self;           // 各函数自身的代码
+    std::vector<VmCost> lines;          // 下标为行号
+    std::vector<char> has_code;         // 行中是否有字节码
+    uint64_t total;                     // 执行的字节码总数
+};
+
+#endif // _DF_VMPROF_H
@@ -0,0 +1,251 @@
+#ifndef _DF_X86_H
+#define _DF_X86_H
+
+#include "ir.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * x86-64 后端
+ * 中间代码先选择为机器指令 MInst，寄存器由线性扫描分配，
+ * 之后既可以按 GNU as 的 AT&T 语法输出，也可以直接编码为目标文件。
+ * 遵循 System V 调用约定：前 6 个实参在 rdi、rsi、rdx、rcx、r8、r9，
+ * 其余在栈上，返回值在 rax，rbx、rbp、r12～r15 由被调用者保存。
+ */
+
+/* 寄存器，按机器编码的顺序 */
+enum X86Reg : uint8_t {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+    RIP,            // 只作为内存操作数的基址
+    NOREG
+};
+
+/* 条件码，按机器编码的顺序 */
+enum X86Cond : uint8_t {
+    CC_O, CC_NO, CC_B, CC_AE, CC_E, CC_NE, CC_BE, CC_A,
+    CC_S, CC_NS, CC_P, CC_NP, CC_L, CC_GE, CC_LE, CC_G
+};
+
+/* 操作数种类 */
+enum MKind : uint8_t {
+    MK_NONE,
+    MK_REG,
+    MK_IMM,
+    MK_MEM,         // [base + index * scale + disp]，base 为 RIP 时相对于 sym，
+                    // 此时 index 为 RIP 表示 sym 在 GOT 中的表项
+    MK_SYM,         // 函数名，用于 call
+    MK_BLOCK,       // 基本块，用于转移
+    MK_XMM          // 向量寄存器 xmm0～xmm15，编号在 reg 中
+};
+
+#define SYM_STR (-1)    // 字符串常量池，disp 为字符串在池中的偏移
+
+/* 操作数 */
+struct MOpnd {
+    MKind kind;
+    uint8_t reg;        // MK_REG 的寄存器或 MK_MEM 的基址
+    uint8_t index;      // MK_MEM 的变址，NOREG 为没有
+    uint8_t scale;
+    int32_t disp;
+    int32_t sym;        // 全局编号或 SYM_STR；MK_BLOCK 为块号
+    int64_t imm;
+};
+
+/* 指令，对应的 AT&T 写法见 asm.cpp */
+enum MOp : uint8_t {
+    M_LABEL,        // 块的开始，sym 为块号，不是指令
+    M_MOV,          // dst = src，宽度为 size
+    M_MOVSX,        // dst = src 的低 size2 个字节符号扩展到 64 位
+    M_MOVZB,        // dst = src 的低字节零扩展到 32 位，即 64 位
+    M_LEA,
+    M_ADD,
+    M_SUB,
+    M_IMUL,
+    M_NEG,
+    M_CMP,          // 按 dst - src 置标志
+    M_TEST,
+    M_CQO,
+    M_IDIV,         // rdx:rax 除以 dst
+    M_SETCC,
+    M_JMP,
+    M_JCC,
+    M_CALL,
+    M_PUSH,
+    M_POP,
+    M_LEAVE,
+    M_RET,
+
+    /* SSE2，size 为每道的字节数，dst 为目标兼左操作数 */
+    M_MOVDQU,       // 向量与内存之间的 16 字节传送
+    M_MOVDQA,       // 向量寄存器之间的传送
+    M_MOVD,         // 通用寄存器的低 32 位送入向量的最低道，其余清零
+    M_PUNPCKLBW,    // 低 8 个字节与 src 的交错为 8 个字
+    M_PSHUFLW,      // 按 size2 重排低 4 个字
+    M_PSHUFD,       // 按 size2 重排 4 个双字
+    M_PADD,
+    M_PSUB,
+    M_PCMPEQ,
+    M_PCMPGT,
+    M_PAND,
+    M_PANDN,        // dst = ~dst & src
+    M_POR,
+    M_PXOR,
+    M_OP_COUNT
+};
+
+struct MInst {
+    MOp op;
+    uint8_t size;       // 操作数的字节数
+    uint8_t size2;      // M_MOVSX 源操作数的字节数，M_PSHUF* 的立即数
+    X86Cond cc;
+    MOpnd dst, src;
+};
+
+/* 一个函数的机器代码 */
+struct MFunc {
+    string name;
+    int global;
+    std::vector<MInst> code;
+};
+
+/* 代码生成统计 */
+struct X86Stats {
+    long funcs;
+    long insts;         // 机器指令数
+    long temps;         // 分配了位置的临时变量
+    long spilled;       // 其中放在栈上的
+    long coalesced;     // 与复制源分到同一寄存器而省去的复制
+    long across_calls;  // 跨调用活跃、只能用被调用者保存寄存器的
+    long saved;         // 函数序言中保存的被调用者保存寄存器
+    long code_bytes;    // 以下为直接编码时的统计
+    long short_jumps;   // 用 8 位位移的转移
+    long long_jumps;
+    long relocs;
+    long vector;        // 其中的 SSE2 指令
+    long xmm;           // 分到向量寄存器的临时变量
+};
+
+/*
+ * 窥孔优化的规则，依次为：转到跳转的转移改为直接转到其目标，删去转到下一条的
+ * 转移，条件转移越过跳转时改为相反条件直接转走，删去跳转之后不可到达的指令，
+ * 存入栈槽后立即取出改为寄存器间传送，寄存器已在该宽度内时删去 movsx，
+ * setcc 以后再 test 的条件转移直接用原来的条件，删去自身传送，
+ * 一条定值之后紧跟的传送合为一条，删去结果不再使用的定值。
+ */
+#define PEEP_RULES(X) \
+    X(jmp_thread) X(jmp_next) X(jcc_over_jmp) X(unreachable) \
+    X(store_load) X(redundant_ext) X(setcc_test) X(mov_self) \
+    X(mov_chain) X(dead_def)
+
+enum PeepRule : uint8_t {
+#define PEEP_ENUM(x) PEEP_##x,
+    PEEP_RULES(PEEP_ENUM)
+#undef PEEP_ENUM
+    PEEP_COUNT
+};
+
+/* 窥孔优化统计 */
+struct PeepStats {
+    long hits[PEEP_COUNT];  // 各规则改写的次数
+    long before, after;     // 前后的机器指令数
+    long passes;            // 规则表整遍应用的次数
+};
+
+/* 编码中引用符号的位置，由链接器或装入时填写 */
+enum X86RelocKind : uint8_t {
+    XR_PC32,        // 32 位相对地址，用于访问全局变量和字符串常量
+    XR_PLT32,       // call 的 32 位相对地址，目标可能在共享库中
+    XR_GOTPCREL,    // 符号在 GOT 中表项的 32 位相对地址
+    XR_64           // 64 位绝对地址，用于数据中的指针
+};
+
+struct X86Reloc {
+    uint32_t off;       // 在所在段中的偏移
+    X86RelocKind kind;
+    int32_t sym;        // 全局编号或 SYM_STR
+    int64_t addend;     // 与 ELF 的 RELA 相同，已计入相对于下一条指令的修正
+};
+
+/* 全局符号所在的段 */
+enum X86Section : uint8_t {
+    XS_UNDEF, XS_TEXT, XS_DATA, XS_BSS
+};
+
+/* 单独编码的一个函数，重定位的偏移从函数开头算起 */
+struct X86Code {
+    std::vector<uint8_t> text;
+    std::vector<X86Reloc> relocs;
+};
+
+/* 编码后的整个模块，字符串常量即字符串池的内容 */
+struct X86Object {
+    std::vector<uint8_t> text;
+    std::vector<X86Reloc> text_relocs;
+    std::vector<uint8_t> data;
+    std::vector<X86Reloc> data_relocs;
+    uint32_t bss_size;
+    uint32_t data_align, bss_align;
+    std::vector<X86Section> sect;       // 各全局符号所在的段
+    std::vector<uint32_t> off;          // 在段中的偏移
+    std::vector<uint32_t> size;
+};
+
+/**
+ * 功能：为一个函数选择指令并分配寄存器，只读取 m 中的全局符号
+ */
+void x86_select_function(const IrModule &m, const IrFunc &f, MFunc &out, X86Stats &st);
+
+/**
+ * 功能：为模块中的每个函数选择指令并分配寄存器
+ */
+void x86_select(const IrModule &m, std::vector<MFunc> &out, X86Stats &st);
+
+/**
+ * 功能：对各函数反复应用窥孔规则，直到没有规则可用
+ * 需要寄存器活跃信息的规则在应用前重新求活跃寄存器
+ */
+void x86_peephole(std::vector<MFunc> &funcs, PeepStats &st);
+
+/**
+ * 功能：对一个函数应用窥孔规则
+ */
+void x86_peephole_function(MFunc &f, PeepStats &st);
+
+/**
+ * 功能：窥孔规则的名字
+ */
+const char *peep_rule_name(int r);
+
+/**
+ * 功能：按 GNU as 的语法输出整个模块，包括数据段和字符串常量
+ */
+void x86_emit_asm(const IrModule &m, const std::vector<MFunc> &funcs, FILE *fp);
+
+/**
+ * 功能：把机器指令编码为机器码，并排好数据段
+ * 转移先按 8 位位移编码，放不下的改为 32 位位移后重新编码该函数
+ */
+void x86_encode(const IrModule &m, const std::vector<MFunc> &funcs, X86Object &obj,
+    X86Stats &st);
+
+/**
+ * 功能：编码一个函数，函数之间只经符号的重定位相互引用，可以分别编码
+ */
+void x86_encode_function(const IrModule &m, const MFunc &f, X86Code &code, X86Stats &st);
+
+/**
+ * 功能：把分别编码的各函数按顺序拼接为模块的代码段，并排好数据段
+ */
+void x86_link(const IrModule &m, const std::vector<MFunc> &funcs,
+    const std::vector<X86Code> &code, X86Object &obj, X86Stats &st);
+
+/**
+ * 功能：把编码后的模块写为 ELF64 可重定位目标文件
+ */
+bool elf_write(const IrModule &m, const X86Object &obj, FILE *fp);
+
+#endif // _DF_X86_H
@@ -0,0 +1,247 @@
+#include "x86.h"
+#include "strpool.h"
+
+static const char *reg_names[4][16] = {
+    {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+     "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"},
+    {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+     "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"},
+    {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+     "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"},
+    {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+     "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"}
+};
+
+static const char *cc_names[16] = {
+    "o", "no", "b", "ae", "e", "ne", "be", "a",
+    "s", "ns", "p", "np", "l", "ge", "le", "g"
+};
+
+static const char *sse_names[] = {
+    "movdqu", "movdqa", "movd", "punpcklbw", "pshuflw", "pshufd",
+    "padd", "psub", "pcmpeq", "pcmpgt", "pand", "pandn", "por", "pxor"
+};
+
+static char suffix(int size)
+{
+    return size == 1 ? 'b' : size == 2 ? 'w' : size == 4 ? 'l' : 'q';
+}
+
+/* 向量运算按每道的宽度 */
+static char lane_suffix(int size)
+{
+    return size == 1 ? 'b' : size == 2 ? 'w' : size == 4 ? 'd' : 'q';
+}
+
+static const char *reg_name(int r, int size)
+{
+    int k = size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : 3;
+    return r == RIP ? "rip" : reg_names[k][r];
+}
+
+/* 按 AT&T 语法书写操作数 */
+class AsmWriter {
+public:
+    AsmWriter(const IrModule &m, FILE *fp) : m(m), fp(fp), func(0) {}
+
+    void function(const MFunc &f, int k);
+    void data();
+
+private:
+    string opnd(const MOpnd &x, int size) const;
+    string symbol(int sym) const;
+
+    const IrModule &m;
+    FILE *fp;
+    int func;
+};
+
+string AsmWriter::symbol(int sym) const
+{
+    return sym == SYM_STR ? ".Lstr" : m.globals[sym].name;
+}
+
+string AsmWriter::opnd(const MOpnd &x, int size) const
+{
+    char buf[128];
+    switch (x.kind) {
+    case MK_REG:
+        return string("%") + reg_name(x.reg, size);
+    case MK_IMM:
+        snprintf(buf, sizeof(buf), "$%lld", (long long)x.imm);
+        return buf;
+    case MK_MEM:
+        if (x.reg == RIP) {
+            if (x.index == RIP)
+                return symbol(x.sym) + "@GOTPCREL(%rip)";
+            if (x.disp)
+                snprintf(buf, sizeof(buf), "%s%+d(%%rip)", symbol(x.sym).c_str(), x.disp);
+            else
+                snprintf(buf, sizeof(buf), "%s(%%rip)", symbol(x.sym).c_str());
+            return buf;
+        }
+        {
+            string s = x.disp ? std::to_string(x.disp) : "";
+            s += string("(%") + reg_name(x.reg, 8);
+            if (x.index != NOREG) {
+                s += string(",%") + reg_name(x.index, 8);
+                if (x.scale > 1)
+                    s += "," + std::to_string(x.scale);
+            }
+            return s + ")";
+        }
+    case MK_SYM: {
+        const IrGlobal &g = m.globals[x.sym];
+        return g.defined ? g.name : g.name + "@PLT";
+    }
+    case MK_BLOCK:
+        snprintf(buf, sizeof(buf), ".L%d_%d", func, x.sym);
+        return buf;
+    case MK_XMM:
+        snprintf(buf, sizeof(buf), "%%xmm%d", x.reg);
+        return buf;
+    default:
+        return "";
+    }
+}
+
+void AsmWriter::function(const MFunc &f, int k)
+{
+    func = k;
+    fprintf(fp, "\n    .text\n    .globl %s\n    .type %s, @function\n%s:\n",
+        f.name.c_str(), f.name.c_str(), f.name.c_str());
+    for (const MInst &x : f.code) {
+        string s;
+        char sx = suffix(x.size);
+        switch (x.op) {
+        case M_LABEL:
+            fprintf(fp, "%s:\n", opnd(x.dst, 8).c_str());
+            continue;
+        case M_MOV:
+            s = string("mov") + sx + " " + opnd(x.src, x.size) + ", " + opnd(x.dst, x.size);
+            break;
+        case M_MOVSX:
+            s = string("movs") + suffix(x.size2) + "q " + opnd(x.src, x.size2) +
+                ", " + opnd(x.dst, 8);
+            break;
+        case M_MOVZB:
+            s = "movzbl " + opnd(x.src, 1) + ", " + opnd(x.dst, 4);
+            break;
+        case M_LEA:
+            s = "leaq " + opnd(x.src, 8) + ", " + opnd(x.dst, 8);
+            break;
+        case M_ADD: case M_SUB: case M_IMUL: case M_CMP: case M_TEST: {
+            static const char *names[] = {"add", "sub", "imul", "cmp", "test"};
+            int n = x.op == M_ADD ? 0 : x.op == M_SUB ? 1 : x.op == M_IMUL ? 2 :
+                x.op == M_CMP ? 3 : 4;
+            s = string(names[n]) + sx + " " + opnd(x.src, x.size) + ", " +
+                opnd(x.dst, x.size);
+            break;
+        }
+        case M_NEG:
+            s = string("neg") + sx + " " + opnd(x.dst, x.size);
+            break;
+        case M_CQO:
+            s = "cqto";
+            break;
+        case M_IDIV:
+            s = string("idiv") + sx + " " + opnd(x.dst, x.size);
+            break;
+        case M_SETCC:
+            s = string("set") + cc_names[x.cc] + " " + opnd(x.dst, 1);
+            break;
+        case M_JMP:
+            s = "jmp " + opnd(x.dst, 8);
+            break;
+        case M_JCC:
+            s = string("j") + cc_names[x.cc] + " " + opnd(x.dst, 8);
+            break;
+        case M_CALL:
+            s = x.dst.kind == MK_REG ? "call *" + opnd(x.dst, 8) : "call " + opnd(x.dst, 8);
+            break;
+        case M_PUSH:
+            s = "pushq " + opnd(x.dst, 8);
+            break;
+        case M_POP:
+            s = "popq " + opnd(x.dst, 8);
+            break;
+        case M_LEAVE:
+            s = "leave";
+            break;
+        case M_RET:
+            s = "ret";
+            break;
+        case M_MOVDQU: case M_MOVDQA: case M_MOVD: case M_PUNPCKLBW:
+        case M_PAND: case M_PANDN: case M_POR: case M_PXOR:
+            s = string(sse_names[x.op - M_MOVDQU]) + " " + opnd(x.src, 4) + ", " +
+                opnd(x.dst, 16);
+            break;
+        case M_PSHUFLW: case M_PSHUFD:
+            s = string(sse_names[x.op - M_MOVDQU]) + " $" + std::to_string(x.size2) +
+                ", " + opnd(x.src, 16) + ", " + opnd(x.dst, 16);
+            break;
+        case M_PADD: case M_PSUB: case M_PCMPEQ: case M_PCMPGT:
+            s = string(sse_names[x.op - M_MOVDQU]) + lane_suffix(x.size) + " " +
+                opnd(x.src, 16) + ", " + opnd(x.dst, 16);
+            break;
+        default:
+            break;
+        }
+        fprintf(fp, "    %s\n", s.c_str());
+    }
+    fprintf(fp, "    .size %s, .-%s\n", f.name.c_str(), f.name.c_str());
+}
+
+/**
+ * 功能：输出字符串常量池和全局变量
+ * 字符串常量按池的内容整体放在 .rodata，各常量为其中的偏移
+ */
+void AsmWriter::data()
+{
+    const StrPool &pool = *m.strs;
+    if (pool.bytes()) {
+        fprintf(fp, "\n    .section .rodata\n.Lstr:");
+        const string &b = pool.bytes_data();
+        for (size_t i = 0; i < b.size(); i++)
+            fprintf(fp, "%s%d", i % 16 ? ", " : "\n    .byte ", (unsigned char)b[i]);
+        fprintf(fp, "\n");
+    }
+    for (const IrGlobal &g : m.globals) {
+        if (g.func || !g.defined)
+            continue;
+        fprintf(fp, "\n    %s\n    .globl %s\n    .align %d\n%s:\n",
+            g.init == INIT_NONE ? ".bss" : ".data", g.name.c_str(),
+            g.align > 0 ? g.align : 1, g.name.c_str());
+        int n = 0;
+        if (g.init == INIT_CONST) {
+            static const char *dirs[] = {"", ".byte", ".short", "", ".long",
+                "", "", "", ".quad"};
+            n = g.size == 1 || g.size == 2 || g.size == 4 || g.size == 8 ? g.size : 0;
+            if (n)
+                fprintf(fp, "    %s %d\n", dirs[n], g.value);
+        }
+        else if (g.init == INIT_STR && g.array) {
+            const char *s = pool.str(g.value);
+            n = std::min<int>(g.size, pool.length(g.value) + 1);
+            for (int i = 0; i < n; i++)
+                fprintf(fp, "%s%d", i % 16 ? ", " : i ? "\n    .byte " : "    .byte ",
+                    (unsigned char)s[i]);
+            fprintf(fp, "\n");
+        }
+        else if (g.init == INIT_STR) {
+            fprintf(fp, "    .quad .Lstr+%u\n", pool.offset(g.value));
+            n = 8;
+        }
+        if (g.size > n)
+            fprintf(fp, "    .zero %d\n", g.size - n);
+    }
+}
+
+void x86_emit_asm(const IrModule &m, const std::vector<MFunc> &funcs, FILE *fp)
+{
+    AsmWriter w(m, fp);
+    for (size_t k = 0; k < funcs.size(); k++)
+        w.function(funcs[k], k);
+    w.data();
+    fprintf(fp, "\n    .section .note.GNU-stack,\"\",@progbits\n");
+}
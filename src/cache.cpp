@@ -0,0 +1,159 @@
+#include "cache.h"
+#include "hash.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+TokenCache::TokenCache(const string &dir)
+    : dir(dir), base(nullptr), size(0)
+{
+    st.hits = st.misses = 0;
+    st.bytes_read = st.bytes_written = 0;
+    mkdir(dir.c_str(), 0777);
+}
+
+TokenCache::~TokenCache()
+{
+    release();
+}
+
+void TokenCache::release()
+{
+    if (base)
+        munmap((void *)base, size);
+    base = nullptr;
+    size = 0;
+}
+
+uint64_t TokenCache::key(const string &src)
+{
+    static const char stamp[] = __DATE__ " " __TIME__;
+    uint32_t version = CACHE_VERSION;
+    uint64_t h = hash_bytes(&version, sizeof(version));
+    h = hash_bytes(stamp, sizeof(stamp), h);
+    return hash_bytes(src.data(), src.size(), h);
+}
+
+string TokenCache::path(uint64_t key)
+{
+    char name[24];
+    snprintf(name, sizeof(name), "%016llx.tkc", (unsigned long long)key);
+    return dir + "/" + name;
+}
+
+/**
+ * 功能：检查单词和诊断是否都落在源码中，文件损坏时重放会越界
+ */
+static bool entry_valid(const CacheEntry &e, size_t src_size)
+{
+    for (uint32_t i = 0; i < e.ntokens; i++) {
+        const PackedToken &p = e.tokens[i];
+        if (p.type > (uint32_t)TokenType::TK_IDENT ||
+            (uint64_t)p.offset + p.len > src_size)
+            return false;
+    }
+    for (uint32_t i = 0; i < e.nlexdiags + e.ndiags; i++) {
+        const Diagnostic &d = e.lexdiags[i];
+        if ((uint32_t)d.code >= (uint32_t)DiagCode::DIAG_COUNT || d.offset > src_size)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * 功能：映射缓存文件并检查各段是否越界，内容不对时也算未命中
+ */
+bool TokenCache::lookup(uint64_t key, size_t src_size, CacheEntry &e)
+{
+    release();
+    int fd = open(path(key).c_str(), O_RDONLY);
+    struct stat sb;
+    if (fd < 0 || fstat(fd, &sb) < 0 || sb.st_size < (off_t)sizeof(CacheHeader)) {
+        if (fd >= 0)
+            close(fd);
+        st.misses++;
+        return false;
+    }
+    void *p = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        st.misses++;
+        return false;
+    }
+    base = (const char *)p;
+    size = sb.st_size;
+
+    const CacheHeader *h = (const CacheHeader *)base;
+    uint64_t need = sizeof(CacheHeader) +
+        (uint64_t)h->ntokens * sizeof(PackedToken) +
+        ((uint64_t)h->nlexdiags + h->ndiags) * sizeof(Diagnostic) + h->strbytes;
+    if (h->magic != CACHE_MAGIC || h->version != CACHE_VERSION ||
+        h->key != key || h->src_size != src_size || need != size) {
+        release();
+        st.misses++;
+        return false;
+    }
+    e.ntokens = h->ntokens;
+    e.nlexdiags = h->nlexdiags;
+    e.ndiags = h->ndiags;
+    e.strbytes = h->strbytes;
+    e.tokens = (const PackedToken *)(h + 1);
+    e.lexdiags = (const Diagnostic *)(e.tokens + e.ntokens);
+    e.diags = e.lexdiags + e.nlexdiags;
+    e.strs = (const char *)(e.diags + e.ndiags);
+    if (!entry_valid(e, src_size)) {
+        release();
+        st.misses++;
+        return false;
+    }
+    st.hits++;
+    st.bytes_read += size;
+    return true;
+}
+
+/**
+ * 功能：写入缓存，先写临时文件再改名，并发的读者只会看到完整的文件
+ */
+bool TokenCache::store(uint64_t key, size_t src_size,
+    const std::vector<PackedToken> &tokens,
+    const std::vector<Diagnostic> &lexdiags,
+    const std::vector<Diagnostic> &diags,
+    const StrPool &strs)
+{
+    string blob;
+    strs.save(blob);
+
+    CacheHeader h;
+    h.magic = CACHE_MAGIC;
+    h.version = CACHE_VERSION;
+    h.key = key;
+    h.src_size = src_size;
+    h.ntokens = tokens.size();
+    h.nlexdiags = lexdiags.size();
+    h.ndiags = diags.size();
+    h.strbytes = blob.size();
+
+    string file = path(key);
+    string tmp = file + "." + std::to_string(getpid());
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    if (!fp)
+        return false;
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    ok = ok && fwrite(tokens.data(), sizeof(PackedToken), tokens.size(), fp) == tokens.size();
+    ok = ok && fwrite(lexdiags.data(), sizeof(Diagnostic), lexdiags.size(), fp) == lexdiags.size();
+    ok = ok && fwrite(diags.data(), sizeof(Diagnostic), diags.size(), fp) == diags.size();
+    ok = ok && fwrite(blob.data(), 1, blob.size(), fp) == blob.size();
+    ok = fclose(fp) == 0 && ok;
+    if (ok)
+        ok = rename(tmp.c_str(), file.c_str()) == 0;
+    else
+        remove(tmp.c_str());
+    if (ok)
+        st.bytes_written += sizeof(h) + tokens.size() * sizeof(PackedToken) +
+            (lexdiags.size() + diags.size()) * sizeof(Diagnostic) + blob.size();
+    return ok;
+}
@@ -0,0 +1,237 @@
+#include "cfg.h"
+
+#include <algorithm>
+
+void build_cfg(const IrFunc &f, Cfg &g)
+{
+    uint32_t n = f.blocks.size();
+    g.nblocks = n;
+    g.succ_at.assign(n + 1, 0);
+    g.succ.clear();
+    for (uint32_t bi = 0; bi < n; bi++) {
+        g.succ_at[bi] = g.succ.size();
+        uint32_t last = f.blocks[bi].end - 1;
+        switch (f.op[last]) {
+        case IR_JMP:
+            g.succ.push_back(ref_index(f.a[last]));
+            break;
+        case IR_BR:
+            g.succ.push_back(ref_index(f.b[last]));
+            if (f.d[last] != f.b[last])
+                g.succ.push_back(ref_index(f.d[last]));
+            break;
+        default:
+            break;
+        }
+    }
+    g.succ_at[n] = g.succ.size();
+
+    // 前驱：先数出各块的入边，再按前缀和填入
+    g.pred_at.assign(n + 1, 0);
+    for (uint32_t s : g.succ)
+        g.pred_at[s + 1]++;
+    for (uint32_t bi = 0; bi < n; bi++)
+        g.pred_at[bi + 1] += g.pred_at[bi];
+    g.pred.resize(g.succ.size());
+    std::vector<uint32_t> fill(g.pred_at.begin(), g.pred_at.end() - 1);
+    for (uint32_t bi = 0; bi < n; bi++)
+        for (const uint32_t *s = g.succ_begin(bi); s != g.succ_end(bi); s++)
+            g.pred[fill[*s]++] = bi;
+
+    // 非递归深度优先，块数很多时也不会耗尽栈
+    g.rpo.clear();
+    g.rpo_index.assign(n, -1);
+    if (!n)
+        return;
+    std::vector<uint32_t> post;
+    std::vector<char> seen(n, 0);
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+    stack.push_back(std::make_pair(0u, g.succ_at[0]));
+    seen[0] = 1;
+    while (!stack.empty()) {
+        uint32_t b = stack.back().first;
+        uint32_t &next = stack.back().second;
+        if (next < g.succ_at[b + 1]) {
+            uint32_t s = g.succ[next++];
+            if (!seen[s]) {
+                seen[s] = 1;
+                stack.push_back(std::make_pair(s, g.succ_at[s]));
+            }
+            continue;
+        }
+        post.push_back(b);
+        stack.pop_back();
+    }
+    g.rpo.assign(post.rbegin(), post.rend());
+    for (uint32_t i = 0; i < g.rpo.size(); i++)
+        g.rpo_index[g.rpo[i]] = i;
+}
+
+
+/**
+ * 功能：沿支配树向上找 a、b 的最近公共祖先
+ * 逆后序号大的一方先向上走，直到两者相遇
+ */
+static int intersect(const Cfg &g, const std::vector<int> &idom, int a, int b)
+{
+    while (a != b) {
+        while (g.rpo_index[a] > g.rpo_index[b])
+            a = idom[a];
+        while (g.rpo_index[b] > g.rpo_index[a])
+            b = idom[b];
+    }
+    return a;
+}
+
+void build_domtree(const Cfg &g, DomTree &t)
+{
+    uint32_t n = g.nblocks;
+    t.idom.assign(n, -1);
+    t.passes = 0;
+    if (!n)
+        return;
+    t.idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        t.passes++;
+        for (uint32_t i = 1; i < g.rpo.size(); i++) {
+            uint32_t b = g.rpo[i];
+            int nd = -1;
+            for (const uint32_t *p = g.pred_begin(b); p != g.pred_end(b); p++) {
+                if (t.idom[*p] < 0)
+                    continue;
+                nd = nd < 0 ? (int)*p : intersect(g, t.idom, *p, nd);
+            }
+            if (nd != t.idom[b]) {
+                t.idom[b] = nd;
+                changed = true;
+            }
+        }
+    }
+
+    // 孩子按逆后序排列，与控制流的先后一致
+    t.child_at.assign(n + 1, 0);
+    for (uint32_t i = 1; i < g.rpo.size(); i++)
+        t.child_at[t.idom[g.rpo[i]] + 1]++;
+    for (uint32_t b = 0; b < n; b++)
+        t.child_at[b + 1] += t.child_at[b];
+    t.child.resize(t.child_at[n]);
+    std::vector<uint32_t> fill(t.child_at.begin(), t.child_at.end() - 1);
+    for (uint32_t i = 1; i < g.rpo.size(); i++)
+        t.child[fill[t.idom[g.rpo[i]]]++] = g.rpo[i];
+
+    t.pre.assign(n, 0);
+    t.post.assign(n, 0);
+    t.depth.assign(n, -1);
+    uint32_t pre = 0, post = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+    stack.push_back(std::make_pair(0u, t.child_at[0]));
+    t.pre[0] = pre++;
+    t.depth[0] = 0;
+    while (!stack.empty()) {
+        uint32_t b = stack.back().first;
+        uint32_t &next = stack.back().second;
+        if (next < t.child_at[b + 1]) {
+            uint32_t c = t.child[next++];
+            t.pre[c] = pre++;
+            t.depth[c] = t.depth[b] + 1;
+            stack.push_back(std::make_pair(c, t.child_at[c]));
+            continue;
+        }
+        t.post[b] = post++;
+        stack.pop_back();
+    }
+}
+
+
+void dominance_frontiers(const Cfg &g, const DomTree &t,
+    std::vector<uint32_t> &df_at, std::vector<uint32_t> &df)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    for (uint32_t b : g.rpo) {
+        if (g.pred_end(b) - g.pred_begin(b) < 2)
+            continue;
+        for (const uint32_t *p = g.pred_begin(b); p != g.pred_end(b); p++) {
+            if (!g.reachable(*p))
+                continue;
+            for (int r = *p; r != t.idom[b]; r = t.idom[r])
+                pairs.push_back(std::make_pair((uint32_t)r, b));
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    df_at.assign(g.nblocks + 1, 0);
+    df.resize(pairs.size());
+    for (size_t i = 0; i < pairs.size(); i++) {
+        df_at[pairs[i].first + 1]++;
+        df[i] = pairs[i].second;
+    }
+    for (uint32_t b = 0; b < g.nblocks; b++)
+        df_at[b + 1] += df_at[b];
+}
+
+
+void find_loops(const Cfg &g, const DomTree &t, std::vector<Loop> &loops)
+{
+    loops.clear();
+    std::vector<uint32_t> mark(g.nblocks, UINT32_MAX);
+    for (uint32_t h : g.rpo) {
+        Loop l;
+        l.header = h;
+        for (const uint32_t *p = g.pred_begin(h); p != g.pred_end(h); p++)
+            if (g.reachable(*p) && t.dominates(h, *p))
+                l.latches.push_back(*p);
+        if (l.latches.empty())
+            continue;
+
+        // 标记时顺便收集循环体，只对循环体排序，不再扫描整个 rpo
+        uint32_t id = loops.size();
+        mark[h] = id;
+        l.blocks.push_back(h);
+        std::vector<uint32_t> work;
+        for (uint32_t b : l.latches)
+            if (mark[b] != id) {
+                mark[b] = id;
+                work.push_back(b);
+                l.blocks.push_back(b);
+            }
+        while (!work.empty()) {
+            uint32_t b = work.back();
+            work.pop_back();
+            for (const uint32_t *p = g.pred_begin(b); p != g.pred_end(b); p++)
+                if (g.reachable(*p) && mark[*p] != id) {
+                    mark[*p] = id;
+                    work.push_back(*p);
+                    l.blocks.push_back(*p);
+                }
+        }
+        std::sort(l.blocks.begin(), l.blocks.end(), [&](uint32_t x, uint32_t y) {
+            return g.rpo_index[x] < g.rpo_index[y];
+        });
+
+        l.preheader = -1;
+        int outside = 0;
+        for (const uint32_t *p = g.pred_begin(h); p != g.pred_end(h); p++)
+            if (mark[*p] != id) {
+                outside++;
+                l.preheader = *p;
+            }
+        if (outside != 1 || g.succ_end(l.preheader) - g.succ_begin(l.preheader) != 1)
+            l.preheader = -1;
+        loops.push_back(l);
+    }
+
+    std::stable_sort(loops.begin(), loops.end(), [](const Loop &x, const Loop &y) {
+        return x.blocks.size() < y.blocks.size();
+    });
+    // 从大到小，包含首块的最后一个循环即为直接外层
+    std::vector<int> inner(g.nblocks, -1);
+    for (size_t i = loops.size(); i-- > 0; ) {
+        loops[i].parent = inner[loops[i].header];
+        for (uint32_t b : loops[i].blocks)
+            inner[b] = i;
+    }
+    for (size_t i = loops.size(); i-- > 0; )
+        loops[i].depth = loops[i].parent < 0 ? 1 : loops[loops[i].parent].depth + 1;
+}
@@ -0,0 +1,413 @@
+#include "dataflow.h"
+#include "diag.h"
+
+#include <iterator>
+
+void SparseSet::set(size_t i)
+{
+    auto it = std::lower_bound(v.begin(), v.end(), (uint32_t)i);
+    if (it == v.end() || *it != i)
+        v.insert(it, i);
+}
+
+void SparseSet::reset(size_t i)
+{
+    auto it = std::lower_bound(v.begin(), v.end(), (uint32_t)i);
+    if (it != v.end() && *it == i)
+        v.erase(it);
+}
+
+bool SparseSet::unite(const SparseSet &x)
+{
+    if (x.v.empty())
+        return false;
+    std::vector<uint32_t> r;
+    r.reserve(v.size() + x.v.size());
+    std::set_union(v.begin(), v.end(), x.v.begin(), x.v.end(), std::back_inserter(r));
+    // 并集只增不减，大小不变即没有变化
+    bool changed = r.size() != v.size();
+    v.swap(r);
+    return changed;
+}
+
+void SparseSet::subtract(const SparseSet &x)
+{
+    std::vector<uint32_t> r;
+    std::set_difference(v.begin(), v.end(), x.v.begin(), x.v.end(), std::back_inserter(r));
+    v.swap(r);
+}
+
+bool SparseSet::transfer(const SparseSet &gen, const SparseSet &x, const SparseSet &kill)
+{
+    std::vector<uint32_t> rest, r;
+    std::set_difference(x.v.begin(), x.v.end(), kill.v.begin(), kill.v.end(),
+        std::back_inserter(rest));
+    r.reserve(gen.v.size() + rest.size());
+    std::set_union(gen.v.begin(), gen.v.end(), rest.begin(), rest.end(),
+        std::back_inserter(r));
+    if (r == v)
+        return false;
+    v.swap(r);
+    return true;
+}
+
+size_t SparseSet::next(size_t i) const
+{
+    auto it = std::lower_bound(v.begin(), v.end(), (uint32_t)std::min(i, n));
+    return it == v.end() ? n : *it;
+}
+
+
+void solve(const Cfg &g, Dataflow &df)
+{
+    uint32_t n = g.nblocks;
+    df.in.assign(n, SparseSet(df.nitems));
+    df.out.assign(n, SparseSet(df.nitems));
+    df.visits = 0;
+
+    std::vector<uint32_t> order(g.rpo);
+    if (!df.forward)
+        order.assign(g.rpo.rbegin(), g.rpo.rend());
+    std::vector<char> pending(n, 0);
+    for (uint32_t b : order)
+        pending[b] = 1;
+    size_t left = order.size();
+
+    // 前向时 x 为入口、y 为出口，后向时相反
+    std::vector<SparseSet> &x = df.forward ? df.in : df.out;
+    std::vector<SparseSet> &y = df.forward ? df.out : df.in;
+    while (left) {
+        for (uint32_t b : order) {
+            if (!pending[b])
+                continue;
+            pending[b] = 0;
+            left--;
+            df.visits++;
+            const uint32_t *p = df.forward ? g.pred_begin(b) : g.succ_begin(b);
+            const uint32_t *e = df.forward ? g.pred_end(b) : g.succ_end(b);
+            for (; p != e; p++)
+                x[b].unite(y[*p]);
+            if (!y[b].transfer(df.gen[b], x[b], df.kill[b]))
+                continue;
+            p = df.forward ? g.succ_begin(b) : g.pred_begin(b);
+            e = df.forward ? g.succ_end(b) : g.pred_end(b);
+            for (; p != e; p++)
+                if (!pending[*p] && g.reachable(*p)) {
+                    pending[*p] = 1;
+                    left++;
+                }
+        }
+    }
+}
+
+
+void liveness(const IrFunc &f, const Cfg &g, std::vector<uint32_t> &temps,
+    Dataflow &df)
+{
+    // 只在一块内定值和使用的临时变量不会跨块活跃，不占位
+    const uint32_t NONE = UINT32_MAX, MANY = UINT32_MAX - 1;
+    std::vector<uint32_t> home(f.ntemps, NONE);
+    for (uint32_t bi = 0; bi < g.nblocks; bi++)
+        for (uint32_t i = f.blocks[bi].first; i < f.blocks[bi].end; i++) {
+            Ref r[3] = {f.d[i], f.a[i], f.b[i]};
+            for (Ref x : r) {
+                if (ref_tag(x) != RT_TEMP)
+                    continue;
+                uint32_t &h = home[ref_index(x)];
+                h = h == NONE || h == bi ? bi : MANY;
+            }
+        }
+    temps.clear();
+    for (uint32_t t = 0; t < f.ntemps; t++) {
+        if (home[t] == MANY) {
+            home[t] = temps.size();
+            temps.push_back(t);
+        }
+        else
+            home[t] = NONE;
+    }
+
+    df.forward = false;
+    df.nitems = temps.size();
+    df.gen.assign(g.nblocks, SparseSet(df.nitems));
+    df.kill.assign(g.nblocks, SparseSet(df.nitems));
+    for (uint32_t bi = 0; bi < g.nblocks; bi++) {
+        SparseSet &use = df.gen[bi], &def = df.kill[bi];
+        // 倒着扫：使用在定值之前的临时变量在入口活跃
+        for (uint32_t i = f.blocks[bi].end; i-- > f.blocks[bi].first; ) {
+            uint32_t k;
+            if (ref_tag(f.d[i]) == RT_TEMP &&
+                (k = home[ref_index(f.d[i])]) != NONE) {
+                def.set(k);
+                use.reset(k);
+            }
+            if (ref_tag(f.a[i]) == RT_TEMP && (k = home[ref_index(f.a[i])]) != NONE)
+                use.set(k);
+            if (ref_tag(f.b[i]) == RT_TEMP && (k = home[ref_index(f.b[i])]) != NONE)
+                use.set(k);
+        }
+    }
+    solve(g, df);
+}
+
+
+/**
+ * 功能：指令是否为栈槽的定值，full 返回是否写满整个栈槽
+ */
+static bool slot_def(const IrFunc &f, uint32_t i, bool &full)
+{
+    if ((f.op[i] != IR_STORE && f.op[i] != IR_COPY) ||
+        ref_tag(f.a[i]) != RT_SLOT)
+        return false;
+    int bytes = f.op[i] == IR_STORE ? f.size[i] : f.constant(f.d[i]);
+    full = bytes >= f.slots[ref_index(f.a[i])].size;
+    return true;
+}
+
+void reaching_defs(const IrFunc &f, const Cfg &g, const DomTree &t,
+    ReachDefs &rd, bool keep_in)
+{
+    // 被块内之后写满同一栈槽的定值注销的定值到不了块外，不编号
+    uint32_t n = g.nblocks, nslots = f.slots.size();
+    std::vector<uint32_t> &defs = rd.defs;
+    defs.clear();
+    std::vector<uint32_t> gen_at(n + 1);        // 块 b 的定值为编号 [gen_at[b], gen_at[b + 1])
+    std::vector<char> full_def;
+    std::vector<uint32_t> covered(nslots, UINT32_MAX), seen(nslots, UINT32_MAX);
+    std::vector<std::pair<uint32_t, uint32_t>> sites;   // (栈槽, 定值它的块)
+    bool full;
+    for (uint32_t bi = 0; bi < n; bi++) {
+        gen_at[bi] = defs.size();
+        for (uint32_t i = f.blocks[bi].end; i-- > f.blocks[bi].first; ) {
+            if (!slot_def(f, i, full))
+                continue;
+            uint32_t slot = ref_index(f.a[i]);
+            if (covered[slot] == bi)
+                continue;
+            defs.push_back(i);
+            full_def.push_back(full);
+            if (full)
+                covered[slot] = bi;
+            if (seen[slot] != bi && g.reachable(bi))
+                sites.push_back(std::make_pair(slot, bi));
+            seen[slot] = bi;
+        }
+        std::reverse(defs.begin() + gen_at[bi], defs.end());
+        std::reverse(full_def.begin() + gen_at[bi], full_def.end());
+    }
+    gen_at[n] = defs.size();
+    std::sort(sites.begin(), sites.end());
+
+    // 每个栈槽在其定值所在块的迭代支配边界上合并
+    std::vector<uint32_t> df_at, df;
+    dominance_frontiers(g, t, df_at, df);
+    std::vector<std::pair<uint32_t, uint32_t>> merges;  // (块, 栈槽)
+    std::vector<uint32_t> merged(n, UINT32_MAX), queued(n, UINT32_MAX), work;
+    for (size_t i = 0; i < sites.size(); ) {
+        uint32_t slot = sites[i].first;
+        for (; i < sites.size() && sites[i].first == slot; i++) {
+            queued[sites[i].second] = slot;
+            work.push_back(sites[i].second);
+        }
+        while (!work.empty()) {
+            uint32_t x = work.back();
+            work.pop_back();
+            for (uint32_t k = df_at[x]; k < df_at[x + 1]; k++) {
+                uint32_t y = df[k];
+                if (merged[y] == slot)
+                    continue;
+                merged[y] = slot;
+                merges.push_back(std::make_pair(y, slot));
+                if (queued[y] != slot) {
+                    queued[y] = slot;
+                    work.push_back(y);
+                }
+            }
+        }
+    }
+    std::sort(merges.begin(), merges.end());
+    rd.merges = merges.size();
+
+    // 节点 0 为空集，其后依次为各合并节点，块 b 的为 merge_at[b] 起的一段
+    rd.nodes.assign(1, ReachNode{REACH_MERGE, 0});
+    rd.ops.assign(1, 0);
+    std::vector<uint32_t> merge_at(n + 1, 0);
+    for (const auto &m : merges) {
+        merge_at[m.first + 1]++;
+        uint32_t npred = g.pred_end(m.first) - g.pred_begin(m.first);
+        rd.nodes.push_back(ReachNode{REACH_MERGE, (uint32_t)rd.ops.size()});
+        rd.ops.push_back(npred);
+        rd.ops.resize(rd.ops.size() + npred, 0);
+    }
+    for (uint32_t b = 0; b < n; b++)
+        merge_at[b + 1] += merge_at[b];
+
+    // 沿支配树先序访问，cur 为各栈槽当前的节点，离开子树时按 undo 恢复
+    rd.in.assign(keep_in ? n : 0, std::vector<uint32_t>());
+    if (!n)
+        return;
+    std::vector<uint32_t> cur(nslots, 0);
+    std::vector<std::pair<uint32_t, uint32_t>> undo;    // (栈槽, 原来的节点)
+    std::vector<size_t> marks;
+    auto set = [&](uint32_t slot, uint32_t node) {
+        undo.push_back(std::make_pair(slot, cur[slot]));
+        cur[slot] = node;
+    };
+    auto enter = [&](uint32_t b) {
+        marks.push_back(undo.size());
+        for (uint32_t k = merge_at[b]; k < merge_at[b + 1]; k++)
+            set(merges[k].second, 1 + k);
+        if (keep_in)
+            for (uint32_t slot = 0; slot < nslots; slot++)
+                if (cur[slot])
+                    rd.in[b].push_back(cur[slot]);
+        for (uint32_t k = gen_at[b]; k < gen_at[b + 1]; k++) {
+            uint32_t slot = ref_index(f.a[defs[k]]);
+            rd.nodes.push_back(ReachNode{k, full_def[k] ? 0 : cur[slot]});
+            set(slot, rd.nodes.size() - 1);
+        }
+        // 本块出口的节点填入各后继合并节点中对应的操作数
+        for (const uint32_t *s = g.succ_begin(b); s != g.succ_end(b); s++)
+            for (uint32_t k = merge_at[*s]; k < merge_at[*s + 1]; k++) {
+                uint32_t *op = &rd.ops[rd.nodes[1 + k].arg + 1];
+                for (const uint32_t *p = g.pred_begin(*s); p != g.pred_end(*s); p++, op++)
+                    if (*p == b)
+                        *op = cur[merges[k].second];
+            }
+    };
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+    enter(0);
+    stack.push_back(std::make_pair(0u, t.child_at[0]));
+    while (!stack.empty()) {
+        uint32_t b = stack.back().first;
+        uint32_t &next = stack.back().second;
+        if (next < t.child_at[b + 1]) {
+            uint32_t c = t.child[next++];
+            enter(c);
+            stack.push_back(std::make_pair(c, t.child_at[c]));
+            continue;
+        }
+        for (size_t k = undo.size(); k-- > marks.back(); )
+            cur[undo[k].first] = undo[k].second;
+        undo.resize(marks.back());
+        marks.pop_back();
+        stack.pop_back();
+    }
+}
+
+void reach_in(const ReachDefs &rd, uint32_t b, std::vector<uint32_t> &defs,
+    std::vector<uint32_t> &seen)
+{
+    defs.clear();
+    std::vector<uint32_t> work(rd.in[b]);
+    while (!work.empty()) {
+        uint32_t x = work.back();
+        work.pop_back();
+        if (seen[x] == b)
+            continue;
+        seen[x] = b;
+        const ReachNode &nd = rd.nodes[x];
+        if (nd.def != REACH_MERGE) {
+            defs.push_back(nd.def);
+            work.push_back(nd.arg);
+            continue;
+        }
+        for (uint32_t k = 1; k <= rd.ops[nd.arg]; k++)
+            work.push_back(rd.ops[nd.arg + k]);
+    }
+    std::sort(defs.begin(), defs.end());
+}
+
+
+/**
+ * 功能：输出集合中的临时变量
+ */
+static void print_temps(FILE *fp, const char *label,
+    const std::vector<uint32_t> &temps, const SparseSet &s)
+{
+    if (!s.count())
+        return;
+    fprintf(fp, "  %s", label);
+    for (size_t i = s.next(0); i < s.size(); i = s.next(i + 1))
+        fprintf(fp, " t%u", temps[i]);
+}
+
+/**
+ * 功能：按栈槽分组输出到达的定值，定值以所在行号表示
+ */
+static void print_reach(FILE *fp, const IrModule &m, const IrFunc &f,
+    Diagnostics &diag, const std::vector<uint32_t> &defs,
+    const std::vector<uint32_t> &s)
+{
+    if (s.empty())
+        return;
+    // 按栈槽分组，组内保持编号即指令的顺序
+    std::vector<uint32_t> order(s);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) {
+        return ref_index(f.a[defs[x]]) < ref_index(f.a[defs[y]]);
+    });
+    fprintf(fp, "    reach");
+    for (size_t i = 0; i < order.size(); i++) {
+        uint32_t i0 = defs[order[i]];
+        int line, col;
+        diag.locate(f.loc[i0], line, col);
+        if (i == 0 || ref_index(f.a[defs[order[i - 1]]]) != ref_index(f.a[i0]))
+            fprintf(fp, " %s:%d", ir_ref_str(m, f, f.a[i0]).c_str(), line);
+        else
+            fprintf(fp, ",%d", line);
+    }
+    fprintf(fp, "\n");
+}
+
+void cfg_report(const IrModule &m, Diagnostics &diag, FILE *fp, CfgStats &st)
+{
+    Cfg g;
+    DomTree dom;
+    Dataflow live;
+    ReachDefs reach;
+    std::vector<uint32_t> temps, reached, seen;
+    for (const IrFunc &f : m.funcs) {
+        build_cfg(f, g);
+        build_domtree(g, dom);
+        liveness(f, g, temps, live);
+        reaching_defs(f, g, dom, reach, fp != nullptr);
+        st.funcs++;
+        st.blocks += g.nblocks;
+        st.edges += g.edges();
+        st.unreachable += g.nblocks - g.rpo.size();
+        st.dom_passes += dom.passes;
+        st.live_visits += live.visits;
+        st.reach_merges += reach.merges;
+        if (!fp)
+            continue;
+        seen.assign(reach.nodes.size(), UINT32_MAX);
+
+        fprintf(fp, "\nfunc @%s  blocks %u  edges %u  dominator passes %d\n",
+            f.name.c_str(), g.nblocks, g.edges(), dom.passes);
+        for (uint32_t bi = 0; bi < g.nblocks; bi++) {
+            fprintf(fp, "b%u", bi);
+            if (!g.reachable(bi)) {
+                fprintf(fp, "  unreachable\n");
+                continue;
+            }
+            if (g.pred_begin(bi) != g.pred_end(bi)) {
+                fprintf(fp, "  pred");
+                for (const uint32_t *p = g.pred_begin(bi); p != g.pred_end(bi); p++)
+                    fprintf(fp, " b%u", *p);
+            }
+            if (g.succ_begin(bi) != g.succ_end(bi)) {
+                fprintf(fp, "  succ");
+                for (const uint32_t *p = g.succ_begin(bi); p != g.succ_end(bi); p++)
+                    fprintf(fp, " b%u", *p);
+            }
+            if (bi)
+                fprintf(fp, "  idom b%d", dom.idom[bi]);
+            fprintf(fp, "  depth %d", dom.depth[bi]);
+            print_temps(fp, "live-in", temps, live.in[bi]);
+            print_temps(fp, "live-out", temps, live.out[bi]);
+            fprintf(fp, "\n");
+            reach_in(reach, bi, reached, seen);
+            print_reach(fp, m, f, diag, reach.defs, reached);
+        }
+    }
+}
@@ -0,0 +1,182 @@
+#include "diag.h"
+#include "token.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+/* 诊断格式表
+ * %t 以单词名展开参数  %c 以字符展开参数  %d 以整数展开参数
+ * %T 以类型展开参数  %n 展开源码中该偏移处的标识符
+ */
+static const struct {
+    const char *name;       // 机器可读输出中的编号
+    const char *fmt;
+} diag_table[] = {
+    {"E0000", "can not open the source file"},
+    {"E0001", "illegal character '%c', lexical cannot recognise it"},
+    {"E0002", "illegal escape character '\\%c'"},
+    {"E0003", "unterminated comment, no '*/' found at the end of file"},
+    {"E0004", "missing terminating %c character"},
+    {"E0005", "expected '%t' before '%t'"},
+    {"E0006", "expected type specifier before '%t'"},
+    {"E0007", "expected identifier before '%t'"},
+    {"E0008", "expected struct identifier name before '%t'"},
+    {"E0009", "nested function definition unsupported"},
+    {"E0010", "invalid type specifier '%t' in parameter list"},
+    {"E0011", "expected identifier or constant value before '%t'"},
+    {"E0012", "field has incomplete type"},
+    {"E0013", "invalid application of 'sizeof' to an incomplete type"},
+    {"E0014", "lvalue required as left operand of assignment"},
+    {"E0015", "incompatible types when assigning to type '%T' from type '%T'"},
+    {"E0016", "called object of type '%T' is not a function"},
+    {"E0017", "function takes %d arguments but %d were given"},
+    {"E0018", "incompatible type for argument %d, expected '%T'"},
+    {"E0019", "'%T' is not a structure as required by '%t'"},
+    {"E0020", "no member named '%n' in '%T'"},
+    {"E0021", "indirection requires pointer operand ('%T' invalid)"},
+    {"E0022", "subscripted value of type '%T' is not an array or pointer"},
+    {"E0023", "incompatible types when returning type '%T' but '%T' was expected"},
+    {"E0024", "lvalue required as unary '&' operand"},
+    {"E0025", "invalid operands to '%t'"},
+    {"E0026", "initializer element is not constant"},
+    {"E0027", "integer constant is too large for its type"},
+    {"E0028", "invalid digit '%c' in octal constant"},
+    {"E0029", "invalid suffix '%n' on integer constant"},
+    {"E0030", "floating constants are not supported"},
+    {"E0031", "escape sequence out of range"},
+    {"E0032", "empty character constant"},
+};
+
+static_assert(sizeof(diag_table) / sizeof(diag_table[0]) ==
+    (size_t)DiagCode::DIAG_COUNT, "diag_table out of sync with DiagCode");
+
+
+bool Diagnostics::has_type_args(DiagCode code) {
+    return strstr(diag_table[(int)code].fmt, "%T") != nullptr;
+}
+
+
+Diagnostics::Diagnostics()
+    : src(nullptr), format(DiagFormat::HUMAN), max_errors(0), error_count(0) {}
+
+
+void Diagnostics::set_source(const string &filename, const string *src) {
+    this->filename = filename;
+    this->src = src;
+    line_start.clear();
+}
+
+
+void Diagnostics::report(DiagCode code, uint32_t offset, int a0, int a1) {
+    error_count++;
+    if (max_errors > 0 && error_count > max_errors)
+        return;
+    Diagnostic d;
+    d.code = code;
+    d.offset = offset;
+    d.args[0] = a0;
+    d.args[1] = a1;
+    diags.push_back(d);
+}
+
+
+void Diagnostics::locate(uint32_t offset, int &line, int &col) {
+    if (line_start.empty()) {
+        line_start.push_back(0);
+        if (src) {
+            for (size_t i = 0; i < src->size(); i++)
+                if ((*src)[i] == '\n')
+                    line_start.push_back(i + 1);
+        }
+    }
+    auto it = std::upper_bound(line_start.begin(), line_start.end(), offset);
+    line = it - line_start.begin();
+    col = offset - *(it - 1) + 1;
+}
+
+
+string Diagnostics::message(const Diagnostic &d) {
+    string s;
+    int argi = 0;
+    char buf[16];
+    for (const char *p = diag_table[(int)d.code].fmt; *p; p++) {
+        if (*p != '%' || !p[1]) {
+            s.push_back(*p);
+            continue;
+        }
+        int a = argi < 2 ? d.args[argi++] : 0;
+        switch (*++p) {
+        case 't':
+            s += token_name((TokenType)a);
+            break;
+        case 'c':
+            if (a >= 0x20 && a < 0x7f)
+                s.push_back((char)a);
+            else {
+                snprintf(buf, sizeof(buf), "\\x%02x", a & 0xff);
+                s += buf;
+            }
+            break;
+        case 'd':
+            s += std::to_string(a);
+            break;
+        case 'T':
+            s += type_namer ? type_namer(a) : "?";
+            break;
+        case 'n':
+            for (size_t i = a; src && i < src->size() &&
+                (isalnum((unsigned char)(*src)[i]) || (*src)[i] == '_'); i++)
+                s.push_back((*src)[i]);
+            break;
+        default:
+            s.push_back(*p);
+            break;
+        }
+    }
+    return s;
+}
+
+
+void Diagnostics::flush(std::ostream &os) {
+    std::stable_sort(diags.begin(), diags.end(),
+        [](const Diagnostic &a, const Diagnostic &b) {
+            return a.offset < b.offset;
+        });
+
+    string out;
+    for (const Diagnostic &d : diags) {
+        int line, col;
+        locate(d.offset, line, col);
+        if (format == DiagFormat::MACHINE) {
+            out += filename + ":" + std::to_string(line) + ":" +
+                std::to_string(col) + ":" + std::to_string(d.offset) + ":" +
+                diag_table[(int)d.code].name + ":" + message(d) + "\n";
+            continue;
+        }
+        out += filename + ":" + std::to_string(line) + ":" +
+            std::to_string(col) + ": error: " + message(d) + "\n";
+        // 源码片段及指示出错位置的 ^
+        if (src && line_start[line - 1] < src->size()) {
+            size_t b = line_start[line - 1];
+            size_t e = src->find('\n', b);
+            if (e == string::npos)
+                e = src->size();
+            if (e > b && (*src)[e - 1] == '\r')
+                e--;
+            string text = src->substr(b, e - b);
+            string caret;
+            for (int i = 0; i < col - 1 && i < (int)text.size(); i++)
+                caret.push_back(text[i] == '\t' ? '\t' : ' ');
+            out += "    " + text + "\n    " + caret + "^\n";
+        }
+    }
+    if (max_errors > 0 && error_count > max_errors && format == DiagFormat::HUMAN)
+        out += filename + ": " + std::to_string(error_count - max_errors) +
+            " more errors suppressed (--max-errors=" +
+            std::to_string(max_errors) + ")\n";
+    os << out;
+    os.flush();
+    diags.clear();
+}
@@ -0,0 +1,208 @@
+#include "x86.h"
+#include "strpool.h"
+
+#include <elf.h>
+#include <algorithm>
+#include <cstring>
+
+/* 节的编号，顺序即在节头表中的顺序 */
+enum {
+    SEC_NULL, SEC_TEXT, SEC_DATA, SEC_BSS, SEC_RODATA,
+    SEC_RELA_TEXT, SEC_RELA_DATA, SEC_SYMTAB, SEC_STRTAB, SEC_SHSTRTAB,
+    SEC_NOTE, SEC_COUNT
+};
+
+/* 前面是空符号和四个段的节符号，它们是局部符号 */
+#define SYM_FIRST_GLOBAL 5
+
+/* 以 \0 分隔的名字表 */
+class StrTab {
+public:
+    StrTab() : s(1, '\0') {}
+
+    uint32_t add(const string &name)
+    {
+        uint32_t off = s.size();
+        s += name;
+        s += '\0';
+        return off;
+    }
+
+    const string &bytes() const { return s; }
+
+private:
+    string s;
+};
+
+/* 按对齐写出各部分，记下各自的偏移 */
+class ElfFile {
+public:
+    explicit ElfFile(FILE *fp) : fp(fp), pos(0) {}
+
+    uint64_t put(const void *p, size_t n, size_t align)
+    {
+        static const char zeros[16] = {0};
+        while (pos % align) {
+            size_t k = std::min(align - pos % align, sizeof(zeros));
+            fwrite(zeros, 1, k, fp);
+            pos += k;
+        }
+        uint64_t off = pos;
+        if (n)
+            fwrite(p, 1, n, fp);
+        pos += n;
+        return off;
+    }
+
+private:
+    FILE *fp;
+    uint64_t pos;
+};
+
+static uint32_t rela_type(X86RelocKind k)
+{
+    switch (k) {
+    case XR_PC32:       return R_X86_64_PC32;
+    case XR_PLT32:      return R_X86_64_PLT32;
+    case XR_GOTPCREL:   return R_X86_64_GOTPCREL;
+    default:            return R_X86_64_64;
+    }
+}
+
+static std::vector<Elf64_Rela> relas(const std::vector<X86Reloc> &rs,
+    const std::vector<uint32_t> &sym_index)
+{
+    std::vector<Elf64_Rela> out;
+    for (const X86Reloc &r : rs) {
+        // 字符串常量经 .rodata 的节符号引用
+        uint32_t s = r.sym == SYM_STR ? (uint32_t)SEC_RODATA : sym_index[r.sym];
+        Elf64_Rela x = {r.off, ELF64_R_INFO(s, rela_type(r.kind)), r.addend};
+        out.push_back(x);
+    }
+    return out;
+}
+
+/**
+ * 功能：写出目标文件
+ * 文件依次为 ELF 头、各节的内容和节头表，全局符号一律为 GLOBAL，
+ * 未定义的由链接器在其他目标文件或共享库中查找
+ */
+bool elf_write(const IrModule &m, const X86Object &obj, FILE *fp)
+{
+    static const unsigned char sect_type[XS_BSS + 1] = {0, SEC_TEXT, SEC_DATA, SEC_BSS};
+
+    StrTab strtab, shstrtab;
+    std::vector<Elf64_Sym> syms(SYM_FIRST_GLOBAL);
+    memset(&syms[0], 0, sizeof(Elf64_Sym) * syms.size());
+    for (int k = 1; k < SYM_FIRST_GLOBAL; k++) {
+        syms[k].st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+        syms[k].st_shndx = k;
+    }
+    std::vector<uint32_t> sym_index(m.globals.size());
+    for (size_t k = 0; k < m.globals.size(); k++) {
+        const IrGlobal &g = m.globals[k];
+        Elf64_Sym s = {};
+        s.st_name = strtab.add(g.name);
+        int type = obj.sect[k] == XS_UNDEF ? STT_NOTYPE : g.func ? STT_FUNC : STT_OBJECT;
+        s.st_info = ELF64_ST_INFO(STB_GLOBAL, type);
+        s.st_shndx = obj.sect[k] == XS_UNDEF ? SHN_UNDEF : sect_type[obj.sect[k]];
+        s.st_value = obj.off[k];
+        s.st_size = obj.size[k];
+        sym_index[k] = syms.size();
+        syms.push_back(s);
+    }
+    std::vector<Elf64_Rela> rela_text = relas(obj.text_relocs, sym_index);
+    std::vector<Elf64_Rela> rela_data = relas(obj.data_relocs, sym_index);
+    const string &rodata = m.strs->bytes_data();
+
+    Elf64_Shdr sh[SEC_COUNT];
+    memset(sh, 0, sizeof(sh));
+    static const char *names[SEC_COUNT] = {"", ".text", ".data", ".bss", ".rodata",
+        ".rela.text", ".rela.data", ".symtab", ".strtab", ".shstrtab",
+        ".note.GNU-stack"};
+    for (int k = 1; k < SEC_COUNT; k++)
+        sh[k].sh_name = shstrtab.add(names[k]);
+
+    ElfFile out(fp);
+    Elf64_Ehdr eh = {};
+    out.put(&eh, sizeof(eh), 1);    // 节头表的位置确定以后重写
+
+    sh[SEC_TEXT].sh_type = SHT_PROGBITS;
+    sh[SEC_TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    sh[SEC_TEXT].sh_addralign = 16;
+    sh[SEC_TEXT].sh_size = obj.text.size();
+    sh[SEC_TEXT].sh_offset = out.put(obj.text.data(), obj.text.size(), 16);
+
+    sh[SEC_DATA].sh_type = SHT_PROGBITS;
+    sh[SEC_DATA].sh_flags = SHF_ALLOC | SHF_WRITE;
+    sh[SEC_DATA].sh_addralign = obj.data_align;
+    sh[SEC_DATA].sh_size = obj.data.size();
+    sh[SEC_DATA].sh_offset = out.put(obj.data.data(), obj.data.size(), obj.data_align);
+
+    sh[SEC_BSS].sh_type = SHT_NOBITS;
+    sh[SEC_BSS].sh_flags = SHF_ALLOC | SHF_WRITE;
+    sh[SEC_BSS].sh_addralign = obj.bss_align;
+    sh[SEC_BSS].sh_size = obj.bss_size;
+    sh[SEC_BSS].sh_offset = out.put(nullptr, 0, 1);
+
+    sh[SEC_RODATA].sh_type = SHT_PROGBITS;
+    sh[SEC_RODATA].sh_flags = SHF_ALLOC;
+    sh[SEC_RODATA].sh_addralign = 1;
+    sh[SEC_RODATA].sh_size = rodata.size();
+    sh[SEC_RODATA].sh_offset = out.put(rodata.data(), rodata.size(), 1);
+
+    const std::vector<Elf64_Rela> *rela[2] = {&rela_text, &rela_data};
+    for (int k = 0; k < 2; k++) {
+        Elf64_Shdr &s = sh[SEC_RELA_TEXT + k];
+        s.sh_type = SHT_RELA;
+        s.sh_flags = SHF_INFO_LINK;
+        s.sh_link = SEC_SYMTAB;
+        s.sh_info = SEC_TEXT + k;
+        s.sh_addralign = 8;
+        s.sh_entsize = sizeof(Elf64_Rela);
+        s.sh_size = rela[k]->size() * sizeof(Elf64_Rela);
+        s.sh_offset = out.put(rela[k]->data(), s.sh_size, 8);
+    }
+
+    sh[SEC_SYMTAB].sh_type = SHT_SYMTAB;
+    sh[SEC_SYMTAB].sh_link = SEC_STRTAB;
+    sh[SEC_SYMTAB].sh_info = SYM_FIRST_GLOBAL;
+    sh[SEC_SYMTAB].sh_addralign = 8;
+    sh[SEC_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+    sh[SEC_SYMTAB].sh_size = syms.size() * sizeof(Elf64_Sym);
+    sh[SEC_SYMTAB].sh_offset = out.put(syms.data(), sh[SEC_SYMTAB].sh_size, 8);
+
+    const string *tabs[2] = {&strtab.bytes(), &shstrtab.bytes()};
+    for (int k = 0; k < 2; k++) {
+        Elf64_Shdr &s = sh[SEC_STRTAB + k];
+        s.sh_type = SHT_STRTAB;
+        s.sh_addralign = 1;
+        s.sh_size = tabs[k]->size();
+        s.sh_offset = out.put(tabs[k]->data(), s.sh_size, 1);
+    }
+
+    // 空的 .note.GNU-stack 表示不需要可执行的栈
+    sh[SEC_NOTE].sh_type = SHT_PROGBITS;
+    sh[SEC_NOTE].sh_addralign = 1;
+    sh[SEC_NOTE].sh_offset = out.put(nullptr, 0, 1);
+
+    uint64_t shoff = out.put(sh, sizeof(sh), 8);
+
+    memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS] = ELFCLASS64;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    eh.e_type = ET_REL;
+    eh.e_machine = EM_X86_64;
+    eh.e_version = EV_CURRENT;
+    eh.e_shoff = shoff;
+    eh.e_ehsize = sizeof(Elf64_Ehdr);
+    eh.e_shentsize = sizeof(Elf64_Shdr);
+    eh.e_shnum = SEC_COUNT;
+    eh.e_shstrndx = SEC_SHSTRTAB;
+    if (fseek(fp, 0, SEEK_SET) != 0)
+        return false;
+    fwrite(&eh, sizeof(eh), 1, fp);
+    return !ferror(fp);
+}
@@ -0,0 +1,494 @@
+#include "x86.h"
+#include "strpool.h"
+
+#include <algorithm>
+
+static bool fits8(int64_t v)
+{
+    return v >= -128 && v <= 127;
+}
+
+static bool fits32(int64_t v)
+{
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+/* 按字节访问时需要 REX 前缀才能表示的寄存器 spl、bpl、sil、dil */
+static bool needs_rex8(const MOpnd &x)
+{
+    return x.kind == MK_REG && x.reg >= RSP && x.reg <= RDI;
+}
+
+/* 一个转移指令在本轮编码中的位置 */
+struct JumpSite {
+    uint32_t inst;
+    uint32_t at;        // 位移字段的偏移
+    uint32_t end;       // 指令末尾的偏移
+    int block;
+};
+
+/* 一个函数的编码 */
+class Encoder {
+public:
+    Encoder(const IrModule &m, X86Code &code, X86Stats &st)
+        : m(m), code(code), st(st), t(code.text) {}
+
+    void function(const MFunc &f);
+
+private:
+    void inst(const MInst &x, uint32_t i);
+    void byte(int b) { t.push_back((uint8_t)b); }
+    void imm(int64_t v, int n);
+    void prefix(int size, int reg, bool reg8, const MOpnd &rm, bool rm8);
+    void modrm(int reg, const MOpnd &rm, int imm_bytes);
+    void op_rm(int size, int opc, int reg, const MOpnd &rm, int imm_bytes = 0,
+        bool reg8 = false, bool rm8 = false);
+    void op2_rm(int size, int opc, int reg, const MOpnd &rm, bool rm8 = false);
+    void alu(const MInst &x, int ext, int opc);
+    void sse(int pfx, int opc, int reg, const MOpnd &rm, int imm_bytes = 0);
+    void mov(const MInst &x);
+    void reloc(X86RelocKind kind, int sym, int64_t addend);
+
+    const IrModule &m;
+    X86Code &code;
+    X86Stats &st;
+    std::vector<uint8_t> &t;
+    std::vector<char> longj;        // 需要 32 位位移的转移
+    std::vector<JumpSite> jumps;
+    std::vector<int> labels;        // 各块在 text 中的偏移
+};
+
+void Encoder::imm(int64_t v, int n)
+{
+    for (int k = 0; k < n; k++)
+        byte((int)(v >> (8 * k)) & 0xff);
+}
+
+void Encoder::reloc(X86RelocKind kind, int sym, int64_t addend)
+{
+    X86Reloc r = {(uint32_t)t.size(), kind, sym, addend};
+    code.relocs.push_back(r);
+}
+
+/**
+ * 功能：输出操作数宽度前缀和 REX 前缀
+ * reg 为 ModRM 的 reg 字段，reg8、rm8 表示对应的操作数是字节寄存器
+ */
+void Encoder::prefix(int size, int reg, bool reg8, const MOpnd &rm, bool rm8)
+{
+    if (size == 2)
+        byte(0x66);
+    int rex = size == 8 ? 0x48 : 0x40;
+    if (reg & 8)
+        rex |= 4;
+    if ((rm.kind == MK_REG || rm.kind == MK_XMM) && (rm.reg & 8))
+        rex |= 1;
+    if (rm.kind == MK_MEM && rm.reg != RIP) {
+        if (rm.reg & 8)
+            rex |= 1;
+        if (rm.index != NOREG && (rm.index & 8))
+            rex |= 2;
+    }
+    bool force = (reg8 && reg >= RSP && reg <= RDI) || (rm8 && needs_rex8(rm));
+    if (rex != 0x40 || force)
+        byte(rex);
+}
+
+/**
+ * 功能：输出 ModRM 及其后的 SIB 和位移
+ * 相对 RIP 的位移以指令末尾为准，其后还有 imm_bytes 个字节的立即数
+ */
+void Encoder::modrm(int reg, const MOpnd &x, int imm_bytes)
+{
+    reg &= 7;
+    if (x.kind == MK_REG || x.kind == MK_XMM) {
+        byte(0xc0 | reg << 3 | (x.reg & 7));
+        return;
+    }
+    if (x.reg == RIP) {
+        byte(reg << 3 | 5);
+        if (x.index == RIP)
+            reloc(XR_GOTPCREL, x.sym, x.disp - 4 - imm_bytes);
+        else
+            reloc(XR_PC32, x.sym, x.disp - 4 - imm_bytes);
+        imm(0, 4);
+        return;
+    }
+    int base = x.reg & 7;
+    // rbp、r13 作基址时没有不带位移的形式
+    int mod = x.disp == 0 && base != RBP ? 0 : fits8(x.disp) ? 1 : 2;
+    if (x.index != NOREG || base == RSP) {
+        // rsp、r12 作基址时必须带 SIB
+        int ss = x.scale == 8 ? 3 : x.scale == 4 ? 2 : x.scale == 2 ? 1 : 0;
+        int index = x.index == NOREG ? RSP : x.index & 7;
+        byte(mod << 6 | reg << 3 | 4);
+        byte(ss << 6 | index << 3 | base);
+    }
+    else
+        byte(mod << 6 | reg << 3 | base);
+    if (mod == 1)
+        imm(x.disp, 1);
+    else if (mod == 2)
+        imm(x.disp, 4);
+}
+
+void Encoder::op_rm(int size, int opc, int reg, const MOpnd &rm, int imm_bytes,
+    bool reg8, bool rm8)
+{
+    prefix(size, reg, reg8, rm, rm8);
+    byte(opc);
+    modrm(reg, rm, imm_bytes);
+}
+
+/* 0F 开头的两字节操作码 */
+void Encoder::op2_rm(int size, int opc, int reg, const MOpnd &rm, bool rm8)
+{
+    prefix(size, reg, false, rm, rm8);
+    byte(0x0f);
+    byte(opc);
+    modrm(reg, rm, 0);
+}
+
+/**
+ * 功能：SSE2 指令，pfx 为 66、F2、F3 等强制前缀，须在 REX 之前
+ */
+void Encoder::sse(int pfx, int opc, int reg, const MOpnd &rm, int imm_bytes)
+{
+    byte(pfx);
+    prefix(4, reg, false, rm, false);
+    byte(0x0f);
+    byte(opc);
+    modrm(reg, rm, imm_bytes);
+}
+
+/**
+ * 功能：add、sub、cmp 一类的运算，ext 为立即数形式中 reg 字段的扩展操作码，
+ * opc 为 r/m 作目标、reg 作源的操作码，其余形式由它推出
+ */
+void Encoder::alu(const MInst &x, int ext, int opc)
+{
+    int n = x.size;
+    bool b = n == 1;
+    if (x.src.kind == MK_IMM) {
+        if (b) {
+            op_rm(n, 0x80, ext, x.dst, 1, false, true);
+            imm(x.src.imm, 1);
+        }
+        else if (fits8(x.src.imm)) {
+            op_rm(n, 0x83, ext, x.dst, 1);
+            imm(x.src.imm, 1);
+        }
+        else if (x.dst.kind == MK_REG && x.dst.reg == RAX) {
+            // rax 有不带 ModRM 的短形式
+            int k = n == 2 ? 2 : 4;
+            prefix(n, 0, false, x.dst, false);
+            byte(ext << 3 | 5);
+            imm(x.src.imm, k);
+        }
+        else {
+            int k = n == 2 ? 2 : 4;
+            op_rm(n, 0x81, ext, x.dst, k);
+            imm(x.src.imm, k);
+        }
+    }
+    else if (x.src.kind == MK_MEM)
+        op_rm(n, opc + 2 - b, x.dst.reg, x.src, 0, b, false);
+    else
+        op_rm(n, opc - b, x.src.reg, x.dst, 0, b, b);
+}
+
+void Encoder::mov(const MInst &x)
+{
+    int n = x.size;
+    bool b = n == 1;
+    if (x.src.kind == MK_IMM) {
+        int64_t v = x.src.imm;
+        if (x.dst.kind == MK_REG && (n == 4 || (n == 8 && !fits32(v)))) {
+            // mov $imm32, r32 高位清零；放不下 32 位的用 movabs
+            prefix(n, 0, false, x.dst, false);
+            byte(0xb8 | (x.dst.reg & 7));
+            imm(v, n);
+            return;
+        }
+        int k = n == 8 ? 4 : n;
+        op_rm(n, b ? 0xc6 : 0xc7, 0, x.dst, k, false, b);
+        imm(v, k);
+    }
+    else if (x.src.kind == MK_MEM)
+        op_rm(n, b ? 0x8a : 0x8b, x.dst.reg, x.src, 0, b, false);
+    else
+        op_rm(n, b ? 0x88 : 0x89, x.src.reg, x.dst, 0, b, b);
+}
+
+void Encoder::inst(const MInst &x, uint32_t i)
+{
+    switch (x.op) {
+    case M_LABEL:
+        labels[x.dst.sym] = t.size();
+        break;
+    case M_MOV:
+        mov(x);
+        break;
+    case M_MOVSX:
+        if (x.size2 == 4)
+            op_rm(8, 0x63, x.dst.reg, x.src);
+        else
+            op2_rm(8, x.size2 == 1 ? 0xbe : 0xbf, x.dst.reg, x.src, x.size2 == 1);
+        break;
+    case M_MOVZB:
+        op2_rm(4, 0xb6, x.dst.reg, x.src, true);
+        break;
+    case M_LEA:
+        op_rm(8, 0x8d, x.dst.reg, x.src);
+        break;
+    case M_ADD:
+        alu(x, 0, 0x01);
+        break;
+    case M_SUB:
+        alu(x, 5, 0x29);
+        break;
+    case M_CMP:
+        alu(x, 7, 0x39);
+        break;
+    case M_TEST:
+        op_rm(x.size, x.size == 1 ? 0x84 : 0x85, x.src.reg, x.dst, 0,
+            x.size == 1, x.size == 1);
+        break;
+    case M_IMUL:
+        if (x.src.kind == MK_IMM) {
+            bool s = fits8(x.src.imm);
+            op_rm(x.size, s ? 0x6b : 0x69, x.dst.reg, x.dst, s ? 1 : 4);
+            imm(x.src.imm, s ? 1 : 4);
+        }
+        else
+            op2_rm(x.size, 0xaf, x.dst.reg, x.src);
+        break;
+    case M_NEG:
+        op_rm(x.size, 0xf7, 3, x.dst);
+        break;
+    case M_CQO:
+        byte(0x48);
+        byte(0x99);
+        break;
+    case M_IDIV:
+        op_rm(x.size, 0xf7, 7, x.dst);
+        break;
+    case M_SETCC:
+        op2_rm(1, 0x90 | x.cc, 0, x.dst, true);
+        break;
+    case M_JMP:
+    case M_JCC: {
+        JumpSite j = {i, 0, 0, x.dst.sym};
+        if (!longj[i])
+            byte(x.op == M_JMP ? 0xeb : 0x70 | x.cc);
+        else if (x.op == M_JMP)
+            byte(0xe9);
+        else {
+            byte(0x0f);
+            byte(0x80 | x.cc);
+        }
+        j.at = t.size();
+        imm(0, longj[i] ? 4 : 1);
+        j.end = t.size();
+        jumps.push_back(j);
+        break;
+    }
+    case M_CALL:
+        if (x.dst.kind == MK_REG)
+            op_rm(4, 0xff, 2, x.dst);
+        else {
+            byte(0xe8);
+            reloc(XR_PLT32, x.dst.sym, -4);
+            imm(0, 4);
+        }
+        break;
+    case M_PUSH:
+        if (x.dst.kind == MK_REG) {
+            if (x.dst.reg & 8)
+                byte(0x41);
+            byte(0x50 | (x.dst.reg & 7));
+        }
+        else if (x.dst.kind == MK_IMM) {
+            bool s = fits8(x.dst.imm);
+            byte(s ? 0x6a : 0x68);
+            imm(x.dst.imm, s ? 1 : 4);
+        }
+        else
+            op_rm(4, 0xff, 6, x.dst);
+        break;
+    case M_POP:
+        if (x.dst.reg & 8)
+            byte(0x41);
+        byte(0x58 | (x.dst.reg & 7));
+        break;
+    case M_LEAVE:
+        byte(0xc9);
+        break;
+    case M_RET:
+        byte(0xc3);
+        break;
+    case M_MOVDQU:
+        if (x.dst.kind == MK_MEM)
+            sse(0xf3, 0x7f, x.src.reg, x.dst);
+        else
+            sse(0xf3, 0x6f, x.dst.reg, x.src);
+        break;
+    case M_MOVDQA:
+        sse(0x66, 0x6f, x.dst.reg, x.src);
+        break;
+    case M_MOVD:
+        sse(0x66, 0x6e, x.dst.reg, x.src);
+        break;
+    case M_PSHUFLW: case M_PSHUFD:
+        sse(x.op == M_PSHUFD ? 0x66 : 0xf2, 0x70, x.dst.reg, x.src, 1);
+        byte(x.size2);
+        break;
+    case M_PUNPCKLBW: case M_PAND: case M_PANDN: case M_POR: case M_PXOR: {
+        static const uint8_t opc[] = {0x60, 0xdb, 0xdf, 0xeb, 0xef};
+        int k = x.op == M_PUNPCKLBW ? 0 : x.op - M_PAND + 1;
+        sse(0x66, opc[k], x.dst.reg, x.src);
+        break;
+    }
+    case M_PADD: case M_PSUB: case M_PCMPEQ: case M_PCMPGT: {
+        // 按 b、w、d、q 排列，比较没有 q 形式
+        static const uint8_t opc[4][4] = {
+            {0xfc, 0xfd, 0xfe, 0xd4}, {0xf8, 0xf9, 0xfa, 0xfb},
+            {0x74, 0x75, 0x76, 0}, {0x64, 0x65, 0x66, 0}};
+        int lane = x.size == 1 ? 0 : x.size == 2 ? 1 : x.size == 4 ? 2 : 3;
+        sse(0x66, opc[x.op - M_PADD][lane], x.dst.reg, x.src);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/**
+ * 功能：编码一个函数
+ * 每轮把放不下 8 位位移的转移改为 32 位，改动只会使距离变长，
+ * 因此至多重复到所有转移都改完为止
+ */
+void Encoder::function(const MFunc &f)
+{
+    uint32_t start = t.size();
+    size_t nrel = code.relocs.size();
+    int nblocks = 0;
+    for (const MInst &x : f.code)
+        if (x.op == M_LABEL)
+            nblocks = std::max(nblocks, x.dst.sym + 1);
+    longj.assign(f.code.size(), 0);
+    for (;;) {
+        t.resize(start);
+        code.relocs.resize(nrel);
+        jumps.clear();
+        labels.assign(nblocks, 0);
+        for (uint32_t i = 0; i < f.code.size(); i++)
+            inst(f.code[i], i);
+        bool again = false;
+        for (const JumpSite &j : jumps) {
+            int64_t d = (int64_t)labels[j.block] - j.end;
+            if (!longj[j.inst] && !fits8(d)) {
+                longj[j.inst] = 1;
+                again = true;
+            }
+        }
+        if (!again)
+            break;
+    }
+    for (const JumpSite &j : jumps) {
+        int32_t d = labels[j.block] - (int32_t)j.end;
+        int n = j.end - j.at;
+        for (int k = 0; k < n; k++)
+            t[j.at + k] = (uint8_t)(d >> (8 * k));
+        if (n == 1)
+            st.short_jumps++;
+        else
+            st.long_jumps++;
+    }
+}
+
+static void put_bytes(std::vector<uint8_t> &out, uint32_t off, int64_t v, int n)
+{
+    for (int k = 0; k < n; k++)
+        out[off + k] = (uint8_t)(v >> (8 * k));
+}
+
+/**
+ * 功能：排定全局变量在 .data 和 .bss 中的位置并填入初值，与 asm.cpp 的输出一致
+ */
+static void layout_data(const IrModule &m, X86Object &obj)
+{
+    const StrPool &pool = *m.strs;
+    obj.bss_size = 0;
+    obj.data_align = obj.bss_align = 1;
+    for (size_t k = 0; k < m.globals.size(); k++) {
+        const IrGlobal &g = m.globals[k];
+        if (g.func || !g.defined)
+            continue;
+        uint32_t a = g.align > 0 ? g.align : 1;
+        obj.size[k] = g.size;
+        if (g.init == INIT_NONE) {
+            obj.bss_size = (obj.bss_size + a - 1) / a * a;
+            obj.sect[k] = XS_BSS;
+            obj.off[k] = obj.bss_size;
+            obj.bss_size += g.size;
+            obj.bss_align = std::max(obj.bss_align, a);
+            continue;
+        }
+        uint32_t off = (obj.data.size() + a - 1) / a * a;
+        obj.data.resize(off + g.size, 0);
+        obj.sect[k] = XS_DATA;
+        obj.off[k] = off;
+        obj.data_align = std::max(obj.data_align, a);
+        if (g.init == INIT_CONST) {
+            if (g.size == 1 || g.size == 2 || g.size == 4 || g.size == 8)
+                put_bytes(obj.data, off, (int64_t)g.value, g.size);
+        }
+        else if (g.init == INIT_STR && g.array) {
+            const char *s = pool.str(g.value);
+            int n = std::min<int>(g.size, pool.length(g.value) + 1);
+            std::copy(s, s + n, obj.data.begin() + off);
+        }
+        else if (g.init == INIT_STR) {
+            X86Reloc r = {off, XR_64, SYM_STR, (int64_t)pool.offset(g.value)};
+            obj.data_relocs.push_back(r);
+        }
+    }
+}
+
+void x86_encode_function(const IrModule &m, const MFunc &f, X86Code &code, X86Stats &st)
+{
+    Encoder e(m, code, st);
+    e.function(f);
+}
+
+void x86_link(const IrModule &m, const std::vector<MFunc> &funcs,
+    const std::vector<X86Code> &code, X86Object &obj, X86Stats &st)
+{
+    obj.sect.assign(m.globals.size(), XS_UNDEF);
+    obj.off.assign(m.globals.size(), 0);
+    obj.size.assign(m.globals.size(), 0);
+    for (size_t k = 0; k < funcs.size(); k++) {
+        uint32_t start = obj.text.size();
+        obj.text.insert(obj.text.end(), code[k].text.begin(), code[k].text.end());
+        for (X86Reloc r : code[k].relocs) {
+            r.off += start;
+            obj.text_relocs.push_back(r);
+        }
+        obj.sect[funcs[k].global] = XS_TEXT;
+        obj.off[funcs[k].global] = start;
+        obj.size[funcs[k].global] = code[k].text.size();
+    }
+    layout_data(m, obj);
+    st.code_bytes = obj.text.size();
+    st.relocs = obj.text_relocs.size() + obj.data_relocs.size();
+}
+
+void x86_encode(const IrModule &m, const std::vector<MFunc> &funcs, X86Object &obj,
+    X86Stats &st)
+{
+    std::vector<X86Code> code(funcs.size());
+    for (size_t k = 0; k < funcs.size(); k++)
+        x86_encode_function(m, funcs[k], code[k], st);
+    x86_link(m, funcs, code, obj, st);
+}
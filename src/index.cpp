@@ -0,0 +1,300 @@
+#include "index.h"
+#include "hash.h"
+#include "syntax.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+/* 引用种类的名字，下标为 XRefKind */
+static const char *kind_names[] = {
+    "struct", "struct-use", "func", "func-decl", "global", "local",
+    "param", "member", "member-use", "use"
+};
+
+const char *xref_kind_name(int kind)
+{
+    if (kind < 0 || kind > XR_USE)
+        return "?";
+    return kind_names[kind];
+}
+
+
+SymbolIndex::SymbolIndex() : base(nullptr), size(0), hdr(nullptr) {}
+
+SymbolIndex::~SymbolIndex()
+{
+    close();
+}
+
+/**
+ * 功能：以只读方式映射索引文件并检查各段及其中的下标、偏移是否越界
+ */
+bool SymbolIndex::open(const string &path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(IndexHeader)) {
+        ::close(fd);
+        return false;
+    }
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return false;
+    base = (const char *)p;
+    size = st.st_size;
+    hdr = (const IndexHeader *)base;
+
+    bool ok = hdr->magic == INDEX_MAGIC && hdr->version == INDEX_VERSION &&
+        hdr->files_off + (uint64_t)hdr->nfiles * sizeof(IndexFile) <= size &&
+        hdr->syms_off + (uint64_t)hdr->nsyms * sizeof(IndexSym) <= size &&
+        hdr->refs_off + (uint64_t)hdr->nrefs * sizeof(IndexRef) <= size &&
+        hdr->str_off + (uint64_t)hdr->strsize <= size;
+    // 查询和更新直接用各项中的下标和偏移，打开时逐项检查一次
+    ok = ok && (hdr->strsize == 0 || str(hdr->strsize - 1)[0] == '\0');
+    for (uint32_t i = 0; ok && i < hdr->nfiles; i++)
+        ok = files()[i].name < hdr->strsize;
+    for (uint32_t i = 0; ok && i < hdr->nsyms; i++) {
+        const IndexSym &s = syms()[i];
+        ok = s.name < hdr->strsize && (uint64_t)s.first + s.count <= hdr->nrefs;
+    }
+    for (uint32_t i = 0; ok && i < hdr->nrefs; i++)
+        ok = refs()[i].file < hdr->nfiles;
+    if (!ok)
+        close();
+    return ok;
+}
+
+void SymbolIndex::close()
+{
+    if (base)
+        munmap((void *)base, size);
+    base = nullptr;
+    size = 0;
+    hdr = nullptr;
+}
+
+/**
+ * 功能：二分查找符号
+ */
+const IndexSym *SymbolIndex::find(const char *name) const
+{
+    if (!hdr)
+        return nullptr;
+    const IndexSym *lo = syms(), *hi = syms() + hdr->nsyms;
+    while (lo < hi) {
+        const IndexSym *mid = lo + (hi - lo) / 2;
+        int c = strcmp(str(mid->name), name);
+        if (c == 0)
+            return mid;
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return nullptr;
+}
+
+/**
+ * 功能：读入整个文件
+ */
+static bool read_file(const string &path, string &out)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp)
+        return false;
+    fseek(fp, 0, SEEK_END);
+    out.resize(ftell(fp));
+    fseek(fp, 0, SEEK_SET);
+    bool ok = fread(&out[0], 1, out.size(), fp) == out.size();
+    fclose(fp);
+    return ok;
+}
+
+/**
+ * 功能：增量更新索引
+ */
+bool SymbolIndex::update(const string &path, const std::vector<string> &files,
+    IndexStats &st)
+{
+    st.parsed = st.reused = st.dropped = st.errors = 0;
+
+    SymbolIndex old;
+    bool have_old = old.open(path);
+    std::unordered_map<string, int> old_files;      // 文件名 -> 旧下标
+    std::vector<int> remap;                         // 旧下标 -> 新下标
+    if (have_old) {
+        remap.assign(old.header()->nfiles, -1);
+        for (uint32_t i = 0; i < old.header()->nfiles; i++)
+            old_files[old.str(old.files()[i].name)] = i;
+    }
+
+    std::vector<string> names;                      // 新索引的文件
+    std::vector<uint64_t> hashes;
+    std::unordered_map<string, std::vector<IndexRef>> table;
+    std::unordered_map<string, bool> listed;
+
+    // 本次列出的文件：内容未变则沿用，否则重新分析
+    string content;
+    for (const string &f : files) {
+        if (listed.count(f))
+            continue;
+        listed[f] = true;
+        if (!read_file(f, content)) {
+            st.errors++;
+            continue;
+        }
+        uint64_t h = hash_bytes(content.data(), content.size(), INDEX_VERSION);
+        auto it = old_files.find(f);
+        if (it != old_files.end() && old.files()[it->second].hash == h) {
+            remap[it->second] = names.size();
+            names.push_back(f);
+            hashes.push_back(h);
+            st.reused++;
+            continue;
+        }
+
+        uint32_t fi = names.size();
+        names.push_back(f);
+        hashes.push_back(h);
+        Syntax syn(f);
+        syn.set_echo(false);
+        syn.set_xref(true);
+        syn.translation_unit();
+        if (syn.diagnostics().errors())
+            st.errors++;
+        for (const XRef &x : syn.xref()) {
+            int line, col;
+            syn.diagnostics().locate(x.offset, line, col);
+            IndexRef r;
+            r.file = fi;
+            r.offset = x.offset;
+            r.kind = x.kind;
+            r.line = line;
+            table[x.name].push_back(r);
+        }
+        st.parsed++;
+    }
+
+    // 未列出的旧文件：仍存在则原样保留
+    bool changed = st.parsed > 0 || !have_old;
+    if (have_old) {
+        for (uint32_t i = 0; i < old.header()->nfiles; i++) {
+            const char *f = old.str(old.files()[i].name);
+            if (listed.count(f))
+                continue;
+            if (access(f, R_OK) != 0) {
+                st.dropped++;
+                continue;
+            }
+            remap[i] = names.size();
+            names.push_back(f);
+            hashes.push_back(old.files()[i].hash);
+        }
+        for (uint32_t i = 0; i < old.header()->nfiles; i++)
+            changed = changed || remap[i] != (int)i;
+        changed = changed || names.size() != old.header()->nfiles;
+    }
+    // 所有文件都沿用时旧索引就是结果
+    if (!changed)
+        return true;
+
+    string pool;
+    std::vector<IndexFile> fv(names.size());
+    for (size_t i = 0; i < names.size(); i++) {
+        fv[i].name = pool.size();
+        fv[i].nrefs = 0;
+        fv[i].hash = hashes[i];
+        pool.append(names[i].c_str(), names[i].size() + 1);
+    }
+
+    // 旧索引的符号已按名字排序，与新分析出的符号归并
+    std::vector<const string *> symnames;
+    for (auto &kv : table)
+        symnames.push_back(&kv.first);
+    std::sort(symnames.begin(), symnames.end(),
+        [](const string *a, const string *b) { return *a < *b; });
+
+    std::vector<IndexSym> sv;
+    std::vector<IndexRef> rv;
+    uint32_t nold = have_old ? old.header()->nsyms : 0;
+    size_t i = 0, j = 0;
+    while (i < nold || j < symnames.size()) {
+        const char *oname = i < nold ? old.str(old.syms()[i].name) : nullptr;
+        int c = !oname ? 1 : j == symnames.size() ? -1 :
+            strcmp(oname, symnames[j]->c_str());
+        IndexSym sym;
+        sym.name = pool.size();
+        sym.first = rv.size();
+        if (c <= 0) {
+            const IndexSym &os = old.syms()[i++];
+            for (uint32_t k = os.first; k < os.first + os.count; k++) {
+                IndexRef r = old.refs()[k];
+                if (remap[r.file] < 0)
+                    continue;
+                r.file = remap[r.file];
+                rv.push_back(r);
+            }
+            pool.append(oname, strlen(oname) + 1);
+        }
+        if (c >= 0) {
+            const string *n = symnames[j++];
+            const std::vector<IndexRef> &refs = table[*n];
+            rv.insert(rv.end(), refs.begin(), refs.end());
+            if (c > 0)
+                pool.append(n->c_str(), n->size() + 1);
+        }
+        sym.count = rv.size() - sym.first;
+        if (sym.count == 0) {
+            pool.resize(sym.name);
+            continue;
+        }
+        std::sort(rv.begin() + sym.first, rv.end(),
+            [](const IndexRef &a, const IndexRef &b) {
+                return a.file != b.file ? a.file < b.file : a.offset < b.offset;
+            });
+        for (size_t k = sym.first; k < rv.size(); k++)
+            fv[rv[k].file].nrefs++;
+        sv.push_back(sym);
+    }
+
+    IndexHeader h;
+    h.magic = INDEX_MAGIC;
+    h.version = INDEX_VERSION;
+    h.nfiles = fv.size();
+    h.nsyms = sv.size();
+    h.nrefs = rv.size();
+    h.strsize = pool.size();
+    h.files_off = sizeof(IndexHeader);
+    h.syms_off = h.files_off + fv.size() * sizeof(IndexFile);
+    h.refs_off = h.syms_off + sv.size() * sizeof(IndexSym);
+    h.str_off = h.refs_off + rv.size() * sizeof(IndexRef);
+    old.close();
+
+    // 先写临时文件再改名，查询方看到的总是完整的索引
+    string tmp = path + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    if (!fp)
+        return false;
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    ok = ok && fwrite(fv.data(), sizeof(IndexFile), fv.size(), fp) == fv.size();
+    ok = ok && fwrite(sv.data(), sizeof(IndexSym), sv.size(), fp) == sv.size();
+    ok = ok && fwrite(rv.data(), sizeof(IndexRef), rv.size(), fp) == rv.size();
+    ok = ok && fwrite(pool.data(), 1, pool.size(), fp) == pool.size();
+    ok = fclose(fp) == 0 && ok;
+    if (ok)
+        ok = rename(tmp.c_str(), path.c_str()) == 0;
+    else
+        remove(tmp.c_str());
+    return ok;
+}
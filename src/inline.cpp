@@ -0,0 +1,307 @@
+#include "opt.h"
+
+#include <algorithm>
+#include <functional>
+
+/* 只含直接调用的调用图，节点为 IrModule::funcs 的下标 */
+struct CallGraph {
+    std::vector<int> func_of;       // 全局编号对应的函数编号，-1 为没有函数体
+    std::vector<std::vector<int>> callees;
+    std::vector<int> sites;         // 各函数被直接调用的次数
+    std::vector<char> recursive;
+    std::vector<int> order;         // 被调函数在调用者之前
+};
+
+/**
+ * 功能：第 i 条指令直接调用的函数编号，不是直接调用或没有函数体时为 -1
+ */
+static int callee_of(const CallGraph &cg, const IrFunc &f, uint32_t i)
+{
+    if (f.op[i] != IR_CALL || ref_tag(f.a[i]) != RT_GLOBAL)
+        return -1;
+    return cg.func_of[ref_index(f.a[i])];
+}
+
+/**
+ * 功能：建立调用图，用 Tarjan 算法求强连通分量
+ * 分量按被调者在前的顺序得出，大于一个函数或有自调用的分量是递归的
+ */
+static void build_call_graph(const IrModule &m, CallGraph &cg)
+{
+    size_t n = m.funcs.size();
+    cg.func_of.assign(m.globals.size(), -1);
+    for (size_t k = 0; k < n; k++)
+        cg.func_of[m.funcs[k].global] = k;
+    cg.callees.assign(n, std::vector<int>());
+    cg.sites.assign(n, 0);
+    cg.recursive.assign(n, 0);
+    cg.order.clear();
+    for (size_t k = 0; k < n; k++) {
+        const IrFunc &f = m.funcs[k];
+        for (uint32_t i = 0; i < f.count(); i++) {
+            int c = callee_of(cg, f, i);
+            if (c < 0)
+                continue;
+            cg.sites[c]++;
+            cg.callees[k].push_back(c);
+            if (c == (int)k)
+                cg.recursive[k] = 1;
+        }
+    }
+
+    std::vector<int> index(n, -1), low(n), stack;
+    std::vector<char> on(n, 0);
+    int next = 0;
+    std::function<void(int)> visit = [&](int v) {
+        index[v] = low[v] = next++;
+        stack.push_back(v);
+        on[v] = 1;
+        for (int w : cg.callees[v]) {
+            if (index[w] < 0) {
+                visit(w);
+                low[v] = std::min(low[v], low[w]);
+            }
+            else if (on[w])
+                low[v] = std::min(low[v], index[w]);
+        }
+        if (low[v] != index[v])
+            return;
+        size_t top = stack.size();
+        do {
+            top--;
+            on[stack[top]] = 0;
+        } while (stack[top] != v);
+        for (size_t k = top; k < stack.size(); k++) {
+            if (stack.size() - top > 1)
+                cg.recursive[stack[k]] = 1;
+            cg.order.push_back(stack[k]);
+        }
+        stack.resize(top);
+    };
+    for (size_t k = 0; k < n; k++)
+        if (index[k] < 0)
+            visit(k);
+}
+
+/* 重建中的指令数组 */
+class Rebuild {
+public:
+    explicit Rebuild(IrFunc &f) : f(f) {}
+
+    void block()
+    {
+        close();
+        IrBlock b = {(uint32_t)op.size(), 0};
+        blocks.push_back(b);
+    }
+
+    void push(IrOp o, int sz, Ref rd, Ref ra, Ref rb, uint32_t l)
+    {
+        op.push_back(o);
+        size.push_back(sz);
+        d.push_back(rd);
+        a.push_back(ra);
+        b.push_back(rb);
+        loc.push_back(l);
+    }
+
+    void pop()
+    {
+        op.pop_back();
+        size.pop_back();
+        d.pop_back();
+        a.pop_back();
+        b.pop_back();
+        loc.pop_back();
+    }
+
+    /* 下一个开始的块的编号 */
+    uint32_t next_block() const { return blocks.size(); }
+
+    void finish()
+    {
+        close();
+        f.op.swap(op);
+        f.size.swap(size);
+        f.d.swap(d);
+        f.a.swap(a);
+        f.b.swap(b);
+        f.loc.swap(loc);
+        f.blocks.swap(blocks);
+    }
+
+    std::vector<uint8_t> op, size;
+    std::vector<Ref> d, a, b;
+    std::vector<uint32_t> loc;
+
+private:
+    void close()
+    {
+        if (!blocks.empty())
+            blocks.back().end = op.size();
+    }
+
+    IrFunc &f;
+    std::vector<IrBlock> blocks;
+};
+
+/**
+ * 功能：把 f 中 chosen 为真的调用换为被调函数的副本
+ * 调用所在的块在实参之前断开，转到副本的入口块；副本的返回改为存入
+ * 返回值栈槽并转到接续块，接续块取出返回值后是调用之后的指令。
+ */
+static void expand(const IrModule &m, const CallGraph &cg, IrFunc &f,
+    const std::vector<char> &chosen)
+{
+    // 插入的块使其后的块都要重新编号
+    uint32_t nb = f.blocks.size();
+    std::vector<uint32_t> new_id(nb);
+    uint32_t next = 0;
+    for (uint32_t b = 0; b < nb; b++) {
+        new_id[b] = next++;
+        for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++)
+            if (chosen[i])
+                next += m.funcs[callee_of(cg, f, i)].blocks.size() + 1;
+    }
+    auto block_ref = [&](Ref r) {
+        return ref_tag(r) == RT_BLOCK ? make_ref(RT_BLOCK, new_id[ref_index(r)]) : r;
+    };
+
+    Rebuild out(f);
+    for (uint32_t b = 0; b < nb; b++) {
+        out.block();
+        for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++) {
+            if (!chosen[i]) {
+                out.push((IrOp)f.op[i], f.size[i], block_ref(f.d[i]),
+                    block_ref(f.a[i]), block_ref(f.b[i]), f.loc[i]);
+                continue;
+            }
+            const IrFunc &g = m.funcs[callee_of(cg, f, i)];
+            int n = f.constant(f.b[i]);
+            std::vector<Ref> args(out.a.end() - n, out.a.end());
+            for (int k = 0; k < n; k++)
+                out.pop();
+            uint32_t entry = out.next_block();
+            uint32_t cont = entry + g.blocks.size();
+            out.push(IR_JMP, 0, REF_NONE, make_ref(RT_BLOCK, entry), REF_NONE, f.loc[i]);
+
+            uint32_t temp_base = f.ntemps, slot_base = f.slots.size();
+            f.ntemps += g.ntemps;
+            for (const IrSlot &s : g.slots)
+                f.slot(s.size, s.align, g.name + "." + s.name, s.decl);
+            int rsize = f.size[i];
+            Ref ret = rsize ? f.slot(rsize, rsize, g.name + ".return", f.loc[i]) :
+                REF_NONE;
+            std::vector<Ref> subst(g.ntemps, REF_NONE);
+            auto remap = [&](Ref r) {
+                uint32_t x = ref_index(r);
+                switch (ref_tag(r)) {
+                case RT_TEMP:
+                    return subst[x] != REF_NONE ? subst[x] : make_ref(RT_TEMP, temp_base + x);
+                case RT_CONST:
+                    return f.imm(g.consts[x]);
+                case RT_SLOT:
+                    return make_ref(RT_SLOT, slot_base + x);
+                case RT_BLOCK:
+                    return make_ref(RT_BLOCK, entry + x);
+                default:
+                    return r;
+                }
+            };
+
+            for (const IrBlock &gb : g.blocks) {
+                out.block();
+                for (uint32_t j = gb.first; j < gb.end; j++) {
+                    IrInst x = g.inst(j);
+                    if (x.op == IR_PARAM) {
+                        // 形参的值直接代入，窄的形参仍按其宽度符号扩展
+                        Ref v = args[g.constant(x.a)];
+                        if (x.size > 0 && x.size < 8)
+                            out.push(IR_EXT, x.size, remap(x.d), v, REF_NONE, x.loc);
+                        else
+                            subst[ref_index(x.d)] = v;
+                        continue;
+                    }
+                    if (x.op == IR_RET) {
+                        if (ret != REF_NONE && x.a != REF_NONE)
+                            out.push(IR_STORE, rsize, REF_NONE, ret, remap(x.a), x.loc);
+                        out.push(IR_JMP, 0, REF_NONE, make_ref(RT_BLOCK, cont),
+                            REF_NONE, x.loc);
+                        continue;
+                    }
+                    out.push(x.op, x.size, remap(x.d), remap(x.a), remap(x.b), x.loc);
+                }
+            }
+
+            out.block();
+            if (f.d[i] != REF_NONE && ret != REF_NONE)
+                out.push(IR_LOAD, rsize, f.d[i], ret, REF_NONE, f.loc[i]);
+        }
+    }
+    out.finish();
+}
+
+/**
+ * 功能：按代价模型选出 f 中要内联的调用，返回是否有
+ */
+static bool choose(const IrModule &m, const CallGraph &cg, int fi, const IrFunc &f,
+    const InlineParams &ip, std::vector<char> &chosen, OptStats &st)
+{
+    Cfg g;
+    DomTree t;
+    std::vector<Loop> loops;
+    build_cfg(f, g);
+    build_domtree(g, t);
+    find_loops(g, t, loops);
+    std::vector<int> depth(f.blocks.size(), 0);
+    for (const Loop &l : loops)
+        for (uint32_t b : l.blocks)
+            depth[b] = std::max(depth[b], l.depth);
+
+    chosen.assign(f.count(), 0);
+    bool any = false;
+    long size = f.count();
+    for (uint32_t b = 0; b < f.blocks.size(); b++) {
+        for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++) {
+            int c = callee_of(cg, f, i);
+            if (c < 0 || c == fi || cg.recursive[c])
+                continue;
+            const IrFunc &callee = m.funcs[c];
+            int n = f.constant(f.b[i]);
+            if (n != callee.nparams || !callee.phis.empty())
+                continue;
+            long cost = (long)callee.count() - 2 * callee.nparams - (n + 1);
+            long limit = ip.threshold + ip.loop_bonus * std::min(depth[b], 3);
+            if (cg.sites[c] == 1)
+                limit += ip.single_bonus;
+            for (int k = 0; k < n; k++) {
+                RefTag tag = ref_tag(f.a[i - n + k]);
+                if (tag == RT_IMM || tag == RT_CONST)
+                    limit += ip.const_bonus;
+            }
+            if (cost > limit || size + cost > ip.max_size)
+                continue;
+            chosen[i] = 1;
+            any = true;
+            size += cost;
+            st.inlined++;
+            st.inline_insts += cost;
+        }
+    }
+    return any;
+}
+
+void inline_calls(IrModule &m, const InlineParams &ip, OptStats &st)
+{
+    if (ip.threshold < 0)
+        return;
+    CallGraph cg;
+    build_call_graph(m, cg);
+    std::vector<char> chosen;
+    // 被调函数先完成自身的内联，调用者复制的是内联以后的函数体
+    for (int fi : cg.order) {
+        IrFunc &f = m.funcs[fi];
+        if (f.phis.empty() && choose(m, cg, fi, f, ip, chosen, st))
+            expand(m, cg, f, chosen);
+    }
+}
@@ -0,0 +1,308 @@
+#include "ir.h"
+#include "diag.h"
+#include "strpool.h"
+
+#include <algorithm>
+
+static const char *op_names[] = {
+    "nop", "mov", "add", "sub", "mul", "div", "mod", "neg", "ext",
+    "eq", "ne", "lt", "le", "gt", "ge",
+    "load", "store", "copy", "param", "phi", "arg", "call", "jmp", "br", "ret",
+    "vsplat", "vload", "vstore", "vadd", "vsub", "veq", "vgt", "vand", "vandn", "vor"
+};
+
+static_assert(sizeof(op_names) / sizeof(op_names[0]) == IR_OP_COUNT,
+    "op_names out of sync with IrOp");
+
+const char *ir_op_name(int op)
+{
+    return op >= 0 && op < IR_OP_COUNT ? op_names[op] : "?";
+}
+
+
+Ref IrFunc::imm(int32_t v)
+{
+    if (v >= IMM_MIN && v <= IMM_MAX)
+        return make_ref(RT_IMM, v);
+    consts.push_back(v);
+    return make_ref(RT_CONST, consts.size() - 1);
+}
+
+Ref IrFunc::slot(int size, int align, const string &name, int decl)
+{
+    IrSlot s = {size, align, decl, name};
+    slots.push_back(s);
+    return make_ref(RT_SLOT, slots.size() - 1);
+}
+
+Ref IrFunc::new_block()
+{
+    IrBlock b = {UINT32_MAX, UINT32_MAX};
+    blocks.push_back(b);
+    return make_ref(RT_BLOCK, blocks.size() - 1);
+}
+
+void IrFunc::place(Ref b)
+{
+    if (open)
+        emit(IR_JMP, 0, REF_NONE, b, REF_NONE, loc.empty() ? 0 : loc.back());
+    cur = ref_index(b);
+    blocks[cur].first = count();
+    open = true;
+}
+
+void IrFunc::emit(IrOp o, int sz, Ref rd, Ref ra, Ref rb, uint32_t l)
+{
+    if (!open)
+        place(new_block());
+    op.push_back(o);
+    size.push_back(sz);
+    d.push_back(rd);
+    a.push_back(ra);
+    b.push_back(rb);
+    loc.push_back(l);
+    if (o == IR_JMP || o == IR_BR || o == IR_RET) {
+        blocks[cur].end = count();
+        open = false;
+    }
+}
+
+/**
+ * 功能：补上最后的返回，按块在代码中的位置重新编号
+ * 生成时 for 语句等先建块后放置，编号与代码顺序不一致
+ */
+void IrFunc::finish(uint32_t l)
+{
+    if (open)
+        emit(IR_RET, ret_size, REF_NONE, ret_size ? imm(0) : REF_NONE,
+            REF_NONE, l);
+
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < blocks.size(); i++)
+        if (blocks[i].first != UINT32_MAX)
+            order.push_back(i);
+    std::sort(order.begin(), order.end(), [this](uint32_t x, uint32_t y) {
+        return blocks[x].first < blocks[y].first;
+    });
+    std::vector<uint32_t> remap(blocks.size(), 0);
+    std::vector<IrBlock> nb(order.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        remap[order[i]] = i;
+        nb[i] = blocks[order[i]];
+    }
+    blocks.swap(nb);
+    for (uint32_t i = 0; i < count(); i++) {
+        if (ref_tag(a[i]) == RT_BLOCK)
+            a[i] = make_ref(RT_BLOCK, remap[ref_index(a[i])]);
+        if (ref_tag(b[i]) == RT_BLOCK)
+            b[i] = make_ref(RT_BLOCK, remap[ref_index(b[i])]);
+        if (ref_tag(d[i]) == RT_BLOCK)
+            d[i] = make_ref(RT_BLOCK, remap[ref_index(d[i])]);
+    }
+    cur = -1;
+    // 生成结束后不再追加，释放各数组多分配的空间
+    op.shrink_to_fit();
+    size.shrink_to_fit();
+    d.shrink_to_fit();
+    a.shrink_to_fit();
+    b.shrink_to_fit();
+    loc.shrink_to_fit();
+    blocks.shrink_to_fit();
+}
+
+
+int IrModule::global(const string &name, bool func)
+{
+    auto it = index.find(name);
+    if (it != index.end())
+        return it->second;
+    IrGlobal g = {name, func, false, false, 0, 1, INIT_NONE, 0};
+    index[name] = globals.size();
+    globals.push_back(g);
+    return globals.size() - 1;
+}
+
+void ir_rewrite(IrFunc &f, const IrEdits &e)
+{
+    uint32_t n = f.blocks.size();
+    std::vector<uint32_t> remap(n, UINT32_MAX);
+    uint32_t nb = 0;
+    for (uint32_t bi = 0; bi < n; bi++)
+        if (!e.dead[bi])
+            remap[bi] = nb++;
+
+    IrFunc g;
+    std::vector<IrBlock> blocks(nb);
+    for (uint32_t bi = 0; bi < n; bi++) {
+        if (e.dead[bi])
+            continue;
+        IrBlock &blk = blocks[remap[bi]];
+        blk.first = g.op.size();
+        std::vector<IrInst> insts(e.head[bi]);
+        for (uint32_t i = f.blocks[bi].first; i < f.blocks[bi].end; i++) {
+            if (i == f.blocks[bi].end - 1)
+                insts.insert(insts.end(), e.tail[bi].begin(), e.tail[bi].end());
+            if (f.op[i] != IR_NOP)
+                insts.push_back(f.inst(i));
+        }
+        for (const IrInst &x : insts) {
+            g.op.push_back(x.op);
+            g.size.push_back(x.size);
+            g.d.push_back(x.d);
+            g.a.push_back(x.a);
+            g.b.push_back(x.b);
+            g.loc.push_back(x.loc);
+        }
+        blk.end = g.op.size();
+    }
+
+    auto fix = [&](Ref r) {
+        return ref_tag(r) == RT_BLOCK ? make_ref(RT_BLOCK, remap[ref_index(r)]) : r;
+    };
+    std::vector<Ref> phis;
+    for (uint32_t i = 0; i < g.op.size(); i++) {
+        if (g.op[i] != IR_PHI) {
+            g.a[i] = fix(g.a[i]);
+            g.b[i] = fix(g.b[i]);
+            g.d[i] = fix(g.d[i]);
+            continue;
+        }
+        uint32_t first = f.constant(g.a[i]), cnt = f.constant(g.b[i]);
+        uint32_t at = phis.size();
+        for (uint32_t k = first; k < first + 2 * cnt; k += 2) {
+            if (e.dead[ref_index(f.phis[k])])
+                continue;
+            phis.push_back(fix(f.phis[k]));
+            phis.push_back(f.phis[k + 1]);
+        }
+        g.a[i] = f.imm(at);
+        g.b[i] = f.imm((phis.size() - at) / 2);
+    }
+
+    f.op.swap(g.op);
+    f.size.swap(g.size);
+    f.d.swap(g.d);
+    f.a.swap(g.a);
+    f.b.swap(g.b);
+    f.loc.swap(g.loc);
+    f.blocks.swap(blocks);
+    f.phis.swap(phis);
+}
+
+IrStats IrModule::stats() const
+{
+    IrStats st = {};
+    for (const IrFunc &f : funcs) {
+        st.funcs++;
+        st.insts += f.count();
+        st.blocks += f.blocks.size();
+        st.temps += f.ntemps;
+        st.bytes += f.op.capacity() + f.size.capacity() +
+            (f.d.capacity() + f.a.capacity() + f.b.capacity()) * sizeof(Ref) +
+            f.loc.capacity() * sizeof(uint32_t) +
+            f.blocks.capacity() * sizeof(IrBlock) +
+            f.consts.capacity() * sizeof(int32_t) +
+            f.phis.capacity() * sizeof(Ref);
+    }
+    return st;
+}
+
+
+string ir_ref_str(const IrModule &m, const IrFunc &f, Ref r)
+{
+    uint32_t i = ref_index(r);
+    switch (ref_tag(r)) {
+    case RT_NONE:
+        return "_";
+    case RT_TEMP:
+        return "t" + std::to_string(i);
+    case RT_IMM:
+    case RT_CONST:
+        return std::to_string(f.constant(r));
+    case RT_SLOT: {
+        // 同名的局部变量加上栈槽编号区分
+        const string &n = f.slots[i].name;
+        for (size_t k = 0; k < f.slots.size(); k++)
+            if (k != i && f.slots[k].name == n)
+                return "&" + n + "." + std::to_string(i);
+        return "&" + n;
+    }
+    case RT_GLOBAL:
+        return "@" + m.globals[i].name;
+    case RT_STR:
+        return "str" + std::to_string(i);
+    case RT_BLOCK:
+        return "b" + std::to_string(i);
+    }
+    return "?";
+}
+
+void ir_dump(const IrModule &m, Diagnostics &diag, FILE *fp)
+{
+    for (const IrGlobal &g : m.globals) {
+        if (g.func && g.defined)
+            continue;
+        if (!g.defined) {
+            fprintf(fp, "extern @%s\n", g.name.c_str());
+            continue;
+        }
+        fprintf(fp, "global @%s %d", g.name.c_str(), g.size);
+        if (g.init == INIT_CONST)
+            fprintf(fp, " = %d", g.value);
+        else if (g.init == INIT_STR)
+            fprintf(fp, " = str%d", g.value);
+        fprintf(fp, "\n");
+    }
+    for (size_t i = 0; m.strs && i < m.strs->count(); i++)
+        fprintf(fp, "string str%zu = %s\n", i, m.strs->quoted(i).c_str());
+
+    for (const IrFunc &f : m.funcs) {
+        fprintf(fp, "\nfunc @%s  params %d  slots %zu  temps %u\n",
+            f.name.c_str(), f.nparams, f.slots.size(), f.ntemps);
+        for (size_t i = 0; i < f.slots.size(); i++)
+            fprintf(fp, "    slot %s  %d\n",
+                ir_ref_str(m, f, make_ref(RT_SLOT, i)).c_str(), f.slots[i].size);
+        int last = -1;
+        for (size_t bi = 0; bi < f.blocks.size(); bi++) {
+            fprintf(fp, "b%zu:\n", bi);
+            for (uint32_t i = f.blocks[bi].first; i < f.blocks[bi].end; i++) {
+                int line, col;
+                diag.locate(f.loc[i], line, col);
+                if (line != last)
+                    fprintf(fp, "    ; line %d\n", line);
+                last = line;
+
+                string s = "    ";
+                if (f.op[i] != IR_BR && ref_tag(f.d[i]) != RT_NONE &&
+                    f.op[i] != IR_COPY)
+                    s += ir_ref_str(m, f, f.d[i]) + " = ";
+                s += ir_op_name(f.op[i]);
+                if (f.size[i])
+                    s += "." + std::to_string(f.size[i]);
+                const char *sep = " ";
+                if (f.op[i] == IR_PHI) {
+                    uint32_t first = f.constant(f.a[i]);
+                    uint32_t end = first + 2 * f.constant(f.b[i]);
+                    for (uint32_t k = first; k < end; k += 2) {
+                        s += sep + ("[" + ir_ref_str(m, f, f.phis[k])) + ": " +
+                            ir_ref_str(m, f, f.phis[k + 1]) + "]";
+                        sep = ", ";
+                    }
+                    fprintf(fp, "%s\n", s.c_str());
+                    continue;
+                }
+                if (ref_tag(f.a[i]) != RT_NONE) {
+                    s += sep + ir_ref_str(m, f, f.a[i]);
+                    sep = ", ";
+                }
+                if (ref_tag(f.b[i]) != RT_NONE) {
+                    s += sep + ir_ref_str(m, f, f.b[i]);
+                    sep = ", ";
+                }
+                if (f.op[i] == IR_BR || f.op[i] == IR_COPY)
+                    s += sep + ir_ref_str(m, f, f.d[i]);
+                fprintf(fp, "%s\n", s.c_str());
+            }
+        }
+    }
+}
@@ -0,0 +1,137 @@
+#include "jit.h"
+#include "strpool.h"
+
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+
+#define STUB_BYTES 8        // jmp *got(%rip) 占 6 个字节，补到 8
+
+static size_t align_up(size_t n, size_t a)
+{
+    return (n + a - 1) / a * a;
+}
+
+Jit::~Jit()
+{
+    if (base)
+        munmap(base, size);
+}
+
+/**
+ * 功能：装入模块
+ * 内存依次为代码、跳板、GOT，按页对齐以后是字符串常量、.data 和 .bss。
+ * 代码与数据在同一次映射中，32 位的相对地址总能够到
+ */
+bool Jit::load(const IrModule &m, const X86Object &obj, JitStats &st, string &err)
+{
+    size_t n = m.globals.size();
+    std::vector<int> stub_of(n, -1), got_of(n, -1);
+    int nstubs = 0, ngot = 0;
+    for (const X86Reloc &r : obj.text_relocs) {
+        if (r.sym == SYM_STR)
+            continue;
+        bool undef = obj.sect[r.sym] == XS_UNDEF;
+        if (r.kind == XR_PLT32 && undef && stub_of[r.sym] < 0)
+            stub_of[r.sym] = nstubs++;
+        if ((r.kind == XR_GOTPCREL || (r.kind == XR_PLT32 && undef)) && got_of[r.sym] < 0)
+            got_of[r.sym] = ngot++;
+    }
+
+    long page = sysconf(_SC_PAGESIZE);
+    const string &strs = m.strs->bytes_data();
+    size_t stub_off = align_up(obj.text.size(), 16);
+    size_t got_off = align_up(stub_off + nstubs * STUB_BYTES, 8);
+    size_t code_size = align_up(got_off + ngot * 8, page);
+    size_t data_off = align_up(code_size + strs.size(), obj.data_align);
+    size_t bss_off = align_up(data_off + obj.data.size(), obj.bss_align);
+    size = std::max(align_up(bss_off + obj.bss_size, page), (size_t)page);
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+        -1, 0);
+    if (p == MAP_FAILED) {
+        base = nullptr;
+        err = "can not map memory";
+        return false;
+    }
+    base = (uint8_t *)p;
+    uint8_t *strs_at = base + code_size;
+    memcpy(base, obj.text.data(), obj.text.size());
+    memcpy(strs_at, strs.data(), strs.size());
+    memcpy(base + data_off, obj.data.data(), obj.data.size());
+
+    addr.assign(n, nullptr);
+    for (size_t k = 0; k < n; k++) {
+        switch (obj.sect[k]) {
+        case XS_TEXT:
+            addr[k] = base + obj.off[k];
+            break;
+        case XS_DATA:
+            addr[k] = base + data_off + obj.off[k];
+            break;
+        case XS_BSS:
+            addr[k] = base + bss_off + obj.off[k];
+            break;
+        default:
+            if (got_of[k] < 0)
+                break;
+            addr[k] = (uint8_t *)dlsym(RTLD_DEFAULT, m.globals[k].name.c_str());
+            if (!addr[k]) {
+                err = "undefined symbol '" + m.globals[k].name + "'";
+                return false;
+            }
+            break;
+        }
+    }
+
+    uint8_t *got = base + got_off;
+    for (size_t k = 0; k < n; k++) {
+        if (got_of[k] >= 0)
+            memcpy(got + 8 * got_of[k], &addr[k], 8);
+        if (stub_of[k] >= 0) {
+            uint8_t *s = base + stub_off + STUB_BYTES * stub_of[k];
+            int32_t rel = (int32_t)(got + 8 * got_of[k] - (s + 6));
+            s[0] = 0xff;
+            s[1] = 0x25;
+            memcpy(s + 2, &rel, 4);
+            s[6] = s[7] = 0xcc;
+        }
+    }
+    for (const X86Reloc &r : obj.text_relocs) {
+        uint8_t *at = base + r.off;
+        uint8_t *s = r.sym == SYM_STR ? strs_at : addr[r.sym];
+        if (r.kind == XR_GOTPCREL)
+            s = got + 8 * got_of[r.sym];
+        else if (r.kind == XR_PLT32 && stub_of[r.sym] >= 0)
+            s = base + stub_off + STUB_BYTES * stub_of[r.sym];
+        int64_t rel = (int64_t)(s - at) + r.addend;
+        int32_t v = (int32_t)rel;
+        memcpy(at, &v, 4);
+    }
+    for (const X86Reloc &r : obj.data_relocs) {
+        uint8_t *s = r.sym == SYM_STR ? strs_at : addr[r.sym];
+        uint64_t v = (uint64_t)(uintptr_t)s + r.addend;
+        memcpy(base + data_off + r.off, &v, 8);
+    }
+
+    if (mprotect(base, code_size, PROT_READ | PROT_EXEC) != 0) {
+        err = "can not make the code executable";
+        return false;
+    }
+    st.code_bytes = obj.text.size();
+    st.data_bytes = strs.size() + obj.data.size() + obj.bss_size;
+    st.stubs = nstubs;
+    st.got = ngot;
+    st.relocs = obj.text_relocs.size() + obj.data_relocs.size();
+    st.pages = size / page;
+    return true;
+}
+
+void *Jit::function(const IrModule &m, const string &name) const
+{
+    for (size_t k = 0; k < m.globals.size() && k < addr.size(); k++)
+        if (m.globals[k].func && m.globals[k].defined && m.globals[k].name == name)
+            return addr[k];
+    return nullptr;
+}
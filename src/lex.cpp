@@ -5,6 +5,8 @@
 
 #include <cstdarg>
 #include <cstdlib>
+#include <cstring>
+#include <sstream>
 
 #define BLUE   34
 #define YELLOW 33
@@ -25,10 +27,26 @@ void color_print(char *fmt, ...)
 }
 
 
+static int (*token_color)(Token &token);
+
+
+void set_token_color(int (*color)(Token &token))
+{
+    token_color = color;
+}
+
+
 void _color_token(Token token)
 {
     char fmt[256];
-    if (token.type() >= TokenType::TK_IDENT)  {// 标识符 为白色
+    int c = token_color ? token_color(token) : 0;
+    if (token_color && c == 0) {
+        sprintf(fmt, "%%s");
+    }
+    else if (token_color) {
+        sprintf(fmt, "\033[%dm%%s\033[0m", c);
+    }
+    else if (token.type() >= TokenType::TK_IDENT)  {// 标识符 为白色
         sprintf(fmt, "%%s");
     }
     else if (token.type() >= TokenType::KW_CHAR)  {// 关键字 蓝色 34
@@ -47,16 +65,63 @@ void _color_token(Token token)
 }
 
 
+/* 单词名，下标为单词编码 */
+static const char *tkname[] = {
+    "+", "-", "*", "/", "%", "==", "!=", "!", "<", "<=", ">", ">=", "=",
+    "->", ".", "#", "&", "|", "(", ")", "[", "]", "{", "}", ";", ",",
+    "end of file",
+    "integer constant", "character constant", "string literal",
+    "char", "short", "int", "void", "struct", "if", "else", "for",
+    "continue", "break", "return", "sizeof",
+    "identifier"
+};
+
+const char *token_name(TokenType type) {
+    if (type >= TokenType::TK_IDENT)
+        return tkname[(int)TokenType::TK_IDENT];
+    if ((int)type < 0)
+        return "?";
+    return tkname[(int)type];
+}
+
+
 void Lex::init() {
     this->line_num = 1;
     this->column_num = 0;
+    this->pos = 0;
+    this->limit = src.size();
     this->is_read = false;
+    this->tkvalue = 0;
+    this->recording = false;
+    this->replay_toks = nullptr;
+    this->replay_count = 0;
+    this->replay_pos = 0;
+    this->replay_diags = nullptr;
+    this->replay_ndiags = 0;
+    this->replay_dpos = 0;
 }
 
 Lex::Lex(string filename) {
-    fin.open(filename, std::ios::in | std::ios::binary);
+    ifstream fin(filename, std::ios::in | std::ios::binary);
+    diag.set_source(filename, &src);
     if (!fin.is_open()) {
-        cerr << "Can not open the SC file: " << filename << endl;
+        lex_error(DiagCode::ERR_OPEN_FILE, 0);
+    }
+    else {
+        // 管道等不能定位的输入 tellg 返回 -1，改为经缓冲区整体读入
+        std::streamoff n = fin.seekg(0, std::ios::end).tellg();
+        if (n < 0) {
+            fin.clear();
+            std::ostringstream ss;
+            ss << fin.rdbuf();
+            src = ss.str();
+        }
+        else {
+            src.resize(n);
+            fin.seekg(0, std::ios::beg);
+            fin.read(&src[0], n);
+            src.resize(fin.gcount());
+        }
     }
     init();
 }
@@ -69,21 +134,32 @@ void Lex::color_token() {
     do {
         t = get_token();
         _color_token(t);
-    } while (!fin.eof());
+    } while (!eof());
     printf("\n 代码行数：%d行, 代码列数：%d列\n", line_num, column_num);
 
     cleanup();
-    fin.close();
     #endif
 }
 
 
 void Lex::getch()
 {
-    fin.get(ch);
+    // 越过末尾时 pos 仍然前进，使 ungetch 对称
+    ch = pos < limit ? src[pos] : EOF;
+    pos++;
     column_num ++;
 }
 
+/**
+ * 退回最近取得的一个字符
+ */
+void Lex::ungetch()
+{
+    pos--;
+    column_num--;
+    ch = pos > 0 && pos <= limit ? src[pos - 1] : EOF;
+}
+
 /**
  * 清理工作
  */
@@ -100,10 +176,11 @@ void Lex::cleanup()
 
 
 void Lex::parse_comment() {
+    uint32_t start = pos - 2;
     getch();
     do {
         do {
-            if (ch == '\n' || ch == '*' || ch == EOF)
+            if (ch == '\n' || ch == '*' || eof())
                 break;
             else 
                 getch();
@@ -121,7 +198,7 @@ void Lex::parse_comment() {
             }
         }
         else {
-            cerr << "No End_Of_File found at the end of file." << endl;
+            lex_error(DiagCode::ERR_UNTERM_COMMENT, start);
             return;
         }
     }while(1);
@@ -155,9 +232,7 @@ void Lex::preprocess() {
                 parse_comment();
             }
             else {
-                fin.unget();
-                column_num--;
-                ch = '/';
+                ungetch();
                 break;
             }
         } 
@@ -176,7 +251,7 @@ string Lex::parse_identifier()
     tkstr.push_back(ch);
     getch();
 
-    while (isalnum(ch) || ch == '_')
+    while (isalnum((unsigned char)ch) || ch == '_')
     {
         tkstr.push_back(ch);
         getch();
@@ -187,104 +262,355 @@ string Lex::parse_identifier()
 
 /**
  * 解析整形常量
+ * 0x 开头为十六进制，0 开头为八进制，其余为十进制
+ * 十进制不能超过 int 的范围，十六进制和八进制不能超过 32 位
  */
 string Lex::parse_num()
 {
     string tkstr;
-    do
-    {
+    uint32_t start = pos - 1;
+    uint64_t v = 0;
+    uint64_t max = INT32_MAX;
+    int base = 10;
+    bool overflow = false, digits = false;
+    if (ch == '0') {
         tkstr.push_back(ch);
         getch();
-    } while (isdigit(ch));
-    if (ch =='.')
-    {
-        do
-        {
+        digits = true;
+        base = 8;
+        max = UINT32_MAX;
+        if (ch == 'x' || ch == 'X') {
+            tkstr.push_back(ch);
+            getch();
+            base = 16;
+            digits = false;
+        }
+    }
+    for (;;) {
+        int d;
+        if (isdigit((unsigned char)ch))
+            d = ch - '0';
+        else if (base == 16 && isxdigit((unsigned char)ch))
+            d = (ch | 0x20) - 'a' + 10;
+        else
+            break;
+        if (d >= base)
+            lex_error(DiagCode::ERR_BAD_DIGIT, pos - 1, (unsigned char)ch);
+        v = v * base + d;
+        if (v > max) {
+            overflow = true;
+            v &= UINT32_MAX;
+        }
+        digits = true;
+        tkstr.push_back(ch);
+        getch();
+    }
+    if (overflow)
+        lex_error(DiagCode::ERR_INT_OVERFLOW, start);
+    tkvalue = (int32_t)(uint32_t)v;
+
+    // 不支持浮点数，小数部分并入该单词
+    if (ch == '.') {
+        lex_error(DiagCode::ERR_FLOAT, start);
+        do {
             tkstr.push_back(ch);
             getch();
-        } while (isdigit(ch));   
+        } while (isdigit((unsigned char)ch));
+    }
+    // 0x 之后没有数字，或者数字之后紧跟字母
+    uint32_t suffix = digits ? pos - 1 : pos - 2;
+    if (!digits || isalpha((unsigned char)ch) || ch == '_') {
+        lex_error(DiagCode::ERR_BAD_SUFFIX, suffix, (int)suffix);
+        while (isalnum((unsigned char)ch) || ch == '_') {
+            tkstr.push_back(ch);
+            getch();
+        }
     }
     return tkstr;
 } 
 
+/**
+ * 解析转义字符，ch 为 \ 之后的字符
+ * 返回值：转义得到的字符
+ */
+int Lex::parse_escape()
+{
+    uint32_t start = pos - 2;
+    int c;
+    switch (ch) {
+    case 'n':  c = '\n'; break;
+    case 't':  c = '\t'; break;
+    case 'r':  c = '\r'; break;
+    case 'b':  c = '\b'; break;
+    case 'f':  c = '\f'; break;
+    case 'v':  c = '\v'; break;
+    case 'a':  c = '\a'; break;
+    case '\\': c = '\\'; break;
+    case '\'': c = '\''; break;
+    case '\"': c = '\"'; break;
+    case '?':  c = '?';  break;
+    case 'x': {
+        // 十六进制转义，至少一位
+        int n = 0;
+        c = 0;
+        getch();
+        while (isxdigit((unsigned char)ch)) {
+            c = c * 16 + (isdigit((unsigned char)ch) ? ch - '0' : (ch | 0x20) - 'a' + 10);
+            if (c > 0xff)
+                c = 0x100;
+            n++;
+            getch();
+        }
+        if (n == 0)
+            lex_error(DiagCode::ERR_ILLEGAL_ESCAPE, start, 'x');
+        else if (c > 0xff)
+            lex_error(DiagCode::ERR_ESCAPE_RANGE, start);
+        return c & 0xff;
+    }
+    default:
+        // 八进制转义，至多三位
+        if (ch >= '0' && ch <= '7') {
+            c = 0;
+            for (int n = 0; n < 3 && ch >= '0' && ch <= '7'; n++) {
+                c = c * 8 + ch - '0';
+                getch();
+            }
+            if (c > 0xff)
+                lex_error(DiagCode::ERR_ESCAPE_RANGE, start);
+            return c & 0xff;
+        }
+        c = (unsigned char)ch;
+        lex_error(DiagCode::ERR_ILLEGAL_ESCAPE, start, c);
+        break;
+    }
+    getch();
+    return c;
+}
+
 /**
  * 解析字符常量和字符串常量
  * sep 单引号为 字符常量  双引号为字符串常量
  */
 string Lex::parse_string(char sep)
 {
-    char c;
     string tkstr;
+    uint32_t start = pos - 1;
+    size_t from;
+    bool closed = false;
+    body.clear();
     tkstr.push_back(ch);
     getch();
     for(;;) {
-        if (ch == sep) {
-            tkstr.push_back(ch);
+        if (eof()) {
+            lex_error(DiagCode::ERR_UNTERM_STRING, start, sep);
             break;
         }
-        else if (ch == '\\') {
+        else if (ch == sep) {
             tkstr.push_back(ch);
-            // dynstring_append(&sourcestr, ch);
             getch();
-            // 解析转义字符
-            switch (ch) {
-            case '0':
-                c = '\0';
-                break;
-            case 'b':
-                c = '\b';
-                break;
-            case 'n':
-                c = '\n';
-                break;
-            case '\'':
-                c = '\'';
-                break;
-            case '\"':
-                c = '\"';
-                break;
-            default:
-                c = ch;
-                cerr << "illegal escape character: \'\\" << c << "\'" << endl;
-                break;
-            }
-            // tkstr.push_back(c);
-            tkstr.push_back(ch);
+            closed = true;
+            break;
+        }
+        else if (ch == '\\') {
+            // 单词的拼写保留转义前的原样
+            from = pos - 1;
             getch();
+            body.push_back((char)parse_escape());
+            tkstr.append(src, from, pos - 1 - from);
         }
         else {
+            body.push_back(ch);
             tkstr.push_back(ch);
             getch();
         }
     }
-    getch();
+    if (sep == '\'') {
+        if (body.empty() && closed)
+            lex_error(DiagCode::ERR_EMPTY_CHAR, start);
+        tkvalue = body.empty() ? 0 : (unsigned char)body[0];
+    }
+    else {
+        tkvalue = pool.intern(body.data(), body.size());
+    }
     return tkstr;
 } 
 
 /**
- * 取单词主程序
+ * 功能：从当前的 { 之后快速匹配到对应的 }，不生成单词
+ * 返回值：} 之后的字节偏移，没有匹配的 } 时返回 -1
+ */
+int Lex::skip_block()
+{
+    // 需要查看的字符：括号、换行、注释及引号的开头
+    static bool special[256];
+    if (!special[(unsigned char)'{']) {
+        for (const char *q = "{}\n/\'\""; *q; q++)
+            special[(unsigned char)*q] = true;
+    }
+    const char *p = src.data() + (pos - 1);
+    const char *end = src.data() + limit;
+    int depth = 1;
+
+    while (p < end) {
+        while (p < end && !special[(unsigned char)*p])
+            p++;
+        if (p == end)
+            break;
+        char c = *p++;
+        switch (c) {
+        case '{':
+            depth++;
+            break;
+        case '}':
+            if (--depth == 0) {
+                pos = p - src.data();
+                getch();
+                return pos - 1;
+            }
+            break;
+        case '\n':
+            line_num++;
+            break;
+        case '/':
+            if (p < end && *p == '*') {
+                for (p++; p < end && !(p[0] == '*' && p + 1 < end && p[1] == '/'); p++)
+                    if (*p == '\n')
+                        line_num++;
+                p += 2;
+            }
+            break;
+        case '\'':
+        case '\"':
+            while (p < end && *p != c) {
+                if (*p == '\\')
+                    p++;
+                p++;
+            }
+            p++;
+            break;
+        default:
+            break;
+        }
+    }
+    pos = limit;
+    getch();
+    return -1;
+}
+
+/**
+ * 功能：重新定位到字节偏移 offset 处，分析到 end 为止
+ */
+void Lex::seek(int offset, int end)
+{
+    limit = end < 0 || end > (int)src.size() ? src.size() : end;
+    pos = offset;
+    column_num = 0;
+    getch();
+}
+
+/**
+ * 判断字符能否作为单词的开头
+ */
+bool Lex::is_token_start(char c)
+{
+    return isalnum((unsigned char)c) || c == '_' ||
+        (c != '\0' && strchr("+-/%=!<>.#&|;([{)]},*\'\"", c));
+}
+
+/**
+ * 记录一条词法诊断
+ */
+void Lex::lex_error(DiagCode code, uint32_t offset, int a)
+{
+    diag.report(code, offset, a);
+    if (recording) {
+        Diagnostic d = {code, offset, {a, (int32_t)tokens.size()}};
+        lexdiags.push_back(d);
+    }
+}
+
+/**
+ * 功能：改为从缓存的单词流中取单词
+ */
+void Lex::replay(const PackedToken *toks, size_t n,
+    const Diagnostic *diags, size_t nd)
+{
+    replay_toks = toks;
+    replay_count = n;
+    replay_pos = 0;
+    replay_diags = diags;
+    replay_ndiags = nd;
+    replay_dpos = 0;
+}
+
+/**
+ * 取单词 给到语法分析
+ * 重放时由单词记录和源码还原单词，否则扫描源码
  */
 Token Lex::get_token() {
+    Token t;
+    if (replay_toks) {
+        while (replay_dpos < replay_ndiags &&
+               replay_diags[replay_dpos].args[1] <= (int32_t)replay_pos) {
+            const Diagnostic &d = replay_diags[replay_dpos++];
+            diag.report(d.code, d.offset, d.args[0]);
+        }
+        if (replay_pos < replay_count) {
+            const PackedToken &p = replay_toks[replay_pos++];
+            t.settype((TokenType)p.type);
+            t.setoffset(p.offset);
+            t.setstr(src.substr(p.offset, p.len));
+            t.setvalue(p.value);
+        }
+        else t.setoffset(src.size());
+        return t;
+    }
+    t = scan_token();
+    if (recording) {
+        size_t end = pos - 1 < limit ? pos - 1 : limit;
+        PackedToken p = {(uint32_t)t.type(), (uint32_t)t.offset(),
+            (uint32_t)(end - t.offset()), t.value()};
+        tokens.push_back(p);
+    }
+    return t;
+}
+
+/**
+ * 扫描源码取得一个单词
+ */
+Token Lex::scan_token() {
     Token t;
     string s;
-    if (fin.eof()) {
+    preprocess();
+    // 连续的非法字符只报告一次
+    while (!eof() && !is_token_start(ch)) {
+        lex_error(DiagCode::ERR_ILLEGAL_CHAR, pos - 1, (unsigned char)ch);
+        do {
+            getch();
+        } while (!eof() && !is_token_start(ch) && !isspace((unsigned char)ch));
+        preprocess();
+    }
+    t.setoffset(pos - 1);
+    if (eof()) {
         t.settype(TokenType::TK_EOF);
+        t.setoffset(limit);
         return t;
     }
-    preprocess();
-    if (isalpha(ch) || ch == '_') {
+    if (isalpha((unsigned char)ch) || ch == '_') {
         // TKWord *tp;
         s = parse_identifier();
-        if (keyword2types.find(s) != keyword2types.end())
-            t.settype(keyword2types.at(s));
+        auto kw = keyword2types.find(s);
+        if (kw != keyword2types.end())
+            t.settype(kw->second);
         else
             t.settype(TokenType::TK_IDENT);
         t.setstr(s);
     }
-    else if (isdigit(ch)) {
+    else if (isdigit((unsigned char)ch)) {
         s = parse_num();
         t.settype(TokenType::TK_CINT);
         t.setstr(s);
+        t.setvalue(tkvalue);
     }
     else {
         switch (ch) {
@@ -431,17 +757,17 @@ Token Lex::get_token() {
         case '\'':
             s = parse_string(ch);
             t.settype(TokenType::TK_CCHAR);
+            t.setvalue(tkvalue);
             t.setstr(s);
             // tkvalue = *(char *)tkstr.data;
             break;
         case '\"':
             s = parse_string(ch);
             t.settype(TokenType::TK_CSTR);
+            t.setvalue(tkvalue);
             t.setstr(s);
             break;
         default:
-            cerr << "illegal word! Lexical cannot recognise " << ch << endl;
-            getch();
             break;
         }
     }
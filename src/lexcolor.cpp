@@ -7,7 +7,12 @@
  */ 
 int main(int argc, char const *argv[])
 {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " file" << endl;
+        return 2;
+    }
     Lex lex(argv[1]);
     lex.color_token();
-    return 0;
+    lex.diagnostics().flush(cerr);
+    return lex.diagnostics().errors() ? 1 : 0;
 }
@@ -0,0 +1,335 @@
+#include "opt.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+/* 已知没有副作用的库函数 */
+static const struct {
+    const char *name;
+    bool reads;         // 是否读取参数所指的内存
+} pure_funcs[] = {
+    {"strlen", true},
+    {"strcmp", true},
+    {"strncmp", true},
+    {"memcmp", true},
+    {"abs", false},
+};
+
+/**
+ * 功能：callee 是否为没有副作用的库函数，reads 返回它是否读内存
+ * 只认没有在本单元定义的同名函数
+ */
+static bool pure_call(const IrModule &m, Ref callee, bool &reads)
+{
+    if (ref_tag(callee) != RT_GLOBAL)
+        return false;
+    const IrGlobal &g = m.globals[ref_index(callee)];
+    if (g.defined)
+        return false;
+    for (const auto &p : pure_funcs)
+        if (g.name == p.name) {
+            reads = p.reads;
+            return true;
+        }
+    return false;
+}
+
+/**
+ * 功能：循环中是否有写内存的指令，调用非纯函数也算
+ */
+static bool writes_memory(const IrModule &m, const IrFunc &f, const Loop &l)
+{
+    bool reads;
+    for (uint32_t b : l.blocks)
+        for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++) {
+            if (f.op[i] == IR_STORE || f.op[i] == IR_COPY)
+                return true;
+            if (f.op[i] == IR_CALL && !pure_call(m, f.a[i], reads))
+                return true;
+        }
+    return false;
+}
+
+/**
+ * 功能：把一个循环中的不变指令移到前置块
+ * 算术和比较只要操作数不变就可以移；除法还须除数是非 0、非 -1 的常量，
+ * 以免把原来不执行的除法提前而出错。取数和读内存的纯函数调用还要求
+ * 循环中没有写内存的指令，并且所在块支配循环的每个出口，即只要进入
+ * 循环就一定执行。
+ */
+static void hoist(const IrModule &m, IrFunc &f, const Cfg &g, const DomTree &t,
+    const Loop &l, const std::vector<uint32_t> &defblk, std::vector<char> &inloop,
+    std::vector<char> &moved, IrEdits &e, OptStats &st)
+{
+    for (uint32_t b : l.blocks)
+        inloop[b] = 1;
+    auto invariant = [&](Ref r) {
+        if (ref_tag(r) != RT_TEMP)
+            return true;
+        uint32_t x = ref_index(r);
+        return moved[x] || defblk[x] == UINT32_MAX || !inloop[defblk[x]];
+    };
+
+    bool writes = writes_memory(m, f, l);
+    std::vector<uint32_t> exits;
+    for (uint32_t b : l.blocks)
+        for (const uint32_t *s = g.succ_begin(b); s != g.succ_end(b); s++)
+            if (!inloop[*s]) {
+                exits.push_back(b);
+                break;
+            }
+
+    std::vector<IrInst> &out = e.tail[l.preheader];
+    for (uint32_t b : l.blocks) {
+        bool always = true;
+        for (uint32_t x : exits)
+            always = always && t.dominates(b, x);
+        for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++) {
+            bool ok = false;
+            uint32_t last = i;
+            switch (f.op[i]) {
+            case IR_MOV: case IR_ADD: case IR_SUB: case IR_MUL: case IR_NEG:
+            case IR_EXT: case IR_EQ: case IR_NE: case IR_LT: case IR_LE:
+            case IR_GT: case IR_GE:
+                ok = invariant(f.a[i]) && invariant(f.b[i]);
+                break;
+            case IR_DIV: case IR_MOD:
+                ok = invariant(f.a[i]) && (ref_tag(f.b[i]) == RT_IMM ||
+                    ref_tag(f.b[i]) == RT_CONST) && f.constant(f.b[i]) != 0 &&
+                    f.constant(f.b[i]) != -1;
+                break;
+            case IR_LOAD:
+                ok = always && !writes && invariant(f.a[i]);
+                break;
+            case IR_ARG: {
+                // 实参与调用一起移动
+                while (f.op[last] == IR_ARG)
+                    last++;
+                bool reads;
+                ok = always && pure_call(m, f.a[last], reads) &&
+                    !(reads && writes);
+                for (uint32_t k = i; ok && k < last; k++)
+                    ok = invariant(f.a[k]);
+                break;
+            }
+            case IR_CALL: {
+                bool reads;
+                ok = always && pure_call(m, f.a[i], reads) && !(reads && writes);
+                break;
+            }
+            default:
+                break;
+            }
+            if (!ok) {
+                i = last;
+                continue;
+            }
+            for (uint32_t k = i; k <= last; k++) {
+                out.push_back(f.inst(k));
+                if (ref_tag(f.d[k]) == RT_TEMP)
+                    moved[ref_index(f.d[k])] = 1;
+                st.hoisted += f.op[k] != IR_ARG;
+                f.op[k] = IR_NOP;
+            }
+            i = last;
+        }
+    }
+    for (uint32_t b : l.blocks)
+        inloop[b] = 0;
+}
+
+void licm(const IrModule &m, IrFunc &f, OptStats &st)
+{
+    Cfg g;
+    DomTree t;
+    std::vector<Loop> loops;
+    build_cfg(f, g);
+    build_domtree(g, t);
+    find_loops(g, t, loops);
+    int depth = 0;
+    for (const Loop &l : loops)
+        depth = std::max(depth, l.depth);
+
+    // 由内向外逐层进行，内层移到前置块的指令在外层可以继续外移
+    for (; depth > 0; depth--) {
+        std::vector<uint32_t> defblk(f.ntemps, UINT32_MAX);
+        for (uint32_t b = 0; b < g.nblocks; b++)
+            for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++)
+                if (ref_tag(f.d[i]) == RT_TEMP)
+                    defblk[ref_index(f.d[i])] = b;
+        std::vector<char> inloop(g.nblocks, 0), moved(f.ntemps, 0);
+        IrEdits e(g.nblocks);
+        for (const Loop &l : loops)
+            if (l.depth == depth && l.preheader >= 0)
+                hoist(m, f, g, t, l, defblk, inloop, moved, e, st);
+        ir_rewrite(f, e);
+        if (depth > 1) {
+            build_cfg(f, g);
+            build_domtree(g, t);
+            find_loops(g, t, loops);
+        }
+    }
+}
+
+
+/* 由基本归纳变量派生的指针：base + iv * scale */
+struct DerivedIv {
+    Ref iv;
+    Ref base;
+    int32_t scale;
+};
+
+static bool operator<(const DerivedIv &x, const DerivedIv &y)
+{
+    if (x.iv != y.iv)
+        return x.iv < y.iv;
+    if (x.base != y.base)
+        return x.base < y.base;
+    return x.scale < y.scale;
+}
+
+void strength_reduce(IrFunc &f, OptStats &st)
+{
+    Cfg g;
+    DomTree t;
+    std::vector<Loop> loops;
+    build_cfg(f, g);
+    build_domtree(g, t);
+    find_loops(g, t, loops);
+    if (loops.empty())
+        return;
+
+    std::vector<uint32_t> def(f.ntemps, UINT32_MAX), defblk(f.ntemps, UINT32_MAX);
+    for (uint32_t b = 0; b < g.nblocks; b++)
+        for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++)
+            if (ref_tag(f.d[i]) == RT_TEMP) {
+                def[ref_index(f.d[i])] = i;
+                defblk[ref_index(f.d[i])] = b;
+            }
+    auto is_imm = [&](Ref r) {
+        return ref_tag(r) == RT_IMM || ref_tag(r) == RT_CONST;
+    };
+
+    std::vector<Ref> subst(f.ntemps, REF_NONE);
+    std::vector<char> inloop(g.nblocks, 0);
+    IrEdits e(g.nblocks);
+    for (const Loop &l : loops) {
+        // 只处理有前置块、只有一条回边的循环
+        if (l.preheader < 0 || l.latches.size() != 1)
+            continue;
+        uint32_t latch = l.latches[0];
+        for (uint32_t b : l.blocks)
+            inloop[b] = 1;
+        auto invariant = [&](Ref r) {
+            return ref_tag(r) != RT_TEMP || defblk[ref_index(r)] == UINT32_MAX ||
+                !inloop[defblk[ref_index(r)]];
+        };
+
+        // 首块中形如 i = phi(init, i + c) 的基本归纳变量
+        std::map<Ref, std::pair<Ref, int32_t>> ivs;    // iv -> (init, c)
+        const IrBlock &hb = f.blocks[l.header];
+        for (uint32_t i = hb.first; i < hb.end && f.op[i] == IR_PHI; i++) {
+            if (f.constant(f.b[i]) != 2)
+                continue;
+            uint32_t k = f.constant(f.a[i]);
+            Ref init = REF_NONE, next = REF_NONE;
+            for (uint32_t j = k; j < k + 4; j += 2) {
+                if (ref_index(f.phis[j]) == (uint32_t)l.preheader)
+                    init = f.phis[j + 1];
+                else if (ref_index(f.phis[j]) == latch)
+                    next = f.phis[j + 1];
+            }
+            if (init == REF_NONE || next == REF_NONE || ref_tag(next) != RT_TEMP)
+                continue;
+            uint32_t n = def[ref_index(next)];
+            if (n == UINT32_MAX || f.op[n] != IR_ADD || f.size[n] != 4)
+                continue;
+            Ref step = f.a[n] == f.d[i] ? f.b[n] : f.b[n] == f.d[i] ? f.a[n] : REF_NONE;
+            if (step == REF_NONE || !is_imm(step))
+                continue;
+            ivs[f.d[i]] = std::make_pair(init, f.constant(step));
+        }
+
+        // 循环中的 base + iv * scale 改用新的指针归纳变量
+        std::map<DerivedIv, Ref> made;
+        for (uint32_t b : l.blocks)
+            for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++) {
+                if (f.op[i] != IR_ADD || f.size[i] != 8)
+                    continue;
+                DerivedIv dv = {REF_NONE, f.a[i], 1};
+                Ref y = f.b[i];
+                if (!invariant(dv.base) || ref_tag(y) != RT_TEMP)
+                    continue;
+                if (!ivs.count(y)) {
+                    uint32_t m = def[ref_index(y)];
+                    if (m == UINT32_MAX || f.op[m] != IR_MUL || f.size[m] != 8 ||
+                        !ivs.count(f.a[m]) || !is_imm(f.b[m]))
+                        continue;
+                    y = f.a[m];
+                    dv.scale = f.constant(f.b[m]);
+                }
+                dv.iv = y;
+                const std::pair<Ref, int32_t> &iv = ivs[y];
+                int64_t inc = (int64_t)iv.second * dv.scale;
+                if (inc < IMM_MIN || inc > IMM_MAX)
+                    continue;
+
+                auto it = made.find(dv);
+                if (it == made.end()) {
+                    // 前置块求初值，回边起点递增
+                    Ref p = f.temp(), next = f.temp(), p0 = dv.base;
+                    uint32_t ploc = f.loc[f.blocks[l.preheader].end - 1];
+                    uint32_t lloc = f.loc[f.blocks[latch].end - 1];
+                    if (is_imm(iv.first)) {
+                        int64_t off = (int64_t)f.constant(iv.first) * dv.scale;
+                        if (off) {
+                            p0 = f.temp();
+                            IrInst x = {IR_ADD, 8, p0, dv.base, f.imm(off), ploc};
+                            e.tail[l.preheader].push_back(x);
+                        }
+                    }
+                    else {
+                        Ref off = iv.first;
+                        if (dv.scale != 1) {
+                            off = f.temp();
+                            IrInst x = {IR_MUL, 8, off, iv.first, f.imm(dv.scale), ploc};
+                            e.tail[l.preheader].push_back(x);
+                        }
+                        p0 = f.temp();
+                        IrInst x = {IR_ADD, 8, p0, dv.base, off, ploc};
+                        e.tail[l.preheader].push_back(x);
+                    }
+                    IrInst phi = {IR_PHI, 8, p, f.imm(f.phis.size()), f.imm(2),
+                        f.loc[hb.first]};
+                    f.phis.push_back(make_ref(RT_BLOCK, l.preheader));
+                    f.phis.push_back(p0);
+                    f.phis.push_back(make_ref(RT_BLOCK, latch));
+                    f.phis.push_back(next);
+                    e.head[l.header].push_back(phi);
+                    IrInst x = {IR_ADD, 8, next, p, f.imm(inc), lloc};
+                    e.tail[latch].push_back(x);
+                    it = made.insert(std::make_pair(dv, p)).first;
+                    st.ivs++;
+                }
+                subst[ref_index(f.d[i])] = it->second;
+                f.op[i] = IR_NOP;
+                st.reduced++;
+            }
+        for (uint32_t b : l.blocks)
+            inloop[b] = 0;
+    }
+
+    auto resolve = [&](Ref &r) {
+        if (ref_tag(r) == RT_TEMP && ref_index(r) < subst.size() &&
+            subst[ref_index(r)] != REF_NONE)
+            r = subst[ref_index(r)];
+    };
+    for (uint32_t i = 0; i < f.count(); i++) {
+        resolve(f.a[i]);
+        resolve(f.b[i]);
+    }
+    for (size_t k = 1; k < f.phis.size(); k += 2)
+        resolve(f.phis[k]);
+    ir_rewrite(f, e);
+}
@@ -0,0 +1,444 @@
+#include "opt.h"
+
+#include <algorithm>
+#include <climits>
+
+/**
+ * 功能：按指令的语义计算常量结果，不能计算（如除以 0）时返回 false
+ * size 为 4 的结果截断为 32 位后符号扩展，与运行时一致
+ */
+static bool eval(int op, int size, int64_t x, int64_t y, int64_t &r)
+{
+    uint64_t ux = x, uy = y;
+    int64_t lo = size == 8 ? INT64_MIN : INT32_MIN;
+    switch (op) {
+    case IR_MOV: r = x; return true;
+    case IR_ADD: r = ux + uy; break;
+    case IR_SUB: r = ux - uy; break;
+    case IR_MUL: r = ux * uy; break;
+    case IR_NEG: r = 0 - ux; break;
+    case IR_DIV:
+    case IR_MOD:
+        if (y == 0 || (x == lo && y == -1))
+            return false;
+        r = op == IR_DIV ? x / y : x % y;
+        break;
+    case IR_EXT:
+        r = size == 1 ? (int8_t)x : size == 2 ? (int16_t)x :
+            size == 4 ? (int32_t)x : x;
+        return true;
+    case IR_EQ: r = x == y; return true;
+    case IR_NE: r = x != y; return true;
+    case IR_LT: r = x < y; return true;
+    case IR_LE: r = x <= y; return true;
+    case IR_GT: r = x > y; return true;
+    case IR_GE: r = x >= y; return true;
+    default:
+        return false;
+    }
+    if (size == 4)
+        r = (int32_t)r;
+    return true;
+}
+
+
+/* 格值：未定、常量、不是常量 */
+enum { LAT_TOP, LAT_CONST, LAT_BOTTOM };
+
+struct Lattice {
+    int state;
+    int64_t value;
+};
+
+/**
+ * 功能：对指令读取的每个操作数调用 fn，phi 为其各参数的值
+ */
+template <class F>
+static void each_use(const IrFunc &f, uint32_t i, F fn)
+{
+    if (f.op[i] == IR_PHI) {
+        uint32_t first = f.constant(f.a[i]), cnt = f.constant(f.b[i]);
+        for (uint32_t k = first; k < first + 2 * cnt; k += 2)
+            fn(f.phis[k + 1]);
+        return;
+    }
+    fn(f.a[i]);
+    fn(f.b[i]);
+}
+
+/**
+ * 功能：控制流边 p -> b 在 succ 中的下标
+ */
+static uint32_t edge(const Cfg &g, uint32_t p, uint32_t b)
+{
+    return std::find(g.succ_begin(p), g.succ_end(p), b) - g.succ.data();
+}
+
+void sccp(IrFunc &f, const Cfg &g, OptStats &st)
+{
+    uint32_t n = f.count();
+    std::vector<uint32_t> blk(n);
+    for (uint32_t b = 0; b < g.nblocks; b++)
+        for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++)
+            blk[i] = b;
+
+    // 各临时变量的使用处，压缩行
+    std::vector<uint32_t> use_at(f.ntemps + 1, 0), uses;
+    for (uint32_t i = 0; i < n; i++)
+        each_use(f, i, [&](Ref r) {
+            if (ref_tag(r) == RT_TEMP)
+                use_at[ref_index(r) + 1]++;
+        });
+    for (uint32_t t = 0; t < f.ntemps; t++)
+        use_at[t + 1] += use_at[t];
+    uses.resize(use_at[f.ntemps]);
+    std::vector<uint32_t> fill(use_at.begin(), use_at.end() - 1);
+    for (uint32_t i = 0; i < n; i++)
+        each_use(f, i, [&](Ref r) {
+            if (ref_tag(r) == RT_TEMP)
+                uses[fill[ref_index(r)]++] = i;
+        });
+
+    std::vector<Lattice> lat(f.ntemps, Lattice{LAT_TOP, 0});
+    std::vector<char> exec_block(g.nblocks, 0), exec_edge(g.edges(), 0);
+    std::vector<uint32_t> flow, ssa;
+
+    auto value = [&](Ref r) -> Lattice {
+        switch (ref_tag(r)) {
+        case RT_TEMP:
+            return lat[ref_index(r)];
+        case RT_IMM:
+        case RT_CONST:
+            return Lattice{LAT_CONST, f.constant(r)};
+        default:
+            return Lattice{LAT_BOTTOM, 0};
+        }
+    };
+    auto lower = [&](Ref d, Lattice v) {
+        // 格值只能下降，两个不同的常量相遇即为不是常量
+        Lattice &o = lat[ref_index(d)];
+        if (o.state == LAT_BOTTOM || v.state == LAT_TOP)
+            return;
+        if (o.state == LAT_CONST) {
+            if (v.state == LAT_CONST && v.value == o.value)
+                return;
+            v.state = LAT_BOTTOM;
+        }
+        o = v;
+        ssa.push_back(ref_index(d));
+    };
+    auto reach = [&](uint32_t p, uint32_t b) {
+        uint32_t e = edge(g, p, b);
+        if (!exec_edge[e]) {
+            exec_edge[e] = 1;
+            flow.push_back(e);
+        }
+    };
+    auto visit = [&](uint32_t i) {
+        switch (f.op[i]) {
+        case IR_PHI: {
+            Lattice v = {LAT_TOP, 0};
+            uint32_t first = f.constant(f.a[i]), cnt = f.constant(f.b[i]);
+            for (uint32_t k = first; k < first + 2 * cnt; k += 2) {
+                if (!exec_edge[edge(g, ref_index(f.phis[k]), blk[i])])
+                    continue;
+                Lattice x = value(f.phis[k + 1]);
+                if (x.state == LAT_TOP)
+                    continue;
+                if (v.state == LAT_TOP)
+                    v = x;
+                else if (x.state == LAT_BOTTOM || x.value != v.value)
+                    v.state = LAT_BOTTOM;
+            }
+            lower(f.d[i], v);
+            break;
+        }
+        case IR_JMP:
+            reach(blk[i], ref_index(f.a[i]));
+            break;
+        case IR_BR: {
+            Lattice c = value(f.a[i]);
+            if (c.state != LAT_BOTTOM && c.state != LAT_CONST)
+                break;
+            if (c.state == LAT_BOTTOM || c.value)
+                reach(blk[i], ref_index(f.b[i]));
+            if (c.state == LAT_BOTTOM || !c.value)
+                reach(blk[i], ref_index(f.d[i]));
+            break;
+        }
+        default: {
+            if (ref_tag(f.d[i]) != RT_TEMP)
+                break;
+            Lattice x = value(f.a[i]), y = value(f.b[i]);
+            bool unary = ref_tag(f.b[i]) == RT_NONE;
+            Lattice v = {LAT_BOTTOM, 0};
+            if (x.state == LAT_TOP || (!unary && y.state == LAT_TOP))
+                break;
+            if (x.state == LAT_CONST && (unary || y.state == LAT_CONST) &&
+                eval(f.op[i], f.size[i], x.value, y.value, v.value))
+                v.state = LAT_CONST;
+            lower(f.d[i], v);
+            break;
+        }
+        }
+    };
+
+    // 参数、调用和取数的结果直接是不是常量，由默认分支求得
+    exec_block[0] = 1;
+    for (uint32_t i = f.blocks[0].first; i < f.blocks[0].end; i++)
+        visit(i);
+    while (!flow.empty() || !ssa.empty()) {
+        while (!flow.empty()) {
+            uint32_t b = g.succ[flow.back()];
+            flow.pop_back();
+            bool first = !exec_block[b];
+            exec_block[b] = 1;
+            for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++)
+                if (first || f.op[i] == IR_PHI)
+                    visit(i);
+        }
+        while (!ssa.empty()) {
+            uint32_t t = ssa.back();
+            ssa.pop_back();
+            for (uint32_t k = use_at[t]; k < use_at[t + 1]; k++)
+                if (exec_block[blk[uses[k]]])
+                    visit(uses[k]);
+        }
+    }
+
+    // 代入常量，只代入 32 位以内的
+    auto fold = [&](Ref &r) {
+        if (ref_tag(r) != RT_TEMP)
+            return;
+        const Lattice &v = lat[ref_index(r)];
+        if (v.state == LAT_CONST && v.value >= INT32_MIN && v.value <= INT32_MAX) {
+            r = f.imm(v.value);
+            st.consts++;
+        }
+    };
+    IrEdits e(g.nblocks);
+    for (uint32_t b = 0; b < g.nblocks; b++) {
+        if (!exec_block[b]) {
+            e.dead[b] = 1;
+            st.dead_blocks++;
+            continue;
+        }
+        for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++) {
+            if (f.op[i] == IR_PHI) {
+                // 去掉不可执行的边带来的参数
+                uint32_t first = f.constant(f.a[i]), cnt = f.constant(f.b[i]);
+                uint32_t w = first;
+                for (uint32_t k = first; k < first + 2 * cnt; k += 2) {
+                    if (!exec_edge[edge(g, ref_index(f.phis[k]), b)])
+                        continue;
+                    f.phis[w] = f.phis[k];
+                    f.phis[w + 1] = f.phis[k + 1];
+                    fold(f.phis[w + 1]);
+                    w += 2;
+                }
+                f.b[i] = f.imm((w - first) / 2);
+                continue;
+            }
+            fold(f.a[i]);
+            fold(f.b[i]);
+            if (f.op[i] == IR_BR &&
+                (ref_tag(f.a[i]) == RT_IMM || ref_tag(f.a[i]) == RT_CONST)) {
+                f.op[i] = IR_JMP;
+                f.a[i] = f.constant(f.a[i]) ? f.b[i] : f.d[i];
+                f.b[i] = f.d[i] = REF_NONE;
+                st.branches++;
+            }
+        }
+    }
+    ir_rewrite(f, e);
+}
+
+
+void dce(IrFunc &f, OptStats &st)
+{
+    uint32_t n = f.count();
+    std::vector<uint32_t> def(f.ntemps, UINT32_MAX);
+    for (uint32_t i = 0; i < n; i++)
+        if (ref_tag(f.d[i]) == RT_TEMP)
+            def[ref_index(f.d[i])] = i;
+
+    std::vector<char> live(n, 0);
+    std::vector<uint32_t> work;
+    for (uint32_t i = 0; i < n; i++) {
+        switch (f.op[i]) {
+        case IR_STORE: case IR_COPY: case IR_ARG: case IR_CALL:
+        case IR_JMP: case IR_BR: case IR_RET: case IR_VSTORE:
+            live[i] = 1;
+            work.push_back(i);
+            break;
+        default:
+            break;
+        }
+    }
+    auto mark = [&](Ref r) {
+        if (ref_tag(r) != RT_TEMP)
+            return;
+        uint32_t i = def[ref_index(r)];
+        if (i != UINT32_MAX && !live[i]) {
+            live[i] = 1;
+            work.push_back(i);
+        }
+    };
+    while (!work.empty()) {
+        uint32_t i = work.back();
+        work.pop_back();
+        each_use(f, i, mark);
+    }
+
+    bool any = false;
+    for (uint32_t i = 0; i < n; i++)
+        if (!live[i] && f.op[i] != IR_NOP) {
+            f.op[i] = IR_NOP;
+            st.dead++;
+            any = true;
+        }
+    if (any)
+        ir_rewrite(f, IrEdits(f.blocks.size()));
+}
+
+
+void thread_jumps(IrFunc &f, OptStats &st)
+{
+    uint32_t n = f.blocks.size();
+    std::vector<uint32_t> to(n);
+    for (uint32_t b = 0; b < n; b++) {
+        const IrBlock &blk = f.blocks[b];
+        to[b] = b && blk.end - blk.first == 1 && f.op[blk.first] == IR_JMP ?
+            ref_index(f.a[blk.first]) : b;
+    }
+    // 沿跳转链走到底，空的死循环最多走 n 步
+    auto final = [&](Ref r) {
+        uint32_t b = ref_index(r);
+        for (uint32_t k = 0; k < n && to[b] != b; k++)
+            b = to[b];
+        if (b != ref_index(r))
+            st.threaded++;
+        return make_ref(RT_BLOCK, b);
+    };
+    for (uint32_t b = 0; b < n; b++) {
+        uint32_t i = f.blocks[b].end - 1;
+        if (f.op[i] == IR_JMP)
+            f.a[i] = final(f.a[i]);
+        else if (f.op[i] == IR_BR) {
+            f.b[i] = final(f.b[i]);
+            f.d[i] = final(f.d[i]);
+            if (f.b[i] == f.d[i]) {
+                f.op[i] = IR_JMP;
+                f.a[i] = f.b[i];
+                f.b[i] = f.d[i] = REF_NONE;
+                st.branches++;
+            }
+        }
+    }
+
+    Cfg g;
+    build_cfg(f, g);
+    IrEdits e(n);
+    for (uint32_t b = 0; b < n; b++)
+        if (!g.reachable(b)) {
+            e.dead[b] = 1;
+            st.dead_blocks++;
+        }
+    ir_rewrite(f, e);
+}
+
+
+void merge_blocks(IrFunc &f, OptStats &st)
+{
+    Cfg g;
+    build_cfg(f, g);
+    uint32_t n = f.blocks.size();
+    // 块 c 能否并入以跳转转到它的唯一前驱
+    auto joins = [&](uint32_t c) {
+        if (c == 0 || g.pred_end(c) - g.pred_begin(c) != 1)
+            return false;
+        uint32_t p = *g.pred_begin(c);
+        return p != c && f.op[f.blocks[p].end - 1] == IR_JMP;
+    };
+    IrEdits e(n);
+    bool any = false;
+    for (uint32_t b = 0; b < n; b++) {
+        if (joins(b))
+            continue;
+        // 沿跳转链把各块除转移外的指令接在 b 的转移之前，最后一块的转移代替它
+        uint32_t last = f.blocks[b].end - 1, c = b;
+        while (f.op[last] == IR_JMP && joins(ref_index(f.a[last]))) {
+            c = ref_index(f.a[last]);
+            for (uint32_t i = f.blocks[c].first; i + 1 < f.blocks[c].end; i++)
+                if (f.op[i] != IR_NOP)
+                    e.tail[b].push_back(f.inst(i));
+            last = f.blocks[c].end - 1;
+            e.dead[c] = 1;
+            st.merged++;
+            any = true;
+        }
+        if (c != b)
+            f.set(f.blocks[b].end - 1, f.inst(last));
+    }
+    if (any)
+        ir_rewrite(f, e);
+}
+
+
+/**
+ * 功能：统计指令数及其中的 load、store、条件分支和循环中的指令
+ */
+static void count(const IrFunc &f, OptStats &st, int k)
+{
+    st.insts[k] += f.count();
+    for (uint32_t i = 0; i < f.count(); i++) {
+        st.loads[k] += f.op[i] == IR_LOAD;
+        st.stores[k] += f.op[i] == IR_STORE;
+        st.brs[k] += f.op[i] == IR_BR;
+    }
+    Cfg g;
+    DomTree t;
+    std::vector<Loop> loops;
+    build_cfg(f, g);
+    build_domtree(g, t);
+    find_loops(g, t, loops);
+    for (const Loop &l : loops)
+        if (l.parent < 0)
+            for (uint32_t b : l.blocks)
+                st.loop_insts[k] += f.blocks[b].end - f.blocks[b].first;
+}
+
+void optimize_module(IrModule &m, OptStats &st, const InlineParams &ip)
+{
+    for (IrFunc &f : m.funcs)
+        count(f, st, 0);
+    inline_calls(m, ip, st);
+}
+
+void optimize_function(const IrModule &m, IrFunc &f, OptStats &st, bool vec)
+{
+    Cfg g;
+    DomTree t;
+    build_cfg(f, g);
+    build_domtree(g, t);
+    mem2reg(f, g, t, st);
+    copy_prop(f, st);
+    build_cfg(f, g);
+    sccp(f, g, st);
+    licm(m, f, st);
+    strength_reduce(f, st);
+    dce(f, st);
+    if (vec)
+        vectorize(f, st);
+    leave_ssa(f);
+    thread_jumps(f, st);
+    merge_blocks(f, st);
+    count(f, st, 1);
+}
+
+void optimize(IrModule &m, OptStats &st, const InlineParams &ip, bool vec)
+{
+    optimize_module(m, st, ip);
+    for (IrFunc &f : m.funcs)
+        optimize_function(m, f, st, vec);
+}
@@ -0,0 +1,504 @@
+#include "x86.h"
+
+#include <algorithm>
+
+static const char *rule_names[] = {
+#define PEEP_NAME(x) #x,
+    PEEP_RULES(PEEP_NAME)
+#undef PEEP_NAME
+};
+
+const char *peep_rule_name(int r)
+{
+    return r >= 0 && r < PEEP_COUNT ? rule_names[r] : "?";
+}
+
+typedef uint32_t RegSet;
+
+static RegSet bit(int r)
+{
+    return r < 16 ? 1u << r : 0;
+}
+
+#define CALLER_SAVED (bit(RAX) | bit(RCX) | bit(RDX) | bit(RSI) | bit(RDI) | \
+    bit(R8) | bit(R9) | bit(R10) | bit(R11))
+#define ARG_REGS (bit(RDI) | bit(RSI) | bit(RDX) | bit(RCX) | bit(R8) | bit(R9))
+#define CALLEE_SAVED (bit(RBX) | bit(R12) | bit(R13) | bit(R14) | bit(R15))
+#define FRAME_REGS (bit(RSP) | bit(RBP))    // 始终当作活跃
+
+static bool is_reg(const MOpnd &x, int r = -1)
+{
+    return x.kind == MK_REG && (r < 0 || x.reg == r);
+}
+
+static MOpnd imm_opnd(int64_t v)
+{
+    MOpnd x = {MK_IMM, NOREG, NOREG, 1, 0, 0, v};
+    return x;
+}
+
+static bool same_mem(const MOpnd &x, const MOpnd &y)
+{
+    return x.kind == MK_MEM && y.kind == MK_MEM && x.reg == y.reg &&
+        x.index == y.index && (x.index == NOREG || x.scale == y.scale) &&
+        x.disp == y.disp && (x.reg != RIP || x.sym == y.sym);
+}
+
+static RegSet read_regs(const MOpnd &x)
+{
+    if (x.kind == MK_REG)
+        return bit(x.reg);
+    if (x.kind != MK_MEM)
+        return 0;
+    RegSet s = x.reg != RIP ? bit(x.reg) : 0;
+    if (x.index != NOREG && x.index != RIP)
+        s |= bit(x.index);
+    return s;
+}
+
+/* 内存操作数中用作地址的寄存器 */
+static RegSet addr_regs(const MOpnd &x)
+{
+    return x.kind == MK_MEM ? read_regs(x) : 0;
+}
+
+static int64_t sext(int64_t v, int n)
+{
+    switch (n) {
+    case 1: return (int8_t)v;
+    case 2: return (int16_t)v;
+    case 4: return (int32_t)v;
+    }
+    return v;
+}
+
+static int width_of(int64_t v)
+{
+    return v == (int8_t)v ? 1 : v == (int16_t)v ? 2 : v == (int32_t)v ? 4 : 8;
+}
+
+/**
+ * 功能：指令读取和写入的寄存器
+ * 只写低 8 或 16 位的指令保留其余的位，因此也算读取
+ */
+static void uses_defs(const MInst &x, RegSet &use, RegSet &def)
+{
+    use = def = 0;
+    switch (x.op) {
+    case M_MOV:
+        use = read_regs(x.src) | addr_regs(x.dst);
+        if (is_reg(x.dst)) {
+            def = bit(x.dst.reg);
+            if (x.size < 4)
+                use |= def;
+        }
+        break;
+    case M_MOVSX: case M_MOVZB: case M_LEA:
+        use = x.op == M_LEA ? addr_regs(x.src) : read_regs(x.src);
+        def = bit(x.dst.reg);
+        break;
+    case M_ADD: case M_SUB: case M_IMUL:
+        use = read_regs(x.src) | read_regs(x.dst);
+        def = is_reg(x.dst) ? bit(x.dst.reg) : 0;
+        break;
+    case M_CMP: case M_TEST:
+        use = read_regs(x.src) | read_regs(x.dst);
+        break;
+    case M_NEG: case M_SETCC:
+        use = read_regs(x.dst);
+        def = is_reg(x.dst) ? bit(x.dst.reg) : 0;
+        break;
+    case M_CQO:
+        use = bit(RAX);
+        def = bit(RDX);
+        break;
+    case M_IDIV:
+        use = bit(RAX) | bit(RDX) | read_regs(x.dst);
+        def = bit(RAX) | bit(RDX);
+        break;
+    case M_CALL:
+        // al 为可变参数函数的向量寄存器个数
+        use = ARG_REGS | bit(RAX) | read_regs(x.dst);
+        def = CALLER_SAVED;
+        break;
+    case M_PUSH:
+        use = read_regs(x.dst) | bit(RSP);
+        def = bit(RSP);
+        break;
+    case M_POP:
+        use = bit(RSP);
+        def = bit(RSP) | bit(x.dst.reg);
+        break;
+    case M_LEAVE:
+        use = bit(RBP);
+        def = bit(RSP) | bit(RBP);
+        break;
+    case M_RET:
+        use = bit(RAX) | CALLEE_SAVED | FRAME_REGS;
+        break;
+    default:
+        // SSE2 指令只读通用寄存器：movd 的源和内存操作数的地址
+        if (x.op >= M_MOVDQU)
+            use = read_regs(x.src) | read_regs(x.dst);
+        break;
+    }
+}
+
+/* 一个函数上的规则应用 */
+class Peephole {
+public:
+    Peephole(MFunc &f, PeepStats &st) : c(f.code), st(st) {}
+
+    bool apply(int rule);
+
+private:
+    void liveness();
+    int label_at(int block) const;
+    bool at_label(uint32_t i, int block) const;
+    void drop(uint32_t i) { del[i] = 1; }
+    void hit(int rule) { st.hits[rule]++; changed = true; }
+    void compact();
+
+    void jmp_thread();
+    void jmp_next();
+    void jcc_over_jmp();
+    void unreachable();
+    void store_load();
+    void redundant_ext();
+    void setcc_test();
+    void mov_self();
+    void mov_chain();
+    void dead_def();
+
+    std::vector<MInst> &c;
+    PeepStats &st;
+    std::vector<char> del;
+    std::vector<RegSet> live_out;   // 各指令之后活跃的寄存器
+    std::vector<int> labels;        // 各块的 M_LABEL 的下标
+    bool changed;
+};
+
+int Peephole::label_at(int block) const
+{
+    return block >= 0 && block < (int)labels.size() ? labels[block] : -1;
+}
+
+/**
+ * 功能：第 i 条起连续的标号中是否有块 block 的，即转到 block 是否就是落到 i
+ */
+bool Peephole::at_label(uint32_t i, int block) const
+{
+    for (; i < c.size() && c[i].op == M_LABEL; i++)
+        if (c[i].dst.sym == block)
+            return true;
+    return false;
+}
+
+/**
+ * 功能：逆向迭代求各指令之后活跃的寄存器，rsp 和 rbp 始终活跃
+ */
+void Peephole::liveness()
+{
+    uint32_t n = c.size();
+    std::vector<RegSet> use(n), def(n), live_in(n, 0);
+    for (uint32_t i = 0; i < n; i++)
+        uses_defs(c[i], use[i], def[i]);
+    live_out.assign(n, FRAME_REGS);
+    auto in_at = [&](int i) { return i >= 0 && i < (int)n ? live_in[i] : 0; };
+    for (bool again = true; again; ) {
+        again = false;
+        for (int i = n - 1; i >= 0; i--) {
+            const MInst &x = c[i];
+            RegSet out = FRAME_REGS;
+            if (x.op == M_JMP || x.op == M_JCC)
+                out |= in_at(label_at(x.dst.sym));
+            if (x.op != M_JMP && x.op != M_RET)
+                out |= in_at(i + 1);
+            RegSet in = use[i] | (out & ~def[i]);
+            if (out != live_out[i] || in != live_in[i]) {
+                live_out[i] = out;
+                live_in[i] = in;
+                again = true;
+            }
+        }
+    }
+}
+
+void Peephole::compact()
+{
+    uint32_t w = 0;
+    for (uint32_t i = 0; i < c.size(); i++)
+        if (!del[i])
+            c[w++] = c[i];
+    c.resize(w);
+}
+
+/* 转到的标号之后紧接着一条跳转时，直接转到跳转的目标 */
+void Peephole::jmp_thread()
+{
+    for (uint32_t i = 0; i < c.size(); i++) {
+        if (c[i].op != M_JMP && c[i].op != M_JCC)
+            continue;
+        // 沿跳转链走，成环时不改
+        int to = c[i].dst.sym;
+        std::vector<char> seen(labels.size(), 0);
+        for (;;) {
+            int j = label_at(to);
+            if (j < 0)
+                break;
+            seen[to] = 1;
+            while (j < (int)c.size() && c[j].op == M_LABEL)
+                j++;
+            if (j >= (int)c.size() || c[j].op != M_JMP)
+                break;
+            if (label_at(c[j].dst.sym) >= 0 && seen[c[j].dst.sym]) {
+                to = c[i].dst.sym;
+                break;
+            }
+            to = c[j].dst.sym;
+        }
+        if (to != c[i].dst.sym) {
+            c[i].dst.sym = to;
+            hit(PEEP_jmp_thread);
+        }
+    }
+}
+
+void Peephole::jmp_next()
+{
+    for (uint32_t i = 0; i < c.size(); i++)
+        if ((c[i].op == M_JMP || c[i].op == M_JCC) && at_label(i + 1, c[i].dst.sym)) {
+            drop(i);
+            hit(PEEP_jmp_next);
+        }
+}
+
+/* jcc L1; jmp L2; L1: 改为 jncc L2; L1: */
+void Peephole::jcc_over_jmp()
+{
+    for (uint32_t i = 0; i + 2 < c.size(); i++)
+        if (c[i].op == M_JCC && c[i + 1].op == M_JMP && at_label(i + 2, c[i].dst.sym)) {
+            c[i].cc = (X86Cond)(c[i].cc ^ 1);
+            c[i].dst.sym = c[i + 1].dst.sym;
+            drop(i + 1);
+            hit(PEEP_jcc_over_jmp);
+            i++;
+        }
+}
+
+void Peephole::unreachable()
+{
+    for (uint32_t i = 0; i < c.size(); i++) {
+        if (c[i].op != M_JMP && c[i].op != M_RET)
+            continue;
+        for (i++; i < c.size() && c[i].op != M_LABEL; i++) {
+            drop(i);
+            hit(PEEP_unreachable);
+        }
+        i--;
+    }
+}
+
+/* mov S, M; movsx M, R 改为 movsx S, R，S 为立即数时直接得到扩展后的值 */
+void Peephole::store_load()
+{
+    for (uint32_t i = 0; i + 1 < c.size(); i++) {
+        const MInst &s = c[i];
+        MInst &l = c[i + 1];
+        if (s.op != M_MOV || s.dst.kind != MK_MEM || s.dst.index == RIP ||
+            !same_mem(s.dst, l.src) || !is_reg(l.dst))
+            continue;
+        int n = s.size;
+        bool load = (l.op == M_MOVSX && l.size2 == n) || (l.op == M_MOV && l.size == 8 && n == 8);
+        if (!load)
+            continue;
+        if (s.src.kind == MK_IMM) {
+            l.op = M_MOV;
+            l.size = 8;
+            l.src = imm_opnd(sext(s.src.imm, n));
+        }
+        else if (n == 8) {
+            l.op = M_MOV;
+            l.src = s.src;
+        }
+        else {
+            l.op = M_MOVSX;
+            l.src = s.src;
+        }
+        hit(PEEP_store_load);
+        i++;
+    }
+}
+
+/**
+ * 功能：在块内正向跟踪各寄存器的值在几个字节内符号扩展，
+ * 已在该宽度内的 movsx R, R 删去，movsx S, R 改为传送
+ */
+void Peephole::redundant_ext()
+{
+    int width[16];
+    std::fill(width, width + 16, 8);
+    for (uint32_t i = 0; i < c.size(); i++) {
+        MInst &x = c[i];
+        if (x.op == M_LABEL) {
+            std::fill(width, width + 16, 8);
+            continue;
+        }
+        if (x.op == M_MOVSX && is_reg(x.src) && width[x.src.reg] <= x.size2) {
+            if (x.src.reg == x.dst.reg) {
+                drop(i);
+                hit(PEEP_redundant_ext);
+                continue;
+            }
+            x.op = M_MOV;
+            x.size = 8;
+            hit(PEEP_redundant_ext);
+        }
+        RegSet use, def;
+        uses_defs(x, use, def);
+        int w = 8;
+        if (x.op == M_MOVSX)
+            w = is_reg(x.src) ? std::min<int>(x.size2, width[x.src.reg]) : x.size2;
+        else if (x.op == M_MOVZB)
+            w = 2;
+        else if (x.op == M_MOV && x.size == 8 && is_reg(x.dst))
+            w = x.src.kind == MK_IMM ? width_of(x.src.imm) :
+                is_reg(x.src) ? width[x.src.reg] : 8;
+        for (int r = 0; r < 16; r++)
+            if (def & bit(r))
+                width[r] = 8;
+        if (is_reg(x.dst) && (def & bit(x.dst.reg)))
+            width[x.dst.reg] = w;
+    }
+}
+
+/**
+ * 功能：setcc %al; movzbl %al, %eax; [mov %rax, R;] test R, R; je/jne L
+ * 标志还是比较的结果，去掉 test 后按原条件转移，其余的定值由 dead_def 删去
+ */
+void Peephole::setcc_test()
+{
+    for (uint32_t i = 2; i + 1 < c.size(); i++) {
+        MInst &t = c[i], &j = c[i + 1];
+        if (t.op != M_TEST || !is_reg(t.dst) || !is_reg(t.src, t.dst.reg) ||
+            j.op != M_JCC || (j.cc != CC_E && j.cc != CC_NE))
+            continue;
+        uint32_t k = i - 1;
+        if (!is_reg(t.dst, RAX)) {
+            if (c[k].op != M_MOV || c[k].size != 8 || !is_reg(c[k].dst, t.dst.reg) ||
+                !is_reg(c[k].src, RAX) || k < 2)
+                continue;
+            k--;
+        }
+        if (c[k].op != M_MOVZB || !is_reg(c[k].dst, RAX) || !is_reg(c[k].src, RAX) ||
+            c[k - 1].op != M_SETCC || !is_reg(c[k - 1].dst, RAX))
+            continue;
+        X86Cond cc = c[k - 1].cc;
+        j.cc = j.cc == CC_NE ? cc : (X86Cond)(cc ^ 1);
+        drop(i);
+        hit(PEEP_setcc_test);
+        i++;
+    }
+}
+
+void Peephole::mov_self()
+{
+    for (uint32_t i = 0; i < c.size(); i++)
+        if (c[i].op == M_MOV && c[i].size == 8 && is_reg(c[i].dst) &&
+            is_reg(c[i].src, c[i].dst.reg)) {
+            drop(i);
+            hit(PEEP_mov_self);
+        }
+}
+
+/* I 定值 R1; mov R1, R2，R1 之后不再使用时 I 直接定值 R2 */
+void Peephole::mov_chain()
+{
+    for (uint32_t i = 0; i + 1 < c.size(); i++) {
+        MInst &x = c[i];
+        const MInst &m = c[i + 1];
+        bool full = (x.op == M_MOV && x.size >= 4) || x.op == M_MOVSX ||
+            x.op == M_MOVZB || x.op == M_LEA;
+        if (!full || !is_reg(x.dst) || m.op != M_MOV || m.size != 8 ||
+            !is_reg(m.dst) || !is_reg(m.src, x.dst.reg) || m.dst.reg == x.dst.reg)
+            continue;
+        RegSet both = bit(x.dst.reg) | bit(m.dst.reg);
+        if ((both & FRAME_REGS) || (live_out[i + 1] & bit(x.dst.reg)))
+            continue;
+        x.dst.reg = m.dst.reg;
+        drop(i + 1);
+        hit(PEEP_mov_chain);
+        i++;
+    }
+}
+
+void Peephole::dead_def()
+{
+    for (uint32_t i = 0; i < c.size(); i++) {
+        const MInst &x = c[i];
+        bool pure = x.op == M_MOV || x.op == M_MOVSX || x.op == M_MOVZB ||
+            x.op == M_LEA || x.op == M_SETCC;
+        if (!pure || !is_reg(x.dst) || (bit(x.dst.reg) & FRAME_REGS) ||
+            (live_out[i] & bit(x.dst.reg)))
+            continue;
+        drop(i);
+        hit(PEEP_dead_def);
+    }
+}
+
+/**
+ * 功能：把一条规则应用到整个函数，返回是否有改写
+ * 改写过的位置跳过其窗口，同一遍中不会用到已经过时的活跃信息
+ */
+bool Peephole::apply(int rule)
+{
+    labels.clear();
+    for (uint32_t i = 0; i < c.size(); i++)
+        if (c[i].op == M_LABEL) {
+            int b = c[i].dst.sym;
+            if (b >= (int)labels.size())
+                labels.resize(b + 1, -1);
+            labels[b] = i;
+        }
+    if (rule == PEEP_mov_chain || rule == PEEP_dead_def)
+        liveness();
+    del.assign(c.size(), 0);
+    changed = false;
+    switch (rule) {
+#define PEEP_CASE(x) case PEEP_##x: x(); break;
+    PEEP_RULES(PEEP_CASE)
+#undef PEEP_CASE
+    default:
+        break;
+    }
+    compact();
+    return changed;
+}
+
+static long count_insts(const MFunc &f)
+{
+    long n = 0;
+    for (const MInst &x : f.code)
+        n += x.op != M_LABEL;
+    return n;
+}
+
+void x86_peephole_function(MFunc &f, PeepStats &st)
+{
+    st.before += count_insts(f);
+    Peephole p(f, st);
+    // 每遍只会删去或缩短指令，删去的总数有限，不动点总能到达
+    for (bool any = true; any; ) {
+        any = false;
+        st.passes++;
+        for (int r = 0; r < PEEP_COUNT; r++)
+            any |= p.apply(r);
+    }
+    st.after += count_insts(f);
+}
+
+void x86_peephole(std::vector<MFunc> &funcs, PeepStats &st)
+{
+    for (MFunc &f : funcs)
+        x86_peephole_function(f, st);
+}
@@ -0,0 +1,70 @@
+#include "pool.h"
+
+#include <algorithm>
+#include <thread>
+
+TaskPool::TaskPool(int threads) : nthreads(threads)
+{
+    if (nthreads <= 0)
+        nthreads = std::max(1u, std::thread::hardware_concurrency());
+    queues = std::vector<Queue>(nthreads);
+}
+
+/**
+ * 功能：为第 w 个线程取一个任务，先取自己的，再依次窃取其他线程的
+ */
+bool TaskPool::take(int w, size_t &task, long &steals)
+{
+    {
+        std::lock_guard<std::mutex> g(queues[w].lock);
+        if (!queues[w].tasks.empty()) {
+            task = queues[w].tasks.front();
+            queues[w].tasks.pop_front();
+            return true;
+        }
+    }
+    for (int k = 1; k < nthreads; k++) {
+        Queue &q = queues[(w + k) % nthreads];
+        std::lock_guard<std::mutex> g(q.lock);
+        if (!q.tasks.empty()) {
+            task = q.tasks.back();
+            q.tasks.pop_back();
+            steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::work(int w, const std::function<void(size_t, int)> &task, long &steals)
+{
+    // 任务不会再产生任务，所有队列都空了即可结束
+    size_t i;
+    while (take(w, i, steals))
+        task(i, w);
+}
+
+void TaskPool::run(size_t n, const std::function<void(size_t, int)> &task, PoolStats &st)
+{
+    int used = (int)std::min((size_t)nthreads, n);
+    st.threads = std::max(st.threads, (long)std::max(used, 1));
+    st.tasks += n;
+    if (used <= 1) {
+        for (size_t i = 0; i < n; i++)
+            task(i, 0);
+        return;
+    }
+    for (int w = 0; w < used; w++)
+        for (size_t i = n * w / used; i < n * (w + 1) / used; i++)
+            queues[w].tasks.push_back(i);
+
+    std::vector<long> steals(used, 0);
+    std::vector<std::thread> workers;
+    for (int w = 1; w < used; w++)
+        workers.emplace_back(&TaskPool::work, this, w, std::cref(task), std::ref(steals[w]));
+    work(0, task, steals[0]);
+    for (std::thread &t : workers)
+        t.join();
+    for (long s : steals)
+        st.steals += s;
+}
@@ -0,0 +1,310 @@
+#include "profile.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+uint32_t prof_shape(const IrModule &m, std::vector<uint32_t> &base)
+{
+    uint64_t h = hash_bytes(nullptr, 0);
+    base.assign(1, 1);      // 第 0 项为文件头
+    for (const IrFunc &f : m.funcs) {
+        uint32_t n = f.blocks.size();
+        h = hash_bytes(f.name.data(), f.name.size() + 1, h);
+        h = hash_bytes(&n, sizeof(n), h);
+        for (const IrBlock &b : f.blocks) {
+            uint32_t shape[2] = {b.end - b.first, f.op[b.end - 1]};
+            h = hash_bytes(shape, sizeof(shape), h);
+        }
+        base.push_back(base.back() + 2 * n);
+    }
+    return (uint32_t)(h ^ h >> 32);
+}
+
+/**
+ * 功能：计数加 1 或加 v 的指令，off 为计数在数组中的项号
+ */
+static void bump(IrFunc &f, int prof, uint32_t off, Ref v, std::vector<IrInst> &out,
+    uint32_t loc)
+{
+    Ref p = f.temp(), c = f.temp(), n = f.temp();
+    IrInst code[3] = {
+        {IR_ADD, 8, p, make_ref(RT_GLOBAL, prof), f.imm(8 * off), loc},
+        {IR_LOAD, 8, c, p, REF_NONE, loc},
+        {IR_ADD, 8, n, c, v, loc},
+    };
+    out.insert(out.end(), code, code + 3);
+    IrInst st = {IR_STORE, 8, REF_NONE, p, n, loc};
+    out.push_back(st);
+}
+
+/**
+ * 功能：新建 __df_prof_dump：写入文件头，把整个数组写到剖析文件
+ */
+static IrFunc dump_function(IrModule &m, int prof, uint32_t total, uint32_t sum,
+    int path, int mode)
+{
+    IrFunc d;
+    d.name = PROF_DUMP;
+    d.global = m.global(d.name, true);
+    m.globals[d.global].defined = true;
+    Ref arr = make_ref(RT_GLOBAL, prof);
+    Ref entry = d.new_block(), write = d.new_block(), done = d.new_block();
+    d.place(entry);
+    d.emit(IR_STORE, 4, REF_NONE, arr, d.imm(PROF_MAGIC), 0);
+    Ref at = d.def(IR_ADD, 8, arr, d.imm(4), 0);
+    d.emit(IR_STORE, 4, REF_NONE, at, d.imm((int32_t)sum), 0);
+    d.emit(IR_ARG, 8, REF_NONE, make_ref(RT_STR, path), REF_NONE, 0);
+    d.emit(IR_ARG, 8, REF_NONE, make_ref(RT_STR, mode), REF_NONE, 0);
+    Ref fp = d.def(IR_CALL, 8, make_ref(RT_GLOBAL, m.global("fopen", true)), d.imm(2), 0);
+    Ref fail = d.def(IR_EQ, 8, fp, d.imm(0), 0);
+    d.emit(IR_BR, 0, write, fail, done, 0);
+    d.place(write);
+    d.emit(IR_ARG, 8, REF_NONE, arr, REF_NONE, 0);
+    d.emit(IR_ARG, 8, REF_NONE, d.imm(8), REF_NONE, 0);
+    d.emit(IR_ARG, 8, REF_NONE, d.imm(total), REF_NONE, 0);
+    d.emit(IR_ARG, 8, REF_NONE, fp, REF_NONE, 0);
+    d.emit(IR_CALL, 0, REF_NONE, make_ref(RT_GLOBAL, m.global("fwrite", true)),
+        d.imm(4), 0);
+    d.emit(IR_ARG, 8, REF_NONE, fp, REF_NONE, 0);
+    d.emit(IR_CALL, 0, REF_NONE, make_ref(RT_GLOBAL, m.global("fclose", true)),
+        d.imm(1), 0);
+    d.place(done);
+    d.finish(0);
+    return d;
+}
+
+void prof_instrument(IrModule &m, int path, int mode, bool at_exit, ProfStats &st)
+{
+    std::vector<uint32_t> base;
+    uint32_t sum = prof_shape(m, base);
+    int prof = m.global(PROF_ARRAY, false);
+    IrGlobal &g = m.globals[prof];
+    g.defined = true;
+    g.size = 8 * base.back();
+    g.align = 8;
+    g.init = INIT_NONE;
+    st.counters += base.back() - 1;
+
+    for (size_t k = 0; k < m.funcs.size(); k++) {
+        IrFunc &f = m.funcs[k];
+        IrEdits e(f.blocks.size());
+        for (uint32_t b = 0; b < f.blocks.size(); b++) {
+            uint32_t last = f.blocks[b].end - 1, loc = f.loc[last];
+            // 计数放在转移之前，不会错开块首的形参
+            uint32_t off = base[k] + 2 * b;
+            bump(f, prof, off, f.imm(1), e.tail[b], loc);
+            if (f.op[last] != IR_BR)
+                continue;
+            Ref v = f.a[last];
+            if (ref_tag(v) == RT_TEMP) {
+                Ref t = f.temp();
+                IrInst ne = {IR_NE, 8, t, v, f.imm(0), loc};
+                e.tail[b].push_back(ne);
+                v = t;
+            }
+            else
+                v = f.imm(f.constant(v) != 0);
+            bump(f, prof, off + 1, v, e.tail[b], loc);
+        }
+        if (at_exit && f.name == "main") {
+            IrInst reg[2] = {
+                {IR_ARG, 8, REF_NONE, make_ref(RT_GLOBAL, m.global(PROF_DUMP, true)),
+                    REF_NONE, f.loc[0]},
+                {IR_CALL, 0, REF_NONE, make_ref(RT_GLOBAL, m.global("atexit", true)),
+                    f.imm(1), f.loc[0]},
+            };
+            e.head[0].assign(reg, reg + 2);
+        }
+        ir_rewrite(f, e);
+    }
+    m.funcs.push_back(dump_function(m, prof, base.back(), sum, path, mode));
+}
+
+bool prof_read(const IrModule &m, const string &path, std::vector<uint64_t> &counts,
+    string &err)
+{
+    std::vector<uint32_t> base;
+    uint32_t sum = prof_shape(m, base);
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) {
+        err = "can not open the profile";
+        return false;
+    }
+    counts.assign(base.back() + 1, 0);
+    size_t n = fread(&counts[0], 8, counts.size(), fp);
+    fclose(fp);
+    if (n != base.back() || (uint32_t)counts[0] != PROF_MAGIC ||
+        (uint32_t)(counts[0] >> 32) != sum) {
+        err = "the profile does not match the program, ignored";
+        return false;
+    }
+    counts.pop_back();
+    return true;
+}
+
+/**
+ * 功能：函数的热度，即执行过的块的总次数
+ */
+static uint64_t heat(const uint64_t *counts, size_t nblocks)
+{
+    uint64_t h = 0;
+    for (size_t b = 0; b < nblocks; b++)
+        h += counts[2 * b];
+    return h;
+}
+
+void prof_order_functions(IrModule &m, const std::vector<uint64_t> &counts,
+    std::vector<uint32_t> &base, ProfStats &st)
+{
+    size_t n = m.funcs.size();
+    std::vector<uint64_t> h(n);
+    std::vector<size_t> order(n);
+    for (size_t k = 0; k < n; k++) {
+        h[k] = heat(&counts[base[k]], m.funcs[k].blocks.size());
+        order[k] = k;
+        st.hot += h[k] > 0;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+        return h[x] > h[y];
+    });
+    std::vector<IrFunc> funcs(n);
+    std::vector<uint32_t> nb(n);
+    for (size_t k = 0; k < n; k++) {
+        std::swap(funcs[k], m.funcs[order[k]]);
+        nb[k] = base[order[k]];
+    }
+    m.funcs.swap(funcs);
+    std::copy(nb.begin(), nb.end(), base.begin());
+}
+
+/**
+ * 功能：按 pos 中的位置排列时，根据计数转走的转移次数
+ * 条件转移的一个目标紧接在后时只有转向另一个目标的次数，否则条件转移和
+ * 随后的跳转各计其次数
+ */
+static uint64_t jumps(const IrFunc &f, const uint64_t *counts,
+    const std::vector<uint32_t> &pos)
+{
+    uint64_t n = 0;
+    for (uint32_t b = 0; b < f.blocks.size(); b++) {
+        uint32_t last = f.blocks[b].end - 1;
+        uint64_t c = counts[2 * b], t = std::min(counts[2 * b + 1], c);
+        if (f.op[last] == IR_JMP) {
+            if (pos[ref_index(f.a[last])] != pos[b] + 1)
+                n += c;
+        }
+        else if (f.op[last] == IR_BR) {
+            uint32_t x = ref_index(f.b[last]), y = ref_index(f.d[last]);
+            if (x == y)
+                n += pos[x] != pos[b] + 1 ? c : 0;
+            else if (pos[x] == pos[b] + 1)
+                n += c - t;
+            else
+                n += t + (pos[y] != pos[b] + 1 ? c - t : 0);
+        }
+    }
+    return n;
+}
+
+/**
+ * 功能：按 order 的次序重新排列块并改写对块的引用，order[0] 须为入口
+ */
+static void reorder(IrFunc &f, const std::vector<uint32_t> &order)
+{
+    std::vector<uint32_t> remap(order.size());
+    for (uint32_t k = 0; k < order.size(); k++)
+        remap[order[k]] = k;
+    auto fix = [&](Ref r) {
+        return ref_tag(r) == RT_BLOCK ? make_ref(RT_BLOCK, remap[ref_index(r)]) : r;
+    };
+    IrFunc g;
+    for (uint32_t b : order) {
+        IrBlock blk = {g.count(), 0};
+        for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++) {
+            g.op.push_back(f.op[i]);
+            g.size.push_back(f.size[i]);
+            g.d.push_back(fix(f.d[i]));
+            g.a.push_back(fix(f.a[i]));
+            g.b.push_back(fix(f.b[i]));
+            g.loc.push_back(f.loc[i]);
+        }
+        blk.end = g.count();
+        g.blocks.push_back(blk);
+    }
+    f.op.swap(g.op);
+    f.size.swap(g.size);
+    f.d.swap(g.d);
+    f.a.swap(g.a);
+    f.b.swap(g.b);
+    f.loc.swap(g.loc);
+    f.blocks.swap(g.blocks);
+}
+
+void prof_layout(IrFunc &f, const uint64_t *counts, ProfStats &st)
+{
+    uint32_t n = f.blocks.size();
+    if (counts[0] == 0 || !f.phis.empty())
+        return;
+
+    /* 控制流图的边，w 为按计数得出的执行次数 */
+    struct Edge {
+        uint32_t from, to;
+        uint64_t w;
+    };
+    std::vector<Edge> edges;
+    for (uint32_t b = 0; b < n; b++) {
+        uint32_t last = f.blocks[b].end - 1;
+        uint64_t c = counts[2 * b], t = std::min(counts[2 * b + 1], c);
+        if (f.op[last] == IR_JMP)
+            edges.push_back(Edge{b, ref_index(f.a[last]), c});
+        else if (f.op[last] == IR_BR) {
+            edges.push_back(Edge{b, ref_index(f.b[last]), t});
+            edges.push_back(Edge{b, ref_index(f.d[last]), c - t});
+        }
+    }
+    std::stable_sort(edges.begin(), edges.end(), [](const Edge &x, const Edge &y) {
+        return x.w > y.w;
+    });
+
+    // 每块起初自成一条链，next 与 prev 为链中的后继和前驱
+    std::vector<uint32_t> next(n, UINT32_MAX), prev(n, UINT32_MAX), head(n);
+    for (uint32_t b = 0; b < n; b++)
+        head[b] = b;
+    for (const Edge &e : edges) {
+        if (e.w == 0)
+            break;
+        if (e.to == 0 || e.from == e.to || next[e.from] != UINT32_MAX ||
+            prev[e.to] != UINT32_MAX || head[e.from] == head[e.to])
+            continue;
+        next[e.from] = e.to;
+        prev[e.to] = e.from;
+        for (uint32_t b = e.to; b != UINT32_MAX; b = next[b])
+            head[b] = head[e.from];
+    }
+
+    std::vector<uint32_t> order;
+    for (int pass = 0; pass < 3; pass++)
+        for (uint32_t b = 0; b < n; b++) {
+            // 依次为入口所在的链、其余执行过的链、从未执行的块
+            bool hot = counts[2 * b] > 0;
+            if (prev[b] != UINT32_MAX || (pass == 0) != (b == 0) ||
+                (pass == 1 && !hot) || (pass == 2 && hot))
+                continue;
+            for (uint32_t x = b; x != UINT32_MAX; x = next[x])
+                order.push_back(x);
+        }
+
+    std::vector<uint32_t> pos(n);
+    for (uint32_t b = 0; b < n; b++)
+        pos[b] = b;
+    st.jumps[0] += jumps(f, counts, pos);
+    for (uint32_t k = 0; k < n; k++)
+        pos[order[k]] = k;
+    st.jumps[1] += jumps(f, counts, pos);
+    for (uint32_t b = 0; b < n; b++) {
+        st.moved += pos[b] != b;
+        st.cold += counts[2 * b] == 0;
+    }
+    reorder(f, order);
+}
@@ -0,0 +1,367 @@
+#include "opt.h"
+
+#include <algorithm>
+
+/**
+ * 功能：找出可以提升的栈槽
+ * 标量栈槽的地址只作为同宽度 load、store 的地址出现时才能提升，
+ * 出现在其他位置（取地址、成员或下标运算、作为值存入）都不行。
+ */
+static std::vector<char> promotable(const IrFunc &f)
+{
+    std::vector<char> ok(f.slots.size(), 0);
+    for (size_t s = 0; s < f.slots.size(); s++) {
+        int n = f.slots[s].size;
+        ok[s] = n == 1 || n == 2 || n == 4 || n == 8;
+    }
+    for (uint32_t i = 0; i < f.count(); i++) {
+        Ref r[3] = {f.d[i], f.a[i], f.b[i]};
+        for (int k = 0; k < 3; k++) {
+            if (ref_tag(r[k]) != RT_SLOT)
+                continue;
+            uint32_t s = ref_index(r[k]);
+            bool access = k == 1 && (f.op[i] == IR_LOAD || f.op[i] == IR_STORE) &&
+                f.size[i] == f.slots[s].size;
+            if (!access)
+                ok[s] = 0;
+        }
+    }
+    return ok;
+}
+
+/**
+ * 功能：v 存入 n 个字节再取出时是否不变
+ * 宽度不超过 n 的访存、运算、形参和调用的结果已经是 n 字节内符号扩展的，
+ * 比较的结果只有 0 和 1。
+ */
+static bool fits(const IrFunc &f, const std::vector<uint32_t> &def, Ref v, int n)
+{
+    if (n == 8)
+        return true;
+    if (ref_tag(v) != RT_TEMP || ref_index(v) >= def.size() ||
+        def[ref_index(v)] == UINT32_MAX)
+        return false;
+    uint32_t i = def[ref_index(v)];
+    switch (f.op[i]) {
+    case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+        return true;
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD:
+    case IR_NEG: case IR_EXT: case IR_LOAD: case IR_PARAM: case IR_CALL:
+        return f.size[i] <= n;
+    default:
+        return false;
+    }
+}
+
+/**
+ * 功能：把 v 的低 n 个字节符号扩展
+ */
+static int64_t sext(int64_t v, int n)
+{
+    switch (n) {
+    case 1: return (int8_t)v;
+    case 2: return (int16_t)v;
+    case 4: return (int32_t)v;
+    }
+    return v;
+}
+
+/* 放置的 phi */
+struct PhiSite {
+    uint32_t slot;
+    Ref temp;
+    std::vector<Ref> args;      // 按前驱的顺序
+};
+
+void mem2reg(IrFunc &f, const Cfg &g, const DomTree &t, OptStats &st)
+{
+    std::vector<char> ok = promotable(f);
+    std::vector<uint32_t> slots;
+    for (uint32_t s = 0; s < ok.size(); s++)
+        if (ok[s])
+            slots.push_back(s);
+    if (slots.empty())
+        return;
+    st.promoted += slots.size();
+
+    // 各变量的定值块
+    std::vector<std::vector<uint32_t>> defblocks(f.slots.size());
+    for (uint32_t b : g.rpo)
+        for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++)
+            if (f.op[i] == IR_STORE && ref_tag(f.a[i]) == RT_SLOT &&
+                ok[ref_index(f.a[i])]) {
+                std::vector<uint32_t> &v = defblocks[ref_index(f.a[i])];
+                if (v.empty() || v.back() != b)
+                    v.push_back(b);
+            }
+
+    // 在迭代支配边界放置 phi
+    std::vector<uint32_t> df_at, df;
+    dominance_frontiers(g, t, df_at, df);
+    std::vector<std::vector<PhiSite>> phis(g.nblocks);
+    std::vector<uint32_t> has(g.nblocks, UINT32_MAX), seen(g.nblocks, UINT32_MAX);
+    for (uint32_t s : slots) {
+        std::vector<uint32_t> work(defblocks[s]);
+        for (uint32_t b : work)
+            seen[b] = s;
+        while (!work.empty()) {
+            uint32_t b = work.back();
+            work.pop_back();
+            for (uint32_t k = df_at[b]; k < df_at[b + 1]; k++) {
+                uint32_t y = df[k];
+                if (has[y] == s)
+                    continue;
+                has[y] = s;
+                PhiSite p;
+                p.slot = s;
+                p.temp = f.temp();
+                p.args.assign(g.pred_end(y) - g.pred_begin(y), f.imm(0));
+                phis[y].push_back(p);
+                st.phis++;
+                if (seen[y] != s) {
+                    seen[y] = s;
+                    work.push_back(y);
+                }
+            }
+        }
+    }
+
+    // 临时变量的定值，用于判断存入时是否要截断
+    std::vector<uint32_t> def(f.ntemps, UINT32_MAX);
+    for (uint32_t i = 0; i < f.count(); i++)
+        if (ref_tag(f.d[i]) == RT_TEMP)
+            def[ref_index(f.d[i])] = i;
+
+    // 沿支配树先序重命名，cur 为各变量当前的值，undo 记录进入块前的值
+    std::vector<Ref> cur(f.slots.size(), f.imm(0));
+    std::vector<Ref> subst(f.ntemps, REF_NONE);
+    std::vector<std::pair<uint32_t, Ref>> undo;
+    std::vector<std::pair<uint32_t, size_t>> stack;     // (块, undo 的长度)
+    auto resolve = [&](Ref r) {
+        return ref_tag(r) == RT_TEMP && ref_index(r) < subst.size() &&
+            subst[ref_index(r)] != REF_NONE ?
+            subst[ref_index(r)] : r;
+    };
+    auto assign = [&](uint32_t s, Ref v) {
+        undo.push_back(std::make_pair(s, cur[s]));
+        cur[s] = v;
+    };
+    stack.push_back(std::make_pair(0u, 0));
+    while (!stack.empty()) {
+        uint32_t b = stack.back().first;
+        size_t mark = stack.back().second;
+        stack.pop_back();
+        if (b == UINT32_MAX) {
+            // 离开子树，恢复进入前的值
+            while (undo.size() > mark) {
+                cur[undo.back().first] = undo.back().second;
+                undo.pop_back();
+            }
+            continue;
+        }
+        stack.push_back(std::make_pair(UINT32_MAX, undo.size()));
+
+        for (PhiSite &p : phis[b])
+            assign(p.slot, p.temp);
+        for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++) {
+            f.a[i] = resolve(f.a[i]);
+            f.b[i] = resolve(f.b[i]);
+            bool mine = ref_tag(f.a[i]) == RT_SLOT && ok[ref_index(f.a[i])];
+            if (f.op[i] == IR_LOAD && mine) {
+                subst[ref_index(f.d[i])] = cur[ref_index(f.a[i])];
+                f.op[i] = IR_NOP;
+            }
+            else if (f.op[i] == IR_STORE && mine) {
+                uint32_t s = ref_index(f.a[i]);
+                int n = f.size[i];
+                Ref v = f.b[i];
+                if (ref_tag(v) == RT_IMM || ref_tag(v) == RT_CONST) {
+                    v = f.imm(sext(f.constant(v), n));
+                    f.op[i] = IR_NOP;
+                }
+                else if (fits(f, def, v, n))
+                    f.op[i] = IR_NOP;
+                else {
+                    // 原来由存入完成的截断改为 ext
+                    f.op[i] = IR_EXT;
+                    f.d[i] = f.temp();
+                    f.a[i] = v;
+                    f.b[i] = REF_NONE;
+                    v = f.d[i];
+                    def.resize(f.ntemps, UINT32_MAX);
+                    def[ref_index(v)] = i;
+                    st.exts++;
+                }
+                assign(s, v);
+            }
+        }
+        for (const uint32_t *sp = g.succ_begin(b); sp != g.succ_end(b); sp++) {
+            const uint32_t *pp = std::find(g.pred_begin(*sp), g.pred_end(*sp), b);
+            size_t k = pp - g.pred_begin(*sp);
+            for (PhiSite &p : phis[*sp])
+                p.args[k] = cur[p.slot];
+        }
+        for (uint32_t k = t.child_at[b + 1]; k-- > t.child_at[b]; )
+            stack.push_back(std::make_pair(t.child[k], undo.size()));
+    }
+
+    // phi 插到块首，栈槽的访问已经都删去
+    IrEdits e(g.nblocks);
+    for (uint32_t b = 0; b < g.nblocks; b++) {
+        e.dead[b] = !g.reachable(b);
+        for (PhiSite &p : phis[b]) {
+            IrInst x = {IR_PHI, (uint8_t)f.slots[p.slot].size, p.temp,
+                f.imm(f.phis.size()), f.imm(p.args.size()),
+                f.loc[f.blocks[b].first]};
+            for (size_t k = 0; k < p.args.size(); k++) {
+                f.phis.push_back(make_ref(RT_BLOCK, g.pred[g.pred_at[b] + k]));
+                f.phis.push_back(p.args[k]);
+            }
+            e.head[b].push_back(x);
+        }
+    }
+    ir_rewrite(f, e);
+
+    // 去掉提升了的栈槽，其余的重新编号
+    std::vector<uint32_t> remap(f.slots.size());
+    std::vector<IrSlot> rest;
+    for (uint32_t s = 0; s < f.slots.size(); s++)
+        if (!ok[s]) {
+            remap[s] = rest.size();
+            rest.push_back(f.slots[s]);
+        }
+    f.slots.swap(rest);
+    for (uint32_t i = 0; i < f.count(); i++) {
+        if (ref_tag(f.a[i]) == RT_SLOT)
+            f.a[i] = make_ref(RT_SLOT, remap[ref_index(f.a[i])]);
+        if (ref_tag(f.b[i]) == RT_SLOT)
+            f.b[i] = make_ref(RT_SLOT, remap[ref_index(f.b[i])]);
+    }
+    for (Ref &r : f.phis)
+        if (ref_tag(r) == RT_SLOT)
+            r = make_ref(RT_SLOT, remap[ref_index(r)]);
+}
+
+
+void leave_ssa(IrFunc &f)
+{
+    IrEdits e(f.blocks.size());
+    for (uint32_t i = 0; i < f.count(); i++) {
+        if (f.op[i] != IR_PHI)
+            continue;
+        Ref x = f.temp();
+        uint32_t first = f.constant(f.a[i]), cnt = f.constant(f.b[i]);
+        for (uint32_t k = first; k < first + 2 * cnt; k += 2) {
+            uint32_t p = ref_index(f.phis[k]);
+            IrInst c = {IR_MOV, f.size[i], x, f.phis[k + 1], REF_NONE,
+                f.loc[f.blocks[p].end - 1]};
+            e.tail[p].push_back(c);
+        }
+        f.op[i] = IR_MOV;
+        f.a[i] = x;
+        f.b[i] = REF_NONE;
+    }
+    f.phis.clear();
+    ir_rewrite(f, e);
+}
+
+
+/**
+ * 功能：常量在几个字节内符号扩展
+ */
+static int width_of(int64_t v)
+{
+    return v == (int8_t)v ? 1 : v == (int16_t)v ? 2 : v == (int32_t)v ? 4 : 8;
+}
+
+void copy_prop(IrFunc &f, OptStats &st)
+{
+    uint32_t n = f.count();
+    std::vector<uint32_t> def(f.ntemps, UINT32_MAX);
+    for (uint32_t i = 0; i < n; i++)
+        if (ref_tag(f.d[i]) == RT_TEMP)
+            def[ref_index(f.d[i])] = i;
+
+    // 各临时变量的宽度，取决于其他临时变量的 phi、mov、ext 从 1 开始只增不减，
+    // 循环中互相依赖时也能到达不动点
+    std::vector<uint8_t> width(f.ntemps, 8);
+    for (uint32_t i = 0; i < n; i++)
+        if ((f.op[i] == IR_PHI || f.op[i] == IR_MOV || f.op[i] == IR_EXT) &&
+            ref_tag(f.d[i]) == RT_TEMP)
+            width[ref_index(f.d[i])] = 1;
+    auto width_ref = [&](Ref r) -> int {
+        switch (ref_tag(r)) {
+        case RT_TEMP:
+            return width[ref_index(r)];
+        case RT_IMM: case RT_CONST:
+            return width_of(f.constant(r));
+        default:
+            return 8;
+        }
+    };
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (uint32_t i = 0; i < n; i++) {
+            if (ref_tag(f.d[i]) != RT_TEMP)
+                continue;
+            int w = 8;
+            switch (f.op[i]) {
+            case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+                w = 1;
+                break;
+            case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD:
+            case IR_NEG: case IR_LOAD: case IR_PARAM: case IR_CALL:
+                w = f.size[i] ? f.size[i] : 8;
+                break;
+            case IR_EXT:
+                w = std::min<int>(f.size[i], width_ref(f.a[i]));
+                break;
+            case IR_MOV:
+                w = width_ref(f.a[i]);
+                break;
+            case IR_PHI: {
+                uint32_t first = f.constant(f.a[i]), cnt = f.constant(f.b[i]);
+                w = 1;
+                for (uint32_t k = first; k < first + 2 * cnt; k += 2)
+                    w = std::max(w, width_ref(f.phis[k + 1]));
+                break;
+            }
+            default:
+                break;
+            }
+            uint8_t &x = width[ref_index(f.d[i])];
+            if (w > x) {
+                x = w;
+                changed = true;
+            }
+        }
+    }
+
+    std::vector<Ref> subst(f.ntemps, REF_NONE);
+    bool any = false;
+    for (uint32_t i = 0; i < n; i++) {
+        bool copy = f.op[i] == IR_MOV ||
+            (f.op[i] == IR_EXT && width_ref(f.a[i]) <= f.size[i]);
+        if (copy && ref_tag(f.d[i]) == RT_TEMP) {
+            subst[ref_index(f.d[i])] = f.a[i];
+            f.op[i] = IR_NOP;
+            st.copies++;
+            any = true;
+        }
+    }
+    if (!any)
+        return;
+    // 复制链一直追到不是复制的源
+    auto resolve = [&](Ref r) {
+        while (ref_tag(r) == RT_TEMP && subst[ref_index(r)] != REF_NONE)
+            r = subst[ref_index(r)];
+        return r;
+    };
+    for (uint32_t i = 0; i < n; i++) {
+        f.a[i] = resolve(f.a[i]);
+        f.b[i] = resolve(f.b[i]);
+    }
+    for (size_t k = 1; k < f.phis.size(); k += 2)
+        f.phis[k] = resolve(f.phis[k]);
+    ir_rewrite(f, IrEdits(f.blocks.size()));
+}
@@ -0,0 +1,173 @@
+#include "strpool.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+StrPool::StrPool() : slots(64, -1)
+{
+    st.interns = st.bytes = st.merged = 0;
+}
+
+uint32_t StrPool::hash(const char *s, size_t n) const
+{
+    return (uint32_t)hash_bytes(s, n);
+}
+
+/**
+ * 功能：散列表加倍，各编号重新散列
+ */
+void StrPool::grow()
+{
+    slots.assign(slots.size() * 2, -1);
+    size_t mask = slots.size() - 1;
+    for (size_t id = 0; id < entries.size(); id++) {
+        size_t i = hashes[id] & mask;
+        while (slots[i] >= 0)
+            i = (i + 1) & mask;
+        slots[i] = id;
+    }
+}
+
+/**
+ * 功能：查找相同内容的字符串，没有时追加到 data
+ */
+int StrPool::intern(const char *s, size_t n)
+{
+    st.interns++;
+    st.bytes += n + 1;
+    size_t mask = slots.size() - 1;
+    uint32_t h = hash(s, n);
+    size_t i = h & mask;
+    for (; slots[i] >= 0; i = (i + 1) & mask) {
+        const StrEntry &e = entries[slots[i]];
+        if (hashes[slots[i]] == h && e.len == n &&
+            memcmp(data.data() + e.off, s, n) == 0)
+            return slots[i];
+    }
+    StrEntry e;
+    e.off = data.size();
+    e.len = n;
+    data.append(s, n);
+    data.push_back('\0');
+    slots[i] = entries.size();
+    entries.push_back(e);
+    hashes.push_back(h);
+    // 装填因子不超过 1/2
+    if (entries.size() * 2 > slots.size())
+        grow();
+    return entries.size() - 1;
+}
+
+/**
+ * 功能：尾部合并
+ * 按从尾到头的字典序排序后，是某个字符串尾部的字符串紧排在它之前，
+ * 于是从后往前扫一遍，每个字符串只需与上一个保留下来的比较
+ */
+void StrPool::merge_tails()
+{
+    std::vector<int> order(entries.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    const char *d = data.data();
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        const StrEntry &x = entries[a], &y = entries[b];
+        uint32_t n = std::min(x.len, y.len);
+        for (uint32_t k = 1; k <= n; k++) {
+            unsigned char cx = d[x.off + x.len - k], cy = d[y.off + y.len - k];
+            if (cx != cy)
+                return cx < cy;
+        }
+        return x.len < y.len;
+    });
+
+    string out;
+    out.reserve(data.size());
+    std::vector<StrEntry> ne(entries);
+    int host = -1;
+    st.merged = 0;
+    for (size_t i = order.size(); i-- > 0; ) {
+        const StrEntry &e = entries[order[i]];
+        if (host >= 0) {
+            const StrEntry &h = entries[host];
+            if (e.len <= h.len &&
+                memcmp(d + e.off, d + h.off + h.len - e.len, e.len) == 0) {
+                ne[order[i]].off = ne[host].off + h.len - e.len;
+                st.merged++;
+                continue;
+            }
+        }
+        host = order[i];
+        ne[host].off = out.size();
+        out.append(d + e.off, e.len);
+        out.push_back('\0');
+    }
+    data.swap(out);
+    entries.swap(ne);
+}
+
+string StrPool::quoted(int id) const
+{
+    string s = "\"";
+    const char *p = str(id);
+    char buf[8];
+    for (size_t i = 0; i < length(id); i++) {
+        unsigned char c = p[i];
+        switch (c) {
+        case '\n': s += "\\n"; break;
+        case '\t': s += "\\t"; break;
+        case '\r': s += "\\r"; break;
+        case '\\': s += "\\\\"; break;
+        case '"':  s += "\\\""; break;
+        default:
+            // 一律写三位八进制，以免与后面的数字连在一起
+            if (c < 0x20 || c >= 0x7f) {
+                snprintf(buf, sizeof(buf), "\\%03o", c);
+                s += buf;
+            }
+            else
+                s.push_back(c);
+        }
+    }
+    return s + "\"";
+}
+
+void StrPool::save(string &out) const
+{
+    uint32_t n = entries.size();
+    out.append((const char *)&n, sizeof(n));
+    out.append((const char *)entries.data(), n * sizeof(StrEntry));
+    out += data;
+}
+
+/**
+ * 功能：恢复保存的池，检查各字符串是否越界
+ */
+bool StrPool::load(const char *p, size_t n)
+{
+    uint32_t cnt;
+    if (n < sizeof(cnt))
+        return false;
+    memcpy(&cnt, p, sizeof(cnt));
+    if (cnt > (n - sizeof(cnt)) / sizeof(StrEntry))
+        return false;
+    size_t head = sizeof(cnt) + (size_t)cnt * sizeof(StrEntry);
+    std::vector<StrEntry> v(cnt);
+    memcpy(v.data(), p + sizeof(cnt), cnt * sizeof(StrEntry));
+    size_t size = n - head;
+    for (const StrEntry &e : v)
+        if ((uint64_t)e.off + e.len >= size)
+            return false;
+    entries.swap(v);
+    data.assign(p + head, size);
+    hashes.resize(entries.size());
+    for (size_t id = 0; id < entries.size(); id++)
+        hashes[id] = hash(str(id), entries[id].len);
+    size_t cap = 64;
+    while (cap < entries.size() * 2)
+        cap *= 2;
+    slots.assign(cap / 2, -1);
+    grow();
+    return true;
+}
@@ -0,0 +1,111 @@
+#include "symbol.h"
+#include "hash.h"
+
+#define INIT_SLOTS 256
+
+SymTable::SymTable() : slots(INIT_SLOTS), used(0)
+{
+    for (Slot &s : slots)
+        s.sym = -1;
+    st.pushes = st.lookups = st.found = st.probes = st.rehashes = 0;
+    st.max_level = 0;
+}
+
+/**
+ * 散列值的最低位区分名字空间
+ */
+static uint32_t sym_hash(const string &name, bool tag)
+{
+    uint64_t h = hash_bytes(name.data(), name.size());
+    return ((uint32_t)(h ^ (h >> 32)) & ~1u) | (tag ? 1 : 0);
+}
+
+int SymTable::probe(const string &name, uint32_t h, long &n)
+{
+    size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    while (1) {
+        n++;
+        const Slot &s = slots[i];
+        if (s.sym < 0)
+            return i;
+        if (s.hash == h && syms[s.sym].name == name)
+            return i;
+        i = (i + 1) & mask;
+    }
+}
+
+void SymTable::rehash()
+{
+    st.rehashes++;
+    slots.assign(slots.size() * 2, Slot{0, -1});
+    long n = 0;
+    // 按定义顺序插入，每个槽最终留下最内层的符号，prev 链不变
+    for (size_t k = 0; k < syms.size(); k++) {
+        Symbol &s = syms[k];
+        int i = probe(s.name, s.hash, n);
+        slots[i].hash = s.hash;
+        slots[i].sym = k;
+        s.slot = i;
+    }
+}
+
+int SymTable::push(const string &name, int type, int sc, int offset)
+{
+    st.pushes++;
+    Symbol s;
+    s.name = name;
+    s.type = type;
+    s.sc = sc;
+    s.level = level();
+    s.offset = offset;
+    s.prev = -1;
+    s.init = INIT_NONE;
+    s.value = 0;
+    s.ir = -1;
+    s.hash = sym_hash(name, sc == SC_STRUCT);
+    int k = syms.size();
+    if ((used + 1) * 2 > (int)slots.size())
+        rehash();
+    long n = 0;
+    int i = probe(name, s.hash, n);
+    if (slots[i].sym < 0)
+        used++;
+    s.prev = slots[i].sym;
+    s.slot = i;
+    slots[i].hash = s.hash;
+    slots[i].sym = k;
+    syms.push_back(s);
+    return k;
+}
+
+int SymTable::find(const string &name, bool tag)
+{
+    st.lookups++;
+    int k = slots[probe(name, sym_hash(name, tag), st.probes)].sym;
+    if (k >= 0)
+        st.found++;
+    return k;
+}
+
+void SymTable::enter_scope()
+{
+    marks.push_back(syms.size());
+    if (level() > st.max_level)
+        st.max_level = level();
+}
+
+void SymTable::leave_scope()
+{
+    if (marks.empty())
+        return;
+    int top = marks.back();
+    marks.pop_back();
+    for (int k = syms.size() - 1; k >= top; k--) {
+        const Symbol &s = syms[k];
+        slots[s.slot].sym = s.prev;
+        if (s.prev < 0)
+            used--;
+    }
+    syms.resize(top);
+}
@@ -1,8 +1,30 @@
 #include "syntax.h"
 
 
+/* 函数内的同步单词：FOLLOW(statement) 中能安全重新开始分析的单词 */
+static const TokenSet SYNC_STMT =
+    TKSET(TokenType::TK_SEMICOLON) | TKSET(TokenType::TK_END) |
+    TKSET(TokenType::TK_BEGIN) | TKSET(TokenType::KW_IF) |
+    TKSET(TokenType::KW_FOR) | TKSET(TokenType::KW_RETURN) |
+    TKSET(TokenType::KW_BREAK) | TKSET(TokenType::KW_CONTINUE) |
+    TKSET(TokenType::TK_EOF);
+
+/* 顶层的同步单词：FOLLOW(external_declaration) 即类型区分符，以及 ; */
+static const TokenSet SYNC_DECL =
+    TKSET(TokenType::TK_SEMICOLON) | TKSET(TokenType::KW_CHAR) |
+    TKSET(TokenType::KW_SHORT) | TKSET(TokenType::KW_INT) |
+    TKSET(TokenType::KW_VOID) | TKSET(TokenType::KW_STRUCT) |
+    TKSET(TokenType::TK_EOF);
+
+
 Syntax::Syntax(string filename) 
-    : lex(filename), is_read(false), syntax_state(SNTX_NUL), syntax_level(0) {}
+    : lex(filename), is_read(false), syntax_state(SNTX_NUL), syntax_level(0),
+      panic(false), tkcount(0), echo(true), lazy_body(false),
+      decl_offset(0), end_offset(0), want_xref(false), func_ret(T_UNKNOWN),
+      lower(false), fn(nullptr) {
+    diagnostics().set_type_namer([this](int t) { return typetab.name(t); });
+    irmod.strs = &lex.strings();
+}
 
 Syntax::~Syntax() {
 
@@ -17,6 +39,7 @@ Token Syntax::next_token() {
         is_read = true;
     }
     token = lex.get_token();
+    tkcount++;
     syntax_indent();
     return token;
 } 
@@ -27,20 +50,75 @@ Token Syntax::next_token() {
  * c 要跳过的单词
 */
 void Syntax::skip(TokenType c) {
-    if (token.type() != c)
-        cerr << "lack of "<< (int)c << endl;
+    if (token.type() != c) {
+        error(DiagCode::ERR_EXPECT, (int)c, (int)token.type());
+        synchronize(TKSET(c));
+        if (token.type() != c)
+            return;
+    }
     next_token();
 }
 
+/**
+ * 功能：在 offset 处记录一条语法错误
+ * offset 缺省为当前单词的位置
+ */
+void Syntax::error(DiagCode code, int a0, int a1, int offset) {
+    if (panic)
+        return;
+    panic = true;
+    if (offset < 0)
+        offset = token.offset();
+    lex.diagnostics().report(code, offset, a0, a1);
+}
+
+/**
+ * 功能：在 offset 处记录一条类型错误
+ */
+void Syntax::type_error(DiagCode code, int a0, int a1, int offset) {
+    if (panic)
+        return;
+    if (offset < 0)
+        offset = token.offset();
+    lex.diagnostics().report(code, offset, a0, a1);
+}
+
+/**
+ * 功能：出错后跳过单词，直到遇到同步单词
+ * follow：调用者额外希望停下的单词
+ */
+void Syntax::synchronize(TokenSet follow) {
+    TokenSet sync = (syntax_level > 0 ? SYNC_STMT : SYNC_DECL) | follow;
+    int depth = 0;      // 跳过的 { } 层数
+
+    while (token.type() != TokenType::TK_EOF) {
+        if (depth == 0 && (TKSET(token.type()) & sync))
+            break;
+        if (token.type() == TokenType::TK_BEGIN)
+            depth++;
+        else if (token.type() == TokenType::TK_END && depth > 0)
+            depth--;
+        next_token();
+    }
+}
+
 /**
  * 功能：翻译单元，语法分析顶层
  * <translation_unit> ::= {<external_declaration>}<TK_EOF>
  */
 void Syntax::translation_unit()  {
     next_token();
-    while(token.type() != TokenType::TK_EOF) {
+    // 达到错误上限后不再继续分析
+    while(token.type() != TokenType::TK_EOF && !diagnostics().full()) {
+        long n = tkcount;
+        panic = false;      // 每个外部声明开始时已重新同步
         external_declaration(SC_GLOBAL);
+        if (tkcount == n)
+            next_token();
     }
+    // 生成中间代码时各后端都直接输出常量池，先合并尾部相同的字符串
+    if (lower)
+        lex.strings().merge_tails();
 }
 
 
@@ -54,26 +132,83 @@ void Syntax::translation_unit()  {
  *       {<TK_COMMA><declarator>[<TK_ASSIGN><initializer>]}<TK_SEMICOLON>)
  */
 void Syntax::external_declaration(int l) {
-    if(!type_specifier()) {
-        cerr << "<type id>" << endl;
+    int btype, t;
+    if(!type_specifier(btype)) {
+        error(DiagCode::ERR_TYPE_EXPECTED, (int)token.type());
+        synchronize();
+        if (token.type() == TokenType::TK_SEMICOLON)
+            next_token();
+        return;
     }
     if (token.type() == TokenType::TK_SEMICOLON) {
         next_token();
         return ;
     }
     while (1) {
-        declarator();
+        t = btype;
+        declarator(t);
+        // 函数先于函数体加入，以便递归调用
+        int sym = -1;
+        if (!decl_name.empty())
+            sym = symtab.push(decl_name, t, decl_func ? SC_GLOBAL : l, decl_offset);
+        if (lower && sym >= 0 && (decl_func || l == SC_GLOBAL))
+            declare_global(sym, !decl_func);
+        else if (fn && sym >= 0) {
+            // 每个局部变量一个栈槽
+            int size = typetab.size(t);
+            symtab[sym].ir = ref_index(fn->slot(size < 0 ? 0 : size,
+                typetab.align(t), decl_name, decl_offset));
+        }
+        if (decl_func)
+            add_xref(token.type() == TokenType::TK_BEGIN ? XR_FUNC_DEF :
+                XR_FUNC_DECL, decl_name, decl_offset);
+        else
+            add_xref(l == SC_GLOBAL ? XR_GLOBAL : XR_LOCAL, decl_name, decl_offset);
+        int ol = -1;        // 顶层声明在大纲中的下标
+        if (l == SC_GLOBAL && !decl_name.empty()) {
+            OutlineEntry e = {decl_func ? OL_PROTO : OL_VAR, decl_name,
+                decl_offset, -1, -1};
+            ol = outlines.size();
+            outlines.push_back(e);
+        }
         if (token.type() == TokenType::TK_BEGIN) {
             if (l == SC_LOCAL) {
-                cerr << "nested func declarator unsupported." <<endl;
+                error(DiagCode::ERR_NESTED_FUNC);
+            }
+            if (ol >= 0) {
+                outlines[ol].kind = OL_FUNC;
+                outlines[ol].body_begin = token.offset();
+            }
+            if (ol >= 0 && lazy_body)
+                skip_funcbody(outlines[ol]);
+            else {
+                func_ret = typetab[t].kind == T_FUNC ? typetab[t].ref : T_UNKNOWN;
+                // 嵌套的函数定义已报错，不另外生成
+                bool gen = lower && l == SC_GLOBAL && sym >= 0;
+                if (gen) {
+                    irmod.funcs.push_back(IrFunc());
+                    fn = &irmod.funcs.back();
+                    fn->name = decl_name;
+                    fn->global = symtab[sym].ir;
+                    irmod.globals[fn->global].defined = true;
+                    fn->ret_size = func_ret >= 0 && func_ret != T_VOID ?
+                        mem_size(func_ret) : 0;
+                    fn->place(fn->new_block());
+                }
+                funcbody();
+                if (gen) {
+                    fn->finish(end_offset - 1);
+                    fn = nullptr;
+                }
+                if (ol >= 0)
+                    outlines[ol].body_end = end_offset;
             }
-            funcbody();
             break;
         }
         else {
             if (token.type() == TokenType::TK_ASSIGN) {
                 next_token();
-                initializer();
+                initializer(t, sym);
             }
             if (token.type() == TokenType::TK_COMMA) {
                 next_token();
@@ -93,25 +228,29 @@ void Syntax::external_declaration(int l) {
  * <type_specifier>
  *  --> <KW_INT>|<KW_CHAR>|<KW_SHORT>|<KW_VOID>|<struct_specifier>
  */
-int Syntax::type_specifier() {
+int Syntax::type_specifier(int &t) {
     bool type_found = false;
     switch (token.type()) {
     case TokenType::KW_CHAR:
+        t = typetab.basic(T_CHAR);
         type_found = true;
         syntax_state = SNTX_SP;
         next_token();
         break;
     case TokenType::KW_SHORT:
+        t = typetab.basic(T_SHORT);
         type_found = true;
         syntax_state = SNTX_SP;
         next_token();
         break;
     case TokenType::KW_VOID:
+        t = typetab.basic(T_VOID);
         type_found = true;
         syntax_state = SNTX_SP;
         next_token();
         break;
     case TokenType::KW_INT:
+        t = typetab.basic(T_INT);
         type_found = true;
         syntax_state = SNTX_SP;
         next_token();
@@ -119,10 +258,11 @@ int Syntax::type_specifier() {
     case TokenType::KW_STRUCT:
         syntax_state = SNTX_SP;
         type_found = true;
-        struct_specifier();
+        struct_specifier(t);
         break;
 
     default:
+        t = typetab.basic(T_INT);
         break;
     }
     return type_found;
@@ -134,27 +274,46 @@ int Syntax::type_specifier() {
  *   --> <KW_STRUCT><IDENTIFIER><TK_BEGIN><struct_declaration_list><TK_END>;
  *      | <KW_STRUCT><IDENTIFIER>
  */
-void Syntax::struct_specifier() {
+void Syntax::struct_specifier(int &t) {
+    int s = -1;
     next_token();       
     auto type = token.type();       // should be identifier
-    syntax_state = SNTX_DELAY;
-    next_token();       
+    if (type < TokenType::TK_IDENT) {
+        // 缺少结构体名时不跳过当前单词，以便继续分析结构体体
+        error(DiagCode::ERR_STRUCT_NAME, (int)type);
+    }
+    else {
+        OutlineEntry e = {OL_STRUCT, token.str(), token.offset(), -1, -1};
+        syntax_state = SNTX_DELAY;
+        next_token();       
+        if (token.type() == TokenType::TK_BEGIN && syntax_level == 0)
+            outlines.push_back(e);
 
-    // for define
-    if (token.type() == TokenType::TK_BEGIN)  
-        syntax_state = SNTX_LF_HT;
-    // for sizeof(struct id)
-    else if (token.type() == TokenType::TK_CLOSPA)
-        syntax_state = SNTX_NUL;
-    // for declarator
-    else syntax_state = SNTX_SP;
+        // 定义时外层的同名结构体被遮蔽，引用时尚未定义的结构体先加入
+        s = symtab.find(e.name, true);
+        if (s < 0 || (token.type() == TokenType::TK_BEGIN &&
+            symtab[s].level < symtab.level()))
+            s = symtab.push(e.name, typetab.new_struct(e.name, e.offset),
+                SC_STRUCT, e.offset);
+        add_xref(token.type() == TokenType::TK_BEGIN ? XR_STRUCT_DEF :
+            XR_STRUCT_USE, e.name, e.offset, symtab[s].offset);
 
-    syntax_indent();
+        // for define
+        if (token.type() == TokenType::TK_BEGIN)  
+            syntax_state = SNTX_LF_HT;
+        // for sizeof(struct id)
+        else if (token.type() == TokenType::TK_CLOSPA)
+            syntax_state = SNTX_NUL;
+        // for declarator
+        else syntax_state = SNTX_SP;
+
+        syntax_indent();
+    }
 
-    if (type < TokenType::TK_IDENT)
-        cerr << "struct identifier name" << endl;
+    // 缺少结构体名时按匿名结构体处理
+    t = s < 0 ? typetab.new_struct("", token.offset()) : symtab[s].type;
     if (token.type() == TokenType::TK_BEGIN)
-        struct_declaration_list();
+        struct_declaration_list(t);
     // skip(TokenType::TK_SEMICOLON);
 }
 
@@ -163,17 +322,23 @@ void Syntax::struct_specifier() {
  * <struct_declaration_list> 
  *  --> <struct_declaration>{<struct_declaration>}
  */
-void Syntax::struct_declaration_list() {
-    int maxalign, offset;
+void Syntax::struct_declaration_list(int t) {
 
     syntax_state = SNTX_LF_HT;
     syntax_level++;
 
     next_token();
-    while (token.type() != TokenType::TK_END) {
-        struct_declaration();
+    while (token.type() != TokenType::TK_END &&
+        token.type() != TokenType::TK_EOF) {
+        long n = tkcount;
+        panic = false;
+        struct_declaration(t);
+        if (tkcount == n)
+            next_token();
     }
+    syntax_level--;
     skip(TokenType::TK_END);
+    typetab.finish_struct(t);
 
     syntax_state = SNTX_LF_HT;
 }
@@ -185,14 +350,24 @@ void Syntax::struct_declaration_list() {
  * <struct_declarator_list>
  *  --> <declarator>{<TK_COMMA><declarator>}
  */
-void Syntax::struct_declaration() {
-    type_specifier();
+void Syntax::struct_declaration(int t) {
+    int btype, mtype;
+    if (!type_specifier(btype))
+        error(DiagCode::ERR_TYPE_EXPECTED, (int)token.type());
     while (1) {
-        declarator();
+        long n = tkcount;
+        mtype = btype;
+        declarator(mtype);
+        add_xref(XR_MEMBER_DEF, decl_name, decl_offset);
+        if (!decl_name.empty() &&
+            !typetab.add_member(t, decl_name, mtype, decl_offset))
+            error(DiagCode::ERR_INCOMPLETE_FIELD, 0, 0, decl_offset);
 
         if (token.type() == TokenType::TK_SEMICOLON)
             break;
         skip(TokenType::TK_COMMA);
+        if (tkcount == n)
+            break;
     }
     syntax_state = SNTX_LF_HT;
     skip(TokenType::TK_SEMICOLON);
@@ -203,11 +378,12 @@ void Syntax::struct_declaration() {
  * <declarator>
  *  --> {<pointer>}<direct_declarator>
  */
-void Syntax::declarator() {
+void Syntax::declarator(int &t) {
     while(token.type() == TokenType::TK_STAR) {
+        t = typetab.pointer(t);
         next_token();
     }
-    direct_declarator();
+    direct_declarator(t);
 }
 
 
@@ -216,15 +392,28 @@ void Syntax::declarator() {
  * <direct_declarator>
  *  --> <IDENTIFIER><direct_declarator_postfix>
  */
-void Syntax::direct_declarator()
+void Syntax::direct_declarator(int &t)
 {
+    string name;
+    int offset = token.offset();
     if (token.type() >= TokenType::TK_IDENT) {
+        name = token.str();
         next_token();
     }
     else {
-        cerr << "Identifier" << endl;
+        error(DiagCode::ERR_IDENT_EXPECTED, (int)token.type());
+        synchronize(TKSET(TokenType::TK_COMMA) | TKSET(TokenType::TK_CLOSPA));
+        decl_name.clear();
+        return;
     }
-    direct_declarator_postfix();
+    bool func = token.type() == TokenType::TK_OPENPA;
+    direct_declarator_postfix(t);
+    // 形参的声明符会覆盖这些记录，分析完后缀再保存
+    if (!func)
+        params.clear();
+    decl_name = name;
+    decl_offset = offset;
+    decl_func = func;
 }
 
 
@@ -236,23 +425,29 @@ void Syntax::direct_declarator()
  *    | <TK_OPENPA><parameter_type_list><TK_CLOSPA>
  *    | <TK_OPENPA><TK_CLOSPA>
  */
-void Syntax::direct_declarator_postfix()
+void Syntax::direct_declarator_postfix(int &t)
 {
-    int n;
+    int n = -1;
     // for function
     if (token.type() == TokenType::TK_OPENPA) {
         parameter_type_list();
+        std::vector<int> ptypes;
+        for (const ParamDecl &p : params)
+            ptypes.push_back(p.type);
+        t = typetab.func(t, ptypes);
     }
     // for array
     else if (token.type() == TokenType::TK_OPENBR) {
         next_token();
         if (token.type() == TokenType::TK_CINT)
         {
+            n = token.value();
             next_token();
-            // n = tkvalue;
         }
         skip(TokenType::TK_CLOSBR);
-        direct_declarator_postfix();
+        // a[2][3] 是 2 个 int [3]，先分析内层的维数
+        direct_declarator_postfix(t);
+        t = typetab.array(t, n);
     }
 }
 
@@ -264,16 +459,27 @@ void Syntax::direct_declarator_postfix()
  */
 void Syntax::parameter_type_list()
 {
+    std::vector<ParamDecl> list;
+    int t;
     next_token();
     while(token.type() != TokenType::TK_CLOSPA) {
-        if (!type_specifier()) {
-            cerr << "invalid type specifier" << endl;
+        long n = tkcount;
+        if (!type_specifier(t)) {
+            error(DiagCode::ERR_PARAM_TYPE, (int)token.type());
+        }
+        declarator(t);
+        add_xref(XR_PARAM, decl_name, decl_offset);
+        if (!decl_name.empty()) {
+            ParamDecl p = {decl_name, decl_offset, t};
+            list.push_back(p);
         }
-        declarator();
         if (token.type() == TokenType::TK_CLOSPA)
             break;
         skip(TokenType::TK_COMMA);
+        if (tkcount == n)
+            break;
     }
+    params.swap(list);
     syntax_state = SNTX_DELAY;
     skip(TokenType::TK_CLOSPA);
     if (token.type() == TokenType::TK_BEGIN)
@@ -290,16 +496,112 @@ void Syntax::parameter_type_list()
  */
 void Syntax::funcbody()
 {
+    symtab.enter_scope();
+    // 形参在入口处存入各自的栈槽，数组形参即指针
+    for (const ParamDecl &p : params) {
+        int t = typetab[p.type].kind == T_ARRAY ?
+            typetab.pointer(typetab[p.type].ref) : p.type;
+        int k = symtab.push(p.name, t, SC_PARAM, p.offset);
+        if (fn) {
+            int n = mem_size(t);
+            Ref s = fn->slot(n, typetab.align(t), p.name, p.offset);
+            symtab[k].ir = ref_index(s);
+            Ref v = fn->def(IR_PARAM, n, fn->imm(fn->nparams++), REF_NONE,
+                p.offset);
+            fn->emit(IR_STORE, n, REF_NONE, s, v, p.offset);
+        }
+    }
+    params.clear();
     compound_statement();
+    symtab.leave_scope();
+}
+
+/**
+ * 功能：大纲模式下跳过函数体，只记录其范围
+ * e：函数的大纲记录，填入函数体的范围
+ */
+void Syntax::skip_funcbody(OutlineEntry &e)
+{
+    e.body_end = lex.skip_block();
+    syntax_state = SNTX_LF_HT;
+    next_token();
+    if (e.body_end < 0) {
+        error(DiagCode::ERR_EXPECT, (int)TokenType::TK_END, (int)token.type());
+        e.body_end = token.offset();
+    }
+}
+
+/**
+ * 功能：按需分析大纲模式下跳过的函数体
+ */
+void Syntax::parse_body(const OutlineEntry &e)
+{
+    if (e.body_begin < 0)
+        return;
+    lex.seek(e.body_begin, e.body_end);
+    is_read = true;
+    panic = false;
+    syntax_level = 0;
+    syntax_state = SNTX_NUL;
+    func_ret = T_UNKNOWN;
+    next_token();
+    funcbody();
 }
 
 /**
  * 功能：解析初值符
  * <initializer> --> <assignment_expression>
  */
-void Syntax::initializer()
+void Syntax::initializer(int t, int sym)
 {
-    assignment_expression();
+    TokenType first = token.type();
+    Operand op = assignment_expression();
+    bool str = first == TokenType::TK_CSTR && op.type >= 0 &&
+        typetab[op.type].kind == T_ARRAY;
+    // 字符数组可以用字符串常量初始化
+    if (!(str && typetab[t].kind == T_ARRAY &&
+        typetab[t].ref == typetab.basic(T_CHAR)) &&
+        !typetab.assignable(t, op.type, op.null()))
+        type_error(DiagCode::ERR_INCOMPATIBLE, t, op.type, op.offset);
+
+    // 局部变量的初值在运行时存入
+    if (fn && sym >= 0 && symtab[sym].sc == SC_LOCAL) {
+        Ref addr = make_ref(RT_SLOT, symtab[sym].ir);
+        if (str && typetab[t].kind == T_ARRAY) {
+            IrSlot &slot = fn->slots[symtab[sym].ir];
+            int n = lex.strings().length(op.value) + 1;
+            if (slot.size < n && typetab[t].count < 0)
+                slot.size = n;
+            fn->emit(IR_COPY, 0, fn->imm(std::min(n, slot.size)), addr,
+                op.val, op.offset);
+        }
+        else if (typetab.is_scalar(t))
+            fn->emit(IR_STORE, mem_size(t), REF_NONE, addr, rvalue(op),
+                op.offset);
+        else if (typetab[t].kind == T_STRUCT && op.type == t)
+            fn->emit(IR_COPY, 0, fn->imm(typetab.size(t)), addr, op.val,
+                op.offset);
+        return;
+    }
+
+    // 全局变量的初值在分析时求出，不生成运行时的初始化代码
+    if (sym < 0 || symtab[sym].sc != SC_GLOBAL)
+        return;
+    if (op.is_const) {
+        symtab[sym].init = INIT_CONST;
+        symtab[sym].value = op.value;
+    }
+    else if (str) {
+        symtab[sym].init = INIT_STR;
+        symtab[sym].value = op.value;
+    }
+    else if (op.type >= 0)
+        type_error(DiagCode::ERR_NOT_CONST, 0, 0, op.offset);
+    if (symtab[sym].ir >= 0) {
+        IrGlobal &g = irmod.globals[symtab[sym].ir];
+        g.init = symtab[sym].init;
+        g.value = symtab[sym].value;
+    }
 }
 
 /**
@@ -345,17 +647,26 @@ void Syntax::compound_statement()
 {
     syntax_state = SNTX_LF_HT;
     syntax_level++;
+    symtab.enter_scope();
 
     next_token();
 
-    while (token.type() != TokenType::TK_END) {
+    while (token.type() != TokenType::TK_END &&
+        token.type() != TokenType::TK_EOF) {
+        long n = tkcount;
+        panic = false;      // 每条语句开始时已重新同步
         if (is_type_specifier(token.type()))
             external_declaration(SC_LOCAL);
         else 
             statement();
+        if (tkcount == n)
+            next_token();
     }
+    symtab.leave_scope();
+    syntax_level--;
     syntax_state = SNTX_LF_HT;
-    next_token();
+    end_offset = token.offset() + 1;
+    skip(TokenType::TK_END);
 }
 
 
@@ -401,16 +712,34 @@ void Syntax::if_statement()
     syntax_state = SNTX_SP;
     next_token();
     skip(TokenType::TK_OPENPA);
-    expression();
+    Operand cond = expression();
+    Ref then_b = 0, else_b = 0;
+    if (fn) {
+        then_b = fn->new_block();
+        else_b = fn->new_block();
+        fn->emit(IR_BR, 0, else_b, rvalue(cond), then_b, cond.offset);
+        fn->place(then_b);
+    }
     syntax_state = SNTX_LF_HT;
     skip(TokenType::TK_CLOSPA);
     statement();
     if (token.type() == TokenType::KW_ELSE)
     {
+        // 没有 else 时假分支就是 if 之后的代码
+        Ref end_b = 0;
+        if (fn) {
+            end_b = fn->new_block();
+            if (!fn->terminated())
+                fn->emit(IR_JMP, 0, REF_NONE, end_b, REF_NONE, token.offset());
+            fn->place(else_b);
+            else_b = end_b;
+        }
         syntax_state = SNTX_LF_HT;
         next_token();
         statement();
     }
+    if (fn)
+        fn->place(else_b);
 }
 
 
@@ -422,20 +751,53 @@ void Syntax::if_statement()
  */
 void Syntax::for_statement()
 {
+    // 代码依次为：初始化 条件 步进 循环体，块在分析到时才放置
+    Ref cond_b = 0, step_b = 0, body_b = 0, exit_b = 0;
+    int offset = token.offset();
     next_token();
     skip(TokenType::TK_OPENPA);
     if (token.type() != TokenType::TK_SEMICOLON)
         expression();
+    if (fn) {
+        cond_b = fn->new_block();
+        step_b = fn->new_block();
+        body_b = fn->new_block();
+        exit_b = fn->new_block();
+        fn->place(cond_b);
+    }
     skip(TokenType::TK_SEMICOLON);
-    if (token.type() != TokenType::TK_SEMICOLON)
-        expression();
+    uint32_t head = offset;
+    if (token.type() != TokenType::TK_SEMICOLON) {
+        Operand cond = expression();
+        head = cond.offset;
+        if (fn)
+            fn->emit(IR_BR, 0, exit_b, rvalue(cond), body_b, cond.offset);
+    }
+    else if (fn)        // 没有条件时直接进入循环体
+        fn->emit(IR_JMP, 0, REF_NONE, body_b, REF_NONE, offset);
+    if (fn)
+        fn->place(step_b);
     skip(TokenType::TK_SEMICOLON);
     if(token.type() != TokenType::TK_CLOSPA)
         expression();
+    if (fn) {
+        fn->emit(IR_JMP, 0, REF_NONE, cond_b, REF_NONE, offset);
+        fn->place(body_b);
+        LoopTarget lt = {exit_b, step_b};
+        loops.push_back(lt);
+    }
 
     syntax_state = SNTX_LF_HT;
     skip(TokenType::TK_CLOSPA);
     statement();
+    if (fn) {
+        loops.pop_back();
+        if (!fn->terminated())
+            fn->emit(IR_JMP, 0, REF_NONE, step_b, REF_NONE, offset);
+        fn->place(exit_b);
+        SpanEntry e = {SPAN_FOR, (uint32_t)offset, (uint32_t)token.offset(), head};
+        spanlist.push_back(e);
+    }
 }
 
 /**
@@ -443,6 +805,9 @@ void Syntax::for_statement()
  */
 void Syntax::continue_statement()
 {
+    if (fn && !loops.empty())
+        fn->emit(IR_JMP, 0, REF_NONE, loops.back().cont, REF_NONE,
+            token.offset());
     next_token();
     syntax_state = SNTX_LF_HT;
     skip(TokenType::TK_SEMICOLON);
@@ -453,6 +818,9 @@ void Syntax::continue_statement()
  */
 void Syntax::break_statement()
 {
+    if (fn && !loops.empty())
+        fn->emit(IR_JMP, 0, REF_NONE, loops.back().brk, REF_NONE,
+            token.offset());
     next_token();
     syntax_state = SNTX_LF_HT;
     skip(TokenType::TK_SEMICOLON);
@@ -473,8 +841,19 @@ void Syntax::return_statement()
         syntax_state = SNTX_SP;
     syntax_indent();
 
-    if (token.type() != TokenType::TK_SEMICOLON)
-        expression();
+    int offset = token.offset();
+    Ref v = REF_NONE;
+    if (token.type() != TokenType::TK_SEMICOLON) {
+        Operand op = expression();
+        if (!typetab.assignable(func_ret, op.type, op.null()))
+            type_error(DiagCode::ERR_RETURN_TYPE, op.type, func_ret, op.offset);
+        if (fn && fn->ret_size)
+            v = rvalue(op);
+    }
+    else if (fn && fn->ret_size)
+        v = fn->imm(0);
+    if (fn)
+        fn->emit(IR_RET, fn->ret_size, REF_NONE, v, REF_NONE, offset);
     syntax_state = SNTX_LF_HT;
     skip(TokenType::TK_SEMICOLON);
 }
@@ -483,14 +862,17 @@ void Syntax::return_statement()
  * 功能：解析表达式
  * <expression>--><assignment_expression>{<TK_COMMA><assignment_expression>}
  */
-void Syntax::expression()
+Operand Syntax::expression()
 {
+    Operand op;
     while (1) {
-        assignment_expression();
+        op = assignment_expression();
         if (token.type() != TokenType::TK_COMMA)
             break;
         next_token();
+        op.lvalue = op.is_const = false;
     }
+    return op;
 }
 
 /**
@@ -498,13 +880,208 @@ void Syntax::expression()
  * <assignment_expression>
  *  --> <equality_expression>|<unary_expression><TK_ASSIGN><assignment_expression>
  */
-void Syntax::assignment_expression()
+Operand Syntax::assignment_expression()
 {
-    equality_expression();
+    Operand lhs = equality_expression();
     if(token.type() == TokenType::TK_ASSIGN) {
         next_token();
-        assignment_expression();
+        Operand rhs = assignment_expression();
+        // 数组名不能被赋值
+        if (!lhs.lvalue ||
+            (lhs.type >= 0 && typetab[lhs.type].kind == T_ARRAY))
+            type_error(DiagCode::ERR_NOT_LVALUE, 0, 0, lhs.offset);
+        else if (!typetab.assignable(lhs.type, rhs.type, rhs.null()))
+            type_error(DiagCode::ERR_INCOMPATIBLE, lhs.type, rhs.type, rhs.offset);
+        if (fn && lhs.type >= 0 && typetab[lhs.type].kind == T_STRUCT)
+            fn->emit(IR_COPY, 0, fn->imm(typetab.size(lhs.type)), lhs.val,
+                rhs.val, rhs.offset);
+        else if (fn) {
+            // 赋值表达式的值是存入后的值，char 和 short 要重新取出
+            int n = mem_size(lhs.type);
+            Ref v = rvalue(rhs);
+            fn->emit(IR_STORE, n, REF_NONE, lhs.val, v, rhs.offset);
+            lhs.val = n < 4 ? fn->def(IR_LOAD, n, lhs.val, REF_NONE,
+                rhs.offset) : v;
+        }
+        lhs.lvalue = false;
+        lhs.is_const = false;
     }
+    return lhs;
+}
+
+/**
+ * 功能：二元运算的结果类型
+ * 指针可以加减整数，同类指针可以相减和比较，其余运算要求整数
+ */
+int Syntax::binary_type(TokenType op, const Operand &a, const Operand &b)
+{
+    int ta = typetab.decay(a.type), tb = typetab.decay(b.type);
+    if (ta < 0 || tb < 0)
+        return T_UNKNOWN;
+    int t = typetab.basic(T_INT);
+    switch (op) {
+    case TokenType::TK_PLUS:
+        if (typetab.is_pointer(ta) && typetab.is_integer(tb))
+            return ta;
+        if (typetab.is_integer(ta) && typetab.is_pointer(tb))
+            return tb;
+        break;
+    case TokenType::TK_MINUS:
+        if (typetab.is_pointer(ta) && typetab.is_integer(tb))
+            return ta;
+        if (typetab.is_pointer(ta) && ta == tb)
+            return t;
+        break;
+    case TokenType::TK_EQ:
+    case TokenType::TK_NEQ:
+    case TokenType::TK_LT:
+    case TokenType::TK_LEQ:
+    case TokenType::TK_GT:
+    case TokenType::TK_GEQ:
+        if (typetab.is_pointer(ta) && (typetab.assignable(ta, tb, b.null()) ||
+            typetab.assignable(tb, ta, a.null())))
+            return t;
+        break;
+    default:
+        break;
+    }
+    if (typetab.is_integer(ta) && typetab.is_integer(tb))
+        return t;
+    type_error(DiagCode::ERR_OPERANDS, (int)op, 0, b.offset);
+    return T_UNKNOWN;
+}
+
+/**
+ * 功能：确定二元运算结果的类型和值，不是常量时生成运算的代码
+ */
+void Syntax::binary(TokenType op, Operand &a, Ref x, const Operand &b)
+{
+    Operand r = a;
+    r.type = binary_type(op, a, b);
+    fold(op, r, b);
+    if (!r.is_const)
+        r.val = lower_binary(op, a, x, b);
+    r.lvalue = false;
+    a = r;
+}
+
+/**
+ * 功能：生成二元运算的代码
+ * 指针运算按 8 字节进行，整数运算按 4 字节进行
+ */
+Ref Syntax::lower_binary(TokenType op, const Operand &a, Ref x, const Operand &b)
+{
+    if (!fn)
+        return REF_NONE;
+    IrOp o;
+    switch (op) {
+    case TokenType::TK_PLUS:    o = IR_ADD; break;
+    case TokenType::TK_MINUS:   o = IR_SUB; break;
+    case TokenType::TK_STAR:    o = IR_MUL; break;
+    case TokenType::TK_DIVIDE:  o = IR_DIV; break;
+    case TokenType::TK_MOD:     o = IR_MOD; break;
+    case TokenType::TK_EQ:      o = IR_EQ; break;
+    case TokenType::TK_NEQ:     o = IR_NE; break;
+    case TokenType::TK_LT:      o = IR_LT; break;
+    case TokenType::TK_LEQ:     o = IR_LE; break;
+    case TokenType::TK_GT:      o = IR_GT; break;
+    case TokenType::TK_GEQ:     o = IR_GE; break;
+    default:
+        return REF_NONE;
+    }
+    Ref y = rvalue(b);
+    int ta = typetab.decay(a.type), tb = typetab.decay(b.type);
+    bool pa = typetab.is_pointer(ta), pb = typetab.is_pointer(tb);
+    if ((o == IR_ADD || o == IR_SUB) && pa != pb) {
+        // 整数乘以所指类型的大小，常量直接算出
+        if (pb) {
+            std::swap(x, y);
+            ta = tb;
+        }
+        int n = typetab.size(typetab[ta].ref);
+        if (n > 1 && ref_tag(y) == RT_IMM &&
+            (int64_t)ref_imm(y) * n >= IMM_MIN && (int64_t)ref_imm(y) * n <= IMM_MAX)
+            y = fn->imm(ref_imm(y) * n);
+        else if (n > 1)
+            y = fn->def(IR_MUL, 8, y, fn->imm(n), b.offset);
+        return fn->def(o, 8, x, y, b.offset);
+    }
+    if (o == IR_SUB && pa && pb) {
+        int n = typetab.size(typetab[ta].ref);
+        Ref diff = fn->def(IR_SUB, 8, x, y, b.offset);
+        return n > 1 ? fn->def(IR_DIV, 8, diff, fn->imm(n), b.offset) : diff;
+    }
+    return fn->def(o, pa || pb ? 8 : 4, x, y, b.offset);
+}
+
+Ref Syntax::rvalue(const Operand &op)
+{
+    if (!fn)
+        return op.val;
+    if (op.is_const)
+        return fn->imm(op.value);
+    if (!op.lvalue || (op.type >= 0 && !typetab.is_scalar(op.type)))
+        return op.val;
+    return fn->def(IR_LOAD, mem_size(op.type), op.val, REF_NONE, op.offset);
+}
+
+int Syntax::mem_size(int t) const
+{
+    return typetab.is_scalar(t) ? typetab.size(t) : 4;
+}
+
+/**
+ * 功能：为全局变量或函数在中间代码中建立记录，同名的声明共用一个
+ */
+void Syntax::declare_global(int sym, bool defined)
+{
+    Symbol &s = symtab[sym];
+    bool func = typetab[s.type].kind == T_FUNC;
+    s.ir = irmod.global(s.name, func);
+    IrGlobal &g = irmod.globals[s.ir];
+    if (!func && defined) {
+        int size = typetab.size(s.type);
+        g.defined = true;
+        g.array = typetab[s.type].kind == T_ARRAY;
+        g.size = size < 0 ? 0 : size;
+        g.align = typetab.align(s.type);
+    }
+}
+
+/**
+ * 功能：常量折叠，按 32 位补码运算
+ */
+void Syntax::fold(TokenType op, Operand &a, const Operand &b)
+{
+    if (!a.is_const || !b.is_const || !typetab.is_integer(a.type)) {
+        a.is_const = false;
+        return;
+    }
+    uint32_t x = a.value, y = b.value;
+    switch (op) {
+    case TokenType::TK_PLUS:    x += y; break;
+    case TokenType::TK_MINUS:   x -= y; break;
+    case TokenType::TK_STAR:    x *= y; break;
+    case TokenType::TK_DIVIDE:
+    case TokenType::TK_MOD:
+        // INT_MIN / -1 同样不折叠
+        if (y == 0 || (a.value == INT32_MIN && b.value == -1)) {
+            a.is_const = false;
+            return;
+        }
+        x = op == TokenType::TK_DIVIDE ? a.value / b.value : a.value % b.value;
+        break;
+    case TokenType::TK_EQ:      x = a.value == b.value; break;
+    case TokenType::TK_NEQ:     x = a.value != b.value; break;
+    case TokenType::TK_LT:      x = a.value < b.value; break;
+    case TokenType::TK_LEQ:     x = a.value <= b.value; break;
+    case TokenType::TK_GT:      x = a.value > b.value; break;
+    case TokenType::TK_GEQ:     x = a.value >= b.value; break;
+    default:
+        a.is_const = false;
+        return;
+    }
+    a.value = (int32_t)x;
 }
 
 /**
@@ -512,14 +1089,18 @@ void Syntax::assignment_expression()
  * <equality_expression> --> <relational_expression>
  *  {<TK_EQ><relational_expression>}|<TK_NEQ><relational_expression>
  */
-void Syntax::equality_expression()
+Operand Syntax::equality_expression()
 {
-    relational_expression();
+    Operand a = relational_expression();
     while (token.type() == TokenType::TK_EQ || 
         token.type() == TokenType::TK_NEQ) {
+        TokenType op = token.type();
+        Ref x = rvalue(a);
         next_token();
-        relational_expression();
+        Operand b = relational_expression();
+        binary(op, a, x, b);
     }
+    return a;
 }
 
 /**
@@ -530,16 +1111,20 @@ void Syntax::equality_expression()
  *  | <TK_LEQ><additive_expression>
  *  | <TK_GEQ><additive_expression>}
  */
-void Syntax::relational_expression()
+Operand Syntax::relational_expression()
 {
-    additive_expression();
+    Operand a = additive_expression();
     while ((token.type() == TokenType::TK_LT ||
         token.type() == TokenType::TK_LEQ) ||
         (token.type() == TokenType::TK_GT || 
         token.type() == TokenType::TK_GEQ)) {
+        TokenType op = token.type();
+        Ref x = rvalue(a);
         next_token();
-        additive_expression();
+        Operand b = additive_expression();
+        binary(op, a, x, b);
     }
+    return a;
 }
 
 /**
@@ -547,14 +1132,18 @@ void Syntax::relational_expression()
  * <additive_expression> --> <multiplicative_expression>
  *  {<TK_PLUS>|<TK_MINUS><multiplicative_expression>}
  */
-void Syntax::additive_expression()
+Operand Syntax::additive_expression()
 {
-    multiplicative_expression();
+    Operand a = multiplicative_expression();
     while (token.type() ==TokenType::TK_PLUS || 
         token.type()==TokenType::TK_MINUS) {
+        TokenType op = token.type();
+        Ref x = rvalue(a);
         next_token();
-        multiplicative_expression();
+        Operand b = multiplicative_expression();
+        binary(op, a, x, b);
     }
+    return a;
 }
 
 /**
@@ -562,15 +1151,19 @@ void Syntax::additive_expression()
  * <multiplicative_expression> --> <unary_expression>
  *  {<TK_STAR>|<TK_DIVIDE>|<TK_MOD><unary_expression>}
  */ 
-void Syntax::multiplicative_expression()
+Operand Syntax::multiplicative_expression()
 {
-    unary_expression();
+    Operand a = unary_expression();
     while (token.type() == TokenType::TK_STAR || 
         token.type() == TokenType::TK_DIVIDE || 
         token.type() == TokenType::TK_MOD) {
+        TokenType op = token.type();
+        Ref x = rvalue(a);
         next_token();
-        unary_expression();
+        Operand b = unary_expression();
+        binary(op, a, x, b);
     }
+    return a;
 }
 
 /**
@@ -579,37 +1172,81 @@ void Syntax::multiplicative_expression()
  *  | <TK_AND>|<TK_STAR> <unary_expression>
  *  |<sizeof_expression>
  */
-void Syntax::unary_expression()
+Operand Syntax::unary_expression()
 {
+    Operand op = {};
+    int offset = token.offset();
     switch (token.type())
     {
     case TokenType::TK_AND:
         next_token();
-        unary_expression();
+        op = unary_expression();
+        if (op.type >= 0 && !op.lvalue && typetab[op.type].kind != T_FUNC) {
+            type_error(DiagCode::ERR_ADDR_LVALUE, 0, 0, offset);
+            op.type = T_UNKNOWN;
+        }
+        if (op.type >= 0)
+            op.type = typetab.pointer(op.type);
+        op.lvalue = false;
         break;
     case TokenType::TK_OR:
         next_token();
-        unary_expression();
+        op = unary_expression();
+        op.val = rvalue(op);
+        op.lvalue = false;
         break;
     case TokenType::TK_STAR:
         next_token();
-        unary_expression();
+        op = unary_expression();
+        // 指针的值就是结果的地址
+        op.val = rvalue(op);
+        op.type = typetab.decay(op.type);
+        if (typetab.is_pointer(op.type)) {
+            op.type = typetab[op.type].ref;
+            op.lvalue = true;
+        }
+        else {
+            if (op.type >= 0)
+                type_error(DiagCode::ERR_DEREF, op.type, 0, offset);
+            op.type = T_UNKNOWN;
+        }
         break;
     case TokenType::TK_PLUS:
+    case TokenType::TK_MINUS: {
+        TokenType t = token.type();
         next_token();
-        unary_expression();
-        break;
-    case TokenType::TK_MINUS:
-        next_token();
-        unary_expression();
-        break;
+        op = unary_expression();
+        op.val = rvalue(op);
+        if (fn && t == TokenType::TK_MINUS && !op.is_const)
+            op.val = fn->def(IR_NEG, 4, op.val, REF_NONE, offset);
+        if (op.type >= 0 && !typetab.is_integer(op.type)) {
+            type_error(DiagCode::ERR_OPERANDS, (int)t, 0, offset);
+            op.type = T_UNKNOWN;
+            op.is_const = false;
+        }
+        else if (op.type >= 0)
+            op.type = typetab.basic(T_INT);
+        if (t == TokenType::TK_MINUS)
+            op.value = (int32_t)(0u - (uint32_t)op.value);
+        op.lvalue = false;
+        op.offset = offset;
+        return op;
+    }
     case TokenType::KW_SIZEOF:
-        sizeof_expression();
-        break;
+        op.value = sizeof_expression();
+        op.type = typetab.basic(T_INT);
+        op.lvalue = false;
+        op.is_const = op.value >= 0;
+        op.offset = offset;
+        // 类型有错时不是常量，给个立即数以免中间代码引用无效的值
+        op.val = make_ref(RT_IMM, 0);
+        return op;
     default:
-        postfix_expression();
-        break;
+        return postfix_expression();
     }
+    op.offset = offset;
+    op.is_const = false;
+    return op;
 }
 
 
@@ -617,12 +1254,18 @@ void Syntax::unary_expression()
  * 功能：解析sizeof表达式
  * <sizeof_expression> --> <KW_SIZEOF><TK_OPENPA><type_specifier><TK_CLOSEPA>
  */
-void Syntax::sizeof_expression()
+int Syntax::sizeof_expression()
 {
+    int t, size = -1, offset = token.offset();
     next_token();
     skip(TokenType::TK_OPENPA);
-    type_specifier();
+    if (type_specifier(t)) {
+        size = typetab.size(t);
+        if (size < 0)
+            error(DiagCode::ERR_INCOMPLETE_SIZEOF, 0, 0, offset);
+    }
     skip(TokenType::TK_CLOSPA);
+    return size;
 }
 
 /**
@@ -631,26 +1274,95 @@ void Syntax::sizeof_expression()
  *  {<TK_OPENBR><expression><TK_CLOSEBR>|<TK_OPENPA><TK_CLOSEPA>
  *  |<TK_DOT><IDENTIFIER>|<TK_POINTSTO><IDENTIFIER>}
  */
-void Syntax::postfix_expression()
+Operand Syntax::postfix_expression()
 {
-    primary_expression();
+    Operand op = primary_expression();
     while (1)
     {
         if (token.type() == TokenType::TK_DOT || 
             token.type() == TokenType::TK_POINTO) {
+            TokenType access = token.type();
             next_token();
             // token |= SC_MEMBER;
+            if (token.type() < TokenType::TK_IDENT) {
+                error(DiagCode::ERR_IDENT_EXPECTED, (int)token.type());
+                synchronize();
+                break;
+            }
+            add_xref(XR_MEMBER_USE, token.str(), token.offset());
+            // . 的对象是结构体，-> 的对象是指向结构体的指针
+            int t = op.type;
+            if (access == TokenType::TK_POINTO)
+                t = typetab.is_pointer(t) ? typetab[t].ref : T_UNKNOWN;
+            if (t >= 0 && typetab[t].kind == T_STRUCT) {
+                const Member *m = typetab.find_member(t, token.str());
+                if (!m)
+                    type_error(DiagCode::ERR_NO_MEMBER, token.offset(), t);
+                // 成员的地址为结构体的地址加上成员的偏移
+                Ref base = access == TokenType::TK_POINTO ? rvalue(op) : op.val;
+                if (fn && m && m->offset)
+                    base = fn->def(IR_ADD, 8, base, fn->imm(m->offset),
+                        token.offset());
+                op.val = base;
+                op.type = m ? m->type : T_UNKNOWN;
+                op.lvalue = true;
+            }
+            else {
+                if (op.type >= 0)
+                    type_error(DiagCode::ERR_NOT_STRUCT, op.type, (int)access);
+                op.type = T_UNKNOWN;
+                op.lvalue = true;
+            }
             next_token();
         } 
         else if (token.type() == TokenType::TK_OPENBR) {
+            Ref base = rvalue(op);
             next_token();
-            expression();
+            Operand index = expression();
             skip(TokenType::TK_CLOSBR);
+            // a[i] 即 *(a + i)
+            int t = typetab.decay(op.type);
+            if (typetab.is_pointer(t)) {
+                if (index.type >= 0 && !typetab.is_integer(index.type))
+                    type_error(DiagCode::ERR_OPERANDS,
+                        (int)TokenType::TK_OPENBR, 0, index.offset);
+                op.val = lower_binary(TokenType::TK_PLUS, op, base, index);
+                op.type = typetab[t].ref;
+            }
+            else {
+                if (t >= 0)
+                    type_error(DiagCode::ERR_SUBSCRIPT, t, 0, op.offset);
+                op.type = T_UNKNOWN;
+            }
+            op.lvalue = true;
         } else if (token.type() == TokenType::TK_OPENPA) {
-            argument_expression_list();
+            // 函数名的值就是函数的地址，函数指针则要先取出
+            Ref callee = op.type < 0 || typetab[op.type].kind == T_FUNC ?
+                op.val : rvalue(op);
+            std::vector<Ref> args = argument_expression_list(op);
+            // 未声明的函数按返回 int 处理
+            int t = op.type;
+            if (typetab.is_pointer(t))
+                t = typetab[t].ref;
+            op.type = t >= 0 && typetab[t].kind == T_FUNC ?
+                typetab[t].ref : t < 0 ? typetab.basic(T_INT) : T_UNKNOWN;
+            op.lvalue = false;
+            if (fn) {
+                for (Ref r : args)
+                    fn->emit(IR_ARG, 8, REF_NONE, r, REF_NONE, op.offset);
+                bool ret = op.type != T_VOID;
+                op.val = ret ? fn->temp() : REF_NONE;
+                fn->emit(IR_CALL, ret ? mem_size(op.type) : 0, op.val, callee,
+                    fn->imm(args.size()), op.offset);
+                SpanEntry e = {SPAN_CALL, (uint32_t)op.offset, (uint32_t)token.offset(),
+                    (uint32_t)op.offset};
+                spanlist.push_back(e);
+            }
         } else 
             break;
+        op.is_const = false;
     }
+    return op;
 } 
 
 /**
@@ -658,29 +1370,56 @@ void Syntax::postfix_expression()
  * <primary_expression> --> <IDENTIFIER>|<TK_CINT>|<TK_CSTR>|<TK_CCHAR>|
  *  <TK_OPENPA><expression><TK_CLOSEPA>
  */
-void Syntax::primary_expression()
+Operand Syntax::primary_expression()
 {
-    TokenType t;
+    Operand op = {typetab.basic(T_INT), false, false, 0, token.offset(),
+        make_ref(RT_IMM, 0)};
     switch (token.type())
     {
     case TokenType::TK_CINT:
     case TokenType::TK_CCHAR:
+        op.is_const = true;
+        op.value = token.value();
+        next_token();
+        break;
     case TokenType::TK_CSTR:
+        // 值为常量池中的编号，数组长度含结尾的 '\0'
+        op.value = token.value();
+        op.type = typetab.array(typetab.basic(T_CHAR),
+            lex.strings().length(op.value) + 1);
+        op.val = make_ref(RT_STR, op.value);
         next_token();
         break;
     case TokenType::TK_OPENPA:
         next_token();
-        expression();
+        op = expression();
         skip(TokenType::TK_CLOSPA);
         break;
     default:
-        t = token.type();
-        next_token();
-        if (t < TokenType::TK_CINT) {
-            cerr << "Identifier or constant value." << endl;
+        if (token.type() < TokenType::TK_IDENT) {
+            error(DiagCode::ERR_PRIMARY, (int)token.type());
+            synchronize();
+            op.type = T_UNKNOWN;
+            break;
+        }
+        {
+            int s = symtab.find(token.str());
+            add_xref(XR_USE, token.str(), token.offset(),
+                s < 0 ? -1 : symtab[s].offset);
+            // 未声明的标识符类型未知，以免连带报错
+            op.type = s < 0 ? T_UNKNOWN : symtab[s].type;
+            op.lvalue = s < 0 || typetab[op.type].kind != T_FUNC;
+            // 未声明的标识符当作外部函数
+            if (s >= 0 && symtab[s].ir >= 0)
+                op.val = make_ref(symtab[s].sc == SC_GLOBAL ? RT_GLOBAL :
+                    RT_SLOT, symtab[s].ir);
+            else if (lower && s < 0)
+                op.val = make_ref(RT_GLOBAL, irmod.global(token.str(), true));
         }
+        next_token();
         break;
     }
+    return op;
 }
 
 /**
@@ -688,18 +1427,39 @@ void Syntax::primary_expression()
  * <argument_expression_list> --> <assignment_expression>
  *  { <TK_COMMA><assignment_expression> }
  */
-void Syntax::argument_expression_list()
+std::vector<Ref> Syntax::argument_expression_list(const Operand &callee)
 {
+    std::vector<Ref> args;
+    int f = callee.type;
+    if (typetab.is_pointer(f))
+        f = typetab[f].ref;
+    if (f >= 0 && typetab[f].kind != T_FUNC) {
+        type_error(DiagCode::ERR_NOT_FUNC, callee.type, 0, callee.offset);
+        f = T_UNKNOWN;
+    }
+    int nargs = 0, offset = token.offset();
     next_token();
     if (token.type() != TokenType::TK_CLOSPA) {
         for(;;) {
-            assignment_expression();
+            long n = tkcount;
+            Operand arg = assignment_expression();
+            args.push_back(rvalue(arg));
+            if (f >= 0 && nargs < typetab[f].count &&
+                !typetab.assignable(typetab.param(f, nargs), arg.type, arg.null()))
+                type_error(DiagCode::ERR_ARG_TYPE, nargs + 1,
+                    typetab.param(f, nargs), arg.offset);
+            nargs++;
             if (token.type() == TokenType::TK_CLOSPA)
                 break;
             skip(TokenType::TK_COMMA);
+            if (tkcount == n)
+                break;
         }
     }
+    if (f >= 0 && nargs != typetab[f].count)
+        type_error(DiagCode::ERR_ARG_COUNT, typetab[f].count, nargs, offset);
     skip(TokenType::TK_CLOSPA);
+    return args;
 }
 
 
@@ -719,6 +1479,10 @@ void print_tab(int n)
  */
 void Syntax::syntax_indent()
 {
+    if (!echo) {
+        syntax_state = SNTX_NUL;
+        return;
+    }
     switch (syntax_state) {
     case SNTX_NUL:
         _color_token(token);
@@ -728,10 +1492,10 @@ void Syntax::syntax_indent()
         _color_token(token);
         break;
     case SNTX_LF_HT:{
-        if (token.type() == TokenType::TK_END)
-            syntax_level--;
+        // } 在所属层数减一之前取得，需少缩进一级
         printf("\n");
-        print_tab(syntax_level);
+        print_tab(token.type() == TokenType::TK_END ?
+            syntax_level - 1 : syntax_level);
         _color_token(token);
         break;
     }
@@ -1,5 +1,566 @@
-
 #include "syntax.h"
+#include "index.h"
+#include "cache.h"
+#include "dataflow.h"
+#include "opt.h"
+#include "vm.h"
+#include "vmprof.h"
+#include "x86.h"
+#include "jit.h"
+#include "pool.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+/**
+ * 功能：打印用法
+ */
+static void usage(const char *prog)
+{
+    cerr << "usage: " << prog << " [options] file...\n"
+         << "       " << prog << " --index=DB file...\n"
+         << "       " << prog << " --index=DB --query=NAME\n"
+         << "  --max-errors=N          stop after N errors (0: no limit)\n"
+         << "  --diag-format=FORMAT    human (default) or machine\n"
+         << "  -q                      check only, do not print the source\n"
+         << "  --outline               list top-level declarations, skipping\n"
+         << "                          function bodies\n"
+         << "  --body=NAME             with --outline, parse and print only\n"
+         << "                          the body of function NAME\n"
+         << "  --index=DB              update the symbol index DB with the\n"
+         << "                          given files, re-parsing changed ones\n"
+         << "  --query=NAME            list definitions and uses of NAME\n"
+         << "  --cache-dir=DIR         reuse the tokens and diagnostics of\n"
+         << "                          unchanged files, keyed by content\n"
+         << "  --cache-stats           print cache hits and misses\n"
+         << "  --sym-stats             print symbol table statistics\n"
+         << "  --str-stats             print string literal pool statistics\n"
+         << "  --layout-report         print struct layouts, flagging padding\n"
+         << "                          and members straddling cache lines\n"
+         << "  --dump-ir               print the three-address code\n"
+         << "  --ir-stats              print instruction counts and memory\n"
+         << "  --dump-cfg              print each function's flow graph,\n"
+         << "                          dominators, live temps and reaching\n"
+         << "                          definitions\n"
+         << "  --cfg-stats             print flow graph and dataflow counts\n"
+         << "  -O                      optimize the three-address code before\n"
+         << "                          printing it\n"
+         << "  --opt-stats             print what -O changed\n"
+         << "  --inline-threshold=N    inline callees of up to N instructions\n"
+         << "                          plus loop, single-call and constant\n"
+         << "                          argument bonuses (default 20)\n"
+         << "  --no-inline             do not inline under -O\n"
+         << "  --no-peephole           keep the selected machine instructions\n"
+         << "                          as they are\n"
+         << "  --no-vectorize          do not turn counted loops into SSE2\n"
+         << "                          loops under -O with -S, -c, -o or --run\n"
+         << "  --jobs=N                generate code for N functions at a time\n"
+         << "                          (default: one per processor)\n"
+         << "  --profile-generate=FILE count blocks and branches of the -o or\n"
+         << "                          --run program, written to FILE at exit\n"
+         << "  --profile-use=FILE      lay out blocks and functions by the\n"
+         << "                          counts in FILE\n"
+         << "  --vm                    run main in the bytecode VM, exiting\n"
+         << "                          with its return value\n"
+         << "  --vm-dispatch=KIND      threaded (default) or switch\n"
+         << "  --vm-stats              print bytecode and execution counts\n"
+         << "  --vm-profile            count executed bytecodes and time calls;\n"
+         << "                          print the source colored by heat after\n"
+         << "                          the program's output, and the hottest\n"
+         << "                          functions, for loops, calls and lines\n"
+         << "  --dump-vm               print the bytecode\n"
+         << "  -S                      write x86-64 assembly to stdout, or to\n"
+         << "                          the -o file\n"
+         << "  -c                      write an ELF object file, to the -o\n"
+         << "                          file or NAME.o\n"
+         << "  -o FILE                 compile to an executable, linking with cc\n"
+         << "  --run                   compile main into memory and run it,\n"
+         << "                          exiting with its return value\n"
+         << "  --run-stats             print load counts and phase times\n"
+         << "  --asm-stats             print instruction and register\n"
+         << "                          allocation counts and peephole hits\n";
+}
+
+
+/**
+ * 功能：在映射的索引中查询符号
+ */
+static int query_index(const char *db, const char *name)
+{
+    SymbolIndex idx;
+    if (!idx.open(db)) {
+        cerr << db << ": can not open the symbol index" << endl;
+        return 2;
+    }
+    const IndexSym *sym = idx.find(name);
+    if (!sym)
+        return 1;
+    for (uint32_t i = sym->first; i < sym->first + sym->count; i++) {
+        const IndexRef &r = idx.refs()[i];
+        printf("%s:%d: %s (offset %u)\n", idx.str(idx.files()[r.file].name),
+            (int)r.line, xref_kind_name(r.kind), r.offset);
+    }
+    return 0;
+}
+
+
+/**
+ * 功能：输出顶层声明的大纲
+ * 每行：种类 名字 行号，函数定义附带函数体的字节范围
+ */
+static void print_outline(Syntax &syn)
+{
+    static const char *kind[] = {"struct", "func", "proto", "var"};
+    for (const OutlineEntry &e : syn.outline()) {
+        int line, col;
+        syn.diagnostics().locate(e.offset, line, col);
+        printf("%-7s %-24s %d", kind[e.kind], e.name.c_str(), line);
+        if (e.kind == OL_FUNC)
+            printf("  body %d-%d", e.body_begin, e.body_end);
+        // 全局变量附带分析时求出的初值
+        int s = e.kind == OL_VAR ? syn.symbols().find(e.name) : -1;
+        if (s >= 0 && syn.symbols()[s].init == INIT_CONST)
+            printf("  = %d", syn.symbols()[s].value);
+        else if (s >= 0 && syn.symbols()[s].init == INIT_STR)
+            printf("  = %s",
+                syn.lexer().strings().quoted(syn.symbols()[s].value).c_str());
+        printf("\n");
+    }
+}
+
+
+static long types, type_requests;     // 各文件的类型数及构造类型的请求数
+static bool str_stats;
+static long str_interns, str_raw, str_distinct, str_pooled, str_merged, str_tails;
+static InlineParams inline_params;      // -O 时内联的代价模型
+static bool peephole = true;            // 选择指令后做窥孔优化
+static bool vectorize_loops = true;     // -O 生成本机代码时向量化
+static int jobs;                        // 代码生成的线程数，0 为处理器数
+static string profile_gen, profile_use; // 插桩写出的与读入的剖析文件
+
+
+/**
+ * 功能：分析一个文件，cache 不为空时先查缓存
+ * 只检查时命中即可直接恢复诊断；要输出源码时重放单词流，省去词法分析
+ */
+static int check_file(const string &file, int max_errors, DiagFormat format,
+    bool quiet, TokenCache *cache, SymStats &sym)
+{
+    Syntax syn(file);
+    Lex &lex = syn.lexer();
+    Diagnostics &diag = syn.diagnostics();
+    diag.set_max_errors(max_errors);
+    diag.set_format(format);
+    syn.set_echo(!quiet);
+
+    // 无法打开的文件不进缓存
+    bool use_cache = cache && !diag.errors();
+    uint64_t key = 0;
+    CacheEntry e;
+    if (use_cache) {
+        key = TokenCache::key(lex.source());
+        if (cache->lookup(key, lex.source().size(), e)) {
+            // 会达到错误上限时分析要提前结束，含类型的诊断要有类型表，
+            // 这两种情况只能重放
+            bool restore = quiet && (max_errors == 0 || (int)e.ndiags < max_errors);
+            for (uint32_t i = 0; i < e.ndiags && restore; i++)
+                restore = !Diagnostics::has_type_args(e.diags[i].code);
+            if (restore) {
+                for (uint32_t i = 0; i < e.ndiags; i++)
+                    diag.report(e.diags[i].code, e.diags[i].offset,
+                        e.diags[i].args[0], e.diags[i].args[1]);
+                diag.flush(cerr);
+                return diag.errors() ? 1 : 0;
+            }
+            // 字符串池损坏时当作未命中，重新分析并覆盖缓存
+            if (lex.strings().load(e.strs, e.strbytes)) {
+                lex.replay(e.tokens, e.ntokens, e.lexdiags, e.nlexdiags);
+                syn.translation_unit();
+                diag.flush(cerr);
+                return diag.errors() ? 1 : 0;
+            }
+        }
+        lex.set_record(true);
+    }
+
+    syn.translation_unit();
+    const SymStats &ss = syn.symbols().stats();
+    sym.pushes += ss.pushes;
+    sym.lookups += ss.lookups;
+    sym.found += ss.found;
+    sym.probes += ss.probes;
+    sym.rehashes += ss.rehashes;
+    sym.max_level = std::max(sym.max_level, ss.max_level);
+    types += syn.types().count();
+    type_requests += syn.types().requests();
+    if (str_stats) {
+        StrPool &pool = lex.strings();
+        str_interns += pool.stats().interns;
+        str_raw += pool.stats().bytes;
+        str_distinct += pool.count();
+        str_pooled += pool.bytes();
+        pool.merge_tails();
+        str_merged += pool.bytes();
+        str_tails += pool.stats().merged;
+    }
+    // 达到错误上限时分析提前结束，单词流不完整，不写缓存
+    if (use_cache && !diag.full())
+        cache->store(key, lex.source().size(), lex.recorded_tokens(),
+            lex.recorded_diags(), diag.entries(), lex.strings());
+    diag.flush(cerr);
+    return diag.errors() ? 1 : 0;
+}
+
+
+/**
+ * 功能：把文件翻译为字节码，输出或从 main 开始执行
+ * 执行时以 main 的返回值为退出码；profile 时在程序的输出之后输出按热度
+ * 着色的源码，在标准错误输出函数、结构和行的剖析
+ */
+static int run_vm(const string &file, int max_errors, DiagFormat format,
+    bool opt, VmDispatch dispatch, bool dump, bool run, bool stats, bool profile)
+{
+    Syntax syn(file);
+    syn.diagnostics().set_max_errors(max_errors);
+    syn.diagnostics().set_format(format);
+    syn.set_echo(false);
+    syn.set_lower(true);
+    syn.translation_unit();
+    syn.diagnostics().flush(cerr);
+    if (syn.diagnostics().errors())
+        return 1;
+    OptStats ost = {};
+    if (opt)
+        optimize(syn.ir(), ost, inline_params);
+
+    VmStats st = {};
+    Vm m(syn.ir(), st);
+    if (dump)
+        m.dump(stdout);
+    if (!run)
+        return 0;
+    int64_t ret = 0;
+    string err;
+    VmProfile prof;
+    auto t0 = std::chrono::steady_clock::now();
+    bool ok = m.run("main", dispatch, ret, err, profile ? &prof : nullptr);
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - t0).count();
+    fflush(stdout);
+    if (!ok)
+        cerr << file << ": runtime error: " << err << endl;
+    if (stats)
+        fprintf(stderr, "vm: %ld instructions -> %ld bytecodes, %ld fused; "
+            "%llu executed in %.1f ms (%.1f M/s, %s dispatch), %llu calls, "
+            "max depth %d\n",
+            st.insts, st.code, st.fused, (unsigned long long)st.steps, ms,
+            ms > 0 ? st.steps / ms / 1000 : 0.0,
+            dispatch == VmDispatch::THREADED ? "threaded" : "switch",
+            (unsigned long long)st.calls, st.max_depth);
+    if (profile && !prof.hits.empty()) {
+        VmReport report(syn, m, prof);
+        report.print_listing(file);
+        fflush(stdout);
+        report.print_functions(stderr);
+        report.print_spans(stderr, 20);
+        report.print_lines(stderr, 20);
+    }
+    return ok ? (int)(ret & 0xff) : 2;
+}
+
+
+/**
+ * 功能：输出窥孔优化前后的指令数和各规则的改写次数
+ */
+static void print_peep_stats(const PeepStats &st)
+{
+    fprintf(stderr, "peep: %ld instructions to %ld in %ld passes;", st.before, st.after,
+        st.passes);
+    for (int r = 0; r < PEEP_COUNT; r++)
+        fprintf(stderr, " %s %ld", peep_rule_name(r), st.hits[r]);
+    fprintf(stderr, "\n");
+}
+
+
+/**
+ * 功能：输出向量化的循环数和生成的 SSE2 指令数
+ */
+static void print_vec_stats(const OptStats &ost, const X86Stats &st)
+{
+    fprintf(stderr, "vec: %ld loops vectorized with %ld vector operations, "
+        "%ld SSE2 instructions, %ld temps in xmm registers\n",
+        ost.vectorized, ost.vec_insts, st.vector, st.xmm);
+}
+
+
+/**
+ * 功能：生成本机代码
+ * 内联以后各函数互不相关，每个函数的优化、指令选择、窥孔优化和编码是线程池
+ * 中的一个任务。各线程的统计分开累加，编码按函数的顺序拼接，输出与线程数无关。
+ * 有剖析选项时优化和其余步骤分两轮，中间依次插桩或读入计数并重排函数。
+ * encode 为假时只生成机器指令，供输出汇编；jit 为真时生成的代码在本进程执行
+ */
+static void codegen(IrModule &m, StrPool &strs, bool opt, bool encode, bool jit,
+    std::vector<MFunc> &funcs, X86Object &obj, OptStats &ost, X86Stats &xst,
+    PeepStats &pst, ProfStats &prs, PoolStats &ps)
+{
+    if (opt)
+        optimize_module(m, ost, inline_params);
+    size_t n = m.funcs.size();
+    TaskPool pool(jobs);
+    std::vector<OptStats> os(pool.threads(), OptStats());
+    std::vector<X86Stats> xs(pool.threads(), X86Stats());
+    std::vector<PeepStats> peeps(pool.threads(), PeepStats());
+    std::vector<ProfStats> profs(pool.threads(), ProfStats());
+    bool profile = !profile_gen.empty() || !profile_use.empty();
+    if (opt && profile)
+        pool.run(n, [&](size_t k, int w) {
+            optimize_function(m, m.funcs[k], os[w], vectorize_loops);
+        }, ps);
+
+    std::vector<uint64_t> counts;
+    std::vector<uint32_t> base;
+    if (!profile_gen.empty()) {
+        int path = strs.intern(profile_gen.data(), profile_gen.size());
+        prof_instrument(m, path, strs.intern("wb", 2), !jit, prs);
+        n = m.funcs.size();
+    }
+    else if (!profile_use.empty()) {
+        string err;
+        prof_shape(m, base);
+        if (prof_read(m, profile_use, counts, err))
+            prof_order_functions(m, counts, base, prs);
+        else {
+            cerr << profile_use << ": " << err << endl;
+            counts.clear();
+        }
+    }
+
+    funcs.assign(n, MFunc());
+    std::vector<X86Code> code(encode ? n : 0);
+    pool.run(n, [&](size_t k, int w) {
+        if (opt && !profile)
+            optimize_function(m, m.funcs[k], os[w], vectorize_loops);
+        if (!counts.empty())
+            prof_layout(m.funcs[k], &counts[base[k]], profs[w]);
+        x86_select_function(m, m.funcs[k], funcs[k], xs[w]);
+        if (peephole)
+            x86_peephole_function(funcs[k], peeps[w]);
+        if (encode)
+            x86_encode_function(m, funcs[k], code[k], xs[w]);
+    }, ps);
+    for (int w = 0; w < pool.threads(); w++) {
+        add_stats(ost, os[w]);
+        add_stats(xst, xs[w]);
+        add_stats(pst, peeps[w]);
+        add_stats(prs, profs[w]);
+    }
+    if (encode)
+        x86_link(m, funcs, code, obj, xst);
+}
+
+
+/**
+ * 功能：输出插桩的计数数，或按剖析重排的函数、块和转走的转移次数
+ */
+static void print_prof_stats(const ProfStats &st)
+{
+    if (!profile_gen.empty())
+        fprintf(stderr, "pgo: %ld counters\n", st.counters);
+    else if (!profile_use.empty())
+        fprintf(stderr, "pgo: %ld functions executed, %ld blocks moved, %ld never "
+            "executed; %ld taken jumps -> %ld\n",
+            st.hot, st.moved, st.cold, st.jumps[0], st.jumps[1]);
+}
+
+
+/**
+ * 功能：输出代码生成的任务数、线程数和窃取的任务数
+ */
+static void print_pool_stats(const PoolStats &st)
+{
+    fprintf(stderr, "pool: %ld functions on %ld threads, %ld stolen\n",
+        st.tasks, st.threads, st.steals);
+}
+
+
+/**
+ * 功能：把文件编译到本进程的内存中并从 main 开始执行，以其返回值为退出码
+ */
+static int run_jit(const string &file, int max_errors, DiagFormat format,
+    bool opt, bool stats)
+{
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::time_point a, Clock::time_point b) {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+    auto t0 = Clock::now();
+    Syntax syn(file);
+    syn.diagnostics().set_max_errors(max_errors);
+    syn.diagnostics().set_format(format);
+    syn.set_echo(false);
+    syn.set_lower(true);
+    syn.translation_unit();
+    syn.diagnostics().flush(cerr);
+    if (syn.diagnostics().errors())
+        return 1;
+
+    auto t1 = Clock::now();
+    OptStats ost = {};
+    X86Stats xst = {};
+    PeepStats pst = {};
+    PoolStats ps = {};
+    std::vector<MFunc> funcs;
+    X86Object obj;
+    ProfStats prs = {};
+    codegen(syn.ir(), syn.lexer().strings(), opt, true, true, funcs, obj, ost, xst, pst,
+        prs, ps);
+
+    auto t2 = Clock::now();
+    Jit jit;
+    JitStats st = {};
+    string err;
+    bool ok = jit.load(syn.ir(), obj, st, err);
+    void *entry = ok ? jit.function(syn.ir(), "main") : nullptr;
+    if (ok && !entry) {
+        ok = false;
+        err = "no function 'main'";
+    }
+    if (!ok) {
+        cerr << file << ": " << err << endl;
+        return 2;
+    }
+
+    // glibc 的 atexit 不在动态符号表中，改由驱动程序登记
+    if (!profile_gen.empty())
+        atexit((void (*)())jit.function(syn.ir(), PROF_DUMP));
+
+    auto t3 = Clock::now();
+    // 中间代码的值一律为 64 位，返回值已经按 main 的类型扩展
+    int64_t ret = ((int64_t (*)())entry)();
+    fflush(stdout);
+    auto t4 = Clock::now();
+    if (stats)
+        fprintf(stderr, "jit: %ld bytes of code, %ld of data in %ld pages, "
+            "%ld stubs, %ld GOT entries, %ld relocations; front end %.2f ms, "
+            "codegen %.2f ms, load %.2f ms, run %.2f ms\n",
+            st.code_bytes, st.data_bytes, st.pages, st.stubs, st.got, st.relocs,
+            ms(t0, t1), ms(t1, t2), ms(t2, t3), ms(t3, t4));
+    if (stats && peephole)
+        print_peep_stats(pst);
+    if (stats && opt)
+        print_vec_stats(ost, xst);
+    if (stats)
+        print_pool_stats(ps);
+    if (stats)
+        print_prof_stats(prs);
+    // atexit 登记的 __df_prof_dump 在生成的代码中，要在卸载之前退出
+    if (!profile_gen.empty())
+        exit((int)(ret & 0xff));
+    return (int)(ret & 0xff);
+}
+
+
+/**
+ * 功能：把文件编译为 x86-64 代码
+ * to_asm 时输出汇编，写到 output 或标准输出；to_obj 时直接编码为目标文件，
+ * 写到 output 或与源文件同名的 .o；否则把目标文件交给 cc 链接为 output
+ */
+static int compile_native(const string &file, int max_errors, DiagFormat format,
+    bool opt, bool to_asm, bool to_obj, const char *output, bool stats)
+{
+    Syntax syn(file);
+    syn.diagnostics().set_max_errors(max_errors);
+    syn.diagnostics().set_format(format);
+    syn.set_echo(false);
+    syn.set_lower(true);
+    syn.translation_unit();
+    syn.diagnostics().flush(cerr);
+    if (syn.diagnostics().errors())
+        return 1;
+    OptStats ost = {};
+    X86Stats st = {};
+    PeepStats pst = {};
+    PoolStats ps = {};
+    std::vector<MFunc> funcs;
+    X86Object obj;
+    ProfStats prs = {};
+    codegen(syn.ir(), syn.lexer().strings(), opt, !to_asm, false, funcs, obj, ost, st,
+        pst, prs, ps);
+    if (stats) {
+        fprintf(stderr, "x86: %ld functions, %ld instructions, %ld temps with "
+            "%ld spilled, %ld live across calls, %ld moves coalesced, "
+            "%ld callee-saved registers saved\n",
+            st.funcs, st.insts, st.temps, st.spilled, st.across_calls,
+            st.coalesced, st.saved);
+        if (!to_asm)
+            fprintf(stderr, "elf: %ld bytes of code, %zu of data, %ld jumps "
+                "short and %ld long, %ld relocations\n",
+                st.code_bytes, obj.data.size(), st.short_jumps, st.long_jumps,
+                st.relocs);
+        if (peephole)
+            print_peep_stats(pst);
+        if (opt)
+            print_vec_stats(ost, st);
+        print_pool_stats(ps);
+        print_prof_stats(prs);
+    }
+    if (!to_asm && !to_obj && !output)
+        return 0;
+
+    string path;
+    if (to_asm || to_obj)
+        path = output ? output : "";
+    else
+        path = "/tmp/syntax-XXXXXX.o";
+    if (to_obj && !output) {
+        size_t slash = file.rfind('/'), dot = file.rfind('.');
+        size_t from = slash == string::npos ? 0 : slash + 1;
+        if (dot == string::npos || dot < from)
+            dot = file.size();
+        path = file.substr(from, dot - from) + ".o";
+    }
+    FILE *fp = stdout;
+    if (!to_asm && !to_obj) {
+        int fd = mkstemps(&path[0], 2);
+        fp = fd >= 0 ? fdopen(fd, "w") : nullptr;
+    }
+    else if (!path.empty())
+        fp = fopen(path.c_str(), to_asm ? "w" : "wb");
+    bool ok = fp != nullptr;
+    if (ok && to_asm)
+        x86_emit_asm(syn.ir(), funcs, fp);
+    else if (ok)
+        ok = elf_write(syn.ir(), obj, fp);
+    if (fp && fp != stdout)
+        ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        cerr << (path.empty() ? file : path) << ": can not write the output" << endl;
+        return 2;
+    }
+    if (to_asm || to_obj)
+        return 0;
+
+    // 不经过 shell，文件名中的空格、引号等原样传给 cc
+    const char *args[] = {"cc", "-o", output, path.c_str(), nullptr};
+    int status = -1;
+    pid_t pid = fork();
+    if (pid == 0) {
+        execvp(args[0], (char *const *)args);
+        perror("cc");
+        _exit(127);
+    }
+    if (pid > 0)
+        waitpid(pid, &status, 0);
+    unlink(path.c_str());
+    return pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+}
 
 
 /**
@@ -7,7 +568,307 @@
  */ 
 int main(int argc, char const *argv[])
 {
-    Syntax syn(argv[1]);
+    const char *file = nullptr;
+    std::vector<string> files;
+    const char *index_db = nullptr, *query = nullptr;
+    int max_errors = 0;
+    DiagFormat format = DiagFormat::HUMAN;
+    bool quiet = false, outline = false;
+    const char *body = nullptr;
+    const char *cache_dir = nullptr;
+    bool cache_stats = false, sym_stats = false, layout = false;
+    bool dump_ir = false, ir_stats = false, dump_cfg = false, cfg_stats = false;
+    bool opt = false, opt_stats = false;
+    bool vm = false, vm_stats = false, dump_vm = false, vm_profile = false;
+    VmDispatch dispatch = VmDispatch::THREADED;
+    bool to_asm = false, to_obj = false, asm_stats = false;
+    bool run = false, run_stats = false;
+    const char *output = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strncmp(argv[i], "--max-errors=", 13)) {
+            max_errors = atoi(argv[i] + 13);
+        }
+        else if (!strcmp(argv[i], "--diag-format=machine")) {
+            format = DiagFormat::MACHINE;
+        }
+        else if (!strcmp(argv[i], "--diag-format=human")) {
+            format = DiagFormat::HUMAN;
+        }
+        else if (!strcmp(argv[i], "-q")) {
+            quiet = true;
+        }
+        else if (!strcmp(argv[i], "--outline")) {
+            outline = true;
+        }
+        else if (!strncmp(argv[i], "--body=", 7)) {
+            body = argv[i] + 7;
+        }
+        else if (!strncmp(argv[i], "--index=", 8)) {
+            index_db = argv[i] + 8;
+        }
+        else if (!strncmp(argv[i], "--query=", 8)) {
+            query = argv[i] + 8;
+        }
+        else if (!strncmp(argv[i], "--cache-dir=", 12)) {
+            cache_dir = argv[i] + 12;
+        }
+        else if (!strcmp(argv[i], "--cache-stats")) {
+            cache_stats = true;
+        }
+        else if (!strcmp(argv[i], "--sym-stats")) {
+            sym_stats = true;
+        }
+        else if (!strcmp(argv[i], "--str-stats")) {
+            str_stats = true;
+        }
+        else if (!strcmp(argv[i], "--layout-report")) {
+            layout = true;
+        }
+        else if (!strcmp(argv[i], "--dump-ir")) {
+            dump_ir = true;
+        }
+        else if (!strcmp(argv[i], "--ir-stats")) {
+            ir_stats = true;
+        }
+        else if (!strcmp(argv[i], "--dump-cfg")) {
+            dump_cfg = true;
+        }
+        else if (!strcmp(argv[i], "--cfg-stats")) {
+            cfg_stats = true;
+        }
+        else if (!strcmp(argv[i], "-O")) {
+            opt = true;
+        }
+        else if (!strncmp(argv[i], "--inline-threshold=", 19)) {
+            inline_params.threshold = atoi(argv[i] + 19);
+        }
+        else if (!strcmp(argv[i], "--no-inline")) {
+            inline_params.threshold = -1;
+        }
+        else if (!strcmp(argv[i], "--no-peephole")) {
+            peephole = false;
+        }
+        else if (!strcmp(argv[i], "--no-vectorize")) {
+            vectorize_loops = false;
+        }
+        else if (!strncmp(argv[i], "--jobs=", 7)) {
+            jobs = atoi(argv[i] + 7);
+        }
+        else if (!strncmp(argv[i], "--profile-generate=", 19)) {
+            profile_gen = argv[i] + 19;
+        }
+        else if (!strncmp(argv[i], "--profile-use=", 14)) {
+            profile_use = argv[i] + 14;
+        }
+        else if (!strcmp(argv[i], "--opt-stats")) {
+            opt = opt_stats = true;
+        }
+        else if (!strcmp(argv[i], "--vm")) {
+            vm = true;
+        }
+        else if (!strcmp(argv[i], "--vm-dispatch=threaded")) {
+            dispatch = VmDispatch::THREADED;
+        }
+        else if (!strcmp(argv[i], "--vm-dispatch=switch")) {
+            dispatch = VmDispatch::SWITCH;
+        }
+        else if (!strcmp(argv[i], "--vm-stats")) {
+            vm = vm_stats = true;
+        }
+        else if (!strcmp(argv[i], "--vm-profile")) {
+            vm = vm_profile = true;
+        }
+        else if (!strcmp(argv[i], "--dump-vm")) {
+            dump_vm = true;
+        }
+        else if (!strcmp(argv[i], "-S")) {
+            to_asm = true;
+        }
+        else if (!strcmp(argv[i], "-c")) {
+            to_obj = true;
+        }
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            output = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--run")) {
+            run = true;
+        }
+        else if (!strcmp(argv[i], "--run-stats")) {
+            run = run_stats = true;
+        }
+        else if (!strcmp(argv[i], "--asm-stats")) {
+            asm_stats = true;
+        }
+        else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 2;
+        }
+        else files.push_back(argv[i]);
+    }
+
+    if (index_db && query)
+        return query_index(index_db, query);
+    if (index_db) {
+        IndexStats st;
+        if (!SymbolIndex::update(index_db, files, st)) {
+            cerr << index_db << ": can not write the symbol index" << endl;
+            return 2;
+        }
+        cerr << "indexed " << st.parsed << " files, reused " << st.reused
+             << ", dropped " << st.dropped << ", " << st.errors
+             << " with errors" << endl;
+        return 0;
+    }
+    bool native = to_asm || to_obj || output || asm_stats;
+    if (files.empty() ||
+        ((outline || vm || dump_vm || native || run) && files.size() != 1)) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (layout) {
+        int rc = 0;
+        for (const string &f : files) {
+            Syntax syn(f);
+            syn.diagnostics().set_max_errors(max_errors);
+            syn.diagnostics().set_format(format);
+            syn.set_echo(false);
+            syn.translation_unit();
+            layout_report(syn.types(), f);
+            syn.diagnostics().flush(cerr);
+            rc |= syn.diagnostics().errors() ? 1 : 0;
+        }
+        return rc;
+    }
+    if (run)
+        return run_jit(files[0], max_errors, format, opt, run_stats);
+    if (native)
+        return compile_native(files[0], max_errors, format, opt, to_asm, to_obj,
+            output, asm_stats);
+    if (vm || dump_vm)
+        return run_vm(files[0], max_errors, format, opt, dispatch, dump_vm,
+            vm, vm_stats, vm_profile);
+    if (dump_ir || ir_stats || dump_cfg || cfg_stats || opt_stats) {
+        int rc = 0;
+        IrStats total = {};
+        CfgStats cfg = {};
+        OptStats ost = {};
+        for (const string &f : files) {
+            Syntax syn(f);
+            syn.diagnostics().set_max_errors(max_errors);
+            syn.diagnostics().set_format(format);
+            syn.set_echo(false);
+            syn.set_lower(true);
+            syn.translation_unit();
+            // 有错误时中间代码不完整，只报告错误
+            if (!syn.diagnostics().errors()) {
+                if (opt)
+                    optimize(syn.ir(), ost, inline_params);
+                if ((dump_ir || dump_cfg) && files.size() > 1)
+                    printf("; %s\n", f.c_str());
+                if (dump_ir)
+                    ir_dump(syn.ir(), syn.diagnostics(), stdout);
+                if (dump_cfg || cfg_stats)
+                    cfg_report(syn.ir(), syn.diagnostics(),
+                        dump_cfg ? stdout : nullptr, cfg);
+                IrStats st = syn.ir().stats();
+                total.funcs += st.funcs;
+                total.insts += st.insts;
+                total.blocks += st.blocks;
+                total.temps += st.temps;
+                total.bytes += st.bytes;
+            }
+            syn.diagnostics().flush(cerr);
+            rc |= syn.diagnostics().errors() ? 1 : 0;
+        }
+        if (ir_stats)
+            fprintf(stderr, "ir: %ld functions, %ld instructions in %ld blocks, "
+                "%ld temps, %ld bytes (%.1f bytes/instruction)\n",
+                total.funcs, total.insts, total.blocks, total.temps, total.bytes,
+                total.insts ? (double)total.bytes / total.insts : 0.0);
+        if (opt_stats) {
+            fprintf(stderr, "opt: promoted %ld slots with %ld phis and %ld "
+                "extensions, %ld constant operands, %ld branches folded, "
+                "%ld jumps threaded, %ld blocks and %ld instructions removed\n",
+                ost.promoted, ost.phis, ost.exts, ost.consts, ost.branches,
+                ost.threaded, ost.dead_blocks, ost.dead);
+            fprintf(stderr, "opt: %ld instructions hoisted out of loops, "
+                "%ld address computations reduced to %ld pointer "
+                "induction variables\n", ost.hoisted, ost.reduced, ost.ivs);
+            fprintf(stderr, "opt: %ld calls inlined adding %ld instructions, "
+                "%ld copies propagated, %ld blocks merged\n",
+                ost.inlined, ost.inline_insts, ost.copies, ost.merged);
+            fprintf(stderr, "opt: instructions %ld -> %ld, loads %ld -> %ld, "
+                "stores %ld -> %ld, branches %ld -> %ld, in loops %ld -> %ld\n",
+                ost.insts[0], ost.insts[1], ost.loads[0], ost.loads[1],
+                ost.stores[0], ost.stores[1], ost.brs[0], ost.brs[1],
+                ost.loop_insts[0], ost.loop_insts[1]);
+        }
+        if (cfg_stats)
+            fprintf(stderr, "cfg: %ld functions, %ld blocks, %ld edges, "
+                "%ld unreachable, %.2f dominator passes/function, "
+                "%.2f liveness visits and %.2f reaching-definition merges/block\n",
+                cfg.funcs, cfg.blocks, cfg.edges, cfg.unreachable,
+                cfg.funcs ? (double)cfg.dom_passes / cfg.funcs : 0.0,
+                cfg.blocks ? (double)cfg.live_visits / cfg.blocks : 0.0,
+                cfg.blocks ? (double)cfg.reach_merges / cfg.blocks : 0.0);
+        return rc;
+    }
+    if (!outline) {
+        TokenCache *cache = cache_dir ? new TokenCache(cache_dir) : nullptr;
+        int rc = 0;
+        SymStats sym = {};
+        for (const string &f : files)
+            rc |= check_file(f, max_errors, format, quiet, cache, sym);
+        if (sym_stats)
+            fprintf(stderr, "symbols: %ld pushed, %ld lookups, %ld found, "
+                "%.2f probes/lookup, max depth %d, %ld rehashes\n",
+                sym.pushes, sym.lookups, sym.found,
+                sym.lookups ? (double)sym.probes / sym.lookups : 0.0,
+                sym.max_level, sym.rehashes);
+        if (sym_stats)
+            fprintf(stderr, "types: %ld distinct for %ld derived-type requests\n",
+                types, type_requests);
+        if (str_stats)
+            fprintf(stderr, "strings: %ld literals in %ld bytes, %ld distinct "
+                "in %ld bytes, %ld bytes after merging %ld tails\n",
+                str_interns, str_raw, str_distinct, str_pooled, str_merged,
+                str_tails);
+        if (cache && cache_stats) {
+            const CacheStats &st = cache->stats();
+            cerr << "cache: " << st.hits << " hits, " << st.misses
+                 << " misses, " << st.bytes_read << " bytes read, "
+                 << st.bytes_written << " bytes written" << endl;
+        }
+        delete cache;
+        return rc;
+    }
+    file = files[0].c_str();
+
+    Syntax syn(file);
+    syn.diagnostics().set_max_errors(max_errors);
+    syn.diagnostics().set_format(format);
+    syn.set_echo(false);
+    syn.set_lazy_body(true);
     syn.translation_unit();
-    return 0;
+    bool found = !body;
+    if (body) {
+        for (const OutlineEntry &e : syn.outline()) {
+            if (e.kind == OL_FUNC && e.name == body) {
+                syn.set_echo(!quiet);
+                syn.parse_body(e);
+                printf("\n");
+                found = true;
+                break;
+            }
+        }
+    }
+    else
+        print_outline(syn);
+    syn.diagnostics().flush(cerr);
+    if (!found) {
+        cerr << file << ": no function " << body << endl;
+        return 1;
+    }
+    return syn.diagnostics().errors() ? 1 : 0;
 }
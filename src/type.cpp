@@ -0,0 +1,301 @@
+#include "type.h"
+
+#include <algorithm>
+#include <cstdio>
+
+TypeTable::TypeTable() : nrequests(0)
+{
+    for (int k = T_INT; k <= T_VOID; k++)
+        add((TypeKind)k, -1, 0);
+}
+
+int TypeTable::add(TypeKind k, int ref, int count, int first)
+{
+    TypeInfo t = {k, ref, count, first};
+    types.push_back(t);
+    return types.size() - 1;
+}
+
+/* 把整数依次追加为结构编码 */
+static void put(string &key, int v)
+{
+    key.append((const char *)&v, sizeof(v));
+}
+
+int TypeTable::intern(const string &key, TypeKind k, int ref, int count, int first)
+{
+    nrequests++;
+    auto it = interned.find(key);
+    if (it != interned.end())
+        return it->second;
+    int t = add(k, ref, count, first);
+    interned[key] = t;
+    return t;
+}
+
+int TypeTable::pointer(int t)
+{
+    string key;
+    put(key, T_PTR);
+    put(key, t);
+    return intern(key, T_PTR, t, 0);
+}
+
+int TypeTable::array(int t, int n)
+{
+    string key;
+    put(key, T_ARRAY);
+    put(key, t);
+    put(key, n);
+    return intern(key, T_ARRAY, t, n);
+}
+
+int TypeTable::func(int ret, const std::vector<int> &ps)
+{
+    std::vector<int> adj;
+    for (int p : ps)
+        adj.push_back(types[p].kind == T_ARRAY ? pointer(types[p].ref) : p);
+    string key;
+    put(key, T_FUNC);
+    put(key, ret);
+    for (int p : adj)
+        put(key, p);
+    auto it = interned.find(key);
+    if (it != interned.end()) {
+        nrequests++;
+        return it->second;
+    }
+    // 只有新的函数类型才保存形参表
+    int first = params.size();
+    params.insert(params.end(), adj.begin(), adj.end());
+    return intern(key, T_FUNC, ret, adj.size(), first);
+}
+
+int TypeTable::decay(int t)
+{
+    if (t < 0)
+        return t;
+    if (types[t].kind == T_ARRAY)
+        return pointer(types[t].ref);
+    if (types[t].kind == T_FUNC)
+        return pointer(t);
+    return t;
+}
+
+bool TypeTable::assignable(int to, int from, bool null)
+{
+    if (to < 0 || from < 0)
+        return true;
+    from = decay(from);
+    if (to == from)
+        return true;
+    if (is_integer(to))
+        return is_integer(from);
+    if (is_pointer(to)) {
+        if (is_integer(from))
+            return null;
+        // void * 与任何对象指针相互赋值
+        return is_pointer(from) &&
+            (types[to].ref == T_VOID || types[from].ref == T_VOID);
+    }
+    return false;
+}
+
+const Member *TypeTable::find_member(int t, const string &name) const
+{
+    for (const Member &m : structs[types[t].ref].members)
+        if (m.name == name)
+            return &m;
+    return nullptr;
+}
+
+int TypeTable::new_struct(const string &name, int decl)
+{
+    StructInfo s;
+    s.name = name;
+    s.decl = decl;
+    s.size = -1;
+    s.align = 1;
+    structs.push_back(s);
+    return add(T_STRUCT, structs.size() - 1, 0);
+}
+
+int TypeTable::size(int t) const
+{
+    const TypeInfo &ti = types[t];
+    switch (ti.kind) {
+    case T_INT:
+        return 4;
+    case T_SHORT:
+        return 2;
+    case T_CHAR:
+    case T_VOID:
+        return 1;
+    case T_PTR:
+        return PTR_SIZE;
+    case T_FUNC:
+        return -1;
+    case T_ARRAY: {
+        int n = size(ti.ref);
+        return n < 0 || ti.count < 0 ? -1 : n * ti.count;
+    }
+    case T_STRUCT:
+        return structs[ti.ref].size;
+    }
+    return -1;
+}
+
+int TypeTable::align(int t) const
+{
+    const TypeInfo &ti = types[t];
+    switch (ti.kind) {
+    case T_ARRAY:
+        return align(ti.ref);
+    case T_STRUCT:
+        return structs[ti.ref].align;
+    case T_FUNC:
+        return 1;
+    default:
+        return size(t);
+    }
+}
+
+/**
+ * 功能：成员对齐到其类型的对齐值后紧接上一个成员存放
+ */
+bool TypeTable::add_member(int t, const string &name, int type, int decl)
+{
+    StructInfo &s = structs[types[t].ref];
+    int n = size(type), a = align(type);
+    int off = 0;
+    if (!s.members.empty()) {
+        const Member &last = s.members.back();
+        off = last.offset + std::max(size(last.type), 0);
+    }
+    off = (off + a - 1) / a * a;
+    Member m = {name, type, off, decl};
+    s.members.push_back(m);
+    s.align = std::max(s.align, a);
+    return n >= 0;
+}
+
+void TypeTable::finish_struct(int t)
+{
+    StructInfo &s = structs[types[t].ref];
+    int end = 0;
+    if (!s.members.empty())
+        end = s.members.back().offset + std::max(size(s.members.back().type), 0);
+    s.size = (end + s.align - 1) / s.align * s.align;
+}
+
+string TypeTable::name(int t) const
+{
+    if (t < 0)
+        return "?";
+    const TypeInfo &ti = types[t];
+    switch (ti.kind) {
+    case T_INT:
+        return "int";
+    case T_CHAR:
+        return "char";
+    case T_SHORT:
+        return "short";
+    case T_VOID:
+        return "void";
+    case T_PTR:
+        return name(ti.ref) + " *";
+    case T_ARRAY: {
+        string s = name(ti.ref);
+        string n = ti.count < 0 ? "" : std::to_string(ti.count);
+        // 多维数组的维数从外到内书写
+        size_t p = s.find('[');
+        if (p == string::npos)
+            return s + " [" + n + "]";
+        return s.substr(0, p) + "[" + n + "]" + s.substr(p);
+    }
+    case T_FUNC: {
+        string s = name(ti.ref) + " (";
+        for (int i = 0; i < ti.count; i++)
+            s += (i ? ", " : "") + name(param(t, i));
+        return s + ")";
+    }
+    case T_STRUCT:
+        return "struct " + structs[ti.ref].name;
+    }
+    return "?";
+}
+
+
+/* 重排后的布局：只需要大小和跨缓存行成员数 */
+static void measure(const TypeTable &tt, const std::vector<Member> &ms,
+    int &size, int &straddle)
+{
+    int off = 0, maxalign = 1;
+    straddle = 0;
+    for (const Member &m : ms) {
+        int n = std::max(tt.size(m.type), 0), a = tt.align(m.type);
+        off = (off + a - 1) / a * a;
+        if (n > 0 && n <= CACHE_LINE && off / CACHE_LINE != (off + n - 1) / CACHE_LINE)
+            straddle++;
+        off += n;
+        maxalign = std::max(maxalign, a);
+    }
+    size = (off + maxalign - 1) / maxalign * maxalign;
+}
+
+void layout_report(const TypeTable &tt, const string &filename)
+{
+    for (const StructInfo &s : tt.all_structs()) {
+        if (s.size < 0)
+            continue;
+        printf("%s: struct %s {%*s/* size %d, align %d */\n", filename.c_str(),
+            s.name.c_str(), (int)std::max(1, 30 - (int)s.name.size()), "",
+            s.size, s.align);
+        int used = 0, straddle = 0, prev_end = 0;
+        for (const Member &m : s.members) {
+            int n = std::max(tt.size(m.type), 0);
+            if (m.offset > prev_end)
+                printf("    %-36s /* %d bytes hole */\n", "", m.offset - prev_end);
+            // 按 C 的写法把成员名放在 * 之后、[ 之前
+            string ts = tt.name(m.type), decl;
+            size_t p = ts.find(" [");
+            string base = p == string::npos ? ts : ts.substr(0, p);
+            decl = base + (base.back() == '*' ? "" : " ") + m.name;
+            if (p != string::npos)
+                decl += ts.substr(p + 1);
+            decl += ";";
+            bool cross = n > 0 && n <= CACHE_LINE &&
+                m.offset / CACHE_LINE != (m.offset + n - 1) / CACHE_LINE;
+            printf("    %-36s /* %5d %5d */%s\n", decl.c_str(), m.offset, n,
+                cross ? "  straddles cache line" : "");
+            straddle += cross;
+            used += n;
+            prev_end = m.offset + n;
+        }
+        int pad = s.size - used;
+        printf("};  /* %d bytes used, %d bytes padding", used, pad);
+        if (straddle)
+            printf(", %d straddling a cache line", straddle);
+        printf(" */\n");
+
+        if (pad == 0 && straddle == 0)
+            continue;
+        // 按对齐从大到小重排可以消除成员间的空洞
+        std::vector<Member> order = s.members;
+        std::stable_sort(order.begin(), order.end(),
+            [&tt](const Member &a, const Member &b) {
+                return tt.align(a.type) > tt.align(b.type);
+            });
+        int nsize, nstraddle;
+        measure(tt, order, nsize, nstraddle);
+        if (nsize < s.size || nstraddle < straddle) {
+            printf("    suggested order:");
+            for (size_t i = 0; i < order.size(); i++)
+                printf("%s %s", i ? "," : "", order[i].name.c_str());
+            printf("  -> size %d (saves %d bytes)", nsize, s.size - nsize);
+            if (nstraddle < straddle)
+                printf(", %d straddling", nstraddle);
+            printf("\n");
+        }
+    }
+}
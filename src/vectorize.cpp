@@ -0,0 +1,803 @@
+#include "opt.h"
+
+#include <algorithm>
+
+#define VEC_BYTES   16
+#define VEC_TEMPS   15      // 向量临时变量至多同时占用的 xmm 寄存器，xmm15 留给指令选择
+
+/* 首块中的归纳变量 v = phi(init, v + step) */
+struct VecIv {
+    Ref v, init, next;
+    int32_t step;
+    int size;           // 递增运算的宽度
+    Ref vv, vnext;      // 向量循环中对应的变量，每次增加 step * 道数
+    bool used;          // 作为访存地址，即一个元素序列
+    bool stored;
+    bool always;        // 在每次迭代都执行的块中取数过
+};
+
+/* 向量的值，exact 为假时各道只有低位与标量相等，只能再加减或存入 */
+struct VecVal {
+    Ref r;
+    bool exact;
+};
+
+/* 掩码，r 为 REF_NONE 时全为 1，neg 表示取反 */
+struct Mask {
+    Ref r;
+    bool neg;
+};
+
+static int width_of(int64_t v)
+{
+    return v == (int8_t)v ? 1 : v == (int16_t)v ? 2 : v == (int32_t)v ? 4 : 8;
+}
+
+/* 一个循环的向量化 */
+class Vectorizer {
+public:
+    Vectorizer(IrFunc &f, const Cfg &g, const DomTree &t, const Loop &l)
+        : f(f), g(g), t(t), l(l) {}
+
+    /**
+     * 功能：检查并改写循环，不能向量化时不改动 f
+     */
+    bool run(OptStats &st);
+
+private:
+    bool check();
+    bool convert();
+    void rebuild();
+
+    bool in_loop(Ref r) const;
+    int iv_of(Ref r) const;
+    Ref object(Ref r) const;
+    bool disjoint(int x, int y) const;
+    bool reaches(uint32_t from, uint32_t to, uint32_t avoid,
+        const std::vector<char> &stop) const;
+    int width(Ref r) const;
+    bool value(Ref r, VecVal &v);
+    Ref vop(IrOp op, Ref a, Ref b);
+    Ref select(Mask m, Ref a, Ref b);
+    Mask mask_and(Mask x, Mask y);
+    Mask mask_or(Mask x, Mask y);
+    Mask edge(uint32_t p, uint32_t s);
+    void emit(std::vector<IrInst> &out, IrOp op, int size, Ref d, Ref a, Ref b);
+    int pressure() const;
+    uint32_t final_block(uint32_t b) const { return b < header ? b : b + 2; }
+
+    IrFunc &f;
+    const Cfg &g;
+    const DomTree &t;
+    const Loop &l;
+    uint32_t header, body, latch, pre;
+    int elem, lanes;
+    std::vector<VecIv> ivs;
+    int counter;                    // 循环条件中的归纳变量
+    Ref bound;                      // 循环条件 i < n 中的 n
+    bool inclusive;                 // 条件为 i <= n
+    std::vector<uint32_t> def;      // 各临时变量的定值指令
+    std::vector<uint32_t> uses;
+    std::vector<char> inloop;
+    std::vector<std::pair<int, int>> checks;    // 运行时检查不重叠的指针对
+
+    std::vector<VecVal> vals;       // 循环中各临时变量对应的向量
+    std::vector<Mask> masks, conds; // 各块执行的道和分支条件
+    std::vector<std::pair<Ref, VecVal>> splats;
+    std::vector<Ref> loaded, pending;   // 各序列取出的向量和待存入的向量
+    std::vector<int> store_order;
+    std::vector<IrInst> pre_code, splat_code, head_code, body_code;
+    Ref end;                        // 向量循环中计数变量的终值
+    uint32_t loc;
+};
+
+bool Vectorizer::in_loop(Ref r) const
+{
+    if (ref_tag(r) != RT_TEMP || def[ref_index(r)] == UINT32_MAX)
+        return false;
+    uint32_t i = def[ref_index(r)];
+    for (uint32_t b : l.blocks)
+        if (i >= f.blocks[b].first && i < f.blocks[b].end)
+            return true;
+    return false;
+}
+
+int Vectorizer::iv_of(Ref r) const
+{
+    for (size_t k = 0; k < ivs.size(); k++)
+        if (ivs[k].v == r)
+            return k;
+    return -1;
+}
+
+/**
+ * 功能：指针所指的对象，即全局变量、栈槽或字符串常量，不能确定时为 REF_NONE
+ */
+Ref Vectorizer::object(Ref r) const
+{
+    RefTag tag = ref_tag(r);
+    if (tag == RT_GLOBAL || tag == RT_SLOT || tag == RT_STR)
+        return r;
+    if (tag != RT_TEMP || def[ref_index(r)] == UINT32_MAX)
+        return REF_NONE;
+    uint32_t i = def[ref_index(r)];
+    if (f.op[i] != IR_ADD || f.size[i] != 8)
+        return REF_NONE;
+    RefTag ta = ref_tag(f.a[i]), tb = ref_tag(f.b[i]);
+    if (tb == RT_IMM || tb == RT_CONST)
+        return object(f.a[i]);
+    if (ta == RT_IMM || ta == RT_CONST)
+        return object(f.b[i]);
+    return REF_NONE;
+}
+
+/**
+ * 功能：两个序列是否在编译时就能确定不重叠，即指向不同的对象
+ */
+bool Vectorizer::disjoint(int x, int y) const
+{
+    Ref a = object(ivs[x].init), b = object(ivs[y].init);
+    return a != REF_NONE && b != REF_NONE && a != b;
+}
+
+/**
+ * 功能：在一次迭代内从 from 出发不经过 avoid 和 stop 中的块能否到达 to
+ */
+bool Vectorizer::reaches(uint32_t from, uint32_t to, uint32_t avoid,
+    const std::vector<char> &stop) const
+{
+    std::vector<char> seen(g.nblocks, 0);
+    std::vector<uint32_t> work(1, from);
+    seen[from] = 1;
+    while (!work.empty()) {
+        uint32_t b = work.back();
+        work.pop_back();
+        if (stop[b] || b == avoid)
+            continue;
+        if (b == to)
+            return true;
+        for (const uint32_t *s = g.succ_begin(b); s != g.succ_end(b); s++)
+            if (*s != header && !seen[*s]) {
+                seen[*s] = 1;
+                work.push_back(*s);
+            }
+    }
+    return false;
+}
+
+/**
+ * 功能：检查循环的形状，找出归纳变量、循环条件和各元素序列
+ */
+bool Vectorizer::check()
+{
+    if (l.preheader < 0 || l.latches.size() != 1 || l.blocks.size() < 2)
+        return false;
+    header = l.header;
+    latch = l.latches[0];
+    pre = l.preheader;
+    def.assign(f.ntemps, UINT32_MAX);
+    uses.assign(f.ntemps, 0);
+    for (uint32_t i = 0; i < f.count(); i++) {
+        if (ref_tag(f.d[i]) == RT_TEMP && f.op[i] != IR_BR)
+            def[ref_index(f.d[i])] = i;
+        if (ref_tag(f.a[i]) == RT_TEMP && f.op[i] != IR_PHI)
+            uses[ref_index(f.a[i])]++;
+        if (ref_tag(f.b[i]) == RT_TEMP && f.op[i] != IR_PHI)
+            uses[ref_index(f.b[i])]++;
+    }
+    for (size_t k = 1; k < f.phis.size(); k += 2)
+        if (ref_tag(f.phis[k]) == RT_TEMP)
+            uses[ref_index(f.phis[k])]++;
+    inloop.assign(g.nblocks, 0);
+    for (uint32_t b : l.blocks)
+        inloop[b] = 1;
+    for (uint32_t b : l.blocks)
+        for (const uint32_t *s = g.succ_begin(b); s != g.succ_end(b); s++)
+            if (!inloop[*s] && b != header)
+                return false;
+    if (f.op[f.blocks[latch].end - 1] != IR_JMP ||
+        f.op[f.blocks[pre].end - 1] != IR_JMP)
+        return false;
+
+    // 首块：各归纳变量的 phi，然后是比较和分支
+    const IrBlock &hb = f.blocks[header];
+    uint32_t i = hb.first;
+    for (; i < hb.end && f.op[i] == IR_PHI; i++) {
+        if (f.constant(f.b[i]) != 2)
+            return false;
+        uint32_t k = f.constant(f.a[i]);
+        VecIv iv = {f.d[i], REF_NONE, REF_NONE, 0, 8, REF_NONE, REF_NONE,
+            false, false, false};
+        for (uint32_t j = k; j < k + 4; j += 2) {
+            if (ref_index(f.phis[j]) == pre)
+                iv.init = f.phis[j + 1];
+            else if (ref_index(f.phis[j]) == latch)
+                iv.next = f.phis[j + 1];
+        }
+        if (iv.init == REF_NONE || !in_loop(iv.next) || uses[ref_index(iv.next)] != 1)
+            return false;
+        uint32_t n = def[ref_index(iv.next)];
+        Ref step = f.a[n] == iv.v ? f.b[n] : f.b[n] == iv.v ? f.a[n] : REF_NONE;
+        if (f.op[n] != IR_ADD || (ref_tag(step) != RT_IMM && ref_tag(step) != RT_CONST))
+            return false;
+        iv.step = f.constant(step);
+        iv.size = f.size[n];
+        ivs.push_back(iv);
+    }
+    if (i + 2 != hb.end || f.op[i + 1] != IR_BR || f.a[i + 1] != f.d[i] ||
+        f.op[i] < IR_EQ || f.op[i] > IR_GE || uses[ref_index(f.d[i])] != 1)
+        return false;
+    body = ref_index(f.b[i + 1]);
+    if (!inloop[body] || inloop[ref_index(f.d[i + 1])])
+        return false;
+
+    // 条件化为 i < n 或 i <= n，i 每次加 1，n 不变
+    IrOp op = (IrOp)f.op[i];
+    Ref x = f.a[i], y = f.b[i];
+    if (op == IR_GT || op == IR_GE) {
+        std::swap(x, y);
+        op = op == IR_GT ? IR_LT : IR_LE;
+    }
+    counter = iv_of(x);
+    if ((op != IR_LT && op != IR_LE) || counter < 0 || ivs[counter].step != 1 ||
+        in_loop(y) || iv_of(y) >= 0)
+        return false;
+    bound = y;
+    inclusive = op == IR_LE;
+    uint32_t cmp = i;
+
+    // 循环体中只能有加减、扩展、比较、经序列的访存和转移
+    elem = 0;
+    bool any_store = false;
+    std::vector<std::pair<uint32_t, int>> stores;   // 已见到的存入所在的块和序列
+    std::vector<char> none(g.nblocks, 0);
+    for (uint32_t b : l.blocks) {
+        if (b == header)
+            continue;
+        bool always = t.dominates(b, latch);
+        for (uint32_t j = f.blocks[b].first; j < f.blocks[b].end; j++) {
+            IrOp o = (IrOp)f.op[j];
+            int s = -1;
+            switch (o) {
+            case IR_NOP: case IR_JMP: case IR_BR: case IR_NEG: case IR_EXT:
+            case IR_ADD: case IR_SUB:
+                break;
+            case IR_PHI:
+                if (f.constant(f.b[j]) != 2)
+                    return false;
+                break;
+            case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+                // 比较的结果只用于本块的分支
+                if (uses[ref_index(f.d[j])] != 1 || f.op[f.blocks[b].end - 1] != IR_BR ||
+                    f.a[f.blocks[b].end - 1] != f.d[j])
+                    return false;
+                break;
+            case IR_LOAD: case IR_STORE:
+                s = iv_of(f.a[j]);
+                if (s < 0 || ivs[s].step != f.size[j] || (elem && elem != f.size[j]))
+                    return false;
+                elem = f.size[j];
+                ivs[s].used = true;
+                if (o == IR_STORE) {
+                    ivs[s].stored = true;
+                    stores.push_back(std::make_pair(b, s));
+                    any_store = true;
+                    break;
+                }
+                ivs[s].always |= always;
+                // 同一次迭代中存入之后再取出可能重叠的序列时次序不能改变，
+                // 按逆后序扫描，能到达本块的存入都已见到
+                for (const std::pair<uint32_t, int> &w : stores)
+                    if (!disjoint(w.second, s) &&
+                        (w.first == b || reaches(w.first, b, UINT32_MAX, none)))
+                        return false;
+                break;
+            default:
+                return false;
+            }
+            // 归纳变量只能用于访存地址、自身的递增和循环条件
+            Ref ops[2] = {f.a[j], f.b[j]};
+            for (int k = 0; k < 2; k++) {
+                if (o == IR_PHI || (k == 0 && s >= 0))
+                    continue;
+                for (const VecIv &iv : ivs)
+                    if (ops[k] == iv.v && !(f.d[j] == iv.next && ref_tag(iv.next) == RT_TEMP))
+                        return false;
+            }
+            if (o == IR_PHI) {
+                uint32_t first = f.constant(f.a[j]);
+                for (uint32_t k = first; k < first + 4; k += 2)
+                    if (iv_of(f.phis[k + 1]) >= 0)
+                        return false;
+            }
+        }
+    }
+    if ((elem != 1 && elem != 2 && elem != 4) || !any_store)
+        return false;
+
+    std::vector<char> stop(g.nblocks, 0);
+    for (size_t s = 0; s < ivs.size(); s++) {
+        if (!ivs[s].used)
+            continue;
+        // 推测执行的取数只能访问每次迭代都会访问的序列，
+        // 存入的序列下面还要检查每次迭代都会存入
+        if (!ivs[s].always && !ivs[s].stored)
+            return false;
+        if (!ivs[s].stored)
+            continue;
+        // 每条路径都须存入，否则按位选择时没有原来的值可选
+        std::fill(stop.begin(), stop.end(), 0);
+        for (uint32_t b : l.blocks)
+            for (uint32_t j = f.blocks[b].first; j < f.blocks[b].end; j++)
+                if (f.op[j] == IR_STORE && f.a[j] == ivs[s].v)
+                    stop[b] = 1;
+        if (reaches(body, latch, UINT32_MAX, stop))
+            return false;
+        for (size_t r = 0; r < ivs.size(); r++)
+            if (r != s && ivs[r].used && !disjoint(s, r) &&
+                !(ivs[r].stored && r < s))
+                checks.push_back(std::make_pair((int)s, (int)r));
+    }
+    lanes = VEC_BYTES / elem;
+    loc = f.loc[cmp];
+    return true;
+}
+
+void Vectorizer::emit(std::vector<IrInst> &out, IrOp op, int size, Ref d, Ref a, Ref b)
+{
+    IrInst x = {op, (uint8_t)size, d, a, b, loc};
+    out.push_back(x);
+}
+
+Ref Vectorizer::vop(IrOp op, Ref a, Ref b)
+{
+    Ref d = f.temp();
+    emit(body_code, op, elem, d, a, b);
+    return d;
+}
+
+/**
+ * 功能：向量循环体中同时活跃的向量临时变量数的最大值
+ * 与分配 xmm 寄存器时一样，在一条指令处结束的变量可以让给在此定值的变量
+ */
+int Vectorizer::pressure() const
+{
+    std::vector<Ref> temps;
+    std::vector<uint32_t> first, last;
+    for (uint32_t k = 0; k < body_code.size(); k++) {
+        const IrInst &x = body_code[k];
+        if (x.op < IR_VSPLAT)
+            continue;
+        Ref ops[3] = {x.d, x.a, x.b};
+        for (int j = 0; j < 3; j++) {
+            if (ref_tag(ops[j]) != RT_TEMP)
+                continue;
+            size_t n = std::find(temps.begin(), temps.end(), ops[j]) - temps.begin();
+            if (n < temps.size())
+                last[n] = k;
+            else if (j == 0) {
+                // 前置块中广播的值和计数变量不在这里定值，另计或不占 xmm
+                temps.push_back(ops[j]);
+                first.push_back(k);
+                last.push_back(k);
+            }
+        }
+    }
+    int most = 0;
+    for (uint32_t k = 0; k < body_code.size(); k++) {
+        int live = 0;
+        for (size_t n = 0; n < temps.size(); n++)
+            live += first[n] <= k && (k < last[n] || first[n] == k);
+        most = std::max(most, live);
+    }
+    return most;
+}
+
+/**
+ * 功能：值在几个字节内符号扩展，按定值指令保守地求出
+ */
+int Vectorizer::width(Ref r) const
+{
+    switch (ref_tag(r)) {
+    case RT_IMM: case RT_CONST:
+        return width_of(f.constant(r));
+    case RT_TEMP: {
+        uint32_t i = def[ref_index(r)];
+        if (i == UINT32_MAX)
+            return 8;
+        switch (f.op[i]) {
+        case IR_PARAM: case IR_LOAD: case IR_EXT: case IR_ADD: case IR_SUB:
+        case IR_MUL: case IR_DIV: case IR_MOD: case IR_NEG: case IR_CALL:
+            return f.size[i] ? f.size[i] : 8;
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+            return 1;
+        default:
+            return 8;
+        }
+    }
+    default:
+        return 8;
+    }
+}
+
+/**
+ * 功能：r 对应的向量，循环外的值在前置块中广播到各道
+ */
+bool Vectorizer::value(Ref r, VecVal &v)
+{
+    if (in_loop(r)) {
+        v = vals[ref_index(r)];
+        return v.r != REF_NONE;
+    }
+    for (const std::pair<Ref, VecVal> &s : splats)
+        if (s.first == r) {
+            v = s.second;
+            return true;
+        }
+    v.r = f.temp();
+    v.exact = width(r) <= elem;
+    emit(splat_code, IR_VSPLAT, elem, v.r, r, REF_NONE);
+    splats.push_back(std::make_pair(r, v));
+    return true;
+}
+
+/**
+ * 功能：按掩码选择，m 中为 1 的道取 a，其余取 b
+ */
+Ref Vectorizer::select(Mask m, Ref a, Ref b)
+{
+    if (m.neg)
+        std::swap(a, b);
+    if (m.r == REF_NONE || a == b)
+        return a;
+    Ref x = vop(IR_VAND, m.r, a);
+    Ref y = vop(IR_VANDN, m.r, b);
+    return vop(IR_VOR, x, y);
+}
+
+/* 取反的掩码按 ~x & y = andn(x, y) 等恒等式合并，不必单独求反 */
+Mask Vectorizer::mask_and(Mask x, Mask y)
+{
+    if (x.r == REF_NONE)
+        return y;
+    if (y.r == REF_NONE)
+        return x;
+    Mask m = {REF_NONE, false};
+    if (!x.neg && !y.neg)
+        m.r = vop(IR_VAND, x.r, y.r);
+    else if (x.neg && !y.neg)
+        m.r = vop(IR_VANDN, x.r, y.r);
+    else if (!x.neg && y.neg)
+        m.r = vop(IR_VANDN, y.r, x.r);
+    else {
+        m.r = vop(IR_VOR, x.r, y.r);
+        m.neg = true;
+    }
+    return m;
+}
+
+Mask Vectorizer::mask_or(Mask x, Mask y)
+{
+    Mask m = {REF_NONE, false};
+    if (x.r == REF_NONE || y.r == REF_NONE)
+        return m;
+    m.neg = x.neg || y.neg;
+    if (!x.neg && !y.neg)
+        m.r = vop(IR_VOR, x.r, y.r);
+    else if (x.neg && !y.neg)
+        m.r = vop(IR_VANDN, y.r, x.r);
+    else if (!x.neg && y.neg)
+        m.r = vop(IR_VANDN, x.r, y.r);
+    else
+        m.r = vop(IR_VAND, x.r, y.r);
+    return m;
+}
+
+/**
+ * 功能：沿边 p -> s 执行的道
+ */
+Mask Vectorizer::edge(uint32_t p, uint32_t s)
+{
+    uint32_t last = f.blocks[p].end - 1;
+    if (f.op[last] != IR_BR || f.b[last] == f.d[last])
+        return masks[p];
+    Mask c = conds[p];
+    if (ref_index(f.b[last]) != s)
+        c.neg = !c.neg;
+    return mask_and(masks[p], c);
+}
+
+/**
+ * 功能：生成前置块中的计数和检查、向量循环的首块和循环体
+ */
+bool Vectorizer::convert()
+{
+    vals.assign(f.ntemps, VecVal{REF_NONE, false});
+    masks.assign(g.nblocks, Mask{REF_NONE, false});
+    conds.assign(g.nblocks, Mask{REF_NONE, false});
+    loaded.assign(ivs.size(), REF_NONE);
+    pending.assign(ivs.size(), REF_NONE);
+
+    // 向量循环执行 (n - i0) 去掉不足一个向量的余数次，指针可能重叠时为 0 次
+    const VecIv &c = ivs[counter];
+    Ref rem = f.temp();
+    emit(pre_code, IR_SUB, 8, rem, bound, c.init);
+    if (inclusive) {
+        Ref r = f.temp();
+        emit(pre_code, IR_ADD, 8, r, rem, f.imm(1));
+        rem = r;
+    }
+    Ref odd = f.temp(), cnt = f.temp();
+    emit(pre_code, IR_MOD, 8, odd, rem, f.imm(lanes));
+    emit(pre_code, IR_SUB, 8, cnt, rem, odd);
+    for (const std::pair<int, int> &k : checks) {
+        Ref dist = f.temp(), ahead = f.temp(), behind = f.temp(), ok = f.temp();
+        emit(pre_code, IR_SUB, 8, dist, ivs[k.second].init, ivs[k.first].init);
+        emit(pre_code, IR_GE, 8, ahead, dist, f.imm(VEC_BYTES));
+        emit(pre_code, IR_LE, 8, behind, dist, f.imm(-VEC_BYTES));
+        emit(pre_code, IR_ADD, 8, ok, ahead, behind);
+        if (!ivs[k.second].stored) {
+            // 只取数的序列与存入的序列相同时逐道读写同一元素，也可以
+            Ref same = f.temp(), any = f.temp();
+            emit(pre_code, IR_EQ, 8, same, dist, f.imm(0));
+            emit(pre_code, IR_ADD, 8, any, ok, same);
+            ok = any;
+        }
+        Ref n = f.temp();
+        emit(pre_code, IR_MUL, 8, n, cnt, ok);
+        cnt = n;
+    }
+    end = f.temp();
+    emit(pre_code, IR_ADD, 8, end, c.init, cnt);
+    for (VecIv &iv : ivs) {
+        iv.vv = f.temp();
+        iv.vnext = f.temp();
+    }
+
+    for (uint32_t b : l.blocks) {
+        if (b == header)
+            continue;
+        int up = t.idom[b];
+        std::vector<char> none(g.nblocks, 0);
+        if (b != body && inloop[up] && (uint32_t)up != header &&
+            !reaches(up, latch, b, none))
+            masks[b] = masks[up];   // 支配者的每次执行都经过 b，执行的道相同
+        else if (b != body) {
+            Mask m = {REF_NONE, false};
+            bool first = true;
+            for (const uint32_t *p = g.pred_begin(b); p != g.pred_end(b); p++) {
+                Mask e = edge(*p, b);
+                m = first ? e : mask_or(m, e);
+                first = false;
+            }
+            masks[b] = m;
+        }
+        for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++) {
+            IrOp op = (IrOp)f.op[i];
+            Ref d = f.d[i];
+            VecVal x, y;
+            switch (op) {
+            case IR_PHI: {
+                uint32_t k = f.constant(f.a[i]);
+                Mask m = edge(ref_index(f.phis[k]), b);
+                if (!value(f.phis[k + 1], x) || !value(f.phis[k + 3], y))
+                    return false;
+                VecVal v = {select(m, x.r, y.r), x.exact && y.exact};
+                vals[ref_index(d)] = v;
+                break;
+            }
+            case IR_LOAD: {
+                int s = iv_of(f.a[i]);
+                if (loaded[s] == REF_NONE)
+                    loaded[s] = vop(IR_VLOAD, ivs[s].vv, REF_NONE);
+                VecVal v = {loaded[s], true};
+                vals[ref_index(d)] = v;
+                break;
+            }
+            case IR_STORE: {
+                int s = iv_of(f.a[i]);
+                if (!value(f.b[i], x))
+                    return false;
+                if (pending[s] == REF_NONE) {
+                    pending[s] = x.r;
+                    store_order.push_back(s);
+                }
+                else
+                    pending[s] = select(masks[b], x.r, pending[s]);
+                break;
+            }
+            case IR_ADD: case IR_SUB: case IR_NEG: {
+                bool step = false;
+                for (const VecIv &iv : ivs)
+                    step |= iv.next == d;
+                if (step)
+                    break;
+                if (op == IR_NEG) {
+                    if (!value(f.imm(0), x) || !value(f.a[i], y))
+                        return false;
+                }
+                else if (!value(f.a[i], x) || !value(f.b[i], y))
+                    return false;
+                // 道宽与运算宽度相同时回绕的结果与标量的截断一致
+                VecVal v = {vop(op == IR_ADD ? IR_VADD : IR_VSUB, x.r, y.r),
+                    f.size[i] == elem};
+                vals[ref_index(d)] = v;
+                break;
+            }
+            case IR_EXT:
+                if (f.size[i] < elem || !value(f.a[i], x))
+                    return false;
+                x.exact = x.exact || f.size[i] == elem;
+                vals[ref_index(d)] = x;
+                break;
+            case IR_BR: {
+                Ref cv = f.a[i];
+                uint32_t k = ref_tag(cv) == RT_TEMP ? def[ref_index(cv)] : UINT32_MAX;
+                Mask m = {REF_NONE, false};
+                if (k != UINT32_MAX && f.op[k] >= IR_EQ && f.op[k] <= IR_GE &&
+                    k >= f.blocks[b].first && k < i) {
+                    if (!value(f.a[k], x) || !value(f.b[k], y) || !x.exact || !y.exact)
+                        return false;
+                    switch (f.op[k]) {
+                    case IR_EQ: m.r = vop(IR_VEQ, x.r, y.r); break;
+                    case IR_NE: m.r = vop(IR_VEQ, x.r, y.r); m.neg = true; break;
+                    case IR_GT: m.r = vop(IR_VGT, x.r, y.r); break;
+                    case IR_LT: m.r = vop(IR_VGT, y.r, x.r); break;
+                    case IR_GE: m.r = vop(IR_VGT, y.r, x.r); m.neg = true; break;
+                    default: m.r = vop(IR_VGT, x.r, y.r); m.neg = true; break;
+                    }
+                }
+                else {
+                    if (!value(cv, x) || !x.exact || !value(f.imm(0), y))
+                        return false;
+                    m.r = vop(IR_VEQ, x.r, y.r);
+                    m.neg = true;
+                }
+                conds[b] = m;
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+    for (int s : store_order)
+        emit(body_code, IR_VSTORE, elem, REF_NONE, ivs[s].vv, pending[s]);
+    if (splats.size() + pressure() > VEC_TEMPS)
+        return false;
+
+    for (const VecIv &iv : ivs)
+        emit(body_code, IR_ADD, iv.size, iv.vnext, iv.vv, f.imm(iv.step * lanes));
+    emit(body_code, IR_JMP, 0, REF_NONE, make_ref(RT_BLOCK, header), REF_NONE);
+    Ref go = f.temp();
+    emit(head_code, IR_LT, 8, go, c.vv, end);
+    emit(head_code, IR_BR, 0, make_ref(RT_BLOCK, header + 2), go,
+        make_ref(RT_BLOCK, header + 1));
+    return true;
+}
+
+/**
+ * 功能：在原循环的首块之前插入向量循环的首块和循环体
+ * 前置块转到向量循环，向量循环结束时转到原来的首块，从已完成的迭代继续
+ */
+void Vectorizer::rebuild()
+{
+    auto fix = [&](Ref r) {
+        return ref_tag(r) == RT_BLOCK ? make_ref(RT_BLOCK, final_block(ref_index(r))) : r;
+    };
+    for (size_t k = 0; k < f.phis.size(); k += 2)
+        f.phis[k] = fix(f.phis[k]);
+    uint32_t vh = header, vb = header + 1, fpre = final_block(pre);
+
+    // 向量循环的归纳变量从原来的初值开始
+    std::vector<IrInst> head;
+    for (const VecIv &iv : ivs) {
+        IrInst x = {IR_PHI, 8, iv.vv, f.imm(f.phis.size()), f.imm(2), loc};
+        f.phis.push_back(make_ref(RT_BLOCK, fpre));
+        f.phis.push_back(iv.init);
+        f.phis.push_back(make_ref(RT_BLOCK, vb));
+        f.phis.push_back(iv.vnext);
+        head.push_back(x);
+    }
+    head.insert(head.end(), head_code.begin(), head_code.end());
+
+    // 原来的首块改从向量循环转入
+    const IrBlock &hb = f.blocks[header];
+    for (uint32_t i = hb.first; i < hb.end && f.op[i] == IR_PHI; i++) {
+        uint32_t k = f.constant(f.a[i]);
+        for (uint32_t j = k; j < k + 4; j += 2)
+            if (ref_index(f.phis[j]) == fpre) {
+                f.phis[j] = make_ref(RT_BLOCK, vh);
+                f.phis[j + 1] = ivs[iv_of(f.d[i])].vv;
+            }
+    }
+
+    IrFunc out;
+    std::vector<IrBlock> blocks;
+    auto put = [&](const IrInst &x) {
+        out.op.push_back(x.op);
+        out.size.push_back(x.size);
+        out.d.push_back(x.d);
+        out.a.push_back(x.a);
+        out.b.push_back(x.b);
+        out.loc.push_back(x.loc);
+    };
+    auto block = [&](const std::vector<IrInst> &code) {
+        IrBlock blk = {(uint32_t)out.op.size(), 0};
+        for (const IrInst &x : code)
+            put(x);
+        blk.end = out.op.size();
+        blocks.push_back(blk);
+    };
+    for (uint32_t b = 0; b < f.blocks.size(); b++) {
+        if (b == header) {
+            block(head);
+            block(body_code);
+        }
+        IrBlock blk = {(uint32_t)out.op.size(), 0};
+        for (uint32_t i = f.blocks[b].first; i < f.blocks[b].end; i++) {
+            IrInst x = f.inst(i);
+            if (x.op != IR_PHI) {
+                x.a = fix(x.a);
+                x.b = fix(x.b);
+                x.d = fix(x.d);
+            }
+            if (b == pre && i == f.blocks[b].end - 1) {
+                for (const IrInst &y : pre_code)
+                    put(y);
+                for (const IrInst &y : splat_code)
+                    put(y);
+                x.a = make_ref(RT_BLOCK, vh);
+            }
+            put(x);
+        }
+        blk.end = out.op.size();
+        blocks.push_back(blk);
+    }
+    f.op.swap(out.op);
+    f.size.swap(out.size);
+    f.d.swap(out.d);
+    f.a.swap(out.a);
+    f.b.swap(out.b);
+    f.loc.swap(out.loc);
+    f.blocks.swap(blocks);
+}
+
+bool Vectorizer::run(OptStats &st)
+{
+    uint32_t ntemps = f.ntemps;
+    size_t nconsts = f.consts.size();
+    if (!check() || !convert()) {
+        f.ntemps = ntemps;
+        f.consts.resize(nconsts);
+        return false;
+    }
+    rebuild();
+    st.vectorized++;
+    for (const IrInst &x : body_code)
+        st.vec_insts += x.op >= IR_VSPLAT;
+    st.vec_insts += splat_code.size();
+    return true;
+}
+
+
+void vectorize(IrFunc &f, OptStats &st)
+{
+    // 每次改写后重新找循环；向量循环和余下的标量循环都不会再被选中
+    for (bool again = true; again; ) {
+        again = false;
+        Cfg g;
+        DomTree t;
+        std::vector<Loop> loops;
+        build_cfg(f, g);
+        build_domtree(g, t);
+        find_loops(g, t, loops);
+        std::vector<char> inner(loops.size(), 1);
+        for (const Loop &l : loops)
+            if (l.parent >= 0)
+                inner[l.parent] = 0;
+        for (size_t k = 0; k < loops.size() && !again; k++)
+            if (inner[k] && Vectorizer(f, g, t, loops[k]).run(st))
+                again = true;
+    }
+}
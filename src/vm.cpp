@@ -0,0 +1,906 @@
+#include "vm.h"
+#include "strpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sys/time.h>
+
+#define VM_REGS     (1 << 22)   // 寄存器栈的大小
+#define VM_STACK    (8 << 20)   // 栈槽所在内存的字节数
+#define VM_MAX_ARGS 64
+#define VM_MAX_DEPTH 100000
+#define VM_SAMPLE_US 200        // 剖析时采样的间隔，微秒
+
+static const char *vm_names[] = {
+#define VM_NAME(x) #x,
+    VM_OPS(VM_NAME)
+#undef VM_NAME
+};
+
+/* 内建函数，对应 C 库中的同名函数 */
+enum Builtin {
+    B_STRLEN, B_STRCMP, B_STRNCMP, B_STRCPY, B_STRCAT, B_MEMCMP, B_MEMCPY,
+    B_MEMSET, B_ABS, B_PUTCHAR, B_PUTS, B_PRINTF, B_MALLOC, B_CALLOC, B_FREE,
+    B_EXIT
+};
+
+static const char *builtin_names[] = {
+    "strlen", "strcmp", "strncmp", "strcpy", "strcat", "memcmp", "memcpy",
+    "memset", "abs", "putchar", "puts", "printf", "malloc", "calloc", "free",
+    "exit"
+};
+
+/**
+ * 功能：把 v 的低 n 个字节符号扩展，n 为 0 或 8 时不变
+ */
+static int64_t sext(int64_t v, int n)
+{
+    switch (n) {
+    case 1: return (int8_t)v;
+    case 2: return (int16_t)v;
+    case 4: return (int32_t)v;
+    }
+    return v;
+}
+
+template <typename T>
+static inline int64_t load(int64_t addr)
+{
+    T v;
+    memcpy(&v, (const void *)(intptr_t)addr, sizeof(T));
+    return v;
+}
+
+template <typename T>
+static inline void store(int64_t addr, int64_t v)
+{
+    T x = (T)v;
+    memcpy((void *)(intptr_t)addr, &x, sizeof(T));
+}
+
+/**
+ * 功能：按格式串输出，每个转换说明取一个 64 位实参
+ * 实参都已扩展为 64 位，按转换说明的长度修饰重新截取后交给 snprintf
+ */
+static int64_t vm_printf(const char *fmt, const int64_t *v, int n)
+{
+    string out;
+    char spec[32], buf[512];
+    int k = 0;
+    for (const char *p = fmt; *p; p++) {
+        if (*p != '%') {
+            out.push_back(*p);
+            continue;
+        }
+        const char *s = p++;
+        while (*p && strchr("-+ #0", *p))
+            p++;
+        while (*p && (isdigit((unsigned char)*p) || *p == '.'))
+            p++;
+        bool is_long = false;
+        while (*p == 'l' || *p == 'h' || *p == 'z') {
+            is_long |= *p != 'h';
+            p++;
+        }
+        if (!*p)
+            break;
+        if (*p == '%') {
+            out.push_back('%');
+            continue;
+        }
+        // 去掉长度修饰，按 64 位重写
+        size_t len = 0;
+        for (const char *q = s; q < p && len + 4 < sizeof(spec); q++)
+            if (*q != 'l' && *q != 'h' && *q != 'z')
+                spec[len++] = *q;
+        int64_t x = k < n ? v[k++] : 0;
+        switch (*p) {
+        case 'd': case 'i':
+            spec[len++] = 'l'; spec[len++] = 'l'; spec[len++] = *p; spec[len] = 0;
+            snprintf(buf, sizeof(buf), spec, (long long)(is_long ? x : (int32_t)x));
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            spec[len++] = 'l'; spec[len++] = 'l'; spec[len++] = *p; spec[len] = 0;
+            snprintf(buf, sizeof(buf), spec,
+                (unsigned long long)(is_long ? x : (uint32_t)x));
+            break;
+        case 'c':
+            spec[len++] = 'c'; spec[len] = 0;
+            snprintf(buf, sizeof(buf), spec, (int)x);
+            break;
+        case 's':
+            spec[len++] = 's'; spec[len] = 0;
+            snprintf(buf, sizeof(buf), spec, x ? (const char *)(intptr_t)x : "(null)");
+            break;
+        case 'p':
+            spec[len++] = 'p'; spec[len] = 0;
+            snprintf(buf, sizeof(buf), spec, (void *)(intptr_t)x);
+            break;
+        default:
+            buf[0] = 0;
+            break;
+        }
+        out += buf;
+    }
+    fwrite(out.data(), 1, out.size(), stdout);
+    return out.size();
+}
+
+/**
+ * 功能：执行内建函数，exit 时返回 false
+ */
+static bool call_builtin(int id, const int64_t *v, int n, int64_t &ret)
+{
+#define P(k) ((char *)(intptr_t)v[k])
+    switch (id) {
+    case B_STRLEN:  ret = strlen(P(0)); break;
+    case B_STRCMP:  ret = strcmp(P(0), P(1)); break;
+    case B_STRNCMP: ret = strncmp(P(0), P(1), v[2]); break;
+    case B_STRCPY:  ret = (intptr_t)strcpy(P(0), P(1)); break;
+    case B_STRCAT:  ret = (intptr_t)strcat(P(0), P(1)); break;
+    case B_MEMCMP:  ret = memcmp(P(0), P(1), v[2]); break;
+    case B_MEMCPY:  ret = (intptr_t)memcpy(P(0), P(1), v[2]); break;
+    case B_MEMSET:  ret = (intptr_t)memset(P(0), (int)v[1], v[2]); break;
+    case B_ABS:     ret = v[0] < 0 ? -v[0] : v[0]; break;
+    case B_PUTCHAR: ret = putchar((int)v[0]); break;
+    case B_PUTS:    ret = puts(P(0)); break;
+    case B_PRINTF:  ret = vm_printf(P(0), v + 1, n - 1); break;
+    case B_MALLOC:  ret = (intptr_t)malloc(v[0]); break;
+    case B_CALLOC:  ret = (intptr_t)calloc(v[0], v[1]); break;
+    case B_FREE:    free(P(0)); ret = 0; break;
+    case B_EXIT:    ret = v[0]; return false;
+    }
+#undef P
+    return true;
+}
+
+
+Vm::Vm(const IrModule &m, VmStats &s)
+    : mod(m), st(s), threaded(false)
+{
+    func_of.assign(m.globals.size(), -1);
+    builtin_of.assign(m.globals.size(), -1);
+    for (size_t g = 0; g < m.globals.size(); g++) {
+        if (!m.globals[g].func || m.globals[g].defined)
+            continue;
+        for (size_t k = 0; k < sizeof(builtin_names) / sizeof(builtin_names[0]); k++)
+            if (m.globals[g].name == builtin_names[k])
+                builtin_of[g] = k;
+    }
+    funcs.resize(m.funcs.size());
+    for (size_t fi = 0; fi < m.funcs.size(); fi++)
+        if (m.funcs[fi].global >= 0)
+            func_of[m.funcs[fi].global] = fi;
+    layout_data();
+    for (size_t fi = 0; fi < m.funcs.size(); fi++)
+        compile(fi, m.funcs[fi]);
+    st.code += code.size();
+}
+
+/**
+ * 功能：排定字符串常量和全局变量在 data 中的位置并写入初值
+ * 函数也占一个字节，其地址用作函数指针的值
+ */
+void Vm::layout_data()
+{
+    const StrPool &pool = *mod.strs;
+    size_t n = pool.bytes();
+    global_off.resize(mod.globals.size());
+    for (size_t g = 0; g < mod.globals.size(); g++) {
+        const IrGlobal &x = mod.globals[g];
+        int size = x.func ? 1 : x.size > 0 ? x.size : 8;
+        int align = x.func ? 1 : x.align > 0 ? x.align : 8;
+        n = (n + align - 1) / align * align;
+        global_off[g] = n;
+        n += size;
+    }
+    data.assign(n + 8, 0);
+    str_off = 0;
+    memcpy(data.data(), pool.bytes_data().data(), pool.bytes());
+    for (size_t g = 0; g < mod.globals.size(); g++) {
+        const IrGlobal &x = mod.globals[g];
+        char *p = data.data() + global_off[g];
+        if (x.func)
+            global_at[(uintptr_t)p] = g;
+        else if (x.init == INIT_CONST) {
+            int64_t v = x.value;
+            memcpy(p, &v, std::min(x.size, 8));
+        }
+        else if (x.init == INIT_STR && x.array)
+            memcpy(p, pool.str(x.value), std::min<size_t>(x.size,
+                pool.length(x.value) + 1));
+        else if (x.init == INIT_STR) {
+            intptr_t v = (intptr_t)(data.data() + str_off + pool.offset(x.value));
+            memcpy(p, &v, sizeof(v));
+        }
+    }
+}
+
+/**
+ * 功能：翻译一个函数
+ * 帧的寄存器依次为临时变量、栈槽地址、实参和常量。比较后紧跟以其结果
+ * 为条件的分支、地址只用于紧接着的 load 时合并为一条超级指令；
+ * 分支的一个目标是下一块时省去跳转。
+ */
+void Vm::compile(uint32_t fi, const IrFunc &f)
+{
+    VmFunc &fn = funcs[fi];
+    fn.name = f.name;
+    fn.entry = code.size();
+    fn.nparams = f.nparams;
+    fn.slot_base = f.ntemps;
+    uint32_t off = 0;
+    for (const IrSlot &s : f.slots) {
+        int align = s.align > 0 ? s.align : 1;
+        off = (off + align - 1) / align * align;
+        fn.slot_off.push_back(off);
+        off += s.size;
+    }
+    fn.frame_bytes = (off + 15) & ~15u;
+    fn.param_base = fn.slot_base + f.slots.size();
+    fn.const_base = fn.param_base + f.nparams;
+    st.insts += f.count();
+
+    std::unordered_map<int64_t, int32_t> pool;
+    auto constant = [&](int64_t v) {
+        auto it = pool.find(v);
+        if (it != pool.end())
+            return it->second;
+        int32_t r = fn.const_base + fn.consts.size();
+        fn.consts.push_back(v);
+        pool[v] = r;
+        return r;
+    };
+    auto reg = [&](Ref r) -> int32_t {
+        switch (ref_tag(r)) {
+        case RT_TEMP:
+            return ref_index(r);
+        case RT_SLOT:
+            return fn.slot_base + ref_index(r);
+        case RT_IMM: case RT_CONST:
+            return constant(f.constant(r));
+        case RT_GLOBAL:
+            return constant((intptr_t)(data.data() + global_off[ref_index(r)]));
+        case RT_STR:
+            return constant((intptr_t)(data.data() + str_off +
+                mod.strs->offset(ref_index(r))));
+        default:
+            return -1;
+        }
+    };
+
+    // 每个临时变量被使用的次数，只用一次的结果才能并入下一条
+    std::vector<uint32_t> uses(f.ntemps, 0);
+    for (uint32_t i = 0; i < f.count(); i++) {
+        if (ref_tag(f.a[i]) == RT_TEMP)
+            uses[ref_index(f.a[i])]++;
+        if (ref_tag(f.b[i]) == RT_TEMP)
+            uses[ref_index(f.b[i])]++;
+    }
+    auto once = [&](uint32_t i, uint32_t j, Ref r) {
+        return j < f.count() && ref_tag(f.d[i]) == RT_TEMP &&
+            uses[ref_index(f.d[i])] == 1 && r == f.d[i];
+    };
+
+    std::vector<uint32_t> start(f.blocks.size());
+    std::vector<std::pair<uint32_t, uint32_t>> fixes;   // (字节码, 目标块)
+    uint32_t loc = 0;       // 正在翻译的中间代码的源码位置
+    auto emit = [&](VmOp op, int32_t d, int32_t a, int32_t b) {
+        VmInst x = {nullptr, op, 0, 0, d, a, b};
+        code.push_back(x);
+        locs.push_back(loc);
+    };
+    auto jump = [&](VmOp op, int32_t a, int32_t b, uint32_t target) {
+        fixes.push_back(std::make_pair(code.size(), target));
+        emit(op, 0, a, b);
+    };
+    // 条件成立转到 t，否则转到 e，next 为紧接着的块
+    auto branch = [&](VmOp op, VmOp inv, int32_t a, int32_t b,
+        uint32_t t, uint32_t e, uint32_t next) {
+        if (t == e) {
+            if (t != next)
+                jump(VM_JMP, 0, 0, t);
+        }
+        else if (e == next)
+            jump(op, a, b, t);
+        else if (t == next)
+            jump(inv, a, b, e);
+        else {
+            jump(op, a, b, t);
+            jump(VM_JMP, 0, 0, e);
+        }
+    };
+    static const VmOp cmp_br[] = {VM_BEQ, VM_BNE, VM_BLT, VM_BLE, VM_BGT, VM_BGE};
+    static const VmOp cmp_inv[] = {VM_BNE, VM_BEQ, VM_BGE, VM_BGT, VM_BLE, VM_BLT};
+    static const VmOp cmp_op[] = {VM_EQ, VM_NE, VM_LT, VM_LE, VM_GT, VM_GE};
+
+    for (uint32_t bi = 0; bi < f.blocks.size(); bi++) {
+        start[bi] = code.size();
+        uint32_t next = bi + 1;
+        for (uint32_t i = f.blocks[bi].first; i < f.blocks[bi].end; i++) {
+            int size = f.size[i];
+            bool wide = size == 8;
+            int32_t d = reg(f.d[i]), a = reg(f.a[i]), b = reg(f.b[i]);
+            loc = f.loc[i];
+            switch (f.op[i]) {
+            case IR_NOP:
+            case IR_PHI:
+                break;
+            case IR_MOV:
+                emit(VM_MOV, d, a, 0);
+                break;
+            case IR_ADD:
+                // t = base + index; v = [t]
+                if (wide && once(i, i + 1, f.a[i + 1]) && f.op[i + 1] == IR_LOAD) {
+                    int n = f.size[i + 1];
+                    if (n == 1 || n == 2 || n == 4 || n == 8) {
+                        emit(n == 1 ? VM_LOADX1 : n == 2 ? VM_LOADX2 :
+                            n == 4 ? VM_LOADX4 : VM_LOADX8, reg(f.d[i + 1]), a, b);
+                        st.fused++;
+                        i++;
+                        break;
+                    }
+                }
+                emit(wide ? VM_ADD8 : VM_ADD4, d, a, b);
+                break;
+            case IR_SUB:
+                emit(wide ? VM_SUB8 : VM_SUB4, d, a, b);
+                break;
+            case IR_MUL:
+                // m = index * n; t = base + m; v = [t]，n 为取出的宽度
+                if (wide && i + 2 < f.blocks[bi].end && f.op[i + 1] == IR_ADD &&
+                    f.size[i + 1] == 8 && f.op[i + 2] == IR_LOAD &&
+                    ref_tag(f.b[i]) == RT_IMM && ref_imm(f.b[i]) == f.size[i + 2] &&
+                    f.size[i + 2] >= 2 &&
+                    (once(i, i + 1, f.a[i + 1]) || once(i, i + 1, f.b[i + 1])) &&
+                    once(i + 1, i + 2, f.a[i + 2]) && f.a[i + 1] != f.b[i + 1]) {
+                    int n = f.size[i + 2];
+                    VmOp op = n == 2 ? VM_LOADXS2 : n == 4 ? VM_LOADXS4 : VM_LOADXS8;
+                    Ref base = f.a[i + 1] == f.d[i] ? f.b[i + 1] : f.a[i + 1];
+                    emit(op, reg(f.d[i + 2]), reg(base), a);
+                    st.fused += 2;
+                    i += 2;
+                    break;
+                }
+                emit(wide ? VM_MUL8 : VM_MUL4, d, a, b);
+                break;
+            case IR_DIV:
+                emit(wide ? VM_DIV8 : VM_DIV4, d, a, b);
+                break;
+            case IR_MOD:
+                emit(wide ? VM_MOD8 : VM_MOD4, d, a, b);
+                break;
+            case IR_NEG:
+                emit(wide ? VM_NEG8 : VM_NEG4, d, a, 0);
+                break;
+            case IR_EXT:
+                emit(size == 1 ? VM_EXT1 : size == 2 ? VM_EXT2 :
+                    size == 4 ? VM_EXT4 : VM_MOV, d, a, 0);
+                break;
+            case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE: {
+                int k = f.op[i] - IR_EQ;
+                if (i + 1 < f.blocks[bi].end && f.op[i + 1] == IR_BR &&
+                    once(i, i + 1, f.a[i + 1])) {
+                    loc = f.loc[i + 1];
+                    branch(cmp_br[k], cmp_inv[k], a, b, ref_index(f.b[i + 1]),
+                        ref_index(f.d[i + 1]), next);
+                    st.fused++;
+                    i++;
+                    break;
+                }
+                emit(cmp_op[k], d, a, b);
+                break;
+            }
+            case IR_LOAD:
+                emit(size == 1 ? VM_LOAD1 : size == 2 ? VM_LOAD2 :
+                    size == 4 ? VM_LOAD4 : VM_LOAD8, d, a, 0);
+                break;
+            case IR_STORE:
+                emit(size == 1 ? VM_STORE1 : size == 2 ? VM_STORE2 :
+                    size == 4 ? VM_STORE4 : VM_STORE8, 0, a, b);
+                break;
+            case IR_COPY:
+                emit(VM_COPY, f.constant(f.d[i]), a, b);
+                break;
+            case IR_PARAM:
+                // 形参按声明的宽度截取
+                emit(size == 1 ? VM_EXT1 : size == 2 ? VM_EXT2 :
+                    size == 4 ? VM_EXT4 : VM_MOV, d,
+                    fn.param_base + f.constant(f.a[i]), 0);
+                break;
+            case IR_ARG:
+                emit(VM_ARG, 0, a, 0);
+                break;
+            case IR_CALL: {
+                int n = f.constant(f.b[i]);
+                int g = ref_tag(f.a[i]) == RT_GLOBAL ? (int)ref_index(f.a[i]) : -1;
+                if (d < 0)
+                    d = -1;
+                if (g >= 0 && func_of[g] >= 0)
+                    emit(VM_CALL, d, func_of[g], n);
+                else if (g >= 0 && builtin_of[g] >= 0)
+                    emit(VM_CALLB, d, builtin_of[g], n);
+                else
+                    emit(VM_CALLI, d, a, n);
+                code.back().size = size;
+                break;
+            }
+            case IR_JMP:
+                if (ref_index(f.a[i]) != next)
+                    jump(VM_JMP, 0, 0, ref_index(f.a[i]));
+                break;
+            case IR_BR:
+                branch(VM_BNZ, VM_BZ, a, 0, ref_index(f.b[i]), ref_index(f.d[i]), next);
+                break;
+            case IR_RET:
+                if (f.a[i] == REF_NONE)
+                    emit(VM_RETV, 0, 0, 0);
+                else
+                    emit(VM_RET, 0, a, 0);
+                break;
+            }
+        }
+    }
+    for (const std::pair<uint32_t, uint32_t> &x : fixes)
+        code[x.first].d = start[x.second];
+    fn.nregs = fn.const_base + fn.consts.size();
+}
+
+
+/* 调用帧，记录返回后要恢复的状态 */
+struct VmFrame {
+    const VmInst *ret;
+    int64_t *regs;
+    char *sp;
+    uint32_t func;
+    int32_t dest;
+    uint8_t size;
+    uint64_t steps;     // 剖析时进入函数时已执行的字节码数
+};
+
+/* 剖析时的调用栈和执行位置，SIGALRM 的处理程序经 vm_sampler 读取 */
+struct VmSampler {
+    VmProfile *prof;
+    const VmInst *base;
+    std::vector<uint32_t> active_fn;    // 各函数尚未返回的调用数
+    std::vector<uint32_t> active_site;  // 各调用点尚未返回的调用数
+    std::vector<int64_t> stack_site;    // 各层调用的调用点，入口为 -1
+    std::vector<uint32_t> stack_fn;
+    volatile int depth;
+    std::vector<uint64_t> mark_fn, mark_site;   // 最后一次计入的采样
+    uint64_t nsample;
+
+    VmSampler(VmProfile *p, const VmInst *code, size_t nfuncs, size_t ncode)
+        : prof(p), base(code), active_fn(nfuncs), active_site(ncode),
+          stack_site(VM_MAX_DEPTH + 1), stack_fn(VM_MAX_DEPTH + 1), depth(0),
+          mark_fn(nfuncs), mark_site(ncode), nsample(0) {}
+
+    /**
+     * 功能：调用 fi，site 为调用的字节码，没有时为 -1
+     */
+    void enter(uint32_t fi, int64_t site)
+    {
+        prof->calls[fi]++;
+        active_fn[fi]++;
+        if (site >= 0)
+            active_site[site]++;
+        stack_site[depth] = site;
+        stack_fn[depth] = fi;
+        std::atomic_signal_fence(std::memory_order_release);
+        depth = depth + 1;
+    }
+
+    /**
+     * 功能：从 fi 返回，fr 为它的帧，steps 为此时已执行的字节码数
+     */
+    void leave(uint32_t fi, const VmFrame &fr, int64_t site, uint64_t steps)
+    {
+        depth = depth - 1;
+        if (--active_fn[fi] == 0)
+            prof->incl_steps[fi] += steps - fr.steps;
+        if (site >= 0 && --active_site[site] == 0)
+            prof->site_steps[site] += steps - fr.steps;
+    }
+
+    /**
+     * 功能：记一次采样，pc 为正在执行的字节码
+     * 递归时同一函数或调用点在栈上出现多次，一次采样只计一次
+     */
+    void sample(const VmInst *pc)
+    {
+        nsample++;
+        prof->nsamples++;
+        if (pc)
+            prof->samples[pc - base]++;
+        for (int k = 0; k < depth; k++) {
+            uint32_t fi = stack_fn[k];
+            int64_t site = stack_site[k];
+            if (mark_fn[fi] != nsample) {
+                mark_fn[fi] = nsample;
+                prof->incl_samples[fi]++;
+            }
+            if (site >= 0 && mark_site[site] != nsample) {
+                mark_site[site] = nsample;
+                prof->site_samples[site]++;
+            }
+        }
+    }
+};
+
+static VmSampler *vm_sampler;
+static const VmInst *volatile vm_pc;    // 剖析时最近分派的字节码
+
+static void on_sample(int)
+{
+    if (vm_sampler)
+        vm_sampler->sample(vm_pc);
+}
+
+/**
+ * 功能：开始或停止定时采样
+ * ITIMER_PROF 只在时钟中断时检查，间隔不到一个时钟周期时采样过稀，
+ * 因此按实际时间采样
+ */
+static void vm_sampling(VmSampler *s)
+{
+    static struct sigaction saved;
+    struct itimerval it = {};
+    if (s) {
+        vm_sampler = s;
+        vm_pc = nullptr;
+        struct sigaction sa = {};
+        sa.sa_handler = on_sample;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGALRM, &sa, &saved);
+        it.it_interval.tv_usec = VM_SAMPLE_US;
+        it.it_value.tv_usec = VM_SAMPLE_US;
+        setitimer(ITIMER_REAL, &it, nullptr);
+    }
+    else {
+        setitimer(ITIMER_REAL, &it, nullptr);
+        sigaction(SIGALRM, &saved, nullptr);
+        vm_sampler = nullptr;
+    }
+}
+
+/**
+ * 功能：执行字节码
+ * 两种分派共用同一组处理程序：线索化时每个处理程序末尾经下一条的
+ * label 间接转移，各处理程序的间接转移各自预测；否则都回到一个 switch。
+ * PROFILE 时分派前累加字节码的执行次数并记下它供采样，进出函数时维护
+ * 调用栈，不剖析的实例不含这些代码。
+ */
+template <bool THREADED, bool PROFILE>
+bool Vm::exec(uint32_t entry, int64_t &ret, string &err, VmProfile *prof)
+{
+    static const void *const labels[] = {
+#define VM_LABEL(x) &&L_##x,
+        VM_OPS(VM_LABEL)
+#undef VM_LABEL
+    };
+    if (THREADED && !threaded) {
+        for (VmInst &x : code)
+            x.label = labels[x.op];
+        threaded = true;
+    }
+
+    // 不必清零，用到的部分在进入函数时填写
+    std::unique_ptr<int64_t[]> regstack(new int64_t[VM_REGS]);
+    std::unique_ptr<char[]> memstack(new char[VM_STACK]);
+    std::vector<VmFrame> frames;
+    int64_t argv[VM_MAX_ARGS + 4];
+    int nargs = 0;
+    const VmInst *const base = code.data();
+    const VmInst *pc = nullptr;
+    int64_t *r = regstack.get();
+    int64_t *const reg_end = r + VM_REGS;
+    char *sp = memstack.get();
+    char *const mem_end = sp + VM_STACK;
+    uint32_t cur = entry;
+    uint64_t steps = 0;
+    int64_t v = 0;
+    uintptr_t addr;
+    int callee;
+    uint32_t fi = entry;
+    int32_t dest = -1;
+    uint8_t size = 0;
+    bool ok = true;
+    uint64_t *const hits = PROFILE ? prof->hits.data() : nullptr;
+    std::unique_ptr<VmSampler> sampler(PROFILE ?
+        new VmSampler(prof, code.data(), funcs.size(), code.size()) : nullptr);
+    auto t0 = std::chrono::steady_clock::now();
+    if (PROFILE)
+        vm_sampling(sampler.get());
+
+#define R(x) r[pc->x]
+#define DISPATCH() do { \
+        steps++; \
+        if (PROFILE) { \
+            hits[pc - base]++; \
+            vm_pc = pc; \
+        } \
+        if (THREADED) \
+            goto *pc->label; \
+        goto dispatch; \
+    } while (0)
+#define NEXT() do { pc++; DISPATCH(); } while (0)
+#define JUMP() do { pc = base + pc->d; DISPATCH(); } while (0)
+#define FAIL(msg) do { err = string(msg) + " in @" + funcs[cur].name; goto fail; } while (0)
+
+    goto call;
+
+dispatch:
+    switch (pc->op) {
+#define VM_CASE(x) case VM_##x: goto L_##x;
+    VM_OPS(VM_CASE)
+#undef VM_CASE
+    default:
+        FAIL("bad bytecode");
+    }
+
+L_MOV:  R(d) = R(a); NEXT();
+L_ADD4: R(d) = (int32_t)((uint64_t)R(a) + (uint64_t)R(b)); NEXT();
+L_ADD8: R(d) = (int64_t)((uint64_t)R(a) + (uint64_t)R(b)); NEXT();
+L_SUB4: R(d) = (int32_t)((uint64_t)R(a) - (uint64_t)R(b)); NEXT();
+L_SUB8: R(d) = (int64_t)((uint64_t)R(a) - (uint64_t)R(b)); NEXT();
+L_MUL4: R(d) = (int32_t)((uint64_t)R(a) * (uint64_t)R(b)); NEXT();
+L_MUL8: R(d) = (int64_t)((uint64_t)R(a) * (uint64_t)R(b)); NEXT();
+L_DIV4:
+    if (!R(b))
+        FAIL("division by zero");
+    R(d) = (int32_t)(R(a) / R(b));
+    NEXT();
+L_DIV8:
+    if (!R(b))
+        FAIL("division by zero");
+    R(d) = R(b) == -1 ? (int64_t)(0 - (uint64_t)R(a)) : R(a) / R(b);
+    NEXT();
+L_MOD4:
+    if (!R(b))
+        FAIL("division by zero");
+    R(d) = (int32_t)(R(a) % R(b));
+    NEXT();
+L_MOD8:
+    if (!R(b))
+        FAIL("division by zero");
+    R(d) = R(b) == -1 ? 0 : R(a) % R(b);
+    NEXT();
+L_NEG4: R(d) = (int32_t)(0 - (uint64_t)R(a)); NEXT();
+L_NEG8: R(d) = (int64_t)(0 - (uint64_t)R(a)); NEXT();
+L_EXT1: R(d) = (int8_t)R(a); NEXT();
+L_EXT2: R(d) = (int16_t)R(a); NEXT();
+L_EXT4: R(d) = (int32_t)R(a); NEXT();
+L_EQ:   R(d) = R(a) == R(b); NEXT();
+L_NE:   R(d) = R(a) != R(b); NEXT();
+L_LT:   R(d) = R(a) < R(b); NEXT();
+L_LE:   R(d) = R(a) <= R(b); NEXT();
+L_GT:   R(d) = R(a) > R(b); NEXT();
+L_GE:   R(d) = R(a) >= R(b); NEXT();
+L_LOAD1: R(d) = load<int8_t>(R(a)); NEXT();
+L_LOAD2: R(d) = load<int16_t>(R(a)); NEXT();
+L_LOAD4: R(d) = load<int32_t>(R(a)); NEXT();
+L_LOAD8: R(d) = load<int64_t>(R(a)); NEXT();
+L_STORE1: store<int8_t>(R(a), R(b)); NEXT();
+L_STORE2: store<int16_t>(R(a), R(b)); NEXT();
+L_STORE4: store<int32_t>(R(a), R(b)); NEXT();
+L_STORE8: store<int64_t>(R(a), R(b)); NEXT();
+L_COPY:
+    memmove((void *)(intptr_t)R(a), (const void *)(intptr_t)R(b), pc->d);
+    NEXT();
+L_ARG:
+    if (nargs < VM_MAX_ARGS)
+        argv[nargs++] = R(a);
+    NEXT();
+L_CALL:
+    fi = pc->a;
+    dest = pc->d;
+    size = pc->size;
+    goto call;
+L_CALLB:
+    callee = pc->a;
+builtin:
+    for (int k = nargs; k < 4; k++)
+        argv[k] = 0;
+    ok = call_builtin(callee, argv, nargs, v);
+    nargs = 0;
+    if (!ok) {
+        ret = v;
+        goto done;
+    }
+    if (pc->d >= 0)
+        R(d) = sext(v, pc->size);
+    NEXT();
+L_CALLI:
+    addr = (uintptr_t)R(a);
+    if (global_at.count(addr)) {
+        int g = global_at[addr];
+        if (func_of[g] >= 0) {
+            fi = func_of[g];
+            dest = pc->d;
+            size = pc->size;
+            goto call;
+        }
+        if (builtin_of[g] >= 0) {
+            callee = builtin_of[g];
+            goto builtin;
+        }
+        FAIL("call to undefined function @" + mod.globals[g].name);
+    }
+    FAIL("call through a bad function pointer");
+L_JMP:  JUMP();
+L_BNZ:  if (R(a)) JUMP(); NEXT();
+L_BZ:   if (!R(a)) JUMP(); NEXT();
+L_BEQ:  if (R(a) == R(b)) JUMP(); NEXT();
+L_BNE:  if (R(a) != R(b)) JUMP(); NEXT();
+L_BLT:  if (R(a) < R(b)) JUMP(); NEXT();
+L_BLE:  if (R(a) <= R(b)) JUMP(); NEXT();
+L_BGT:  if (R(a) > R(b)) JUMP(); NEXT();
+L_BGE:  if (R(a) >= R(b)) JUMP(); NEXT();
+L_LOADX1: R(d) = load<int8_t>(R(a) + R(b)); NEXT();
+L_LOADX2: R(d) = load<int16_t>(R(a) + R(b)); NEXT();
+L_LOADX4: R(d) = load<int32_t>(R(a) + R(b)); NEXT();
+L_LOADX8: R(d) = load<int64_t>(R(a) + R(b)); NEXT();
+L_LOADXS2: R(d) = load<int16_t>(R(a) + R(b) * 2); NEXT();
+L_LOADXS4: R(d) = load<int32_t>(R(a) + R(b) * 4); NEXT();
+L_LOADXS8: R(d) = load<int64_t>(R(a) + R(b) * 8); NEXT();
+L_RET:
+    v = R(a);
+    goto leave;
+L_RETV:
+    v = 0;
+leave:
+    {
+        VmFrame fr = frames.back();
+        frames.pop_back();
+        if (PROFILE)
+            sampler->leave(cur, fr, fr.ret ? fr.ret - 1 - base : -1, steps);
+        if (frames.empty()) {
+            ret = v;
+            goto done;
+        }
+        r = fr.regs;
+        sp = fr.sp;
+        cur = fr.func;
+        pc = fr.ret;
+        if (fr.dest >= 0)
+            r[fr.dest] = sext(v, fr.size);
+    }
+    DISPATCH();
+call:
+    // 进入函数 fi：新帧放在当前帧之后，填好常量、栈槽地址和实参
+    {
+        const VmFunc &fn = funcs[fi];
+        int64_t *nr = frames.empty() ? r : r + funcs[cur].nregs;
+        if (nr + fn.nregs > reg_end || sp + fn.frame_bytes > mem_end ||
+            frames.size() >= VM_MAX_DEPTH)
+            FAIL("stack overflow");
+        VmFrame fr = {pc ? pc + 1 : nullptr, r, sp, cur, dest, size, steps};
+        frames.push_back(fr);
+        if (PROFILE)
+            sampler->enter(fi, pc ? pc - base : -1);
+        memcpy(nr + fn.const_base, fn.consts.data(), fn.consts.size() * sizeof(int64_t));
+        for (uint32_t k = 0; k < fn.slot_off.size(); k++)
+            nr[fn.slot_base + k] = (intptr_t)(sp + fn.slot_off[k]);
+        memset(sp, 0, fn.frame_bytes);
+        sp += fn.frame_bytes;
+        for (uint32_t k = 0; k < fn.nparams; k++)
+            nr[fn.param_base + k] = (int)k < nargs ? argv[k] : 0;
+        nargs = 0;
+        r = nr;
+        cur = fi;
+        pc = base + fn.entry;
+        st.calls++;
+        st.max_depth = std::max(st.max_depth, (int)frames.size());
+    }
+    DISPATCH();
+
+#undef R
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef FAIL
+
+done:
+    ok = true;
+    goto finish;
+fail:
+    ok = false;
+finish:
+    // exit 或出错时还有没返回的调用，由内向外结算
+    for (size_t k = frames.size(); PROFILE && k-- > 0; ) {
+        const VmFrame &fr = frames[k];
+        sampler->leave(cur, fr, fr.ret ? fr.ret - 1 - base : -1, steps);
+        cur = fr.func;
+    }
+    if (PROFILE) {
+        vm_sampling(nullptr);
+        double ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - t0).count();
+        prof->sample_ns = prof->nsamples ? ns / prof->nsamples : 0.0;
+    }
+    st.steps += steps;
+    return ok;
+}
+
+bool Vm::run(const string &entry, VmDispatch dispatch, int64_t &ret, string &err,
+    VmProfile *prof)
+{
+    for (size_t fi = 0; fi < funcs.size(); fi++) {
+        if (funcs[fi].name != entry)
+            continue;
+        if (!prof)
+            return dispatch == VmDispatch::THREADED ?
+                exec<true, false>(fi, ret, err, prof) :
+                exec<false, false>(fi, ret, err, prof);
+        prof->hits.assign(code.size(), 0);
+        prof->samples.assign(code.size(), 0);
+        prof->site_steps.assign(code.size(), 0);
+        prof->site_samples.assign(code.size(), 0);
+        prof->calls.assign(funcs.size(), 0);
+        prof->incl_steps.assign(funcs.size(), 0);
+        prof->incl_samples.assign(funcs.size(), 0);
+        prof->nsamples = 0;
+        return dispatch == VmDispatch::THREADED ?
+            exec<true, true>(fi, ret, err, prof) : exec<false, true>(fi, ret, err, prof);
+    }
+    err = "no function @" + entry;
+    return false;
+}
+
+void Vm::dump(FILE *fp) const
+{
+    for (const VmFunc &fn : funcs) {
+        fprintf(fp, "\nfunc @%s  regs %u  frame %u\n", fn.name.c_str(),
+            fn.nregs, fn.frame_bytes);
+        for (size_t k = 0; k < fn.consts.size(); k++)
+            fprintf(fp, "    r%u = %lld\n", (unsigned)(fn.const_base + k),
+                (long long)fn.consts[k]);
+        uint32_t end = &fn == &funcs.back() ? code.size() : (&fn + 1)->entry;
+        for (uint32_t pc = fn.entry; pc < end; pc++) {
+            const VmInst &x = code[pc];
+            fprintf(fp, "%6u  %-8s", pc, vm_names[x.op]);
+            switch (x.op) {
+            case VM_JMP:
+                fprintf(fp, "%d\n", x.d);
+                break;
+            case VM_BNZ: case VM_BZ:
+                fprintf(fp, "r%d, %d\n", x.a, x.d);
+                break;
+            case VM_BEQ: case VM_BNE: case VM_BLT: case VM_BLE: case VM_BGT: case VM_BGE:
+                fprintf(fp, "r%d, r%d, %d\n", x.a, x.b, x.d);
+                break;
+            case VM_CALL:
+                fprintf(fp, "r%d, @%s, %d\n", x.d, funcs[x.a].name.c_str(), x.b);
+                break;
+            case VM_CALLB:
+                fprintf(fp, "r%d, @%s, %d\n", x.d, builtin_names[x.a], x.b);
+                break;
+            case VM_CALLI:
+                fprintf(fp, "r%d, r%d, %d\n", x.d, x.a, x.b);
+                break;
+            case VM_STORE1: case VM_STORE2: case VM_STORE4: case VM_STORE8:
+                fprintf(fp, "r%d, r%d\n", x.a, x.b);
+                break;
+            case VM_ARG: case VM_RET:
+                fprintf(fp, "r%d\n", x.a);
+                break;
+            case VM_COPY:
+                fprintf(fp, "r%d, r%d, %d\n", x.a, x.b, x.d);
+                break;
+            case VM_RETV:
+                fprintf(fp, "\n");
+                break;
+            default:
+                fprintf(fp, "r%d, r%d, r%d\n", x.d, x.a, x.b);
+                break;
+            }
+        }
+    }
+}
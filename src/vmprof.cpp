@@ -0,0 +1,199 @@
+#include "vmprof.h"
+
+#include <algorithm>
+#include <cctype>
+
+#define HEAT_NONE   90      // 有代码但没执行过，灰色
+#define HEAT_COOL   34      // 不到 0.1%，蓝色
+#define HEAT_WARM   32      // 不到 1%，绿色
+#define HEAT_HOT    33      // 不到 10%，黄色
+#define HEAT_BURN   31      // 其余，红色
+
+VmReport::VmReport(Syntax &syn, const Vm &vm, const VmProfile &prof)
+    : syn(syn), vm(vm), prof(prof), total(0)
+{
+    const std::vector<VmFunc> &funcs = vm.functions();
+    const std::vector<uint32_t> &locs = vm.locations();
+    uint32_t n = locs.size();
+    self.assign(funcs.size(), VmCost{0, 0.0});
+    for (size_t fi = 0; fi < funcs.size(); fi++) {
+        uint32_t end = fi + 1 < funcs.size() ? funcs[fi + 1].entry : n;
+        for (uint32_t pc = funcs[fi].entry; pc < end; pc++) {
+            self[fi].steps += prof.hits[pc];
+            self[fi].ns += prof.samples[pc] * prof.sample_ns;
+        }
+        total += self[fi].steps;
+    }
+
+    sites.resize(n);
+    for (uint32_t pc = 0; pc < n; pc++)
+        sites[pc] = Site{locs[pc], pc};
+    std::stable_sort(sites.begin(), sites.end(), [](const Site &x, const Site &y) {
+        return x.loc < y.loc;
+    });
+    prefix.assign(n + 1, VmCost{0, 0.0});
+    for (uint32_t k = 0; k < n; k++) {
+        uint32_t pc = sites[k].pc;
+        prefix[k + 1].steps = prefix[k].steps + prof.hits[pc] + prof.site_steps[pc];
+        prefix[k + 1].ns = prefix[k].ns +
+            (prof.samples[pc] + prof.site_samples[pc]) * prof.sample_ns;
+    }
+
+    int line, col;
+    syn.diagnostics().locate(syn.lexer().source().size(), line, col);
+    lines.assign(line + 1, VmCost{0, 0.0});
+    has_code.assign(line + 1, 0);
+    for (uint32_t pc = 0; pc < n; pc++) {
+        syn.diagnostics().locate(locs[pc], line, col);
+        lines[line].steps += prof.hits[pc];
+        lines[line].ns += prof.samples[pc] * prof.sample_ns;
+        has_code[line] = 1;
+    }
+}
+
+/**
+ * 功能：源码位置在 [begin, end) 中的字节码及其调用的累计
+ */
+VmCost VmReport::sum(uint32_t begin, uint32_t end) const
+{
+    auto less = [](const Site &s, uint32_t loc) { return s.loc < loc; };
+    size_t i = std::lower_bound(sites.begin(), sites.end(), begin, less) - sites.begin();
+    size_t j = std::lower_bound(sites.begin(), sites.end(), end, less) - sites.begin();
+    return VmCost{prefix[j].steps - prefix[i].steps, prefix[j].ns - prefix[i].ns};
+}
+
+/**
+ * 功能：源码 [begin, end) 在第一行中的部分，去掉首尾空白，过长时截断
+ */
+string VmReport::text(uint32_t begin, uint32_t end) const
+{
+    const string &src = syn.lexer().source();
+    end = std::min<size_t>(end, src.size());
+    uint32_t eol = begin;
+    while (eol < end && src[eol] != '\n')
+        eol++;
+    while (begin < eol && isspace((unsigned char)src[begin]))
+        begin++;
+    while (eol > begin && isspace((unsigned char)src[eol - 1]))
+        eol--;
+    string s = src.substr(begin, eol - begin);
+    return s.size() > 48 ? s.substr(0, 45) + "..." : s;
+}
+
+void VmReport::print_functions(FILE *fp) const
+{
+    const std::vector<VmFunc> &funcs = vm.functions();
+    std::vector<size_t> order;
+    for (size_t fi = 0; fi < funcs.size(); fi++)
+        if (prof.calls[fi])
+            order.push_back(fi);
+    std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+        return self[x].steps > self[y].steps;
+    });
+    fprintf(fp, "profile: %llu bytecodes executed, %llu samples of %.0f us\n",
+        (unsigned long long)total, (unsigned long long)prof.nsamples,
+        prof.sample_ns / 1e3);
+    fprintf(fp, "%7s %12s %12s %10s %9s %9s  %s\n", "self%", "self", "total",
+        "calls", "self ms", "total ms", "function");
+    for (size_t fi : order)
+        fprintf(fp, "%6.2f%% %12llu %12llu %10llu %9.2f %9.2f  %s\n",
+            total ? 100.0 * self[fi].steps / total : 0.0,
+            (unsigned long long)self[fi].steps,
+            (unsigned long long)prof.incl_steps[fi],
+            (unsigned long long)prof.calls[fi], self[fi].ns / 1e6,
+            prof.incl_samples[fi] * prof.sample_ns / 1e6, funcs[fi].name.c_str());
+}
+
+void VmReport::print_spans(FILE *fp, size_t n) const
+{
+    /* 一个结构的累计及其执行次数 */
+    struct Row {
+        const SpanEntry *span;
+        VmCost cost;
+        uint64_t count;
+    };
+    std::vector<Row> rows;
+    for (const SpanEntry &e : syn.spans()) {
+        Row r = {&e, sum(e.begin, e.end), 0};
+        // head 处最常执行的字节码
+        auto less = [](const Site &s, uint32_t loc) { return s.loc < loc; };
+        for (auto it = std::lower_bound(sites.begin(), sites.end(), e.head, less);
+            it != sites.end() && it->loc == e.head; ++it)
+            r.count = std::max(r.count, prof.hits[it->pc]);
+        if (r.cost.steps)
+            rows.push_back(r);
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](const Row &x, const Row &y) {
+        return x.cost.steps > y.cost.steps;
+    });
+    if (rows.size() > n)
+        rows.resize(n);
+    fprintf(fp, "%7s %12s %10s %9s  %-9s %s\n", "total%", "total", "count",
+        "total ms", "line:col", "construct");
+    for (const Row &r : rows) {
+        int line, col;
+        syn.diagnostics().locate(r.span->begin, line, col);
+        char where[32];
+        snprintf(where, sizeof(where), "%d:%d", line, col);
+        fprintf(fp, "%6.2f%% %12llu %10llu %9.2f  %-9s %-4s %s\n",
+            total ? 100.0 * r.cost.steps / total : 0.0,
+            (unsigned long long)r.cost.steps, (unsigned long long)r.count,
+            r.cost.ns / 1e6, where, r.span->kind == SPAN_FOR ? "for" : "call",
+            text(r.span->begin, r.span->end).c_str());
+    }
+}
+
+void VmReport::print_lines(FILE *fp, size_t n) const
+{
+    std::vector<int> order;
+    for (size_t line = 1; line < lines.size(); line++)
+        if (lines[line].steps)
+            order.push_back(line);
+    std::stable_sort(order.begin(), order.end(), [&](int x, int y) {
+        return lines[x].steps > lines[y].steps;
+    });
+    if (order.size() > n)
+        order.resize(n);
+    const string &src = syn.lexer().source();
+    fprintf(fp, "%7s %12s %9s %6s  %s\n", "self%", "self", "ms", "line", "source");
+    for (int line : order) {
+        size_t from = 0;
+        for (int k = 1; k < line; k++)
+            from = src.find('\n', from) + 1;
+        fprintf(fp, "%6.2f%% %12llu %9.2f %6d  %s\n",
+            100.0 * lines[line].steps / total, (unsigned long long)lines[line].steps,
+            lines[line].ns / 1e6, line, text(from, src.size()).c_str());
+    }
+}
+
+int VmReport::heat(uint32_t offset) const
+{
+    int line, col;
+    syn.diagnostics().locate(offset, line, col);
+    if (line >= (int)lines.size() || !has_code[line])
+        return 0;
+    double share = total ? (double)lines[line].steps / total : 0.0;
+    return lines[line].steps == 0 ? HEAT_NONE : share < 0.001 ? HEAT_COOL :
+        share < 0.01 ? HEAT_WARM : share < 0.1 ? HEAT_HOT : HEAT_BURN;
+}
+
+static const VmReport *listing;     // 正在输出的报告，供着色函数使用
+
+static int heat_color(Token &token)
+{
+    return listing->heat(token.offset());
+}
+
+void VmReport::print_listing(const string &file) const
+{
+    Syntax s(file);
+    listing = this;
+    set_token_color(heat_color);
+    s.translation_unit();
+    set_token_color(nullptr);
+    listing = nullptr;
+    printf("\nheat: \033[%dmnever run\033[0m \033[%dm<0.1%%\033[0m "
+        "\033[%dm<1%%\033[0m \033[%dm<10%%\033[0m \033[%dm>=10%%\033[0m "
+        "of executed bytecodes\n",
+        HEAT_NONE, HEAT_COOL, HEAT_WARM, HEAT_HOT, HEAT_BURN);
+}
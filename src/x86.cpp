@@ -0,0 +1,916 @@
+#include "x86.h"
+#include "cfg.h"
+#include "dataflow.h"
+#include "strpool.h"
+
+#include <algorithm>
+
+static const X86Reg arg_regs[6] = {RDI, RSI, RDX, RCX, R8, R9};
+
+/* 可分配的寄存器，rax、rcx、rdx、r11 留作指令选择的临时寄存器 */
+static const X86Reg callee_saved[] = {RBX, R12, R13, R14, R15};
+static const X86Reg caller_saved[] = {RSI, RDI, R8, R9, R10};
+
+static MOpnd none()
+{
+    MOpnd x = {MK_NONE, NOREG, NOREG, 1, 0, 0, 0};
+    return x;
+}
+
+static MOpnd reg(X86Reg r)
+{
+    MOpnd x = none();
+    x.kind = MK_REG;
+    x.reg = r;
+    return x;
+}
+
+static MOpnd imm(int64_t v)
+{
+    MOpnd x = none();
+    x.kind = MK_IMM;
+    x.imm = v;
+    return x;
+}
+
+static MOpnd mem(X86Reg base, int32_t disp)
+{
+    MOpnd x = none();
+    x.kind = MK_MEM;
+    x.reg = base;
+    x.disp = disp;
+    return x;
+}
+
+static MOpnd xmm(int n)
+{
+    MOpnd x = none();
+    x.kind = MK_XMM;
+    x.reg = n;
+    return x;
+}
+
+static MOpnd sym_mem(int sym, int32_t disp)
+{
+    MOpnd x = mem(RIP, disp);
+    x.sym = sym;
+    return x;
+}
+
+static MOpnd target(MKind k, int sym)
+{
+    MOpnd x = none();
+    x.kind = k;
+    x.sym = sym;
+    return x;
+}
+
+static bool same_reg(const MOpnd &x, const MOpnd &y)
+{
+    return x.kind == y.kind && (x.kind == MK_REG || x.kind == MK_XMM) && x.reg == y.reg;
+}
+
+static int64_t sext(int64_t v, int n)
+{
+    switch (n) {
+    case 1: return (int8_t)v;
+    case 2: return (int16_t)v;
+    case 4: return (int32_t)v;
+    }
+    return v;
+}
+
+static int align_up(int n, int a)
+{
+    return (n + a - 1) / a * a;
+}
+
+
+/* 临时变量的活跃区间 [start, end]，以指令下标计 */
+struct Interval {
+    uint32_t temp;
+    uint32_t start, end;
+    bool across;        // 跨过调用
+    int reg;            // 分到的寄存器，-1 为放在栈上
+};
+
+/* 一个函数的指令选择 */
+class Selector {
+public:
+    Selector(const IrModule &m, const IrFunc &f, MFunc &out, X86Stats &st)
+        : m(m), f(f), out(out), st(st) {}
+
+    void run();
+
+private:
+    void find_fused();
+    void build_intervals(std::vector<Interval> &ivs);
+    void allocate(std::vector<Interval> &ivs);
+    void allocate_xmm(std::vector<Interval> &ivs);
+    void layout(const std::vector<Interval> &ivs);
+    void select(uint32_t i, uint32_t next);
+    void call(uint32_t i);
+    void ret(uint32_t i);
+    void vector(uint32_t i);
+
+    void ins(MOp op, int size, MOpnd dst, MOpnd src, X86Cond cc = CC_O, int size2 = 0);
+    void mov(MOpnd dst, MOpnd src);
+    MOpnd addr_mem(Ref r);
+    MOpnd operand(Ref r, X86Reg scratch);
+    X86Reg in_reg(Ref r, X86Reg scratch);
+    MOpnd mem_at(Ref addr, X86Reg scratch);
+    MOpnd home(Ref r) const { return homes[ref_index(r)]; }
+    MOpnd loc(Ref r) const { return ref_tag(r) == RT_TEMP ? home(r) : none(); }
+    X86Reg dst_reg(Ref d) const;
+    void put(Ref d, X86Reg r);
+    void jump(X86Cond cc, bool always, uint32_t block, uint32_t next);
+
+    const IrModule &m;
+    const IrFunc &f;
+    MFunc &out;
+    X86Stats &st;
+    std::vector<uint32_t> uses;
+    std::vector<char> fused;        // 与下一条合并选择的指令
+    std::vector<char> vec;          // 向量临时变量，放在 xmm 寄存器中
+    std::vector<MOpnd> homes;       // 各临时变量的位置
+    std::vector<int> slot_off;
+    int param_off[6];
+    std::vector<std::pair<X86Reg, int>> saves;
+    int frame;
+};
+
+void Selector::ins(MOp op, int size, MOpnd dst, MOpnd src, X86Cond cc, int size2)
+{
+    MInst x = {op, (uint8_t)size, (uint8_t)size2, cc, dst, src};
+    out.code.push_back(x);
+}
+
+void Selector::mov(MOpnd dst, MOpnd src)
+{
+    if (!same_reg(dst, src))
+        ins(M_MOV, 8, dst, src);
+}
+
+/**
+ * 功能：地址为 r 的内存操作数，r 为栈槽、全局变量或字符串常量
+ * 未定义的全局变量可能在共享库中，要经 GOT 取地址，这里返回 NONE
+ */
+MOpnd Selector::addr_mem(Ref r)
+{
+    switch (ref_tag(r)) {
+    case RT_SLOT:
+        return mem(RBP, slot_off[ref_index(r)]);
+    case RT_GLOBAL:
+        if (!m.globals[ref_index(r)].defined)
+            return none();
+        return sym_mem(ref_index(r), 0);
+    case RT_STR:
+        return sym_mem(SYM_STR, m.strs->offset(ref_index(r)));
+    default:
+        return none();
+    }
+}
+
+/**
+ * 功能：r 作为源操作数的形式，地址先用 lea 取到 scratch 中
+ */
+MOpnd Selector::operand(Ref r, X86Reg scratch)
+{
+    switch (ref_tag(r)) {
+    case RT_TEMP:
+        return home(r);
+    case RT_IMM: case RT_CONST:
+        return imm(f.constant(r));
+    case RT_GLOBAL:
+        if (!m.globals[ref_index(r)].defined) {
+            MOpnd got = sym_mem(ref_index(r), 0);
+            got.index = RIP;    // 表示 GOT 中的表项
+            ins(M_MOV, 8, reg(scratch), got);
+            return reg(scratch);
+        }
+        // fall through
+    case RT_SLOT: case RT_STR:
+        ins(M_LEA, 8, reg(scratch), addr_mem(r));
+        return reg(scratch);
+    default:
+        return imm(0);
+    }
+}
+
+X86Reg Selector::in_reg(Ref r, X86Reg scratch)
+{
+    MOpnd x = operand(r, scratch);
+    if (x.kind == MK_REG)
+        return (X86Reg)x.reg;
+    ins(M_MOV, 8, reg(scratch), x);
+    return scratch;
+}
+
+/**
+ * 功能：地址在 addr 中的内存操作数
+ */
+MOpnd Selector::mem_at(Ref addr, X86Reg scratch)
+{
+    MOpnd x = addr_mem(addr);
+    if (x.kind == MK_MEM)
+        return x;
+    return mem(in_reg(addr, scratch), 0);
+}
+
+X86Reg Selector::dst_reg(Ref d) const
+{
+    MOpnd h = home(d);
+    return h.kind == MK_REG ? (X86Reg)h.reg : RAX;
+}
+
+void Selector::put(Ref d, X86Reg r)
+{
+    if (ref_tag(d) == RT_TEMP && home(d).kind != MK_NONE)
+        mov(home(d), reg(r));
+}
+
+void Selector::jump(X86Cond cc, bool always, uint32_t block, uint32_t next)
+{
+    if (always && block == next)
+        return;
+    ins(always ? M_JMP : M_JCC, 8, target(MK_BLOCK, block), none(), cc);
+}
+
+
+/**
+ * 功能：找出与下一条合并选择的指令
+ * 比较的结果只用于紧接着的分支时直接按标志转移；
+ * 地址 base + index 只用于紧接着的 load 时用变址寻址。
+ */
+void Selector::find_fused()
+{
+    uses.assign(f.ntemps, 0);
+    for (uint32_t i = 0; i < f.count(); i++) {
+        if (ref_tag(f.a[i]) == RT_TEMP)
+            uses[ref_index(f.a[i])]++;
+        if (ref_tag(f.b[i]) == RT_TEMP)
+            uses[ref_index(f.b[i])]++;
+    }
+    fused.assign(f.count(), 0);
+    for (uint32_t i = 0; i + 1 < f.count(); i++) {
+        if (ref_tag(f.d[i]) != RT_TEMP || uses[ref_index(f.d[i])] != 1 ||
+            f.a[i + 1] != f.d[i])
+            continue;
+        IrOp op = (IrOp)f.op[i], next = (IrOp)f.op[i + 1];
+        if (op >= IR_EQ && op <= IR_GE && next == IR_BR)
+            fused[i] = 1;
+        else if (op == IR_ADD && f.size[i] == 8 && next == IR_LOAD &&
+            ref_tag(f.a[i]) == RT_TEMP && ref_tag(f.b[i]) == RT_TEMP)
+            fused[i] = 1;
+    }
+}
+
+/**
+ * 功能：求各临时变量的活跃区间
+ * 块内出现的位置取最小和最大；跨块活跃的再延伸到其入口、出口活跃的块的
+ * 首尾。实参在调用处才读取，按调用的位置计。合并选择的结果没有区间。
+ */
+void Selector::build_intervals(std::vector<Interval> &ivs)
+{
+    Cfg g;
+    build_cfg(f, g);
+    std::vector<uint32_t> temps;
+    Dataflow live;
+    liveness(f, g, temps, live);
+
+    std::vector<uint32_t> lo(f.ntemps, UINT32_MAX), hi(f.ntemps, 0);
+    auto touch = [&](Ref r, uint32_t p) {
+        if (ref_tag(r) != RT_TEMP)
+            return;
+        uint32_t t = ref_index(r);
+        lo[t] = std::min(lo[t], p);
+        hi[t] = std::max(hi[t], p);
+    };
+    std::vector<uint32_t> calls;
+    uint32_t next_call = f.count();
+    for (uint32_t i = f.count(); i-- > 0; ) {
+        if (f.op[i] == IR_CALL) {
+            next_call = i;
+            calls.push_back(i);
+        }
+        uint32_t p = f.op[i] == IR_ARG ? next_call : i;
+        if (!fused[i])
+            touch(f.d[i], i);
+        if (!(i > 0 && fused[i - 1] && f.a[i] == f.d[i - 1]))
+            touch(f.a[i], p);
+        touch(f.b[i], p);
+    }
+    std::reverse(calls.begin(), calls.end());
+    for (uint32_t bi = 0; bi < g.nblocks; bi++) {
+        if (!g.reachable(bi))
+            continue;
+        for (size_t k = live.in[bi].next(0); k < temps.size(); k = live.in[bi].next(k + 1))
+            touch(make_ref(RT_TEMP, temps[k]), f.blocks[bi].first);
+        for (size_t k = live.out[bi].next(0); k < temps.size(); k = live.out[bi].next(k + 1))
+            touch(make_ref(RT_TEMP, temps[k]), f.blocks[bi].end - 1);
+    }
+
+    ivs.clear();
+    for (uint32_t t = 0; t < f.ntemps; t++) {
+        if (lo[t] == UINT32_MAX)
+            continue;
+        Interval iv = {t, lo[t], hi[t], false, -1};
+        // 区间内部有调用即跨过调用，在两端的调用只读实参或写结果
+        auto c = std::upper_bound(calls.begin(), calls.end(), iv.start);
+        iv.across = c != calls.end() && *c < iv.end;
+        ivs.push_back(iv);
+    }
+}
+
+/**
+ * 功能：线性扫描分配寄存器
+ * 区间按起点排序，到达起点时先释放已结束的区间，同一条指令读完源操作数
+ * 再写结果，所以在此结束的区间的寄存器可以给在此开始的区间。复制的结果
+ * 优先用源的寄存器，这样复制可以省去。跨调用的区间只能用被调用者保存的
+ * 寄存器；没有空闲寄存器时，结束最晚的区间放到栈上。
+ */
+void Selector::allocate(std::vector<Interval> &ivs)
+{
+    std::sort(ivs.begin(), ivs.end(), [](const Interval &x, const Interval &y) {
+        return x.start < y.start || (x.start == y.start && x.temp < y.temp);
+    });
+    std::vector<int> owner(16, -1);         // 寄存器 -> 区间下标
+    std::vector<int> by_temp(f.ntemps, -1);
+    std::vector<uint32_t> active;           // 区间下标
+    for (uint32_t k = 0; k < ivs.size(); k++) {
+        Interval &iv = ivs[k];
+        by_temp[iv.temp] = k;
+        for (size_t j = 0; j < active.size(); ) {
+            if (ivs[active[j]].end <= iv.start) {
+                owner[ivs[active[j]].reg] = -1;
+                active[j] = active.back();
+                active.pop_back();
+            }
+            else
+                j++;
+        }
+
+        auto allowed = [&](int r) {
+            if (!iv.across)
+                return true;
+            for (X86Reg c : callee_saved)
+                if (c == r)
+                    return true;
+            return false;
+        };
+        int pick = -1;
+        // 复制的源在此结束时沿用其寄存器
+        uint32_t i = iv.start;
+        if (f.op[i] == IR_MOV && ref_tag(f.a[i]) == RT_TEMP &&
+            f.d[i] == make_ref(RT_TEMP, iv.temp)) {
+            int s = by_temp[ref_index(f.a[i])];
+            if (s >= 0 && ivs[s].reg >= 0 && ivs[s].end == i &&
+                owner[ivs[s].reg] < 0 && allowed(ivs[s].reg)) {
+                pick = ivs[s].reg;
+                st.coalesced++;
+            }
+        }
+        if (pick < 0 && !iv.across)
+            for (X86Reg r : caller_saved)
+                if (owner[r] < 0) {
+                    pick = r;
+                    break;
+                }
+        if (pick < 0)
+            for (X86Reg r : callee_saved)
+                if (owner[r] < 0) {
+                    pick = r;
+                    break;
+                }
+        if (pick < 0) {
+            // 抢占结束最晚且寄存器可用的区间
+            int victim = -1;
+            for (size_t j = 0; j < active.size(); j++) {
+                const Interval &a = ivs[active[j]];
+                if (allowed(a.reg) && (victim < 0 || a.end > ivs[active[victim]].end))
+                    victim = j;
+            }
+            if (victim >= 0 && ivs[active[victim]].end > iv.end) {
+                Interval &v = ivs[active[victim]];
+                pick = v.reg;
+                v.reg = -1;
+                active[victim] = active.back();
+                active.pop_back();
+            }
+        }
+        st.temps++;
+        st.across_calls += iv.across;
+        if (pick < 0) {
+            iv.reg = -1;
+            continue;
+        }
+        iv.reg = pick;
+        owner[pick] = k;
+        active.push_back(k);
+    }
+}
+
+/**
+ * 功能：给向量临时变量分配 xmm0～xmm14，xmm15 留作临时寄存器
+ * 向量临时变量只出现在向量化的循环及其前置块中，其间没有调用，
+ * 一个循环至多有 15 个，因此总能分到寄存器，不必放到栈上
+ */
+void Selector::allocate_xmm(std::vector<Interval> &ivs)
+{
+    std::sort(ivs.begin(), ivs.end(), [](const Interval &x, const Interval &y) {
+        return x.start < y.start || (x.start == y.start && x.temp < y.temp);
+    });
+    std::vector<uint32_t> busy(15, 0);      // 各寄存器被占用到的位置
+    std::vector<char> taken(15, 0);
+    for (Interval &iv : ivs) {
+        int pick = 0;
+        for (int r = 0; r < 15; r++)
+            if (!taken[r] || busy[r] <= iv.start) {
+                pick = r;
+                break;
+            }
+        taken[pick] = 1;
+        busy[pick] = iv.end;
+        iv.reg = pick;
+        st.xmm++;
+    }
+}
+
+/**
+ * 功能：排定帧的布局
+ * rbp 之下依次为保存的被调用者保存寄存器、寄存器传来的实参、栈槽和
+ * 放在栈上的临时变量，总大小按 16 字节对齐，调用时 rsp 保持对齐。
+ */
+void Selector::layout(const std::vector<Interval> &ivs)
+{
+    int off = 0;
+    std::vector<char> used(16, 0);
+    for (const Interval &iv : ivs)
+        if (iv.reg >= 0)
+            used[iv.reg] = 1;
+    saves.clear();
+    for (X86Reg r : callee_saved)
+        if (used[r]) {
+            off += 8;
+            saves.push_back(std::make_pair(r, -off));
+        }
+    st.saved += saves.size();
+    for (int k = 0; k < 6 && k < f.nparams; k++) {
+        off += 8;
+        param_off[k] = -off;
+    }
+    slot_off.resize(f.slots.size());
+    for (size_t s = 0; s < f.slots.size(); s++) {
+        int align = std::max(f.slots[s].align, 1);
+        off = align_up(off + f.slots[s].size, align);
+        slot_off[s] = -off;
+    }
+    homes.assign(f.ntemps, none());
+    for (const Interval &iv : ivs) {
+        if (iv.reg >= 0)
+            homes[iv.temp] = reg((X86Reg)iv.reg);
+        else {
+            off += 8;
+            homes[iv.temp] = mem(RBP, -off);
+            st.spilled++;
+        }
+    }
+    frame = align_up(off, 16);
+}
+
+void Selector::run()
+{
+    out.name = f.name;
+    out.global = f.global;
+    out.code.clear();
+    find_fused();
+    vec.assign(f.ntemps, 0);
+    for (uint32_t i = 0; i < f.count(); i++)
+        if (f.op[i] >= IR_VSPLAT && ref_tag(f.d[i]) == RT_TEMP)
+            vec[ref_index(f.d[i])] = 1;
+    std::vector<Interval> ivs, vivs;
+    build_intervals(ivs);
+    for (size_t k = 0; k < ivs.size(); ) {
+        if (vec[ivs[k].temp]) {
+            vivs.push_back(ivs[k]);
+            ivs[k] = ivs.back();
+            ivs.pop_back();
+        }
+        else
+            k++;
+    }
+    allocate(ivs);
+    allocate_xmm(vivs);
+    layout(ivs);
+    for (const Interval &iv : vivs)
+        homes[iv.temp] = xmm(iv.reg);
+
+    // 序言：建立帧，保存用到的被调用者保存寄存器和寄存器中的实参
+    ins(M_PUSH, 8, reg(RBP), none());
+    ins(M_MOV, 8, reg(RBP), reg(RSP));
+    if (frame)
+        ins(M_SUB, 8, reg(RSP), imm(frame));
+    for (const std::pair<X86Reg, int> &s : saves)
+        ins(M_MOV, 8, mem(RBP, s.second), reg(s.first));
+    for (int k = 0; k < 6 && k < f.nparams; k++)
+        ins(M_MOV, 8, mem(RBP, param_off[k]), reg(arg_regs[k]));
+
+    for (uint32_t bi = 0; bi < f.blocks.size(); bi++) {
+        ins(M_LABEL, 0, target(MK_BLOCK, bi), none());
+        for (uint32_t i = f.blocks[bi].first; i < f.blocks[bi].end; i++) {
+            select(i, bi + 1);
+            if (fused[i])
+                i++;
+        }
+    }
+    st.funcs++;
+    for (const MInst &x : out.code) {
+        st.insts += x.op != M_LABEL;
+        st.vector += x.op >= M_MOVDQU;
+    }
+}
+
+static X86Cond cond_of(int op)
+{
+    static const X86Cond cc[] = {CC_E, CC_NE, CC_L, CC_LE, CC_G, CC_GE};
+    return cc[op - IR_EQ];
+}
+
+/**
+ * 功能：选择第 i 条指令，next 为紧接着的块，转到它时不必跳转
+ */
+void Selector::select(uint32_t i, uint32_t next)
+{
+    IrOp op = (IrOp)f.op[i];
+    int size = f.size[i];
+    Ref d = f.d[i], a = f.a[i], b = f.b[i];
+    switch (op) {
+    case IR_NOP:
+    case IR_PHI:
+    case IR_ARG:        // 在调用处一并处理
+        break;
+
+    case IR_MOV: {
+        if (home(d).kind == MK_NONE)
+            break;
+        MOpnd x = operand(a, dst_reg(d));
+        if (x.kind == MK_MEM && home(d).kind == MK_MEM) {
+            ins(M_MOV, 8, reg(RAX), x);
+            x = reg(RAX);
+        }
+        mov(home(d), x);
+        break;
+    }
+
+    case IR_ADD:
+        if (fused[i]) {
+            // t = base + index; v = [t] 合并为变址寻址
+            X86Reg base = in_reg(a, RCX), index = in_reg(b, RDX);
+            MOpnd x = mem(base, 0);
+            x.index = index;
+            int n = f.size[i + 1];
+            X86Reg r = dst_reg(f.d[i + 1]);
+            if (n == 8)
+                ins(M_MOV, 8, reg(r), x);
+            else
+                ins(M_MOVSX, 8, reg(r), x, CC_O, n);
+            put(f.d[i + 1], r);
+            break;
+        }
+        // fall through
+    case IR_SUB:
+    case IR_MUL: {
+        if (home(d).kind == MK_NONE)
+            break;
+        MOp mop = op == IR_ADD ? M_ADD : op == IR_SUB ? M_SUB : M_IMUL;
+        X86Reg r = dst_reg(d);
+        MOpnd y = operand(b, RCX);
+        if (same_reg(y, reg(r)) && !same_reg(loc(a), y)) {
+            // b 已在结果寄存器中：可交换的运算对调操作数，减法先移开 b
+            if (op == IR_SUB) {
+                ins(M_MOV, 8, reg(RCX), y);
+                y = reg(RCX);
+            }
+            else {
+                std::swap(a, b);
+                y = operand(b, RCX);
+            }
+        }
+        MOpnd x = operand(a, r);
+        if (op == IR_ADD && size == 8 && x.kind == MK_REG && y.kind == MK_IMM &&
+            x.reg != r)
+            ins(M_LEA, 8, reg(r), mem((X86Reg)x.reg, (int32_t)y.imm));
+        else {
+            mov(reg(r), x);
+            ins(mop, 8, reg(r), y);
+        }
+        if (size == 4)
+            ins(M_MOVSX, 8, reg(r), reg(r), CC_O, 4);
+        put(d, r);
+        break;
+    }
+
+    case IR_DIV:
+    case IR_MOD: {
+        // 操作数已经符号扩展，32 位的也按 64 位除，不会因 INT_MIN / -1 溢出
+        MOpnd y = operand(b, RCX);
+        if (y.kind == MK_IMM) {
+            ins(M_MOV, 8, reg(RCX), y);
+            y = reg(RCX);
+        }
+        mov(reg(RAX), operand(a, RAX));
+        ins(M_CQO, 8, none(), none());
+        ins(M_IDIV, 8, y, none());
+        X86Reg r = op == IR_DIV ? RAX : RDX;
+        if (size == 4)
+            ins(M_MOVSX, 8, reg(r), reg(r), CC_O, 4);
+        put(d, r);
+        break;
+    }
+
+    case IR_NEG: {
+        X86Reg r = dst_reg(d);
+        mov(reg(r), operand(a, r));
+        ins(M_NEG, 8, reg(r), none());
+        if (size == 4)
+            ins(M_MOVSX, 8, reg(r), reg(r), CC_O, 4);
+        put(d, r);
+        break;
+    }
+
+    case IR_EXT: {
+        X86Reg r = dst_reg(d);
+        MOpnd x = operand(a, r);
+        if (x.kind == MK_IMM) {
+            ins(M_MOV, 8, reg(r), x);
+            x = reg(r);
+        }
+        if (size == 8)
+            mov(reg(r), x);
+        else
+            ins(M_MOVSX, 8, reg(r), x, CC_O, size);
+        put(d, r);
+        break;
+    }
+
+    case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE: {
+        // cmp 的左操作数不能是立即数，两个操作数不能都在内存中
+        MOpnd x = operand(a, RAX), y = operand(b, RCX);
+        if (x.kind != MK_REG && (x.kind == MK_IMM || y.kind == MK_MEM)) {
+            ins(M_MOV, 8, reg(RAX), x);
+            x = reg(RAX);
+        }
+        ins(M_CMP, 8, x, y);
+        if (fused[i]) {
+            uint32_t t = ref_index(f.b[i + 1]), e = ref_index(f.d[i + 1]);
+            X86Cond cc = cond_of(op);
+            if (t == next) {
+                cc = (X86Cond)(cc ^ 1);     // 编码的最低位取反即为相反条件
+                std::swap(t, e);
+            }
+            jump(cc, false, t, next);
+            jump(CC_O, true, e, next);
+            break;
+        }
+        ins(M_SETCC, 1, reg(RAX), none(), cond_of(op));
+        ins(M_MOVZB, 4, reg(RAX), reg(RAX));
+        put(d, RAX);
+        break;
+    }
+
+    case IR_LOAD: {
+        MOpnd x = mem_at(a, RCX);
+        X86Reg r = dst_reg(d);
+        if (size == 8)
+            ins(M_MOV, 8, reg(r), x);
+        else
+            ins(M_MOVSX, 8, reg(r), x, CC_O, size);
+        put(d, r);
+        break;
+    }
+
+    case IR_STORE: {
+        MOpnd y = operand(b, RAX);
+        if (y.kind == MK_MEM) {
+            ins(M_MOV, 8, reg(RAX), y);
+            y = reg(RAX);
+        }
+        if (y.kind == MK_IMM && size < 8)
+            y.imm = sext(y.imm, size);
+        ins(M_MOV, size, mem_at(a, RCX), y);
+        break;
+    }
+
+    case IR_COPY: {
+        // 按 8、4、2、1 字节展开，经 rax 逐段复制
+        X86Reg dst = in_reg(a, RCX), src = in_reg(b, RDX);
+        int n = f.constant(d);
+        for (int off = 0; off < n; ) {
+            int w = n - off >= 8 ? 8 : n - off >= 4 ? 4 : n - off >= 2 ? 2 : 1;
+            ins(M_MOV, w, reg(RAX), mem(src, off));
+            ins(M_MOV, w, mem(dst, off), reg(RAX));
+            off += w;
+        }
+        break;
+    }
+
+    case IR_PARAM: {
+        int k = f.constant(a);
+        if (home(d).kind == MK_NONE)
+            break;
+        MOpnd x = k < 6 ? mem(RBP, param_off[k]) : mem(RBP, 16 + 8 * (k - 6));
+        X86Reg r = dst_reg(d);
+        if (size == 8)
+            ins(M_MOV, 8, reg(r), x);
+        else
+            ins(M_MOVSX, 8, reg(r), x, CC_O, size);
+        put(d, r);
+        break;
+    }
+
+    case IR_CALL:
+        call(i);
+        break;
+
+    case IR_JMP:
+        jump(CC_O, true, ref_index(a), next);
+        break;
+
+    case IR_BR: {
+        uint32_t t = ref_index(b), e = ref_index(d);
+        if (t == e) {
+            jump(CC_O, true, t, next);
+            break;
+        }
+        MOpnd x = operand(a, RAX);
+        if (x.kind != MK_REG) {
+            ins(M_MOV, 8, reg(RAX), x);
+            x = reg(RAX);
+        }
+        ins(M_TEST, 8, x, x);
+        X86Cond cc = CC_NE;
+        if (t == next) {
+            cc = CC_E;
+            std::swap(t, e);
+        }
+        jump(cc, false, t, next);
+        jump(CC_O, true, e, next);
+        break;
+    }
+
+    case IR_RET:
+        ret(i);
+        break;
+
+    default:
+        if (op >= IR_VSPLAT)
+            vector(i);
+        break;
+    }
+}
+
+/**
+ * 功能：选择向量运算
+ * 两操作数的 SSE2 指令以目标为左操作数，目标与右操作数同在一个寄存器时
+ * 可交换的运算对调，否则右操作数先移到 xmm15
+ */
+void Selector::vector(uint32_t i)
+{
+    static const MOp ops[] = {M_PADD, M_PSUB, M_PCMPEQ, M_PCMPGT, M_PAND, M_PANDN, M_POR};
+    IrOp op = (IrOp)f.op[i];
+    int size = f.size[i];
+    Ref d = f.d[i], a = f.a[i], b = f.b[i];
+    if (op == IR_VSTORE) {
+        ins(M_MOVDQU, 16, mem_at(a, RCX), home(b));
+        return;
+    }
+    MOpnd x = home(d);
+    if (x.kind == MK_NONE)
+        return;
+    switch (op) {
+    case IR_VSPLAT:
+        if ((ref_tag(a) == RT_IMM || ref_tag(a) == RT_CONST) && f.constant(a) == 0) {
+            ins(M_PXOR, 16, x, x);
+            break;
+        }
+        // 最低道的值先复制到低 4 个字，再复制到 4 个双字
+        ins(M_MOVD, 4, x, reg(in_reg(a, RAX)));
+        if (size == 1)
+            ins(M_PUNPCKLBW, 16, x, x);
+        if (size <= 2)
+            ins(M_PSHUFLW, 16, x, x, CC_O, 0);
+        ins(M_PSHUFD, 16, x, x, CC_O, 0);
+        break;
+    case IR_VLOAD:
+        ins(M_MOVDQU, 16, x, mem_at(a, RCX));
+        break;
+    default: {
+        MOp mop = ops[op - IR_VADD];
+        MOpnd y = home(a), z = home(b);
+        if (same_reg(x, z) && !same_reg(x, y)) {
+            if (op == IR_VADD || op == IR_VEQ || op == IR_VAND || op == IR_VOR)
+                std::swap(y, z);
+            else {
+                ins(M_MOVDQA, 16, xmm(15), z);
+                z = xmm(15);
+            }
+        }
+        if (!same_reg(x, y))
+            ins(M_MOVDQA, 16, x, y);
+        ins(mop, size, x, z);
+        break;
+    }
+    }
+}
+
+/**
+ * 功能：选择调用及其之前的实参
+ * 第 7 个起的实参逆序压栈。寄存器实参的来源可能正是某个实参寄存器，
+ * 这时先全部压栈再依次弹出，否则直接传送。
+ */
+void Selector::call(uint32_t i)
+{
+    int n = f.constant(f.b[i]);
+    std::vector<Ref> args;
+    for (uint32_t j = i; j-- > 0 && f.op[j] == IR_ARG && (int)args.size() < n; )
+        args.push_back(f.a[j]);
+    std::reverse(args.begin(), args.end());
+    n = args.size();
+
+    // 间接调用的目标先取到 r11，以免被实参覆盖
+    Ref callee = f.a[i];
+    bool direct = ref_tag(callee) == RT_GLOBAL && m.globals[ref_index(callee)].func;
+    if (!direct)
+        mov(reg(R11), operand(callee, R11));
+
+    int nstack = std::max(n - 6, 0);
+    int pad = nstack % 2 ? 8 : 0;
+    if (pad)
+        ins(M_SUB, 8, reg(RSP), imm(pad));
+    for (int k = n - 1; k >= 6; k--) {
+        MOpnd x = operand(args[k], RAX);
+        if (x.kind == MK_IMM && (x.imm < INT32_MIN || x.imm > INT32_MAX)) {
+            ins(M_MOV, 8, reg(RAX), x);
+            x = reg(RAX);
+        }
+        ins(M_PUSH, 8, x, none());
+    }
+
+    int nreg = std::min(n, 6);
+    bool clash = false;
+    for (int k = 0; k < nreg; k++) {
+        MOpnd h = loc(args[k]);
+        for (int j = 0; j < nreg; j++)
+            clash |= h.kind == MK_REG && h.reg == arg_regs[j] && j != k;
+    }
+    if (clash) {
+        for (int k = 0; k < nreg; k++)
+            ins(M_PUSH, 8, operand(args[k], RAX), none());
+        for (int k = nreg; k-- > 0; )
+            ins(M_POP, 8, reg(arg_regs[k]), none());
+    }
+    else
+        for (int k = 0; k < nreg; k++)
+            mov(reg(arg_regs[k]), operand(args[k], arg_regs[k]));
+
+    // 可变参数函数从 al 得知向量寄存器中的实参个数
+    ins(M_MOV, 4, reg(RAX), imm(0));
+    if (direct)
+        ins(M_CALL, 8, target(MK_SYM, ref_index(callee)), none());
+    else
+        ins(M_CALL, 8, reg(R11), none());
+    if (nstack * 8 + pad)
+        ins(M_ADD, 8, reg(RSP), imm(nstack * 8 + pad));
+
+    Ref d = f.d[i];
+    if (ref_tag(d) != RT_TEMP || home(d).kind == MK_NONE)
+        return;
+    int size = f.size[i];
+    if (size && size < 8)
+        ins(M_MOVSX, 8, reg(RAX), reg(RAX), CC_O, size);
+    put(d, RAX);
+}
+
+void Selector::ret(uint32_t i)
+{
+    if (f.a[i] != REF_NONE)
+        mov(reg(RAX), operand(f.a[i], RAX));
+    for (const std::pair<X86Reg, int> &s : saves)
+        ins(M_MOV, 8, reg(s.first), mem(RBP, s.second));
+    ins(M_LEAVE, 8, none(), none());
+    ins(M_RET, 8, none(), none());
+}
+
+
+void x86_select_function(const IrModule &m, const IrFunc &f, MFunc &out, X86Stats &st)
+{
+    Selector s(m, f, out, st);
+    s.run();
+}
+
+void x86_select(const IrModule &m, std::vector<MFunc> &out, X86Stats &st)
+{
+    out.resize(m.funcs.size());
+    for (size_t k = 0; k < m.funcs.size(); k++)
+        x86_select_function(m, m.funcs[k], out[k], st);
+}
@@ -0,0 +1,58 @@
+#!/bin/sh
+# 词法缓存的基准：以 test/gen.py 的种子 1 到 N 生成语料（缺省 2000 个文件），
+# 每 50 个中有 1 个插入词法和语法错误，另加 example 下的程序，
+# 分别计时 -q 不用缓存、缓存为空（冷）和再次运行命中缓存（热）的用时
+# （5 次取最短），输出热运行的 --cache-stats，并检查三者报告的诊断一致
+# 用法：sh test/cache_bench.sh [syntax 的路径] [文件数]
+
+SYNTAX=${1:-./syntax}
+N=${2:-2000}
+TMP=${TMPDIR:-/tmp}/df-cachebench.$$
+fail=0
+
+mkdir -p "$TMP.src"
+python3 - "$TMP.src" "$N" <<'EOF'
+import contextlib, io, runpy, sys
+d, n = sys.argv[1], int(sys.argv[2])
+for s in range(1, n + 1):
+    sys.argv = ["gen.py", str(s)]
+    out = io.StringIO()
+    with contextlib.redirect_stdout(out):
+        runpy.run_path("test/gen.py")
+    lines = out.getvalue().split("\n")
+    if s % 50 == 0:
+        lines[19] += " x = x @ 1; y = 09 + 1;"
+    with open("%s/p%d.c" % (d, s), "w") as f:
+        f.write("\n".join(lines))
+EOF
+cp example/*.c "$TMP.src"
+
+# 运行 5 次，诊断输出到 $TMP.$1，最短的毫秒数存入 ms；
+# $1 为 cold 时每次先清空缓存
+run() {
+    mode=$1
+    shift
+    ms=
+    for k in 1 2 3 4 5; do
+        [ $mode = cold ] && rm -rf "$TMP.cache"
+        start=$(date +%s%N)
+        "$SYNTAX" -q "$@" "$TMP.src"/*.c > "$TMP.$mode" 2>&1
+        t=$((($(date +%s%N) - start) / 1000000))
+        [ -z "$ms" ] || [ $t -lt $ms ] && ms=$t
+    done
+    printf "%-6s %8d ms\n" $mode $ms
+}
+
+echo "$(ls "$TMP.src" | wc -l) files, $(($(cat "$TMP.src"/*.c | wc -c) / 1024)) KB"
+run none
+run cold --cache-dir="$TMP.cache"
+run warm --cache-dir="$TMP.cache"
+"$SYNTAX" -q --cache-dir="$TMP.cache" --cache-stats "$TMP.src"/*.c 2>&1 | grep '^cache:'
+for mode in cold warm; do
+    if ! cmp -s "$TMP.none" "$TMP.$mode"; then
+        echo "FAIL: $mode cache reports different diagnostics"
+        fail=1
+    fi
+done
+rm -rf "$TMP.src" "$TMP.cache" "$TMP.none" "$TMP.cold" "$TMP.warm"
+[ $fail -eq 0 ]
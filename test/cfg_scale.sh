@@ -0,0 +1,56 @@
+#!/bin/sh
+# 控制流分析的规模测试：一个函数中串联 N 组带 break、continue 的循环，
+# 块数依次加倍，有无 -O 各求一次控制流图、支配树、活跃性和到达定值。
+# 输出各规模的用时（3 次取最短）和最大内存，规模加倍时用时或内存
+# 超过 3 倍即为超线性增长，算失败
+# 用法：sh test/cfg_scale.sh [syntax 的路径]
+
+SYNTAX=${1:-./syntax}
+TMP=${TMPDIR:-/tmp}/df-scale.$$
+fail=0
+
+# 运行 3 次，输出 "最短毫秒数 最大内存KB"
+measure() {
+    python3 -c '
+import resource, subprocess, sys, time
+best = None
+for k in range(3):
+    t = time.time()
+    if subprocess.call(sys.argv[1:], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL):
+        sys.exit(1)
+    t = time.time() - t
+    best = t if best is None else min(best, t)
+print(int(best * 1000), resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss)
+' "$@"
+}
+
+for opt in "" "-O"; do
+    last_ms=
+    for n in 1200 2400 4800; do
+        awk -v n=$n 'BEGIN {
+            print "int f(int n, char *s)\n{\n    int i;\n    int j;\n    int x;\n    x = 0;"
+            for (q = 0; q < n; q++) {
+                print "    for (i = 0; i < n; i = i + 1) {"
+                printf "        if (s[i] > %d) {\n            x = x + i;\n", q % 100
+                printf "        } else {\n            x = x - %d;\n", q
+                print "            if (x < 0) break;\n        }"
+                print "        for (j = 0; j < i; j = j + 1) { if (j > x) continue; x = x + j; }"
+                print "    }"
+            }
+            print "    return x;\n}"
+        }' > "$TMP.c"
+        "$SYNTAX" $opt --cfg-stats "$TMP.c" > /dev/null 2> "$TMP.out" || { cat "$TMP.out"; fail=1; continue; }
+        blocks=$(sed -n 's/.* \([0-9]*\) blocks,.*/\1/p' "$TMP.out")
+        set -- $(measure "$SYNTAX" $opt --cfg-stats "$TMP.c")
+        printf "cfg-scale: %-2s %6d blocks %6d ms %8d KB\n" "$opt" "$blocks" "$1" "$2"
+        if [ -n "$last_ms" ] && ! awk -v t="$1" -v lt="$last_ms" -v m="$2" -v lm="$last_kb" \
+            'BEGIN { exit !(t <= 3 * lt + 10 && m <= 3 * lm) }'; then
+            echo "FAIL $opt: time or memory more than tripled going to $blocks blocks"
+            fail=1
+        fi
+        last_ms=$1
+        last_kb=$2
+    done
+done
+rm -f "$TMP.c" "$TMP.out"
+[ $fail -eq 0 ]
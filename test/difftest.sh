@@ -0,0 +1,49 @@
+#!/bin/sh
+# 与 gcc 的随机对比测试：test/gen.py 以种子 FROM 到 TO 生成程序，
+# gcc -O0 编译运行的输出和退出码作为期望，依次与各方式编译运行的比较。
+# 方式以 -o 结尾的生成可执行文件再运行，其余由 syntax 直接运行。
+# 不一致的程序留在 $TMPDIR/difftest-种子.c
+# 用法：sh test/difftest.sh FROM TO [方式...]
+#   缺省为 -o、-O -o、--vm、-O --vm，如 sh test/difftest.sh 1 100 "--vm"
+
+SYNTAX=${SYNTAX:-./syntax}
+TIMEOUT=${TIMEOUT:-20}
+DIR=${TMPDIR:-/tmp}
+TMP=$DIR/df-diff.$$
+from=${1:-1}
+to=${2:-100}
+[ $# -ge 2 ] && shift 2 || shift $#
+[ $# -eq 0 ] && set -- "-o" "-O -o" "--vm" "-O --vm"
+count=0
+fail=0
+
+for seed in $(seq $from $to); do
+    python3 test/gen.py $seed > "$TMP.c"
+    gcc -w -fwrapv -include stdio.h -include string.h "$TMP.c" -o "$TMP.gcc" ||
+        { echo "gcc failed on seed $seed"; continue; }
+    timeout "$TIMEOUT" "$TMP.gcc" > "$TMP.expect"
+    want=$?
+    count=$((count + 1))
+    bad=0
+    for mode in "$@"; do
+        case "$mode" in
+        *-o)
+            "$SYNTAX" $mode "$TMP.bin" "$TMP.c" &&
+                timeout "$TIMEOUT" "$TMP.bin" > "$TMP.out" ;;
+        *)
+            timeout "$TIMEOUT" "$SYNTAX" $mode "$TMP.c" > "$TMP.out" ;;
+        esac
+        got=$?
+        if [ $got -ne $want ] || ! cmp -s "$TMP.out" "$TMP.expect"; then
+            echo "FAIL seed $seed ($mode): exit $got, gcc $want"
+            bad=1
+        fi
+    done
+    if [ $bad -ne 0 ]; then
+        cp "$TMP.c" "$DIR/difftest-$seed.c"
+        fail=$((fail + 1))
+    fi
+done
+rm -f "$TMP.c" "$TMP.gcc" "$TMP.bin" "$TMP.expect" "$TMP.out"
+echo "difftest: $count programs, $fail failed"
+[ $fail -eq 0 ]
@@ -0,0 +1,37 @@
+# 多函数程序的生成器，用于 --jobs 的并行代码生成基准
+# 生成 N 个中等大小的函数 f0..f(N-1)，含带 if/else 的 for 循环、
+# 全局数组下标和对前 20 个以内函数的调用，main 依次调用它们并输出散列值
+# 用法：python3 test/funcgen.py 种子 N > prog.c
+import random, sys
+
+r = random.Random(int(sys.argv[1]))
+n = int(sys.argv[2])
+print("int g[64];")
+for k in range(n):
+    print("int f%d(int a, int b)\n{\n    int i;\n    int j;\n    int s;\n    s = a;" % k)
+    for _ in range(r.randint(3, 8)):
+        c = r.random()
+        if c < 0.4:
+            print("    for (i = 0; i < %d; i = i + 1) {" % r.randint(2, 9))
+            print("        if (i %% %d == %d) {" % (r.randint(2, 5), r.randint(0, 1)))
+            print("            s = s * %d + i - b;" % r.randint(2, 7))
+            print("        } else {")
+            print("            g[i + 9] = g[i] + s %% %d;" % r.randint(3, 17))
+            print("        }")
+            print("    }")
+        elif c < 0.7:
+            print("    if (s > %d) {" % r.randint(-50, 50))
+            print("        s = s - a * %d;" % r.randint(1, 9))
+            print("    } else {")
+            print("        s = s + b / %d;" % r.randint(1, 9))
+            print("    }")
+        elif c < 0.85 and k > 0:
+            print("    s = s + f%d(s %% 16, b %% 8 + %d);" % (r.randint(max(0, k - 20), k - 1), r.randint(0, 9)))
+        else:
+            print("    j = (s - %d) + g[b %% 8 + 8];" % r.randint(0, 1000))
+            print("    s = s + j %% %d;" % r.randint(2, 50))
+    print("    return s;\n}")
+print("int main()\n{\n    int h;\n    h = 0;")
+for k in range(n):
+    print("    h = h * 31 + f%d(%d, %d);" % (k, r.randint(0, 20), r.randint(0, 20)))
+print("    printf(\"%d\\n\", h);\n    return 0;\n}")
@@ -0,0 +1,66 @@
+# 随机测试程序的生成器，用于与 gcc 对比
+# 生成三个函数 f0-f2，含嵌套的 for、if/else、数组下标、char/short 截断、
+# strlen 循环、除法和取模、函数调用，main 以不同参数调用它们并输出结果。
+# 下标都取模到数组范围内，不会越界；溢出按回绕计算，gcc 需加 -fwrapv。
+# 用法：python3 test/gen.py 种子 > prog.c
+import random, sys
+
+seed = int(sys.argv[1])
+random.seed(seed)
+
+def expr(vars, d=0):
+    r = random.random()
+    if d > 2 or r < 0.3:
+        c = random.random()
+        if c < 0.5:
+            return random.choice(vars)
+        if c < 0.7:
+            return "a[((%s %% 8) + 8) %% 8]" % random.choice(vars)
+        if c < 0.8:
+            return "s[%d]" % random.randint(0, 5)
+        return str(random.randint(-20, 100))
+    op = random.choice(["+", "-", "*", "/", "%", "<", ">", "==", "!=", "<=", ">="])
+    x, y = expr(vars, d + 1), expr(vars, d + 1)
+    if op in "/%":
+        return "(%s %s %d)" % (x, op, random.choice([1, 2, 3, 7, -5, 16]))
+    return "(%s %s %s)" % (x, op, y)
+
+def stmt(vars, d=0):
+    r = random.random()
+    v = random.choice(vars)
+    if d < 2 and r < 0.2:
+        i = "i%d" % d
+        return ["for (%s = 0; %s < %d; %s = %s + 1) {" % (i, i, random.randint(1, 8), i, i)] + \
+            sum([stmt(vars + [i], d + 1) for _ in range(random.randint(1, 4))], []) + ["}"]
+    if d < 3 and r < 0.4:
+        return ["if (%s) {" % expr(vars)] + stmt(vars, d + 1) + ["} else {"] + stmt(vars, d + 1) + ["}"]
+    if r < 0.5:
+        return ["a[((%s %% 8) + 8) %% 8] = %s;" % (v, expr(vars))]
+    if r < 0.53 and d > 0:
+        i = "i%d" % (d - 1)
+        return ["%s = %s + a[((%s %% 8) + 8) %% 8] * s[((%s %% 8) + 8) %% 8];" % (random.choice(["x", "y", "z"]), expr(vars), i, i)]
+    if r < 0.56 and d > 0:
+        i = "i%d" % (d - 1)
+        return ["a[((%s %% 8) + 8) %% 8] = a[((%s %% 8) + 8) %% 8] + %s;" % (i, i, expr(vars))]
+    if r < 0.58:
+        return ["for (i2 = 0; i2 < strlen(str); i2 = i2 + 1) {", "z = z + str[i2] * %s;" % v, "}"]
+    if r < 0.6:
+        return ["%s = g%d(%s, %s);" % (random.choice(["x", "y", "z"]), random.randint(0, 1), expr(vars), expr(vars))]
+    return ["%s = %s;" % (random.choice(["x", "y", "z", "c", "h"]), expr(vars))]
+
+prog = ["int ga[8];", "int g0(int p, int q)", "{", "    return p * 3 - q / 2;", "}",
+        "int g1(int p, int q)", "{", "    if (p > q) return p - q;", "    return q % 5 + p;", "}"]
+for f in range(3):
+    prog += ["int f%d(int x, int y)" % f, "{", "    int a[8];", "    char s[8];", "    char *str;",
+             "    int i0;", "    int i1;", "    int i2;", "    int z;", "    char c;", "    short h;",
+             "    z = x + y; c = 'a'; h = 300; i1 = 0; i2 = 0; str = \"hello\";",
+             "    for (i0 = 0; i0 < 8; i0 = i0 + 1) { a[i0] = i0 * x; s[i0] = i0 + 65; }"]
+    for _ in range(8):
+        prog += stmt(["x", "y", "z", "c", "h"])
+    prog += ["    printf(\"f%d %%d %%d %%d %%d %%d %%d\\n\", x, y, z, c, h, a[3] + s[2]);" % f,
+             "    return x + y * 2 + z + a[5];", "}"]
+prog += ["int main()", "{", "    int k;", "    int t;", "    t = 0;",
+         "    for (k = -3; k < 4; k = k + 1) {",
+         "        t = t + f0(k, k * 7) + f1(k * 3, 5 - k) + f2(100 - k, k);", "    }",
+         "    printf(\"t %d\\n\", t);", "    return t % 256;", "}"]
+print("\n".join(prog))
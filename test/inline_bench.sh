@@ -0,0 +1,44 @@
+#!/bin/sh
+# 内联的基准：以 -O --no-inline 和 -O 运行 test/programs/c1.c-c3.c
+# （12 个小函数，部分互相调用，在 3000x100 的循环中调用 6 次），
+# 输出虚拟机执行的字节码数、调用次数、用时和本地代码的用时（3 次取最短），
+# 并检查各方式的输出一致
+# 用法：sh test/inline_bench.sh [syntax 的路径]
+
+SYNTAX=${1:-./syntax}
+TMP=${TMPDIR:-/tmp}/df-inlbench.$$
+fail=0
+
+printf "%-4s %-11s %12s %9s %10s %10s\n" "" "" "executed" "calls" "vm ms" "native ms"
+for src in test/programs/c1.c test/programs/c2.c test/programs/c3.c; do
+    name=$(basename "$src" .c)
+    rm -f "$TMP.expect"
+    for opt in "--no-inline" ""; do
+        vm=
+        for k in 1 2 3; do
+            "$SYNTAX" -O $opt --vm --vm-stats "$src" > "$TMP.out" 2> "$TMP.err" ||
+                { cat "$TMP.err"; fail=1; }
+            # vm: ... N executed in T ms (...), C calls, ...
+            set -- $(sed -n 's/.* \([0-9]*\) executed in \([0-9.]*\) ms .*, \([0-9]*\) calls.*/\1 \2 \3/p' "$TMP.err")
+            if [ -z "$vm" ] || awk -v t="$2" -v b="$vm" 'BEGIN { exit !(t < b) }'; then
+                vm=$2
+                executed=$1
+                calls=$3
+            fi
+        done
+        [ -f "$TMP.expect" ] || cp "$TMP.out" "$TMP.expect"
+        cmp -s "$TMP.out" "$TMP.expect" || { echo "FAIL $name (-O $opt --vm): output differs"; fail=1; }
+        "$SYNTAX" -O $opt -o "$TMP.bin" "$src" || { echo "FAIL $name (-O $opt): does not compile"; fail=1; continue; }
+        ms=
+        for k in 1 2 3; do
+            start=$(date +%s%N)
+            "$TMP.bin" > "$TMP.out"
+            t=$((($(date +%s%N) - start) / 1000000))
+            [ -z "$ms" ] || [ $t -lt $ms ] && ms=$t
+        done
+        cmp -s "$TMP.out" "$TMP.expect" || { echo "FAIL $name (-O $opt -o): output differs"; fail=1; }
+        printf "%-4s %-11s %12s %9s %10s %10s\n" "$name" "$opt" "$executed" "$calls" "$vm" "$ms"
+    done
+done
+rm -f "$TMP.out" "$TMP.err" "$TMP.expect" "$TMP.bin"
+[ $fail -eq 0 ]
@@ -0,0 +1,36 @@
+#!/bin/sh
+# 并行代码生成的基准：test/funcgen.py 生成 N 个（缺省 2000）中等大小的函数，
+# 以 -O -c 和 --jobs=1、2、4 编译，输出用时（3 次取最短）、相对 1 个线程的
+# 加速比和 pool: 行的任务窃取数，并检查各线程数生成的目标文件逐字节相同。
+# 处理器只有一个时加速比只反映调度的开销
+# 用法：sh test/jobs_bench.sh [syntax 的路径] [函数数]
+
+SYNTAX=${1:-./syntax}
+N=${2:-2000}
+TMP=${TMPDIR:-/tmp}/df-jobs.$$
+fail=0
+
+python3 test/funcgen.py 1 $N > "$TMP.c"
+echo "$N functions, $(nproc) processors"
+printf "%-8s %8s %8s %8s\n" "jobs" "ms" "speedup" "stolen"
+for j in 1 2 4; do
+    ms=
+    for k in 1 2 3; do
+        start=$(date +%s%N)
+        "$SYNTAX" -O --jobs=$j --asm-stats -c -o "$TMP.$j.o" "$TMP.c" 2> "$TMP.err" ||
+            { head -5 "$TMP.err"; fail=1; break; }
+        t=$((($(date +%s%N) - start) / 1000000))
+        [ -z "$ms" ] || [ $t -lt $ms ] && ms=$t
+    done
+    [ $j -eq 1 ] && base=$ms
+    # pool: N functions on T threads, S stolen
+    stolen=$(sed -n 's/^pool: .*, \([0-9]*\) stolen.*/\1/p' "$TMP.err")
+    awk -v j=$j -v t=$ms -v b=$base -v s="$stolen" \
+        'BEGIN { printf "%-8d %8d %7.2fx %8s\n", j, t, b / t, s }'
+    if ! cmp -s "$TMP.1.o" "$TMP.$j.o"; then
+        echo "FAIL --jobs=$j: object differs from --jobs=1"
+        fail=1
+    fi
+done
+rm -f "$TMP.c" "$TMP.err" "$TMP.1.o" "$TMP.2.o" "$TMP.4.o"
+[ $fail -eq 0 ]
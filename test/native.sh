@@ -0,0 +1,51 @@
+#!/bin/sh
+# 本地代码与 gcc -O0 的对比：example 和 test/programs 下的每个程序
+# 以 -S 生成汇编（有无 -O 各一次），用系统的 cc 汇编、链接后运行，
+# 输出和退出码须与 gcc -O0 编译的一致，并列出三者的运行时间（5 次取最短）。
+# example/lex3.c、lex4.c 修改字符串常量，两边都会因段错误退出
+# 用法：sh test/native.sh [syntax 的路径]
+
+SYNTAX=${1:-./syntax}
+TIMEOUT=${TIMEOUT:-20}
+TMP=${TMPDIR:-/tmp}/df-native.$$
+fail=0
+
+# 运行 5 次，输出到 $TMP.out，退出码存入 rc，最短的毫秒数存入 ms
+run() {
+    ms=
+    for k in 1 2 3 4 5; do
+        start=$(date +%s%N)
+        timeout "$TIMEOUT" "$1" > "$TMP.out" 2> /dev/null
+        rc=$?
+        t=$((($(date +%s%N) - start) / 1000000))
+        [ -z "$ms" ] || [ $t -lt $ms ] && ms=$t
+    done
+}
+
+printf "%-12s %10s %10s %10s\n" "program" "gcc -O0" "syntax" "syntax -O"
+for src in example/*.c test/programs/*.c; do
+    name=$(basename "$src" .c)
+    gcc -O0 -w -fwrapv -include stdio.h -include string.h "$src" -o "$TMP.gcc" ||
+        { echo "gcc failed on $src"; fail=$((fail + 1)); continue; }
+    run "$TMP.gcc"
+    cp "$TMP.out" "$TMP.expect"
+    want=$rc
+    line=$(printf "%-12s %8d ms" "$name" "$ms")
+    for opt in "" "-O"; do
+        if ! "$SYNTAX" $opt -S -o "$TMP.s" "$src" || ! cc "$TMP.s" -o "$TMP.bin"; then
+            echo "FAIL $src ($opt): does not assemble or link"
+            fail=$((fail + 1))
+            continue
+        fi
+        run "$TMP.bin"
+        line="$line $(printf "%8d ms" "$ms")"
+        if [ $rc -ne $want ] || ! cmp -s "$TMP.out" "$TMP.expect"; then
+            echo "FAIL $src ($opt): exit $rc, gcc $want"
+            diff "$TMP.expect" "$TMP.out" | head -5
+            fail=$((fail + 1))
+        fi
+    done
+    echo "$line"
+done
+rm -f "$TMP.gcc" "$TMP.s" "$TMP.bin" "$TMP.out" "$TMP.expect"
+[ $fail -eq 0 ]
@@ -0,0 +1,53 @@
+#!/bin/sh
+# 直接生成目标文件的基准：对 example/lex4.c、test/programs/t2.c 和
+# test/gen.py 以种子 1 生成的程序，分别计时 -S 再用 as 汇编与直接 -c、
+# -S 再用 cc 汇编链接与直接 -o（5 次取最短），并检查两种目标文件的
+# .text、.data、.rodata 逐字节相同
+# 用法：sh test/obj_bench.sh [syntax 的路径]
+
+SYNTAX=${1:-./syntax}
+TMP=${TMPDIR:-/tmp}/df-objbench.$$
+fail=0
+
+# 运行命令 5 次，最短的毫秒数存入 ms
+run() {
+    ms=
+    for k in 1 2 3 4 5; do
+        start=$(date +%s%N)
+        sh -c "$1" || { echo "FAIL: $1"; fail=1; return; }
+        t=$((($(date +%s%N) - start) / 1000000))
+        [ -z "$ms" ] || [ $t -lt $ms ] && ms=$t
+    done
+}
+
+# 以十六进制输出目标文件 $1 中节 $2 的内容
+section() {
+    objcopy -O binary --only-section=$2 "$1" "$TMP.sec" && od -An -tx1 -v "$TMP.sec"
+}
+
+python3 test/gen.py 1 > "$TMP.gen.c"
+printf "%-10s %6s %10s %8s %12s %8s\n" "program" "lines" "-S + as" "-c" "-S + cc -o" "-o"
+for src in example/lex4.c test/programs/t2.c "$TMP.gen.c"; do
+    case "$src" in
+    "$TMP.gen.c") name=gen ;;
+    *) name=$(basename "$src" .c) ;;
+    esac
+    line=$(printf "%-10s %6d" "$name" $(wc -l < "$src"))
+    run "'$SYNTAX' -S -o '$TMP.s' '$src' && as '$TMP.s' -o '$TMP.as.o'"
+    line="$line $(printf "%7d ms" "$ms")"
+    run "'$SYNTAX' -c -o '$TMP.o' '$src'"
+    line="$line $(printf "%5d ms" "$ms")"
+    for sec in .text .data .rodata; do
+        if [ "$(section "$TMP.as.o" $sec)" != "$(section "$TMP.o" $sec)" ]; then
+            echo "FAIL $name: $sec of -c differs from -S + as"
+            fail=1
+        fi
+    done
+    run "'$SYNTAX' -S -o '$TMP.s' '$src' && cc '$TMP.s' -o '$TMP.bin'"
+    line="$line $(printf "%9d ms" "$ms")"
+    run "'$SYNTAX' -o '$TMP.bin' '$src'"
+    line="$line $(printf "%5d ms" "$ms")"
+    echo "$line"
+done
+rm -f "$TMP.gen.c" "$TMP.s" "$TMP.as.o" "$TMP.o" "$TMP.bin" "$TMP.sec"
+[ $fail -eq 0 ]
@@ -0,0 +1,55 @@
+#!/bin/sh
+# 大纲模式的基准：生成 N 个（缺省 20000）约 150 个记号的函数，
+# 每 10 个函数前有一个结构体和原型，函数体的字符串、字符常量和注释
+# 中带有花括号。输出完整分析 -q、--outline 和 --outline --body
+# 的用时（5 次取最短），并检查大纲列出了全部函数
+# 用法：sh test/outline_bench.sh [syntax 的路径] [函数数]
+
+SYNTAX=${1:-./syntax}
+N=${2:-20000}
+TMP=${TMPDIR:-/tmp}/df-outline.$$
+fail=0
+
+awk -v n=$N 'BEGIN {
+    for (f = 0; f < n; f++) {
+        if (f % 10 == 0) {
+            printf "struct s%d {\n    int a;\n    char *b;\n};\n", f
+            printf "int f%d(int x, char *p);\n", f + 9
+        }
+        printf "int g%d;\n", f
+        printf "int f%d(int x, char *p)\n{\n    int i;\n    int t;\n", f
+        print "    /* } 注释中的花括号 { */"
+        print "    t = x;"
+        print "    for (i = 0; i < x; i = i + 1) {"
+        print "        if (p[i] == \x27}\x27) {\n            t = t + i * 3;\n        } else {\n            t = t - 1;\n        }"
+        print "    }"
+        print "    for (i = 0; t > 100; i = i + 1) {\n        t = t / 2;\n    }"
+        printf "    return t + f%d(t, \"}{\") + g%d;\n}\n", f / 2, f
+    }
+}' > "$TMP.c"
+
+# 运行 5 次，输出到 $TMP.out，最短的毫秒数存入 ms
+run() {
+    ms=
+    for k in 1 2 3 4 5; do
+        start=$(date +%s%N)
+        "$SYNTAX" "$@" "$TMP.c" > "$TMP.out" 2> "$TMP.err" || { head -5 "$TMP.err"; fail=1; }
+        t=$((($(date +%s%N) - start) / 1000000))
+        [ -z "$ms" ] || [ $t -lt $ms ] && ms=$t
+    done
+}
+
+echo "$N functions, $(($(wc -c < "$TMP.c") / 1024)) KB"
+run -q
+printf "%-26s %6d ms\n" "-q" $ms
+run --outline
+printf "%-26s %6d ms\n" "--outline" $ms
+funcs=$(grep -c '^func' "$TMP.out")
+if [ "$funcs" -ne "$N" ]; then
+    echo "FAIL: --outline lists $funcs functions, expected $N"
+    fail=1
+fi
+run --outline --body=f$((N / 2))
+printf "%-26s %6d ms\n" "--outline --body=f$((N / 2))" $ms
+rm -f "$TMP.c" "$TMP.out" "$TMP.err"
+[ $fail -eq 0 ]
@@ -0,0 +1,87 @@
+#!/bin/sh
+# 窥孔优化的基准：test/gen.py 以种子 FROM 到 TO（缺省 5000-5099）生成的程序，
+# 有无 -O 各以 -c --asm-stats 编译，累计优化前后的指令数、有无 --no-peephole
+# 的代码字节数和各规则的命中次数；再对 test/programs 下的 bench.c、c1-c3.c
+# 比较有无 --no-peephole 时的代码字节数和可执行文件的运行时间（5 次取最短），
+# 并检查两者的输出一致
+# 用法：sh test/peep_bench.sh [syntax 的路径] [FROM TO]
+
+SYNTAX=${1:-./syntax}
+from=${2:-5000}
+to=${3:-5099}
+TMP=${TMPDIR:-/tmp}/df-peep.$$
+fail=0
+
+# 代码字节数，取自 --asm-stats 的 elf: 行
+code_bytes() {
+    sed -n 's/^elf: \([0-9]*\) bytes of code.*/\1/p' "$1"
+}
+
+: > "$TMP.peep"
+off=0
+on=0
+for seed in $(seq $from $to); do
+    python3 test/gen.py $seed > "$TMP.c"
+    for opt in "" "-O"; do
+        "$SYNTAX" $opt --no-peephole --asm-stats -c -o "$TMP.o" "$TMP.c" 2> "$TMP.err" &&
+            off=$((off + $(code_bytes "$TMP.err"))) &&
+            "$SYNTAX" $opt --asm-stats -c -o "$TMP.o" "$TMP.c" 2> "$TMP.err" &&
+            on=$((on + $(code_bytes "$TMP.err"))) ||
+            { echo "FAIL seed $seed ($opt): does not compile"; head -5 "$TMP.err"; fail=1; }
+        grep '^peep:' "$TMP.err" >> "$TMP.peep"
+    done
+done
+# peep: A instructions to B in N passes; rule hits rule hits ...
+awk -v off=$off -v on=$on '{
+    before += $2; after += $5
+    for (i = 9; i < NF; i += 2) {
+        if (!($i in hits))
+            rules[n++] = $i
+        hits[$i] += $(i + 1)
+    }
+} END {
+    printf "instructions %9d -> %d (%.1f%%)\n", before, after, 100 * (after - before) / before
+    printf "code bytes   %9d -> %d (%.1f%%)\n", off, on, 100 * (on - off) / off
+    printf "hits:"
+    for (i = 0; i < n; i++) printf " %s %d", rules[i], hits[rules[i]]
+    printf "\n"
+}' "$TMP.peep"
+
+# 运行 5 次，输出到 $2，最短的毫秒数存入 ms
+run() {
+    ms=
+    for k in 1 2 3 4 5; do
+        start=$(date +%s%N)
+        "$1" > "$2"
+        t=$((($(date +%s%N) - start) / 1000000))
+        [ -z "$ms" ] || [ $t -lt $ms ] && ms=$t
+    done
+}
+
+printf "%-10s %19s %11s\n" "program" "code bytes" "ms"
+for prog in bench "bench -O" c1 c2 c3; do
+    set -- $prog
+    src=test/programs/$1.c
+    if ! "$SYNTAX" $2 --no-peephole --asm-stats -o "$TMP.bin" "$src" 2> "$TMP.err"; then
+        echo "FAIL $prog (--no-peephole): does not compile"
+        fail=1
+        continue
+    fi
+    run "$TMP.bin" "$TMP.off"
+    off=$(code_bytes "$TMP.err")
+    off_ms=$ms
+    if ! "$SYNTAX" $2 --asm-stats -o "$TMP.bin" "$src" 2> "$TMP.err"; then
+        echo "FAIL $prog: does not compile"
+        fail=1
+        continue
+    fi
+    run "$TMP.bin" "$TMP.on"
+    on=$(code_bytes "$TMP.err")
+    printf "%-10s %8d -> %-7d %6d -> %d\n" "$prog" $off $on $off_ms $ms
+    if ! cmp -s "$TMP.off" "$TMP.on"; then
+        echo "FAIL $prog: output differs with --no-peephole"
+        fail=1
+    fi
+done
+rm -f "$TMP.c" "$TMP.o" "$TMP.err" "$TMP.peep" "$TMP.bin" "$TMP.off" "$TMP.on"
+[ $fail -eq 0 ]
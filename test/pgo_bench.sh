@@ -0,0 +1,68 @@
+#!/bin/sh
+# 剖析反馈的基准：以 --profile-generate 编译训练程序，本地代码和 --run
+# 各运行一次，两者写出的剖析文件须逐字节相同；再以 --profile-use 读入，
+# 编译评估程序。输出训练运行中布局前后跳转的次数、插桩程序的用时，
+# 以及评估程序 -O 与 -O --profile-use 的用时（5 次取最短），
+# 检查剖析文件没有被拒绝、各方式的输出一致
+# 训练与评估：test/programs/pgo_train.c 与 pgo.c（分类循环），bench.c 与自身
+# 用法：sh test/pgo_bench.sh [syntax 的路径]
+
+SYNTAX=${1:-./syntax}
+TMP=${TMPDIR:-/tmp}/df-pgo.$$
+fail=0
+
+# 运行 5 次，输出到 $2，最短的毫秒数存入 ms
+run() {
+    ms=
+    for k in 1 2 3 4 5; do
+        start=$(date +%s%N)
+        "$1" > "$2"
+        t=$((($(date +%s%N) - start) / 1000000))
+        [ -z "$ms" ] || [ $t -lt $ms ] && ms=$t
+    done
+}
+
+printf "%-10s %26s %8s %18s\n" "program" "taken jumps" "instr" "-O -> profile-use"
+for pair in "pgo_train pgo" "bench bench"; do
+    set -- $pair
+    train=test/programs/$1.c
+    eval=test/programs/$2.c
+    rm -f "$TMP.prof" "$TMP.jit.prof"
+    if ! "$SYNTAX" -O --profile-generate="$TMP.prof" -o "$TMP.bin" "$train"; then
+        echo "FAIL $1: does not compile with --profile-generate"
+        fail=1
+        continue
+    fi
+    rm -f "$TMP.prof"
+    run "$TMP.bin" "$TMP.out"
+    instr=$ms
+    "$SYNTAX" -O --profile-generate="$TMP.jit.prof" --run "$train" > "$TMP.jit"
+    if ! cmp -s "$TMP.out" "$TMP.jit" || ! cmp -s "$TMP.prof" "$TMP.jit.prof"; then
+        echo "FAIL $1: --run and native code give different output or profiles"
+        fail=1
+    fi
+
+    "$SYNTAX" -O -o "$TMP.bin" "$eval" && run "$TMP.bin" "$TMP.base"
+    base=$ms
+    if ! "$SYNTAX" -O --profile-use="$TMP.prof" --asm-stats -o "$TMP.bin" "$eval" 2> "$TMP.err"; then
+        echo "FAIL $2: does not compile with --profile-use"
+        fail=1
+        continue
+    fi
+    # 统计行以外的输出说明剖析文件被拒绝
+    if grep -v '^[a-z0-9]*: [0-9]' "$TMP.err"; then
+        echo "FAIL $2: profile from $1 was not used"
+        fail=1
+    fi
+    # pgo: ...; A taken jumps -> B
+    jumps=$(sed -n 's/^pgo: .*; \([0-9]*\) taken jumps -> \([0-9]*\)/\1 -> \2/p' "$TMP.err")
+    run "$TMP.bin" "$TMP.use"
+    printf "%-10s %26s %5d ms %6d -> %d ms\n" "$2" "$jumps" $instr $base $ms
+    if ! cmp -s "$TMP.base" "$TMP.use"; then
+        echo "FAIL $2: output differs with --profile-use"
+        fail=1
+    fi
+done
+rm -f "$TMP.prof" "$TMP.jit.prof" "$TMP.bin" "$TMP.out" "$TMP.jit" "$TMP.base" \
+    "$TMP.use" "$TMP.err"
+[ $fail -eq 0 ]
@@ -0,0 +1,61 @@
+/* 基准：筛法、冒泡排序和递归的 fib */
+
+int fib(int n)
+{
+    if (n < 2)
+        return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+int sieve(char *flags, int n)
+{
+    int i;
+    int j;
+    int count;
+    count = 0;
+    for (i = 0; i < n; i = i + 1)
+        flags[i] = 1;
+    for (i = 2; i < n; i = i + 1) {
+        if (flags[i]) {
+            count = count + 1;
+            for (j = i + i; j < n; j = j + i)
+                flags[j] = 0;
+        }
+    }
+    return count;
+}
+
+int sort(int *v, int n)
+{
+    int i;
+    int j;
+    int t;
+    for (i = 0; i < n; i = i + 1)
+        v[i] = (i * 7919) % 1000;
+    for (i = 0; i < n; i = i + 1) {
+        for (j = 0; j < n - 1 - i; j = j + 1) {
+            if (v[j] > v[j + 1]) {
+                t = v[j];
+                v[j] = v[j + 1];
+                v[j + 1] = t;
+            }
+        }
+    }
+    return v[n / 2];
+}
+
+char flags[100000];
+int v[2000];
+
+int main()
+{
+    int k;
+    int s;
+    s = 0;
+    for (k = 0; k < 10; k = k + 1)
+        s = s + sieve(flags, 100000);
+    printf("primes %d\n", s);
+    printf("median %d\n", sort(v, 2000));
+    printf("fib %d\n", fib(27));
+    return 0;
+}
@@ -0,0 +1,33 @@
+/* 内联：12 个小函数，部分互相调用，在 3000x100 的循环中调用其中 6 个 */
+
+int h0(int a, int b) { if (a < b) { return b - a; } return a - b; }
+int h1(int a, int b) { return a - b + 8; }
+int h2(int a, int b) { return h1(b, a) + 4; }
+int h3(int a, int b) { if (a < b) { return b - a; } return a - b; }
+int h4(int a, int b) { return a - b + 7; }
+int h5(int a, int b) { return h4(b, a) + 1; }
+int h6(int a, int b) { return h2(b, a) + 2; }
+int h7(int a, int b) { return a - b + 1; }
+int h8(int a, int b) { return a * b * 1; }
+int h9(int a, int b) { return h3(b, a) + 4; }
+int h10(int a, int b) { return a * b + 8; }
+int h11(int a, int b) { return h8(b, a) + 2; }
+int main()
+{
+    int i;
+    int j;
+    int s;
+    s = 0;
+    for (i = 0; i < 3000; i = i + 1) {
+        for (j = 0; j < 100; j = j + 1) {
+            s = h5(s, i + j) % 100003;
+            s = h3(s, i + j) % 100003;
+            s = h10(s, i + j) % 100003;
+            s = h3(s, i + j) % 100003;
+            s = h7(s, i + j) % 100003;
+            s = h4(s, i + j) % 100003;
+        }
+    }
+    printf("%d\n", s);
+    return 0;
+}
@@ -0,0 +1,33 @@
+/* 内联：12 个小函数，部分互相调用，在 3000x100 的循环中调用其中 6 个 */
+
+int h0(int a, int b) { return a + b + 6; }
+int h1(int a, int b) { if (a < b) { return b - a; } return a - b; }
+int h2(int a, int b) { int t; t = a * 4 + b; if (t > 1000) { t = t % 1000; } return t; }
+int h3(int a, int b) { if (a < b) { return b - a; } return a - b; }
+int h4(int a, int b) { return a * b * 3; }
+int h5(int a, int b) { return h3(b, a) + 3; }
+int h6(int a, int b) { return h4(b, a) + 3; }
+int h7(int a, int b) { return a + b - 8; }
+int h8(int a, int b) { int t; t = a * 5 + b; if (t > 1000) { t = t % 1000; } return t; }
+int h9(int a, int b) { return h8(b, a) + 2; }
+int h10(int a, int b) { if (a < b) { return b - a; } return a - b; }
+int h11(int a, int b) { if (a < b) { return b - a; } return a - b; }
+int main()
+{
+    int i;
+    int j;
+    int s;
+    s = 0;
+    for (i = 0; i < 3000; i = i + 1) {
+        for (j = 0; j < 100; j = j + 1) {
+            s = h3(s, i + j) % 100003;
+            s = h0(s, i + j) % 100003;
+            s = h2(s, i + j) % 100003;
+            s = h5(s, i + j) % 100003;
+            s = h2(s, i + j) % 100003;
+            s = h2(s, i + j) % 100003;
+        }
+    }
+    printf("%d\n", s);
+    return 0;
+}
@@ -0,0 +1,33 @@
+/* 内联：12 个小函数，部分互相调用，在 3000x100 的循环中调用其中 6 个 */
+
+int h0(int a, int b) { if (a < b) { return b - a; } return a - b; }
+int h1(int a, int b) { if (a < b) { return b - a; } return a - b; }
+int h2(int a, int b) { int t; t = a * 6 + b; if (t > 1000) { t = t % 1000; } return t; }
+int h3(int a, int b) { return h2(b, a) + 1; }
+int h4(int a, int b) { return a - b - 4; }
+int h5(int a, int b) { if (a < b) { return b - a; } return a - b; }
+int h6(int a, int b) { return h4(b, a) + 4; }
+int h7(int a, int b) { return h5(b, a) + 2; }
+int h8(int a, int b) { if (a < b) { return b - a; } return a - b; }
+int h9(int a, int b) { if (a < b) { return b - a; } return a - b; }
+int h10(int a, int b) { return h0(b, a) + 1; }
+int h11(int a, int b) { if (a < b) { return b - a; } return a - b; }
+int main()
+{
+    int i;
+    int j;
+    int s;
+    s = 0;
+    for (i = 0; i < 3000; i = i + 1) {
+        for (j = 0; j < 100; j = j + 1) {
+            s = h9(s, i + j) % 100003;
+            s = h0(s, i + j) % 100003;
+            s = h4(s, i + j) % 100003;
+            s = h0(s, i + j) % 100003;
+            s = h4(s, i + j) % 100003;
+            s = h7(s, i + j) % 100003;
+        }
+    }
+    printf("%d\n", s);
+    return 0;
+}
@@ -0,0 +1,54 @@
+/* 剖析反馈的训练程序：与 pgo.c 相同，循环 300 万次 */
+
+int check(int v)
+{
+    if (v < 0) {
+        printf("negative %d\n", v);
+        return -1;
+    }
+    if (v > 1000000000) {
+        printf("too big %d\n", v);
+        return -2;
+    }
+    return 0;
+}
+
+int classify(int x)
+{
+    int r;
+    if (x % 97 == 0)
+        r = 3;
+    else if (x % 13 == 0)
+        r = 2;
+    else if (x % 2 == 0)
+        r = 1;
+    else
+        r = 0;
+    if (check(x) != 0)
+        r = r * 100;
+    return r;
+}
+
+int cold_report(int a, int b)
+{
+    printf("report %d %d\n", a, b);
+    return a + b;
+}
+
+int main()
+{
+    int i;
+    int s = 0;
+    int t = 0;
+    for (i = 0; i < 3000000; i = i + 1) {
+        int c = classify(i);
+        if (c == 3)
+            s = s + 7;
+        else
+            s = s + c;
+        if (s < 0)
+            t = t + cold_report(s, i);
+    }
+    printf("%d %d\n", s, t);
+    return 0;
+}
@@ -0,0 +1,85 @@
+/* 后端：结构、全局初值、九个参数的调用、寄存器压力、char/short 截断、除法的符号 */
+
+struct pt {
+    int x;
+    char c;
+    short s;
+    struct pt *next;
+};
+
+int gi = 7;
+char gc = -3;
+short gs = 1000;
+char gbuf[16] = "hello";
+char *gp = "world";
+int garr[10];
+struct pt gpt;
+
+int many(int a, int b, int c, int d, int e, int f, int g, int h, int i)
+{
+    return a - b * 2 + c * 3 - d * 4 + e * 5 - f * 6 + g * 7 - h * 8 + i * 9;
+}
+
+int pressure(int n)
+{
+    int a; int b; int c; int d; int e; int f; int g; int h;
+    int i; int j; int k; int l; int m; int o; int p; int q;
+    int r;
+    a = n; b = n + 1; c = n + 2; d = n + 3; e = n + 4; f = n + 5; g = n + 6; h = n + 7;
+    i = n * 2; j = n * 3; k = n * 4; l = n * 5; m = n * 6; o = n * 7; p = n * 8; q = n * 9;
+    for (r = 0; r < 10; r = r + 1) {
+        a = a + b; b = b + c; c = c + d; d = d + e; e = e + f; f = f + g; g = g + h; h = h + i;
+        i = i + j; j = j + k; k = k + l; l = l + m; m = m + o; o = o + p; p = p + q; q = q + a;
+        if (a > 100000)
+            a = a % 1000;
+        printf("%d ", many(a, b, c, d, e, f, g, h, r));
+    }
+    printf("\n");
+    return a + b + c + d + e + f + g + h + i + j + k + l + m + o + p + q;
+}
+
+int sum_list(struct pt *p)
+{
+    int s;
+    s = 0;
+    for (; p; p = p->next) {
+        s = s + p->x * 100 + p->c + p->s;
+    }
+    return s;
+}
+
+int fact(int n)
+{
+    if (n < 2)
+        return 1;
+    return n * fact(n - 1);
+}
+
+int main()
+{
+    struct pt a;
+    struct pt b;
+    struct pt c;
+    int i;
+    char buf[20];
+    short sh;
+    a.x = 1; a.c = 'A'; a.s = 300; a.next = &b;
+    b.x = 2; b.c = -1; b.s = -30000; b.next = &c;
+    c.x = 3; c.c = 127; c.s = 32767; c.next = 0;
+    gpt = a;
+    printf("list %d %d\n", sum_list(&a), sum_list(&gpt));
+    printf("pressure %d\n", pressure(3));
+    printf("fact %d\n", fact(10));
+    printf("globals %d %d %d %s %s %d\n", gi, gc, gs, gbuf, gp, strlen(gbuf));
+    for (i = 0; i < 10; i = i + 1)
+        garr[i] = i * i - gi;
+    for (i = 0; i < 19; i = i + 1)
+        buf[i] = 'a' + i;
+    buf[19] = 0;
+    printf("%s %d %d\n", buf, garr[9], garr[2]);
+    sh = 40000;
+    gc = 200;
+    printf("%d %d %d\n", sh, gc, many(1, 2, 3, 4, 5, 6, 7, 8, 9));
+    printf("%d %d %d %d\n", -7 / 2, -7 % 2, 7 / -2, 100000 * 100000);
+    return fact(5);
+}
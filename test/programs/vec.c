@@ -0,0 +1,62 @@
+/* 向量化：100 万字符转大写、25 万个 int 截断，各 200 轮，最后输出散列值 */
+
+char s[1000000];
+char t[1000000];
+int a[250000];
+int b[250000];
+
+int upper(char *p, char *q, int n)
+{
+    int i;
+    for (i = 0; i < n; i = i + 1) {
+        if (p[i] >= 'a') {
+            if (p[i] <= 'z') {
+                q[i] = p[i] - 32;
+            } else {
+                q[i] = p[i];
+            }
+        } else {
+            q[i] = p[i];
+        }
+    }
+    return 0;
+}
+
+int clamp(int *x, int *y, int n, int k)
+{
+    int i;
+    for (i = 0; i < n; i = i + 1) {
+        if (x[i] > k) {
+            y[i] = k;
+        } else {
+            y[i] = x[i] + y[i];
+        }
+    }
+    return 0;
+}
+
+int main()
+{
+    int i;
+    int r;
+    int h;
+    for (i = 0; i < 1000000; i = i + 1) {
+        s[i] = 32 + i * 7 % 95;
+    }
+    for (i = 0; i < 250000; i = i + 1) {
+        a[i] = i * 13 % 1000;
+    }
+    for (r = 0; r < 200; r = r + 1) {
+        upper(s, t, 1000000);
+        clamp(a, b, 250000, 700);
+    }
+    h = 0;
+    for (i = 0; i < 1000000; i = i + 1) {
+        h = h * 31 + t[i];
+    }
+    for (i = 0; i < 250000; i = i + 1) {
+        h = h * 31 + b[i];
+    }
+    printf("%d\n", h);
+    return 0;
+}
@@ -0,0 +1,7 @@
+/* sizeof 的类型有错时操作数未初始化，生成中间代码时越界访问 */
+int main()
+{
+    int x;
+    x = sizeof(struct Nope) + 1;
+    return x;
+}
@@ -0,0 +1,32 @@
+/* -O 时临时变量宽度的不动点在 phi 与 mov 互相依赖时来回变化，不能结束 */
+int g1;
+
+int f0()
+{
+    int i1;
+    int i2;
+    int a;
+    a = 0;
+    if (g1) {
+        for (i1 = 0; i1 < 19; i1 = i1 + 1) {
+            for (i2 = 0; i2 < 7; i2 = i2 + 1) {
+                a = g1;
+            }
+            if (a)
+                continue;
+            for (i2 = 3; i2 < 35; i2 = i2 + 1) {
+                a = 5;
+            }
+        }
+    }
+    return a;
+}
+
+int main()
+{
+    g1 = 0;
+    printf("%d\n", f0());
+    g1 = 3;
+    printf("%d\n", f0());
+    return 0;
+}
@@ -0,0 +1,23 @@
+executed 185
+function main 172 185 1
+function foo 13 13 1
+construct 20:5 for 154 11
+construct 22:9 call 40 10
+construct 16:9 call 19 1
+construct 5:5 call 6 1
+construct 4:5 call 2 1
+line 20 74
+line 21 40
+line 22 40
+line 5 6
+line 16 6
+line 14 5
+line 2 4
+line 4 2
+line 15 2
+line 6 1
+line 10 1
+line 11 1
+line 13 1
+line 17 1
+line 24 1
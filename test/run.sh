@@ -0,0 +1,63 @@
+#!/bin/sh
+# 回归测试：test/regress 下的每个 .c 依次以各种方式编译执行
+# NAME.expect 为期望的标准输出，NAME.rc 为期望的退出码（缺省为 0）；
+# pipe 方式经管道从 /dev/stdin 读入源程序，以 --vm 执行；
+# NAME.profile 为 --vm --vm-profile 报告的执行次数，去掉了百分比和用时；
+# 超时、被信号终止、退出码或输出不对都算失败
+# 用法：sh test/run.sh [syntax 的路径]
+
+SYNTAX=${1:-./syntax}
+TIMEOUT=${TIMEOUT:-20}
+TMP=${TMPDIR:-/tmp}/df-regress.$$
+fail=0
+count=0
+
+# 从 --vm-profile 的报告中取出执行次数：总数，各函数的自身、总计和调用次数，
+# 各调用点和循环的总计与次数，各行的自身次数
+profile_counts() {
+    awk '/^profile:/ { print "executed", $2; on = 1; next }
+        !on { next }
+        / function$/ { t = "function"; next }
+        / construct$/ { t = "construct"; next }
+        / source$/ { t = "line"; next }
+        t == "function" { print t, $7, $2, $3, $4 }
+        t == "construct" { print t, $5, $6, $2, $3 }
+        t == "line" { print t, $4, $2 }'
+}
+
+for src in test/regress/*.c; do
+    name=${src%.c}
+    rc=0
+    [ -f "$name.rc" ] && rc=$(cat "$name.rc")
+    for mode in "--dump-ir" "-O --dump-ir" "--vm" "-O --vm" "--run" "-O --run" "pipe"; do
+        count=$((count + 1))
+        case "$mode" in
+        pipe)
+            cat "$src" | timeout "$TIMEOUT" "$SYNTAX" --vm /dev/stdin > "$TMP.out" 2> "$TMP.err" ;;
+        *)
+            timeout "$TIMEOUT" "$SYNTAX" $mode "$src" > "$TMP.out" 2> "$TMP.err" ;;
+        esac
+        got=$?
+        if [ $got -ne $rc ]; then
+            echo "FAIL $src ($mode): exit $got, expected $rc"
+            head -5 "$TMP.err"
+            fail=$((fail + 1))
+        elif [ -f "$name.expect" ] && [ "$mode" != "--dump-ir" ] &&
+            [ "$mode" != "-O --dump-ir" ] && ! cmp -s "$TMP.out" "$name.expect"; then
+            echo "FAIL $src ($mode): output differs"
+            diff "$name.expect" "$TMP.out" | head -5
+            fail=$((fail + 1))
+        fi
+    done
+    [ -f "$name.profile" ] || continue
+    count=$((count + 1))
+    timeout "$TIMEOUT" "$SYNTAX" --vm --vm-profile "$src" 2>&1 > /dev/null | profile_counts > "$TMP.out"
+    if ! cmp -s "$TMP.out" "$name.profile"; then
+        echo "FAIL $src (--vm-profile): counts differ"
+        diff "$name.profile" "$TMP.out" | head -5
+        fail=$((fail + 1))
+    fi
+done
+rm -f "$TMP.out" "$TMP.err"
+echo "regress: $count runs, $fail failed"
+[ $fail -eq 0 ]
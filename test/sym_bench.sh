@@ -0,0 +1,29 @@
+#!/bin/sh
+# 符号表的基准：以 test/symgen.py 生成深层嵌套、标识符密集的程序
+# （200 个函数，48 层块，每层 12 个局部变量），输出 -q --sym-stats 的
+# 统计和用时（5 次取最短）；再编译运行 test/sym_bench.cpp 的微基准
+# 用法：sh test/sym_bench.sh [syntax 的路径]
+
+SYNTAX=${1:-./syntax}
+TMP=${TMPDIR:-/tmp}/df-symbench.$$
+fail=0
+
+python3 test/symgen.py 200 48 12 > "$TMP.c"
+ms=
+for k in 1 2 3 4 5; do
+    start=$(date +%s%N)
+    "$SYNTAX" -q --sym-stats "$TMP.c" 2> "$TMP.err" || { cat "$TMP.err"; fail=1; break; }
+    t=$((($(date +%s%N) - start) / 1000000))
+    [ -z "$ms" ] || [ $t -lt $ms ] && ms=$t
+done
+grep '^sym' "$TMP.err"
+echo "-q: $ms ms on $(($(wc -c < "$TMP.c") / 1048576)) MB"
+
+if ${CXX:-c++} -std=c++11 -O2 -Iinclude test/sym_bench.cpp src/symbol.cpp -o "$TMP.bin"; then
+    "$TMP.bin" || fail=1
+else
+    echo "FAIL: test/sym_bench.cpp does not compile"
+    fail=1
+fi
+rm -f "$TMP.c" "$TMP.err" "$TMP.bin"
+[ $fail -eq 0 ]
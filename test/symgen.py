@@ -0,0 +1,26 @@
+# 符号表基准的输入生成器：深层嵌套、标识符密集的程序
+# 200 个全局变量，NF 个函数，每个函数嵌套 DEPTH 层块，每层定义 NV 个
+# 局部变量（每 3 个中有 1 个与外层同名）并做 NV 次赋值，
+# 赋值引用最近定义的 60 个和最早的 20 个名字
+# 用法：python3 test/symgen.py NF DEPTH NV > prog.c
+import random, sys
+
+random.seed(1)
+nf, depth, nv = int(sys.argv[1]), int(sys.argv[2]), int(sys.argv[3])
+out = ["int g%d;" % i for i in range(200)]
+for f in range(nf):
+    out.append("int f%d(int p0, int p1, int p2)\n{" % f)
+    names = ["g%d" % i for i in range(200)] + ["p0", "p1", "p2"]
+    for d in range(depth):
+        ind = "    " * (d + 1)
+        for v in range(nv):
+            n = "v%d_%d" % (d, v) if v % 3 else "v%d" % v
+            out.append(ind + "int %s;" % n)
+            names.append(n)
+        for s in range(nv):
+            out.append(ind + "%s = %s + %s * %s;" % tuple(random.sample(names[-60:] + names[:20], 4)))
+        out.append(ind + "{")
+    for d in range(depth, 0, -1):
+        out.append("    " * d + "}")
+    out.append("    return p0;\n}")
+print("\n".join(out))
@@ -0,0 +1,38 @@
+#!/bin/sh
+# 向量化的基准：以 -O 和 -O --no-vectorize 把 test/programs/vec.c
+# （100 万字符转大写、25 万个 int 截断，各 200 轮）编译为可执行文件，
+# 输出 --asm-stats 的 vec: 行、两者的运行时间（3 次取最短）和加速比，
+# 并检查两者的输出一致
+# 用法：sh test/vec_bench.sh [syntax 的路径] [程序]
+
+SYNTAX=${1:-./syntax}
+SRC=${2:-test/programs/vec.c}
+TMP=${TMPDIR:-/tmp}/df-vecbench.$$
+fail=0
+
+# 运行 3 次，输出到 $2，最短的毫秒数存入 ms
+run() {
+    ms=
+    for k in 1 2 3; do
+        start=$(date +%s%N)
+        "$1" > "$2"
+        t=$((($(date +%s%N) - start) / 1000000))
+        [ -z "$ms" ] || [ $t -lt $ms ] && ms=$t
+    done
+}
+
+"$SYNTAX" -O --asm-stats -S -o "$TMP.s" "$SRC" 2>&1 | grep '^vec:'
+for opt in "--no-vectorize" ""; do
+    "$SYNTAX" -O $opt -o "$TMP.bin" "$SRC" || { echo "FAIL -O $opt: does not compile"; fail=1; continue; }
+    run "$TMP.bin" "$TMP.out$opt"
+    printf "%-18s %8d ms\n" "-O $opt" "$ms"
+    [ -n "$opt" ] && scalar=$ms
+done
+if ! cmp -s "$TMP.out--no-vectorize" "$TMP.out"; then
+    echo "FAIL: vectorized and scalar code print different output"
+    fail=1
+elif [ -n "$scalar" ] && [ "$ms" -gt 0 ]; then
+    awk -v s="$scalar" -v v="$ms" 'BEGIN { printf "speedup %.2fx\n", s / v }'
+fi
+rm -f "$TMP.s" "$TMP.bin" "$TMP.out" "$TMP.out--no-vectorize"
+[ $fail -eq 0 ]
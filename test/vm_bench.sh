@@ -0,0 +1,34 @@
+#!/bin/sh
+# 虚拟机分派方式的基准：以线程化和 switch 两种分派、有无 -O 运行
+# test/programs/bench.c（筛法、冒泡排序、fib），输出执行的字节码数、
+# 用时和每秒执行的字节码（3 次取最短），并检查两种分派的输出一致
+# 用法：sh test/vm_bench.sh [syntax 的路径] [程序]
+
+SYNTAX=${1:-./syntax}
+SRC=${2:-test/programs/bench.c}
+TMP=${TMPDIR:-/tmp}/df-vmbench.$$
+fail=0
+
+printf "%-4s %-9s %12s %10s %10s\n" "" "dispatch" "executed" "ms" "M/s"
+for opt in "" "-O"; do
+    for dispatch in threaded switch; do
+        best=
+        for k in 1 2 3; do
+            "$SYNTAX" $opt --vm --vm-stats --vm-dispatch=$dispatch "$SRC" \
+                > "$TMP.$dispatch" 2> "$TMP.err" || { cat "$TMP.err"; fail=1; }
+            # vm: ... N executed in T ms (R M/s, ...
+            set -- $(sed -n 's/.* \([0-9]*\) executed in \([0-9.]*\) ms (\([0-9.]*\) M\/s.*/\1 \2 \3/p' "$TMP.err")
+            if [ -z "$best" ] || awk -v t="$2" -v b="$best" 'BEGIN { exit !(t < b) }'; then
+                best=$2
+                line=$(printf "%-4s %-9s %12s %10s %10s" "$opt" $dispatch "$1" "$2" "$3")
+            fi
+        done
+        echo "$line"
+    done
+    if ! cmp -s "$TMP.threaded" "$TMP.switch"; then
+        echo "FAIL $opt: threaded and switch dispatch print different output"
+        fail=1
+    fi
+done
+rm -f "$TMP.threaded" "$TMP.switch" "$TMP.err"
+[ $fail -eq 0 ]